@@ -13,6 +13,7 @@ FRAME_LIMITS=(1085 1085 1085 1085 1125 1125 1125)
 COUNT=${#WEIGHTS[*]}
 
 USE_DISPNET="true"
+ODOMETRY_ROOT=~/datasets/kitti/odometry-dataset
 
 #for weight in ${WEIGHTS[*]}; do
 for (( i = 0; i < $COUNT; i++ )); do
@@ -28,13 +29,14 @@ for (( i = 0; i < $COUNT; i++ )); do
 
     # TODO(andrei): ulimit that shit to ~32gb of ram to ensure no thrashing.
     ./DynSLAMGUI \
-    --dataset_root=/home/barsana/datasets/kitti/odometry-dataset/sequences/09 \
+    --dataset_root=${ODOMETRY_ROOT}/sequences/09 \
     --dynamic_mode=true             \
     --enable_evaluation=true         \
     --min_decay_age=$min_age               \
     --max_decay_weight=$weight      \
     --evaluation_delay=$eval_delay            \
     --use_dispnet=${USE_DISPNET}    \
+    --lidar_projection_cache=${ODOMETRY_ROOT}/lidar_projection_cache \
     --voxel_decay=true              \
     --use_depth_weighting=false     \
     --frame_limit=$frame_limit
@@ -53,6 +53,7 @@ for (( i = 0; i < $SEQ_COUNT; i++ )); do
                 --max_decay_weight=$MAX_DECAY_WEIGHT     \
                 --evaluation_delay=0                    \
                 --use_dispnet=${USE_DISPNET}            \
+                --lidar_projection_cache=${ODOMETRY_ROOT}/lidar_projection_cache \
                 --voxel_decay=true                      \
                 --use_depth_weighting=true              \
                 --frame_limit=4400                      \
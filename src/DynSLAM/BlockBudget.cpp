@@ -0,0 +1,102 @@
+#include "BlockBudget.h"
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+void BlockBudget::Touch(const Vector3s &block_pos, int frame_idx) {
+  int64_t key = PackBlockPos(block_pos);
+  auto it = last_observed_frame_.find(key);
+  if (it == last_observed_frame_.end()) {
+    last_observed_frame_.emplace(key, frame_idx);
+    blocks_by_frame_[frame_idx].push_back(key);
+  }
+  else {
+    it->second = frame_idx;
+  }
+}
+
+size_t BlockBudget::Enforce(HostVoxelBlockMap &block_map,
+                            int frame_idx,
+                            const VisibilityTest &is_visible,
+                            const EvictionSink &sink) {
+  if (last_observed_frame_.size() > 2 * static_cast<size_t>(block_map.GetBlockCapacity())) {
+    Prune(block_map);
+  }
+
+  int free_blocks = block_map.GetFreeBlockCount();
+  if (free_blocks >= headroom_blocks_) {
+    return 0;
+  }
+
+  int to_evict = 2 * headroom_blocks_ - free_blocks;
+  vector<VoxelBlock> evicted;
+  const int newest_evictable_frame = frame_idx - protected_frames_;
+  while (to_evict > 0 && ! blocks_by_frame_.empty() &&
+         blocks_by_frame_.begin()->first <= newest_evictable_frame) {
+    vector<int64_t> bucket;
+    bucket.swap(blocks_by_frame_.begin()->second);
+    blocks_by_frame_.erase(blocks_by_frame_.begin());
+
+    for (int64_t key : bucket) {
+      auto it = last_observed_frame_.find(key);
+      if (it == last_observed_frame_.end()) {
+        continue;
+      }
+      if (it->second > newest_evictable_frame || to_evict <= 0) {
+        // Observed since it was enqueued, or we're done evicting.
+        blocks_by_frame_[it->second].push_back(key);
+        continue;
+      }
+
+      Vector3s pos = UnpackBlockPos(key);
+      if (is_visible(pos)) {
+        // Not observed, e.g., because it's occluded, but it would get restored right away.
+        it->second = frame_idx;
+        blocks_by_frame_[frame_idx].push_back(key);
+        continue;
+      }
+
+      int entry_id = block_map.FindEntry(pos);
+      if (entry_id >= 0) {
+        evicted.emplace_back();
+        block_map.ReadBlock(entry_id, evicted.back());
+        block_map.RemoveBlock(entry_id);
+        to_evict--;
+      }
+      last_observed_frame_.erase(it);
+    }
+  }
+
+  evicted_block_count_ += evicted.size();
+  if (! evicted.empty()) {
+    sink(evicted);
+  }
+  return evicted.size();
+}
+
+void BlockBudget::Prune(const HostVoxelBlockMap &block_map) {
+  for (auto it = last_observed_frame_.begin(); it != last_observed_frame_.end(); ) {
+    if (block_map.FindEntry(UnpackBlockPos(it->first)) < 0) {
+      it = last_observed_frame_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  for (auto &pair : blocks_by_frame_) {
+    vector<int64_t> &bucket = pair.second;
+    vector<int64_t> kept;
+    for (int64_t key : bucket) {
+      if (last_observed_frame_.find(key) != last_observed_frame_.end()) {
+        kept.push_back(key);
+      }
+    }
+    bucket.swap(kept);
+  }
+}
+
+}  // namespace drivers
+}  // namespace dynslam
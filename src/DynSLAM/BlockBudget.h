@@ -0,0 +1,77 @@
+#ifndef DYNSLAM_BLOCKBUDGET_H
+#define DYNSLAM_BLOCKBUDGET_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Keeps a number of blocks free in a map's voxel block array by evicting the least recently
+///        observed blocks, so that there is always room for new geometry.
+///
+/// The voxel block array has a fixed size, and InfiniTAM silently stops allocating new blocks once
+/// it is full, so without this, large maps would stop growing in front of the camera.
+///
+/// Only the blocks passed to 'Touch' are ever evicted, i.e., the ones fused into, and the ones
+/// brought back from the cold store or the disk. Blocks which are still in view are never evicted
+/// either, since they would come right back.
+class BlockBudget {
+ public:
+  /// \brief Takes ownership of blocks evicted from the map.
+  using EvictionSink = std::function<void(const std::vector<VoxelBlock>&)>;
+
+  /// \brief Tells whether the block at the given position may be visible from the current
+  ///        viewpoint.
+  using VisibilityTest = std::function<bool(const Vector3s&)>;
+
+  /// \param headroom_blocks Eviction kicks in once fewer than this many blocks are free, and frees
+  ///                        up twice as many.
+  /// \param protected_frames Blocks observed in the past this many frames are never evicted.
+  BlockBudget(int headroom_blocks, int protected_frames)
+      : headroom_blocks_(headroom_blocks),
+        protected_frames_(protected_frames),
+        evicted_block_count_(0) {}
+
+  /// \brief Records that the block at the given position was observed in the given frame.
+  void Touch(const Vector3s &block_pos, int frame_idx);
+
+  /// \brief Evicts blocks from the map if it is running out of free blocks.
+  /// \returns The number of evicted blocks, which can be fewer than needed if too many blocks
+  ///          were observed recently.
+  /// \note The changes are not committed to the map.
+  size_t Enforce(HostVoxelBlockMap &block_map,
+                 int frame_idx,
+                 const VisibilityTest &is_visible,
+                 const EvictionSink &sink);
+
+  int GetHeadroomBlocks() const { return headroom_blocks_; }
+
+  /// \brief The total number of blocks evicted so far.
+  size_t GetEvictedBlockCount() const { return evicted_block_count_; }
+
+ private:
+  int headroom_blocks_;
+  int protected_frames_;
+  size_t evicted_block_count_;
+
+  /// \brief The latest observation of every tracked block.
+  std::unordered_map<int64_t, int> last_observed_frame_;
+
+  /// \brief Every tracked block, in the bucket of the frame it was (re)enqueued in. Buckets are
+  ///        updated lazily, when blocks are considered for eviction.
+  std::map<int, std::vector<int64_t>> blocks_by_frame_;
+
+  /// \brief Forgets about the blocks which are no longer in the map, e.g., because they decayed.
+  void Prune(const HostVoxelBlockMap &block_map);
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_BLOCKBUDGET_H
@@ -0,0 +1,80 @@
+#include "BlockConvergence.h"
+
+#include <cstdlib>
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+namespace {
+
+/// \brief Blocks which have not been evaluated for this many full fusions are forgotten.
+const int kForgetAfterFusions = 10;
+
+int8_t QuantizeSdf(short sdf) {
+  return static_cast<int8_t>(sdf >> 8);
+}
+
+}
+
+void BlockConvergenceTracker::Update(const HostVoxelBlockMap &block_map,
+                                     const vector<int> &entry_ids,
+                                     int frame_idx) {
+  VoxelBlock block;
+  for (int entry_id : entry_ids) {
+    if (block_map.GetEntry(entry_id).ptr < 0) {
+      continue;
+    }
+    block_map.ReadBlock(entry_id, block);
+
+    auto it = blocks_.find(PackBlockPos(block.pos));
+    bool has_snapshot = (it != blocks_.end());
+    if (! has_snapshot) {
+      it = blocks_.emplace(PackBlockPos(block.pos), BlockState()).first;
+    }
+    BlockState &state = it->second;
+
+    bool saturated = true;
+    int observed = 0;
+    int total_change = 0;
+    for (int i = 0; i < SDF_BLOCK_SIZE3; ++i) {
+      const ITMVoxel &voxel = block.voxels[i];
+      int8_t sdf = QuantizeSdf(voxel.sdf);
+      if (voxel.w_depth > 0) {
+        saturated &= (voxel.w_depth >= max_weight_);
+        total_change += abs(sdf - state.sdf_snapshot[i]);
+        observed++;
+      }
+      state.sdf_snapshot[i] = sdf;
+    }
+
+    float residual = (observed > 0) ? total_change / (127.0f * observed) : 0.0f;
+    bool converged = has_snapshot && observed > 0 && saturated &&
+                     residual < residual_threshold_;
+    if (converged != state.converged) {
+      converged_block_count_ += converged ? 1 : -1;
+      state.converged = converged;
+    }
+    state.last_update_frame = frame_idx;
+  }
+
+  Prune(frame_idx);
+}
+
+void BlockConvergenceTracker::Prune(int frame_idx) {
+  for (auto it = blocks_.begin(); it != blocks_.end(); ) {
+    if (frame_idx - it->second.last_update_frame > kForgetAfterFusions * fuse_every_) {
+      if (it->second.converged) {
+        converged_block_count_--;
+      }
+      it = blocks_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace drivers
+}  // namespace dynslam
@@ -0,0 +1,72 @@
+#ifndef DYNSLAM_BLOCKCONVERGENCE_H
+#define DYNSLAM_BLOCKCONVERGENCE_H
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Keeps track of the map blocks which have converged, i.e., whose voxels have reached the
+///        maximum weight, and which no longer change noticeably when new frames are fused into
+///        them. Fusing into such blocks is mostly wasted work, e.g., while the car is stopped.
+///
+/// Converged blocks are still fused into every 'fuse_every' frames, which is when they get
+/// re-evaluated, so that blocks whose surroundings change start being fused into normally again.
+class BlockConvergenceTracker {
+ public:
+  /// \param max_weight The maximum voxel weight used by the map.
+  /// \param residual_threshold The mean absolute change in (normalized) SDF between two full
+  ///                           fusions, below which a block with saturated weights is considered
+  ///                           converged.
+  /// \param fuse_every How often converged blocks are still fused into.
+  BlockConvergenceTracker(int max_weight, float residual_threshold, int fuse_every)
+      : max_weight_(max_weight),
+        residual_threshold_(residual_threshold),
+        fuse_every_(fuse_every),
+        converged_block_count_(0) {}
+
+  /// \brief Whether every block, converged or not, should be fused into in the given frame.
+  bool IsFullFusionFrame(int frame_idx) const {
+    return frame_idx % fuse_every_ == 0;
+  }
+
+  bool IsConverged(const Vector3s &block_pos) const {
+    auto it = blocks_.find(PackBlockPos(block_pos));
+    return it != blocks_.end() && it->second.converged;
+  }
+
+  /// \brief Re-evaluates the given blocks, which should have just been fused into.
+  void Update(const HostVoxelBlockMap &block_map, const std::vector<int> &entry_ids, int frame_idx);
+
+  size_t GetConvergedBlockCount() const { return converged_block_count_; }
+
+ private:
+  struct BlockState {
+    /// \brief The SDF at the previous evaluation, quantized to 8 bits, which is plenty for
+    ///        measuring the change.
+    std::array<int8_t, SDF_BLOCK_SIZE3> sdf_snapshot;
+    bool converged;
+    int last_update_frame;
+  };
+
+  int max_weight_;
+  float residual_threshold_;
+  int fuse_every_;
+  size_t converged_block_count_;
+
+  std::unordered_map<int64_t, BlockState> blocks_;
+
+  /// \brief Forgets about the blocks which have not been evaluated in a while, e.g., because they
+  ///        went out of view or left the map.
+  void Prune(int frame_idx);
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_BLOCKCONVERGENCE_H
@@ -0,0 +1,202 @@
+#include "ColdBlockStore.h"
+
+#include <cmath>
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+void ColdBlockStore::Restore(HostVoxelBlockMap &block_map,
+                             int frame_idx,
+                             const SphereTest &is_visible,
+                             vector<Vector3s> *restored) {
+  vector<BlockChunkKey> to_restore;
+  for (const auto &pair : chunks_) {
+    if (is_visible(GetChunkCenter(pair.first), GetChunkRadius())) {
+      to_restore.push_back(pair.first);
+    }
+  }
+
+  for (const BlockChunkKey &key : to_restore) {
+    vector<VoxelBlock> blocks;
+    vector<VoxelBlock> leftovers;
+    LoadChunk(key, blocks);
+    ResidentChunk &resident = resident_chunks_[key];
+    resident.last_seen_frame = frame_idx;
+    for (const VoxelBlock &block : blocks) {
+      // Should not normally happen, but blocks allocated since the chunk was compressed would be
+      // newer, so we keep them.
+      if (block_map.FindEntry(block.pos) >= 0) {
+        continue;
+      }
+
+      if (block_map.InsertBlock(block)) {
+        resident.blocks.insert(PackBlockPos(block.pos));
+        if (nullptr != restored) {
+          restored->push_back(block.pos);
+        }
+      }
+      else {
+        leftovers.push_back(block);
+      }
+    }
+
+    StoreChunk(key, leftovers);
+  }
+}
+
+void ColdBlockStore::Compress(HostVoxelBlockMap &block_map,
+                              const vector<Vector3s> &fused_blocks,
+                              int frame_idx,
+                              const SphereTest &is_visible) {
+  for (const Vector3s &pos : fused_blocks) {
+    ResidentChunk &resident = resident_chunks_[GetBlockChunk(pos)];
+    resident.blocks.insert(PackBlockPos(pos));
+    resident.last_seen_frame = frame_idx;
+  }
+
+  map<BlockChunkKey, vector<VoxelBlock>> to_compress;
+  for (auto it = resident_chunks_.begin(); it != resident_chunks_.end(); ) {
+    ResidentChunk &resident = it->second;
+    if (resident.last_seen_frame != frame_idx &&
+        is_visible(GetChunkCenter(it->first), GetChunkRadius())) {
+      resident.last_seen_frame = frame_idx;
+    }
+
+    if (frame_idx - resident.last_seen_frame < idle_frames_) {
+      ++it;
+      continue;
+    }
+
+    vector<VoxelBlock> &chunk_blocks = to_compress[it->first];
+    for (int64_t packed_pos : resident.blocks) {
+      int entry_id = block_map.FindEntry(UnpackBlockPos(packed_pos));
+      if (entry_id >= 0) {
+        chunk_blocks.emplace_back();
+        block_map.ReadBlock(entry_id, chunk_blocks.back());
+        block_map.RemoveBlock(entry_id);
+      }
+    }
+    it = resident_chunks_.erase(it);
+  }
+
+  AddToChunks(to_compress);
+}
+
+void ColdBlockStore::Insert(const vector<VoxelBlock> &blocks) {
+  map<BlockChunkKey, vector<VoxelBlock>> blocks_by_chunk;
+  for (const VoxelBlock &block : blocks) {
+    blocks_by_chunk[GetBlockChunk(block.pos)].push_back(block);
+  }
+  AddToChunks(blocks_by_chunk);
+}
+
+void ColdBlockStore::AddToChunks(map<BlockChunkKey, vector<VoxelBlock>> &blocks_by_chunk) {
+  for (auto &pair : blocks_by_chunk) {
+    vector<VoxelBlock> &blocks = pair.second;
+    if (chunks_.find(pair.first) != chunks_.end()) {
+      LoadChunk(pair.first, blocks);
+    }
+    StoreChunk(pair.first, blocks);
+  }
+
+  EnforceSizeLimit();
+}
+
+void ColdBlockStore::ExtractChunks(const SphereTest &predicate, vector<VoxelBlock> &out) {
+  vector<BlockChunkKey> to_extract;
+  for (const auto &pair : chunks_) {
+    if (predicate(GetChunkCenter(pair.first), GetChunkRadius())) {
+      to_extract.push_back(pair.first);
+    }
+  }
+
+  for (const BlockChunkKey &key : to_extract) {
+    LoadChunk(key, out);
+    StoreChunk(key, vector<VoxelBlock>());
+  }
+}
+
+void ColdBlockStore::CopyAll(vector<VoxelBlock> &out) const {
+  for (const auto &pair : chunks_) {
+    LoadChunk(pair.first, out);
+  }
+}
+
+void ColdBlockStore::StoreChunk(const BlockChunkKey &key, const vector<VoxelBlock> &blocks) {
+  auto it = chunks_.find(key);
+  if (it != chunks_.end()) {
+    block_count_ -= it->second.block_count;
+    compressed_bytes_ -= it->second.data.size();
+    chunks_.erase(it);
+  }
+
+  if (blocks.empty()) {
+    return;
+  }
+
+  ColdChunk &chunk = chunks_[key];
+  EncodeVoxelBlocks(blocks, quantization_, chunk.data);
+  chunk.data.shrink_to_fit();
+  chunk.block_count = blocks.size();
+  chunk.store_idx = next_store_idx_++;
+  store_order_.emplace_back(chunk.store_idx, key);
+
+  block_count_ += chunk.block_count;
+  compressed_bytes_ += chunk.data.size();
+}
+
+void ColdBlockStore::EnforceSizeLimit() {
+  size_t overflow_count = 0;
+  vector<VoxelBlock> overflow;
+  while (max_bytes_ > 0 && compressed_bytes_ > max_bytes_ && ! store_order_.empty()) {
+    uint64_t store_idx = store_order_.front().first;
+    BlockChunkKey key = store_order_.front().second;
+    store_order_.pop_front();
+
+    auto it = chunks_.find(key);
+    if (it == chunks_.end() || it->second.store_idx != store_idx) {
+      continue;
+    }
+
+    overflow_count += it->second.block_count;
+    if (overflow_sink_) {
+      LoadChunk(key, overflow);
+    }
+    StoreChunk(key, vector<VoxelBlock>());
+  }
+
+  // Drop the entries of chunks which were stored again, or restored, since.
+  if (store_order_.size() > 2 * chunks_.size()) {
+    deque<pair<uint64_t, BlockChunkKey>> store_order;
+    for (const auto &entry : store_order_) {
+      auto it = chunks_.find(entry.second);
+      if (it != chunks_.end() && it->second.store_idx == entry.first) {
+        store_order.push_back(entry);
+      }
+    }
+    store_order_.swap(store_order);
+  }
+
+  overflow_block_count_ += overflow_count;
+  if (! overflow.empty()) {
+    overflow_sink_(overflow);
+  }
+}
+
+void ColdBlockStore::LoadChunk(const BlockChunkKey &key, vector<VoxelBlock> &out) const {
+  DecodeVoxelBlocks(chunks_.at(key).data, out);
+}
+
+Eigen::Vector3f ColdBlockStore::GetChunkCenter(const BlockChunkKey &key) const {
+  Eigen::Vector3f center(get<0>(key) + 0.5f, get<1>(key) + 0.5f, get<2>(key) + 0.5f);
+  return center * (kBlockChunkSize * block_size_m_);
+}
+
+float ColdBlockStore::GetChunkRadius() const {
+  return kBlockChunkSize * block_size_m_ * sqrt(3.0f) * 0.5f;
+}
+
+}  // namespace drivers
+}  // namespace dynslam
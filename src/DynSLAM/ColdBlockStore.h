@@ -0,0 +1,177 @@
+#ifndef DYNSLAM_COLDBLOCKSTORE_H
+#define DYNSLAM_COLDBLOCKSTORE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <unordered_set>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "VoxelBlockCodec.h"
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief A second residency tier for the voxel blocks of a map, which keeps blocks that have not
+///        been seen in a while compressed in host memory, instead of at full size in the voxel
+///        block array.
+///
+/// Blocks move in and out of the store in chunks. A chunk is brought back into the map as soon as
+/// it becomes visible from the tracked camera, before the frame is fused, or from the viewpoint of
+/// a render, e.g., a free-view preview, before it is raycast. Chunks are compressed once they have
+/// not been visible from the tracked camera for a while. Both decisions are made for whole chunks,
+/// with the same visibility test, so blocks don't bounce between the map and the store.
+class ColdBlockStore {
+ public:
+  /// \brief A test applied to a sphere, given by its center and radius in meters.
+  using SphereTest = std::function<bool(const Eigen::Vector3f&, float)>;
+
+  /// \brief Takes ownership of the blocks which no longer fit in the store.
+  using OverflowSink = std::function<void(const std::vector<VoxelBlock>&)>;
+
+  /// \param idle_frames Chunks which have not been visible for this many frames become cold.
+  /// \param block_size_m The side of a voxel block, in meters.
+  /// \param format The format cold voxels are converted to before being compressed.
+  /// \param max_bytes Once the compressed blocks take up more than this, the chunks which were
+  ///                  stored first are passed on to the overflow sink. 0 = no limit.
+  ColdBlockStore(int idle_frames,
+                 float block_size_m,
+                 VoxelFormat format = VoxelFormat::kFull,
+                 size_t max_bytes = 0)
+      : idle_frames_(idle_frames),
+        block_size_m_(block_size_m),
+        quantization_(kColdSdfDropBits, true, format),
+        max_bytes_(max_bytes),
+        block_count_(0),
+        compressed_bytes_(0),
+        overflow_block_count_(0),
+        next_store_idx_(0) {}
+
+  ColdBlockStore(const ColdBlockStore&) = delete;
+  ColdBlockStore& operator=(const ColdBlockStore&) = delete;
+
+  virtual ~ColdBlockStore() = default;
+
+  /// \brief Brings back the cold chunks which became visible. Should be called before fusing
+  ///        into the map.
+  /// \param is_visible Tells whether a region may be visible from the current viewpoint.
+  /// \param restored If not null, receives the positions of the restored blocks.
+  /// \note The changes are not committed to the map.
+  void Restore(HostVoxelBlockMap &block_map,
+               int frame_idx,
+               const SphereTest &is_visible,
+               std::vector<Vector3s> *restored = nullptr);
+
+  /// \brief Compresses the chunks which have not been visible in the past 'idle_frames' frames.
+  ///
+  /// Only the chunks with blocks in them are examined, which the store learns about from the
+  /// blocks fused into the map, and the ones it restores itself, so this does not need to go
+  /// through the whole map.
+  /// \param fused_blocks The blocks touched by the latest fusion.
+  /// \note The changes are not committed to the map.
+  void Compress(HostVoxelBlockMap &block_map,
+                const std::vector<Vector3s> &fused_blocks,
+                int frame_idx,
+                const SphereTest &is_visible);
+
+  /// \brief Applies the test to the chunk holding the given block, e.g., to tell whether the block
+  ///        would be restored right away if it were moved to the store.
+  bool TestChunk(const Vector3s &block_pos, const SphereTest &test) const {
+    BlockChunkKey key = GetBlockChunk(block_pos);
+    return test(GetChunkCenter(key), GetChunkRadius());
+  }
+
+  /// \brief Compresses the given blocks, which must no longer be in the map.
+  void Insert(const std::vector<VoxelBlock> &blocks);
+
+  /// \brief Sets what happens to the blocks which no longer fit in the store. By default, they are
+  ///        discarded.
+  void SetOverflowSink(const OverflowSink &sink) {
+    overflow_sink_ = sink;
+  }
+
+  /// \brief Moves the chunks whose bounding spheres pass the test out of the store, appending
+  ///        their blocks to 'out'.
+  void ExtractChunks(const SphereTest &predicate, std::vector<VoxelBlock> &out);
+
+  /// \brief Decompresses all the blocks in the store, appending them to 'out'.
+  void CopyAll(std::vector<VoxelBlock> &out) const;
+
+  size_t GetBlockCount() const { return block_count_; }
+
+  /// \brief The size the cold blocks would have in the voxel block array.
+  size_t GetRawBytes() const { return block_count_ * sizeof(ITMVoxel) * SDF_BLOCK_SIZE3; }
+
+  /// \brief The memory actually used by the cold blocks.
+  size_t GetCompressedBytes() const { return compressed_bytes_; }
+
+  float GetCompressionRatio() const {
+    return (compressed_bytes_ > 0) ? static_cast<float>(GetRawBytes()) / compressed_bytes_ : 1.0f;
+  }
+
+  /// \brief The total number of blocks which were moved out of the store to keep it within its
+  ///        size limit.
+  size_t GetOverflowBlockCount() const { return overflow_block_count_; }
+
+ private:
+  struct ColdChunk {
+    std::vector<uint8_t> data;
+    size_t block_count;
+    /// \brief When the chunk was (last) stored, relative to the other chunks.
+    uint64_t store_idx;
+  };
+
+  /// \brief A chunk with blocks in the map.
+  struct ResidentChunk {
+    /// \brief The blocks in the chunk which may still be in the map. Some of them may have left
+    ///        it in other ways, e.g., through voxel decay.
+    std::unordered_set<int64_t> blocks;
+    int last_seen_frame;
+  };
+
+  /// \brief Cold blocks may be fused into again once restored, so we only drop the SDF bits
+  ///        which are well below the noise floor of the input depth.
+  static const int kColdSdfDropBits = 4;
+
+  int idle_frames_;
+  float block_size_m_;
+  VoxelQuantization quantization_;
+  size_t max_bytes_;
+  OverflowSink overflow_sink_;
+
+  std::map<BlockChunkKey, ColdChunk> chunks_;
+  size_t block_count_;
+  size_t compressed_bytes_;
+  size_t overflow_block_count_;
+
+  /// \brief The order the chunks were stored in, oldest first. Entries whose chunk has been
+  ///        removed or stored again since are skipped.
+  std::deque<std::pair<uint64_t, BlockChunkKey>> store_order_;
+  uint64_t next_store_idx_;
+
+  std::map<BlockChunkKey, ResidentChunk> resident_chunks_;
+
+  /// \brief Adds the blocks to their respective chunks.
+  void AddToChunks(std::map<BlockChunkKey, std::vector<VoxelBlock>> &blocks_by_chunk);
+
+  /// \brief Replaces the contents of the chunk, dropping it if 'blocks' is empty.
+  void StoreChunk(const BlockChunkKey &key, const std::vector<VoxelBlock> &blocks);
+
+  void LoadChunk(const BlockChunkKey &key, std::vector<VoxelBlock> &out) const;
+
+  /// \brief Passes the oldest chunks on to the overflow sink until the store fits in its limit.
+  void EnforceSizeLimit();
+
+  Eigen::Vector3f GetChunkCenter(const BlockChunkKey &key) const;
+
+  float GetChunkRadius() const;
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_COLDBLOCKSTORE_H
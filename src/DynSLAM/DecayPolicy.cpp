@@ -0,0 +1,64 @@
+#include "DecayPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dynslam {
+
+using namespace std;
+using drivers::PackBlockPos;
+
+/// \brief Memory budget pressure starts increasing the decay weight at this fraction of the budget.
+const float kBudgetPressureStart = 0.5f;
+
+void DistanceDecayPolicy::BeginFrame(const DecayContext &context) {
+  camera_position_ = context.camera_position;
+  block_size_m_ = context.block_size_m;
+}
+
+int DistanceDecayPolicy::GetMaxDecayWeight(const Vector3s &block_pos,
+                                           int default_max_weight) const {
+  Eigen::Vector3f center(block_pos.x + 0.5f, block_pos.y + 0.5f, block_pos.z + 0.5f);
+  center *= block_size_m_;
+  float distance_m = (center - camera_position_).norm();
+  float t = (distance_m - near_m_) / max(far_m_ - near_m_, 1e-3f);
+  t = min(max(t, 0.0f), 1.0f);
+
+  return default_max_weight + static_cast<int>(round(t * max_extra_weight_));
+}
+
+void MemoryBudgetDecayPolicy::BeginFrame(const DecayContext &context) {
+  float usage = static_cast<float>(context.used_memory_bytes) / budget_bytes_;
+  float t = (usage - kBudgetPressureStart) / (1.0f - kBudgetPressureStart);
+  t = min(max(t, 0.0f), 1.0f);
+
+  extra_weight_ = static_cast<int>(round(t * max_extra_weight_));
+}
+
+void DynamicRegionDecayPolicy::BeginFrame(const DecayContext &context) {
+  if (nullptr != context.dynamic_blocks) {
+    for (const Vector3s &block_pos : *context.dynamic_blocks) {
+      covered_frame_[PackBlockPos(block_pos)] = context.frame_idx;
+    }
+  }
+
+  for (auto it = covered_frame_.begin(); it != covered_frame_.end(); ) {
+    if (context.frame_idx - it->second > memory_frames_) {
+      it = covered_frame_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+int DynamicRegionDecayPolicy::GetMaxDecayWeight(const Vector3s &block_pos,
+                                                int default_max_weight) const {
+  if (covered_frame_.find(PackBlockPos(block_pos)) != covered_frame_.end()) {
+    return default_max_weight + extra_weight_;
+  }
+
+  return default_max_weight;
+}
+
+}  // namespace dynslam
@@ -0,0 +1,155 @@
+#ifndef DYNSLAM_DECAYPOLICY_H
+#define DYNSLAM_DECAYPOLICY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+
+/// \brief Information about the current frame which decay policies can base their decisions on.
+struct DecayContext {
+  /// \brief Measured in fused frames, like the block ages.
+  int frame_idx;
+  /// \brief The camera's position in the map's coordinate frame.
+  Eigen::Vector3f camera_position;
+  /// \brief The side of a voxel block, in meters.
+  float block_size_m;
+  /// \brief The memory currently used by the map's voxel blocks.
+  size_t used_memory_bytes;
+  /// \brief Blocks covered by potentially dynamic objects in the current frame.
+  const std::vector<Vector3s> *dynamic_blocks;
+
+  DecayContext(int frame_idx,
+               const Eigen::Vector3f &camera_position,
+               float block_size_m,
+               size_t used_memory_bytes,
+               const std::vector<Vector3s> *dynamic_blocks)
+      : frame_idx(frame_idx),
+        camera_position(camera_position),
+        block_size_m(block_size_m),
+        used_memory_bytes(used_memory_bytes),
+        dynamic_blocks(dynamic_blocks) {}
+};
+
+/// \brief Decides how aggressively individual voxel blocks are decayed once they become old enough.
+///
+/// When a block is examined, every policy proposes a maximum voxel weight for decay, and the highest
+/// one is used. Policies are credited with the blocks freed thanks to their proposals.
+class DecayPolicy {
+ public:
+  explicit DecayPolicy(const std::string &name) : name_(name), reclaimed_block_count_(0) {}
+
+  DecayPolicy(const DecayPolicy&) = delete;
+  DecayPolicy& operator=(const DecayPolicy&) = delete;
+
+  virtual ~DecayPolicy() = default;
+
+  const std::string& GetName() const { return name_; }
+
+  /// \brief Called once per decay step, before any blocks are examined.
+  virtual void BeginFrame(const DecayContext &context) {}
+
+  /// \brief Returns the maximum weight of the voxels in the given block which should be decayed.
+  /// \param default_max_weight The maximum weight from the decay parameters.
+  virtual int GetMaxDecayWeight(const Vector3s &block_pos, int default_max_weight) const = 0;
+
+  /// \brief Whether the policy uses the dynamic blocks from the decay context, which are expensive
+  ///        to compute.
+  virtual bool NeedsDynamicBlocks() const { return false; }
+
+  void CountReclaimedBlock() { reclaimed_block_count_++; }
+
+  size_t GetReclaimedBlockCount() const { return reclaimed_block_count_; }
+
+ private:
+  std::string name_;
+  size_t reclaimed_block_count_;
+};
+
+/// \brief Decays blocks more aggressively the farther they are from the camera, since distant
+///        measurements are noisier and less likely to be observed again.
+class DistanceDecayPolicy : public DecayPolicy {
+ public:
+  /// \param near_m Blocks closer than this are decayed normally.
+  /// \param far_m Blocks farther than this get the maximum extra weight.
+  /// \param max_extra_weight Added to the default maximum weight for blocks beyond 'far_m'.
+  DistanceDecayPolicy(float near_m, float far_m, int max_extra_weight)
+      : DecayPolicy("distance"),
+        near_m_(near_m),
+        far_m_(far_m),
+        max_extra_weight_(max_extra_weight),
+        camera_position_(Eigen::Vector3f::Zero()),
+        block_size_m_(0.0f) {}
+
+  void BeginFrame(const DecayContext &context) override;
+
+  int GetMaxDecayWeight(const Vector3s &block_pos, int default_max_weight) const override;
+
+ private:
+  float near_m_;
+  float far_m_;
+  int max_extra_weight_;
+  Eigen::Vector3f camera_position_;
+  float block_size_m_;
+};
+
+/// \brief Decays blocks more aggressively as the map's memory usage approaches a budget.
+class MemoryBudgetDecayPolicy : public DecayPolicy {
+ public:
+  /// \param budget_bytes The memory the map should stay under.
+  /// \param max_extra_weight Added to the default maximum weight once the budget is reached.
+  MemoryBudgetDecayPolicy(size_t budget_bytes, int max_extra_weight)
+      : DecayPolicy("budget"),
+        budget_bytes_(budget_bytes),
+        max_extra_weight_(max_extra_weight),
+        extra_weight_(0) {}
+
+  void BeginFrame(const DecayContext &context) override;
+
+  int GetMaxDecayWeight(const Vector3s &block_pos, int default_max_weight) const override {
+    return default_max_weight + extra_weight_;
+  }
+
+ private:
+  size_t budget_bytes_;
+  int max_extra_weight_;
+  /// \brief Computed once per frame from the memory usage.
+  int extra_weight_;
+};
+
+/// \brief Decays blocks more aggressively if they were covered by potentially dynamic objects,
+///        such as cars, in the recent past, since those are a common source of ghosting artifacts.
+class DynamicRegionDecayPolicy : public DecayPolicy {
+ public:
+  /// \param extra_weight Added to the default maximum weight for the affected blocks.
+  /// \param memory_frames How long blocks are remembered after being covered by an object. Should
+  ///                      be longer than the minimum decay age, since that's how long it takes
+  ///                      for blocks to become eligible for decay.
+  DynamicRegionDecayPolicy(int extra_weight, int memory_frames)
+      : DecayPolicy("dynamic"),
+        extra_weight_(extra_weight),
+        memory_frames_(memory_frames) {}
+
+  void BeginFrame(const DecayContext &context) override;
+
+  int GetMaxDecayWeight(const Vector3s &block_pos, int default_max_weight) const override;
+
+  bool NeedsDynamicBlocks() const override { return true; }
+
+ private:
+  int extra_weight_;
+  int memory_frames_;
+
+  /// \brief The last frame in which every affected block was covered by an object.
+  std::unordered_map<int64_t, int> covered_frame_;
+};
+
+}  // namespace dynslam
+
+#endif  // DYNSLAM_DECAYPOLICY_H
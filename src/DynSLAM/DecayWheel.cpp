@@ -0,0 +1,60 @@
+#include "DecayWheel.h"
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+void DecayWheel::Touch(const Vector3s &block_pos, int frame_idx) {
+  int64_t key = PackBlockPos(block_pos);
+  auto it = last_update_frame_.find(key);
+  if (it == last_update_frame_.end()) {
+    last_update_frame_.emplace(key, frame_idx);
+    GetBucket(frame_idx).push_back(key);
+  }
+  else {
+    // The block stays in its current bucket, and is rescheduled lazily when that expires.
+    it->second = frame_idx;
+  }
+}
+
+void DecayWheel::PopExpired(int frame_idx, vector<Vector3s> &out) {
+  int expiring_frame = frame_idx - min_age_;
+
+  // Decay may not be triggered every frame, so we may need to go through multiple buckets.
+  for (; next_expiring_frame_ <= expiring_frame; ++next_expiring_frame_) {
+    vector<int64_t> bucket;
+    bucket.swap(GetBucket(next_expiring_frame_));
+
+    for (int64_t key : bucket) {
+      auto it = last_update_frame_.find(key);
+      if (it->second <= expiring_frame) {
+        out.push_back(UnpackBlockPos(key));
+        last_update_frame_.erase(it);
+      }
+      else {
+        // Updated more recently, so it cannot expire before the bucket of its latest update does.
+        // That bucket is always a different one, since the update happened less than 'min_age'
+        // frames ago.
+        GetBucket(it->second).push_back(key);
+      }
+    }
+  }
+}
+
+void DecayWheel::DrainAll(vector<Vector3s> &out) {
+  for (const auto &pair : last_update_frame_) {
+    out.push_back(UnpackBlockPos(pair.first));
+  }
+  Clear();
+}
+
+void DecayWheel::Clear() {
+  for (auto &bucket : buckets_) {
+    bucket.clear();
+  }
+  last_update_frame_.clear();
+}
+
+}  // namespace drivers
+}  // namespace dynslam
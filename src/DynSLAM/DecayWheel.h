@@ -0,0 +1,64 @@
+#ifndef DYNSLAM_DECAYWHEEL_H
+#define DYNSLAM_DECAYWHEEL_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Timing wheel which tells when voxel blocks become old enough to be eligible for decay.
+///
+/// Every block is kept in the bucket of the frame in which it was enqueued. When a bucket expires,
+/// the blocks which have been updated since are moved to the bucket of their latest update instead
+/// of being examined, so every block is looked at most once every 'min_age' frames, and only the
+/// blocks which were really left alone for 'min_age' frames are reported as expired.
+class DecayWheel {
+ public:
+  explicit DecayWheel(int min_age)
+      : min_age_(min_age),
+        buckets_(static_cast<size_t>(min_age + 1)),
+        next_expiring_frame_(0) {}
+
+  /// \brief Records that the block at the given position was updated in the given frame.
+  void Touch(const Vector3s &block_pos, int frame_idx);
+
+  /// \brief Removes the blocks which were last updated at least 'min_age' frames before the given
+  ///        one from the wheel, appending their positions to 'out'.
+  void PopExpired(int frame_idx, std::vector<Vector3s> &out);
+
+  /// \brief Removes all the blocks from the wheel, regardless of their age.
+  void DrainAll(std::vector<Vector3s> &out);
+
+  /// \brief Forgets about all blocks. Frame indices must keep increasing afterwards.
+  void Clear();
+
+  /// \brief The number of blocks which have not yet expired.
+  size_t GetPendingBlockCount() const {
+    return last_update_frame_.size();
+  }
+
+ private:
+  int min_age_;
+
+  /// \brief Packed block positions, with frame 'f' in bucket 'f % (min_age + 1)'.
+  std::vector<std::vector<int64_t>> buckets_;
+
+  /// \brief The latest update of every block in the wheel.
+  std::unordered_map<int64_t, int> last_update_frame_;
+
+  /// \brief The oldest frame whose bucket has not been expired yet.
+  int next_expiring_frame_;
+
+  std::vector<int64_t>& GetBucket(int frame_idx) {
+    return buckets_[static_cast<size_t>(frame_idx) % buckets_.size()];
+  }
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_DECAYWHEEL_H
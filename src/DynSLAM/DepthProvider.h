@@ -2,6 +2,7 @@
 #ifndef DYNSLAM_DEPTHPROVIDER_H
 #define DYNSLAM_DEPTHPROVIDER_H
 
+#include <algorithm>
 #include <limits>
 
 #include <opencv/cv.h>
@@ -105,14 +106,15 @@ class DepthProvider {
     // our map will be very noisy; too small, and we only map the road and a couple of meters of
     // the sidewalks.
     int32_t min_depth_mm = static_cast<int32_t>(min_depth_m_ * kMetersToMillimeters);
-    int32_t max_depth_mm = static_cast<int32_t>(max_depth_m_ * kMetersToMillimeters);
+    float far_max_depth_m = GetFarMaxDepthMeters();
+    int32_t max_depth_mm = static_cast<int32_t>(far_max_depth_m * kMetersToMillimeters);
 
     // InfiniTAM requires short depth maps, so we need to ensure our depth can actually fit in a
     // short.
     int32_t max_representable_depth = std::numeric_limits<int16_t>::max();
     if (max_depth_mm >= max_representable_depth) {
       throw std::runtime_error(utils::Format("Unsupported maximum depth of %f meters (%d mm, "
-                                                 "larger than the %d limit).", max_depth_m_,
+                                                 "larger than the %d limit).", far_max_depth_m,
                                              max_depth_mm, max_representable_depth));
     }
 
@@ -155,6 +157,17 @@ class DepthProvider {
     this->max_depth_m_ = max_depth_m;
   }
 
+  /// \brief The depth up to which depth is still computed, so that the far range can be fused
+  ///        into a coarser map. Never below the maximum depth, which the regular input and the
+  ///        evaluation keep using.
+  float GetFarMaxDepthMeters() const {
+    return std::max(max_depth_m_, far_max_depth_m_);
+  }
+
+  void SetFarMaxDepthMeters(float far_max_depth_m) {
+    this->far_max_depth_m_ = far_max_depth_m;
+  }
+
  protected:
   /// \param Whether the input is a depth map, or just a disparity map.
   /// \param min_depth_m The minimum depth, in meters, which is not considered too noisy.
@@ -162,7 +175,8 @@ class DepthProvider {
   explicit DepthProvider(bool input_is_depth, float min_depth_m, float max_depth_m) :
       input_is_depth_(input_is_depth),
       min_depth_m_(min_depth_m),
-      max_depth_m_(max_depth_m) {}
+      max_depth_m_(max_depth_m),
+      far_max_depth_m_(max_depth_m) {}
 
   /// \brief If true, then assume the read maps are depth maps, instead of disparity maps.
   /// In this case, the depth from disparity computation is no longer performed.
@@ -173,6 +187,7 @@ class DepthProvider {
  private:
   float min_depth_m_;
   float max_depth_m_;
+  float far_max_depth_m_;
 };
 
 } // namespace dynslam
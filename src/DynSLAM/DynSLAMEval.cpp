@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include <dirent.h>
+#include <gflags/gflags.h>
+
+#include "Evaluation/Evaluation.h"
+
+DEFINE_string(dump_folder, "", "A folder of depth samples dumped by DynSLAMGUI with "
+                               "--depth_dump_folder, e.g., 'dumps/k-8-kitti-odometry-09-...'.");
+DEFINE_string(csv_folder, "csv", "Where to write the results. They are named like the CSV files of "
+                                 "the run which produced the dumps, and have the same format.");
+DEFINE_string(metrics_format, "csv", "Whether to write the results as 'csv', 'columnar' binary "
+                                     "files, or 'both'.");
+DEFINE_int32(cpu_threads, 0, "How many threads to evaluate frames on. 0 = one per core.");
+
+using namespace std;
+using namespace dynslam;
+using namespace dynslam::eval;
+using namespace dynslam::utils;
+
+/// \brief Returns the frame indices of all the dumps in the given folder, in increasing order.
+vector<int> ListDumpedFrames(const string &dump_folder) {
+  DIR *dir = opendir(dump_folder.c_str());
+  if (nullptr == dir) {
+    throw runtime_error(Format("Could not open the dump folder [%s].", dump_folder.c_str()));
+  }
+
+  vector<int> frames;
+  while (dirent *entry = readdir(dir)) {
+    int frame_idx = -1;
+    char extension[8] = {0};
+    if (2 == sscanf(entry->d_name, "%d.%7s", &frame_idx, extension) &&
+        string(extension) == "bin") {
+      frames.push_back(frame_idx);
+    }
+  }
+  closedir(dir);
+
+  sort(frames.begin(), frames.end());
+  return frames;
+}
+
+int main(int argc, char **argv) {
+  gflags::SetUsageMessage("Computes the depth evaluation metrics of a DynSLAM run from the depth "
+                          "samples it dumped, producing the same CSV files as the run itself.");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_cpu_threads > 0) {
+    SetWorkerCount(FLAGS_cpu_threads);
+  }
+
+  string dump_folder = FLAGS_dump_folder;
+  while (dump_folder.size() > 1 && dump_folder.back() == '/') {
+    dump_folder.pop_back();
+  }
+  if (dump_folder.empty()) {
+    cerr << "The --dump_folder=<path> flag must be set." << endl;
+    return -1;
+  }
+
+  vector<int> frames = ListDumpedFrames(dump_folder);
+  cout << "Evaluating " << frames.size() << " dumped frame(s) from [" << dump_folder << "]..."
+       << endl;
+  Tic("Offline evaluation");
+
+  // Frames are evaluated in parallel, but written out in order.
+  using FrameResult = pair<DepthFrameEvaluation, DepthFrameEvaluation>;
+  vector<unique_ptr<FrameResult>> results(frames.size());
+  ParallelFor(0, static_cast<int>(frames.size()), [&](int begin, int end) {
+    DepthSamples samples;
+    for (int i = begin; i < end; ++i) {
+      ReadDepthSamples(Format("%s/%06d.bin", dump_folder.c_str(), frames[i]), samples);
+      results[i].reset(new FrameResult(Evaluation::EvaluateSamplesSeparate(samples)));
+    }
+  }, 1);
+
+  string name = dump_folder.substr(dump_folder.rfind('/') + 1);
+  int formats = MetricsSink::ParseFormats(FLAGS_metrics_format);
+  MetricsSink static_csv(Format("%s/%s-static-depth-result.csv", FLAGS_csv_folder.c_str(),
+                                name.c_str()), formats);
+  MetricsSink dynamic_csv(Format("%s/%s-dynamic-depth-result.csv", FLAGS_csv_folder.c_str(),
+                                 name.c_str()), formats);
+  for (const unique_ptr<FrameResult> &result : results) {
+    static_csv.Write(result->first);
+    dynamic_csv.Write(result->second);
+  }
+  static_csv.Flush();
+  dynamic_csv.Flush();
+
+  Toc();
+  cout << "Wrote [" << static_csv.output_fpath_ << "] and [" << dynamic_csv.output_fpath_ << "]."
+       << endl;
+  return 0;
+}
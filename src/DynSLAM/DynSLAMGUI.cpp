@@ -38,9 +38,17 @@ DEFINE_bool(voxel_decay, true, "Whether to enable map regularization via voxel d
                                "garbage collection).");
 DEFINE_int32(min_decay_age, 200, "The minimum voxel *block* age for voxels within it to be eligible "
                                 "for deletion (garbage collection).");
-DEFINE_int32(max_decay_weight, 1, "The maximum voxel weight for decay. Voxels which have "
-                                  "accumulated more than this many measurements will not be "
-                                  "removed.");
+DEFINE_double(distance_decay_start, 0.0, "Static map blocks farther than this many meters from "
+                                         "the camera are decayed increasingly aggressively, up "
+                                         "to twice this distance. 0 = disabled.");
+DEFINE_double(static_map_memory_budget_mb, 0.0, "Decay the static map increasingly aggressively as "
+                                                "its memory usage approaches this many MiB. "
+                                                "0 = disabled.");
+DEFINE_bool(dynamic_region_decay, false, "Whether to decay the parts of the static map recently "
+                                         "covered by potentially dynamic objects more "
+                                         "aggressively, to reduce ghosting.");
+DEFINE_int32(decay_policy_extra_weight, 3, "The largest amount by which the decay policies may "
+                                           "raise 'max_decay_weight'.");
 DEFINE_int32(kitti_tracking_sequence_id, -1, "Used in conjunction with --dataset_type kitti-tracking.");
 DEFINE_bool(direct_refinement, false, "Whether to refine motion estimates for other cars computed "
                                      "sparsely with RANSAC using a semidense direct image "
@@ -49,27 +57,97 @@ DEFINE_bool(direct_refinement, false, "Whether to refine motion estimates for ot
 DEFINE_bool(use_depth_weighting, false, "Whether to adaptively set fusion weights as a function of "
                                         "the inverse depth (w \\propto \\frac{1}{Z}). If disabled, "
                                         "all new measurements have a constant weight of 1.");
-DEFINE_bool(semantic_evaluation, true, "Whether to separately evaluate the static and dynamic "
-                                       "parts of the reconstruction, based on the semantic "
-                                       "segmentation of each frame.");
 DEFINE_double(scale, 1.0, "Whether to run in reduced-scale mode. Used for experimental purposes. "
                           "Requires the (odometry) sequence to have been preprocessed using the "
                           "'scale_sequence.py' script.");
 DEFINE_bool(use_dispnet, false, "Whether to use DispNet depth maps. Otherwise ELAS is used.");
-DEFINE_int32(evaluation_delay, 0, "How many frames behind the current one should the evaluation be "
-                                  "performed. A value of 0 signifies always computing the "
-                                  "evaluation metrics on the most recent frames. Useful for "
-                                  "measuring the impact of the regularization, which ``follows'' "
-                                  "the camera with a delay of 'min_decay_age'. Warning: does not "
-                                  "support dynamic scenes.");
 DEFINE_bool(close_on_complete, true, "Whether to shut down automatically once 'frame_limit' is "
                                      "reached.");
 DEFINE_bool(record, false, "Whether to record a video of the GUI and save it to disk. Using an "
                            "external program usually leads to better results, though.");
 DEFINE_bool(chase_cam, false, "Whether to preview the reconstruction in chase cam mode, following "
                              "the camera from a third person view.");
-DEFINE_int32(fusion_every, 1, "Fuse every kth frame into the map. Used for evaluating the system's "
-                              "behavior under reduced temporal resolution.");
+DEFINE_int32(instance_volume_pool_size, 8, "The memory budget for reconstructing object instances, "
+                                           "expressed as the number of regular-size instance "
+                                           "volumes it could hold. Instance volumes are sized "
+                                           "based on the objects they hold, grow on demand, and "
+                                           "are recycled once their tracks end.");
+DEFINE_int32(instance_offload_after, 0, "Number of frames after which the reconstructions of "
+                                        "objects which are no longer seen are compressed (with "
+                                        "some loss of precision) and moved out of their "
+                                        "volumes. They are restored if the object is seen "
+                                        "again. 0 = keep them in their volumes.");
+DEFINE_string(instance_spill_dir, "", "Directory where offloaded object reconstructions are "
+                                      "stored. If empty, they are kept in (host) memory.");
+DEFINE_int32(static_map_cold_after, 0, "Number of frames after which the parts of the static map "
+                                       "which are out of view are compressed in (host) memory. "
+                                       "They are restored once they come into view again. "
+                                       "0 = keep the full map uncompressed.");
+DEFINE_double(static_map_cold_limit_mb, 0.0, "Limit for the (host) memory used by the compressed "
+                                             "parts of the static map. Beyond it, the ones which "
+                                             "were compressed first are written to disk if map "
+                                             "streaming is enabled, and discarded otherwise. "
+                                             "0 = no limit.");
+DEFINE_double(static_map_memory_limit_mb, 0.0, "Hard limit for the (device) memory used by the "
+                                               "static map's voxel block array and hash table. "
+                                               "The least recently observed blocks are evicted to "
+                                               "keep room for new geometry. 0 = use InfiniTAM's "
+                                               "default size, without eviction.");
+DEFINE_double(static_map_stream_radius, 0.0, "Parts of the static map farther than this many meters "
+                                             "from the camera are written to disk and removed "
+                                             "from memory, and loaded back when the camera gets "
+                                             "close to them again. 0 = keep the full map in "
+                                             "memory.");
+DEFINE_string(static_map_stream_dir, "/tmp/dynslam-static-map", "Directory where the streamed "
+                                                                "parts of the static map are "
+                                                                "stored.");
+DEFINE_string(static_map_voxel_format, "full", "Format of the static map voxels which are kept "
+                                               "compressed or streamed to disk: 'full', "
+                                               "'compact' (8-bit SDF, 4-bit weights, RGB565), or "
+                                               "'compact-nocolor'. The active map is unaffected.");
+DEFINE_string(instance_voxel_format, "full", "Format of the offloaded object reconstructions. See "
+                                             "'static_map_voxel_format'.");
+DEFINE_double(converged_block_threshold, 0.0, "Static map blocks with saturated weights whose "
+                                              "(normalized) SDF changes by less than this on "
+                                              "average between full fusions are considered "
+                                              "converged, and are only fused into every "
+                                              "'converged_fuse_every' frames. 0 = always fuse.");
+DEFINE_int32(converged_fuse_every, 5, "How often converged static map blocks are still fused into, "
+                                      "and re-evaluated.");
+DEFINE_double(coarse_map_start, 0.0, "Depth in meters beyond which the static scene is fused "
+                                    "into a separate, coarser map, since far-range stereo depth "
+                                    "is too noisy for full-resolution voxels. 0 = use a single "
+                                    "map.");
+DEFINE_int32(coarse_map_voxel_factor, 4, "How many times larger the voxels of the coarse static "
+                                         "map are.");
+DEFINE_double(coarse_map_max_depth, 30.0, "The maximum input depth, in meters, which is fused "
+                                          "into the coarse static map, when enabled. The rest of "
+                                          "the system and the evaluation keep using the dataset's "
+                                          "maximum depth. Must be below 32m, due to the depth map "
+                                          "format.");
+DEFINE_bool(cpu_raycast, false, "Whether to render the map previews with DynSLAM's tiled, "
+                                "multi-threaded CPU raycaster, instead of InfiniTAM's. Mostly "
+                                "useful in CPU-only builds. Keeps a planar host-side copy of "
+                                "every map, which costs as much memory as the maps themselves.");
+DEFINE_int32(preview_reprojection_refresh_every, 0, "If positive, map previews are produced by "
+                                                   "reprojecting the previous ones whenever the "
+                                                   "map has not changed, e.g., while moving the "
+                                                   "free-view camera, with a full refresh after "
+                                                   "this many. Requires --cpu_raycast.");
+DEFINE_int32(cpu_threads, 0, "How many threads to use for the CPU parts of the fusion pipeline. "
+                            "0 = one per core.");
+DEFINE_string(lidar_projection_cache, "", "If set, the LIDAR points projected for evaluation are "
+                                          "cached in this folder, so that later runs over the "
+                                          "same sequence skip reading and projecting them.");
+DEFINE_int32(evaluation_queue_size, 0, "How many frames may wait to be evaluated on the background "
+                                      "thread before the pipeline blocks. 0 evaluates every "
+                                      "frame synchronously.");
+DEFINE_string(depth_dump_folder, "", "If set, the samples every frame's depth is evaluated on are "
+                                     "also dumped to a subfolder of this folder, so that the "
+                                     "metrics can be recomputed offline with DynSLAMEval.");
+DEFINE_string(metrics_format, "csv", "How to write the evaluation results and the other metrics: "
+                                     "'csv', 'columnar' binary files, or 'both'. Either way, they "
+                                     "are written from a background thread.");
 DEFINE_bool(autoplay, false, "Whether to start with autoplay enabled. Useful for batch experiments.");
 
 // Note: the [RIP] tags signal spots where I wasted more than 30 minutes debugging a small, silly
@@ -1205,6 +1283,11 @@ void BuildDynSlamKittiOdometry(const string &dataset_root,
       input_config.min_depth_m,
       input_config.max_depth_m
   );
+  if (FLAGS_coarse_map_start > 0) {
+    // The far range is no longer discarded, but fused into the coarse map. The regular maximum
+    // depth stays, so the evaluation and the instances are unaffected.
+    depth->SetFarMaxDepthMeters(static_cast<float>(FLAGS_coarse_map_max_depth));
+  }
   (*input_out)->SetDepthProvider(depth);
 
   // [RIP] I lost a couple of hours debugging a bug caused by the fact that InfiniTAM still works
@@ -1217,6 +1300,18 @@ void BuildDynSlamKittiOdometry(const string &dataset_root,
   if (FLAGS_dynamic_weights) {
     driver_settings->sceneParams.maxW = driver_settings->maxWDynamic;
   }
+  if (FLAGS_static_map_memory_limit_mb > 0) {
+    // The hash table has a fixed size, and whatever is left goes to the voxel block array.
+    size_t limit_bytes = static_cast<size_t>(FLAGS_static_map_memory_limit_mb * 1024 * 1024);
+    size_t hash_table_bytes = InfiniTamDriver::GetHashTableBytes();
+    if (limit_bytes <= hash_table_bytes) {
+      throw runtime_error(Format("The static map memory limit must be larger than the %.2f MiB "
+                                 "taken up by the hash table.",
+                                 hash_table_bytes / 1024.0 / 1024.0));
+    }
+    driver_settings->sdfLocalBlockNum = static_cast<long>(
+        (limit_bytes - hash_table_bytes) / InfiniTamDriver::GetBlockFootprintBytes());
+  }
 
   drivers::InfiniTamDriver *driver = new InfiniTamDriver(
       driver_settings,
@@ -1225,6 +1320,65 @@ void BuildDynSlamKittiOdometry(const string &dataset_root,
       ToItmVec((*input_out)->GetDepthSize()),
       voxel_decay_params,
       FLAGS_use_depth_weighting);
+  if (FLAGS_static_map_cold_after > 0) {
+    size_t cold_limit_bytes = static_cast<size_t>(FLAGS_static_map_cold_limit_mb * 1024 * 1024);
+    driver->EnableColdBlockStore(FLAGS_static_map_cold_after,
+                                 ParseVoxelFormat(FLAGS_static_map_voxel_format),
+                                 cold_limit_bytes);
+  }
+  // The GUI's raycast preview is the only consumer of the tracker's raycast, since the pose comes
+  // from the sparse visual odometry.
+  driver->AddRaycastConsumer(InfiniTamDriver::kPreview);
+  if (FLAGS_cpu_raycast) {
+    driver->EnableCpuRaycaster();
+  }
+  if (FLAGS_preview_reprojection_refresh_every > 0) {
+    driver->EnablePreviewReprojection(FLAGS_preview_reprojection_refresh_every);
+  }
+  if (FLAGS_converged_block_threshold > 0) {
+    driver->EnableConvergenceTracking(static_cast<float>(FLAGS_converged_block_threshold),
+                                      FLAGS_converged_fuse_every);
+  }
+  if (FLAGS_static_map_memory_limit_mb > 0) {
+    // Comfortably more than a single frame's worth of new blocks.
+    const float kHeadroomFraction = 0.1f;
+    driver->EnableBlockBudget(static_cast<int>(driver->GetBlockCapacity() * kHeadroomFraction));
+  }
+  if (FLAGS_distance_decay_start > 0) {
+    float start_m = static_cast<float>(FLAGS_distance_decay_start);
+    driver->AddDecayPolicy(new DistanceDecayPolicy(start_m, 2 * start_m,
+                                                   FLAGS_decay_policy_extra_weight));
+  }
+  if (FLAGS_static_map_memory_budget_mb > 0) {
+    size_t budget_bytes = static_cast<size_t>(FLAGS_static_map_memory_budget_mb * 1024 * 1024);
+    driver->AddDecayPolicy(new MemoryBudgetDecayPolicy(budget_bytes,
+                                                       FLAGS_decay_policy_extra_weight));
+  }
+  if (FLAGS_dynamic_region_decay) {
+    // Blocks only become eligible for decay 'min_decay_age' frames after they were last updated.
+    driver->AddDecayPolicy(new DynamicRegionDecayPolicy(FLAGS_decay_policy_extra_weight,
+                                                        2 * FLAGS_min_decay_age));
+  }
+
+  drivers::InfiniTamDriver *coarse_driver = nullptr;
+  if (FLAGS_coarse_map_start > 0) {
+    ITMLibSettings *coarse_settings = new ITMLibSettings(*driver_settings);
+    float voxel_factor = static_cast<float>(FLAGS_coarse_map_voxel_factor);
+    coarse_settings->sceneParams.voxelSize *= voxel_factor;
+    coarse_settings->sceneParams.mu *= voxel_factor;
+    coarse_settings->sceneParams.viewFrustum_max = static_cast<float>(FLAGS_coarse_map_max_depth);
+
+    coarse_driver = new InfiniTamDriver(
+        coarse_settings,
+        CreateItmCalib(left_color_proj, frame_size),
+        ToItmVec((*input_out)->GetRgbSize()),
+        ToItmVec((*input_out)->GetDepthSize()),
+        voxel_decay_params,
+        FLAGS_use_depth_weighting);
+    if (FLAGS_cpu_raycast) {
+      coarse_driver->EnableCpuRaycaster();
+    }
+  }
 
   const string seg_folder = dataset_root + "/" + input_config.segmentation_folder;
   auto segmentation_provider =
@@ -1265,7 +1419,17 @@ void BuildDynSlamKittiOdometry(const string &dataset_root,
                                                   FLAGS_direct_refinement,
                                                   FLAGS_dynamic_mode,
                                                   FLAGS_use_depth_weighting,
-                                                  FLAGS_semantic_evaluation);
+                                                  FLAGS_semantic_evaluation,
+                                                  MetricsSink::ParseFormats(FLAGS_metrics_format));
+  if (! FLAGS_lidar_projection_cache.empty()) {
+    evaluation->EnableProjectionCache(FLAGS_lidar_projection_cache);
+  }
+  if (! FLAGS_depth_dump_folder.empty()) {
+    evaluation->EnableDepthDumps(FLAGS_depth_dump_folder);
+  }
+  if (FLAGS_evaluation_queue_size > 0) {
+    evaluation->EnableAsync(FLAGS_evaluation_queue_size);
+  }
 
   Vector2i input_shape((*input_out)->GetRgbSize().width, (*input_out)->GetRgbSize().height);
   *dyn_slam_out = new DynSlam(
@@ -1279,7 +1443,16 @@ void BuildDynSlamKittiOdometry(const string &dataset_root,
       baseline_m,
       FLAGS_direct_refinement,
       FLAGS_dynamic_mode,
-      FLAGS_fusion_every
+      FLAGS_fusion_every,
+      FLAGS_instance_volume_pool_size,
+      OffloadParams(FLAGS_instance_offload_after,
+                    FLAGS_instance_spill_dir,
+                    ParseVoxelFormat(FLAGS_instance_voxel_format)),
+      static_cast<float>(FLAGS_static_map_stream_radius),
+      FLAGS_static_map_stream_dir,
+      ParseVoxelFormat(FLAGS_static_map_voxel_format),
+      coarse_driver,
+      static_cast<float>(FLAGS_coarse_map_start)
   );
 }
 
@@ -1296,6 +1469,9 @@ int main(int argc, char **argv) {
                           "Based on the amazing InfiniTAM volumetric fusion framework (https://github.com/victorprad/InfiniTAM).\n"
                           "Please see the README.md file for further information and credits.");
   gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_cpu_threads > 0) {
+    SetWorkerCount(FLAGS_cpu_threads);
+  }
 
   const string dataset_root = FLAGS_dataset_root;
   if (dataset_root.empty()) {
@@ -1303,6 +1479,12 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  if (FLAGS_preview_reprojection_refresh_every > 0 && ! FLAGS_cpu_raycast) {
+    // Otherwise, only the static map would switch to the CPU raycaster behind the user's back.
+    cerr << "The --preview_reprojection_refresh_every flag requires --cpu_raycast." << endl;
+    return -1;
+  }
+
   dynslam::DynSlam *dyn_slam;
   dynslam::Input *input;
   BuildDynSlamKittiOdometry(dataset_root, &dyn_slam, &input);
@@ -1310,6 +1492,13 @@ int main(int argc, char **argv) {
   dynslam::gui::PangolinGui pango_gui(dyn_slam, input);
   pango_gui.Run();
 
+  // The last few frames may still be getting evaluated in the background.
+  dyn_slam->GetEvaluation()->WaitForPending();
+  dyn_slam->GetEvaluation()->FlushMetrics();
+
+  // Leave the full static map in the store, and not just its far-away parts.
+  dyn_slam->FlushStaticMapStore();
+
   delete dyn_slam;
   delete input;
 }
@@ -2,13 +2,29 @@
 
 #include <chrono>
 #include <thread>
+#include <unordered_set>
 
 #include "DynSlam.h"
 #include "Evaluation/Evaluation.h"
 
 DEFINE_bool(dynamic_weights, false, "Whether to use depth-based weighting when performing fusion.");
-DECLARE_bool(semantic_evaluation);
-DECLARE_int32(evaluation_delay);
+
+// These are defined here, instead of in the GUI, since the evaluation reads them as well, e.g., to
+// name its output, and it is also used by other tools, such as 'DynSLAMEval'.
+DEFINE_int32(max_decay_weight, 1, "The maximum voxel weight for decay. Voxels which have "
+                                  "accumulated more than this many measurements will not be "
+                                  "removed.");
+DEFINE_int32(fusion_every, 1, "Fuse every kth frame into the map. Used for evaluating the system's "
+                              "behavior under reduced temporal resolution.");
+DEFINE_bool(semantic_evaluation, true, "Whether to separately evaluate the static and dynamic "
+                                       "parts of the reconstruction, based on the semantic "
+                                       "segmentation of each frame.");
+DEFINE_int32(evaluation_delay, 0, "How many frames behind the current one should the evaluation be "
+                                  "performed. A value of 0 signifies always computing the "
+                                  "evaluation metrics on the most recent frames. Useful for "
+                                  "measuring the impact of the regularization, which ``follows'' "
+                                  "the camera with a delay of 'min_decay_age'. Warning: does not "
+                                  "support dynamic scenes.");
 
 namespace dynslam {
 
@@ -113,6 +129,7 @@ void DynSlam::ProcessFrame(Input *input) {
 
   utils::Tic("Input preprocessing");
   input->GetCvImages(&input_rgb_image_, &input_raw_depth_image_);
+  input_far_depth_image_ = *input->GetFarDepth();
   static_scene_->UpdateView(*input_rgb_image_, *input_raw_depth_image_);
   utils::Toc();
 
@@ -130,6 +147,15 @@ void DynSlam::ProcessFrame(Input *input) {
           sparse_sf_provider_->GetFlow(),
           *sparse_sf_provider_,
           always_reconstruct_objects_);
+      if (coarse_static_scene_) {
+        RemoveDynamicFarDepth();
+      }
+    }
+
+    if (dynamic_mode_ && static_scene_->NeedsDynamicBlocks()) {
+      vector<Vector3s> dynamic_blocks;
+      ComputeDynamicBlocks(dynamic_blocks);
+      static_scene_->SetDynamicBlocks(std::move(dynamic_blocks));
     }
   }
   utils::Toc();
@@ -138,17 +164,65 @@ void DynSlam::ProcessFrame(Input *input) {
   // information to enhance tracking.
   if (! first_frame) {
     if (current_frame_no_ % experimental_fusion_every_ == 0) {
+      // Bring back any compressed blocks which came into view before we fuse into them.
+      utils::Tic("Cold block restore");
+      static_scene_->RestoreColdBlocks(current_frame_no_);
+      utils::TocMicro();
+
+      if (coarse_static_scene_) {
+        utils::Tic("Coarse static map fusion");
+        FuseCoarseMap();
+        utils::TocMicro();
+      }
+
+      utils::Tic("Converged block skipping");
+      static_scene_->SkipConvergedBlocks(current_frame_no_);
+      utils::TocMicro();
+
       utils::Tic("Static map fusion");
       static_scene_->Integrate();
       static_scene_->PrepareNextStep();
       utils::TocMicro();
 
+      utils::Tic("Block convergence update");
+      static_scene_->UpdateBlockConvergence(current_frame_no_);
+      utils::TocMicro();
+
+      utils::Tic("Static map budget");
+      static_scene_->EnforceBlockBudget(current_frame_no_);
+      utils::TocMicro();
+      if (static_scene_->IsFull()) {
+        cerr << "Warning: The static map is full, so new geometry is being dropped! Consider "
+             << "setting a memory limit, which makes room for it by evicting old blocks." << endl;
+      }
+
       // Idea: trigger decay not based on frame gap, but using translation-based threshold.
       // Decay old, possibly noisy, voxels to improve map quality and reduce its memory footprint.
       utils::Tic("Map decay");
       static_scene_->Decay();
       utils::TocMicro();
+
+      utils::Tic("Cold block compression");
+      static_scene_->CompressIdleBlocks(current_frame_no_);
+      utils::TocMicro();
+
+      utils::Tic("Planar mirror update");
+      static_scene_->UpdatePlanarMirror();
+      utils::TocMicro();
     }
+
+    if (static_map_streamer_ && current_frame_no_ % kStaticMapStreamEvery == 0) {
+      utils::Tic("Static map streaming");
+      Eigen::Vector3f camera_position = static_scene_->GetPose().block(0, 3, 3, 1);
+      static_map_streamer_->Update(camera_position, current_frame_no_);
+      utils::TocMicro();
+    }
+
+    // All the passes above share one host-side view of the map, which only gets written back
+    // once, and only if any of them changed it.
+    utils::Tic("Static map commit");
+    static_scene_->CommitBlockMap();
+    utils::TocMicro();
   }
 
   int evaluated_frame_idx = current_frame_no_ - FLAGS_evaluation_delay;
@@ -186,6 +260,113 @@ const unsigned char* DynSlam::GetObjectPreview(int object_idx) {
   return out_image_->GetData(MemoryDeviceType::MEMORYDEVICE_CPU)->getValues();
 }
 
+void DynSlam::ComputeDynamicBlocks(std::vector<Vector3s> &out) const {
+  // Every few pixels are plenty, since a block covers many pixels at typical depths.
+  const int kPixelStride = 4;
+  const float kMillimetersToMeters = 1.0f / 1000.0f;
+
+  float block_size_m = static_scene_->GetVoxelSize() * SDF_BLOCK_SIZE;
+  float fx = projection_left_rgb_(0, 0);
+  float fy = projection_left_rgb_(1, 1);
+  float cx = projection_left_rgb_(0, 2);
+  float cy = projection_left_rgb_(1, 2);
+  Eigen::Matrix4f pose = static_scene_->GetPose();
+
+  unordered_set<int64_t> seen;
+  for (const InstanceDetection &detection : latest_seg_result_->instance_detections) {
+    const instreclib::utils::Mask &mask = *detection.delete_mask;
+    const instreclib::utils::BoundingBox &bbox = mask.GetBoundingBox();
+    for (int y = max(bbox.r.y0, 0); y <= min(bbox.r.y1, input_raw_depth_image_->rows - 1);
+         y += kPixelStride) {
+      for (int x = max(bbox.r.x0, 0); x <= min(bbox.r.x1, input_raw_depth_image_->cols - 1);
+           x += kPixelStride) {
+        int16_t depth_mm = input_raw_depth_image_->at<int16_t>(y, x);
+        if (depth_mm <= 0 || ! mask.ContainsPoint(x, y)) {
+          continue;
+        }
+
+        float z = depth_mm * kMillimetersToMeters;
+        Eigen::Vector4f point_cam((x - cx) * z / fx, (y - cy) * z / fy, z, 1.0f);
+        Eigen::Vector4f point = pose * point_cam;
+        Vector3s block_pos(static_cast<short>(floor(point(0) / block_size_m)),
+                           static_cast<short>(floor(point(1) / block_size_m)),
+                           static_cast<short>(floor(point(2) / block_size_m)));
+        if (seen.insert(drivers::PackBlockPos(block_pos)).second) {
+          out.push_back(block_pos);
+        }
+      }
+    }
+  }
+}
+
+void DynSlam::RemoveDynamicFarDepth() {
+  const auto &removed_masks = instance_reconstructor_->GetRemovedMasks();
+  if (removed_masks.empty()) {
+    return;
+  }
+
+  // The far depth shares its buffer with the input, so it must not be modified in place.
+  input_far_depth_image_ = input_far_depth_image_.clone();
+  cv::Mat1s &depth = input_far_depth_image_;
+  for (const auto &mask : removed_masks) {
+    const instreclib::utils::BoundingBox &bbox = mask->GetBoundingBox();
+    for (int y = max(bbox.r.y0, 0); y <= min(bbox.r.y1, depth.rows - 1); ++y) {
+      for (int x = max(bbox.r.x0, 0); x <= min(bbox.r.x1, depth.cols - 1); ++x) {
+        if (mask->ContainsPoint(x, y)) {
+          depth(y, x) = 0;
+        }
+      }
+    }
+  }
+}
+
+void DynSlam::FuseCoarseMap() {
+  float overlap_m = coarse_map_start_m_ * kCoarseMapOverlap;
+  cv::Mat1s far_depth_mm;
+  static_scene_->SplitViewDepth(input_far_depth_image_,
+                                coarse_map_start_m_ - overlap_m,
+                                coarse_map_start_m_ + overlap_m,
+                                far_depth_mm);
+
+  coarse_static_scene_->SetPose(static_scene_->GetPose());
+  coarse_static_scene_->UpdateView(*input_rgb_image_, far_depth_mm);
+  coarse_static_scene_->Integrate();
+  coarse_static_scene_->PrepareNextStep();
+  coarse_static_scene_->Decay();
+  coarse_static_scene_->UpdatePlanarMirror();
+  coarse_static_scene_->CommitBlockMap();
+}
+
+void DynSlam::CompositeCoarseMap(ITMUChar4Image *color,
+                                 ITMFloatImage *depth,
+                                 PreviewType preview,
+                                 const pangolin::OpenGlMatrix &model_view) {
+  if (! coarse_static_scene_) {
+    return;
+  }
+
+  coarse_static_scene_->GetFloatImage(coarse_out_image_float_.get(), PreviewType::kDepth,
+                                      model_view);
+  if (nullptr != color) {
+    coarse_static_scene_->GetImage(coarse_out_image_.get(), preview, model_view);
+  }
+
+  float *depth_data = depth->GetData(MEMORYDEVICE_CPU);
+  const float *coarse_depth_data = coarse_out_image_float_->GetData(MEMORYDEVICE_CPU);
+  Vector4u *color_data = (nullptr != color) ? color->GetData(MEMORYDEVICE_CPU) : nullptr;
+  const Vector4u *coarse_color_data = coarse_out_image_->GetData(MEMORYDEVICE_CPU);
+  size_t pixel_count = static_cast<size_t>(depth->noDims.x) * depth->noDims.y;
+  for (size_t i = 0; i < pixel_count; ++i) {
+    float coarse_depth = coarse_depth_data[i];
+    if (coarse_depth != 0 && (depth_data[i] == 0 || coarse_depth < depth_data[i])) {
+      depth_data[i] = coarse_depth;
+      if (nullptr != color_data) {
+        color_data[i] = coarse_color_data[i];
+      }
+    }
+  }
+}
+
 void DynSlam::SaveStaticMap(const std::string &dataset_name, const std::string &depth_name) const {
   string target_folder = EnsureDumpFolderExists(dataset_name);
   string map_fpath = utils::Format("%s/static-%s-mesh-%06d-frames.obj",
@@ -194,6 +375,15 @@ void DynSlam::SaveStaticMap(const std::string &dataset_name, const std::string &
                                    current_frame_no_);
   cout << "Saving full static map to: " << map_fpath << endl;
   static_scene_->SaveSceneToMesh(map_fpath.c_str());
+
+  if (coarse_static_scene_) {
+    string coarse_map_fpath = utils::Format("%s/static-%s-coarse-mesh-%06d-frames.obj",
+                                            target_folder.c_str(),
+                                            depth_name.c_str(),
+                                            current_frame_no_);
+    cout << "Saving coarse static map to: " << coarse_map_fpath << endl;
+    coarse_static_scene_->SaveSceneToMesh(coarse_map_fpath.c_str());
+  }
 }
 
 void DynSlam::SaveDynamicObject(const std::string &dataset_name,
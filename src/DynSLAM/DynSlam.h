@@ -10,8 +10,12 @@
 #include "InstRecLib/PrecomputedSegmentationProvider.h"
 #include "InstRecLib/SparseSFProvider.h"
 #include "Input.h"
+#include "PreviewCache.h"
+#include "StaticMapStreamer.h"
 
 DECLARE_bool(dynamic_weights);
+DECLARE_bool(semantic_evaluation);
+DECLARE_int32(evaluation_delay);
 
 namespace dynslam {
 namespace eval {
@@ -42,13 +46,22 @@ class DynSlam {
           float stereo_baseline_m,
           bool enable_direct_refinement,
           bool dynamic_mode,
-          int fusion_every)
+          int fusion_every,
+          int instance_volume_pool_size = kDefaultInstanceVolumePoolSize,
+          const OffloadParams &instance_offload_params = OffloadParams::Disabled(),
+          float static_map_stream_radius_m = 0.0f,
+          const std::string &static_map_stream_dir = "",
+          VoxelFormat static_map_stream_format = VoxelFormat::kFull,
+          InfiniTamDriver *coarse_static_scene = nullptr,
+          float coarse_map_start_m = 0.0f)
     : static_scene_(itm_static_scene_engine),
       segmentation_provider_(segmentation_provider),
       instance_reconstructor_(new InstanceReconstructor(
           itm_static_scene_engine,
           itm_static_scene_engine->IsDecayEnabled(),
-          enable_direct_refinement
+          enable_direct_refinement,
+          instance_volume_pool_size,
+          instance_offload_params
       )),
       sparse_sf_provider_(sparse_sf_provider),
       evaluation_(evaluation),
@@ -65,8 +78,40 @@ class DynSlam {
       projection_left_rgb_(proj_left_rgb),
       projection_right_rgb_(proj_right_rgb),
       stereo_baseline_m_(stereo_baseline_m),
-      experimental_fusion_every_(fusion_every)
-  {}
+      experimental_fusion_every_(fusion_every),
+      coarse_static_scene_(coarse_static_scene),
+      coarse_map_start_m_(coarse_map_start_m),
+      coarse_out_image_(nullptr),
+      coarse_out_image_float_(nullptr),
+      static_preview_(new ITMUChar4Image(input_shape, true, true)),
+      static_preview_depth_(new ITMFloatImage(input_shape, true, true)),
+      static_depth_preview_(new ITMFloatImage(input_shape, true, true)),
+      object_raycast_preview_(new ITMUChar4Image(input_shape, true, true))
+  {
+    if (coarse_static_scene_) {
+      coarse_out_image_.reset(new ITMUChar4Image(input_shape, true, true));
+      coarse_out_image_float_.reset(new ITMFloatImage(input_shape, true, true));
+    }
+
+    if (static_map_stream_radius_m > 0.0f) {
+      static_map_streamer_.reset(new StaticMapStreamer(
+          itm_static_scene_engine,
+          static_map_stream_dir,
+          static_map_stream_radius_m,
+          static_map_stream_format));
+
+      // Blocks evicted to keep the map within its budget are better off on disk than gone.
+      StaticMapStreamer *streamer = static_map_streamer_.get();
+      itm_static_scene_engine->SetBlockEvictionSink([streamer](const vector<VoxelBlock> &blocks) {
+        streamer->Spill(blocks);
+      });
+    }
+
+    if (dynamic_mode_) {
+      // Avoid large allocation spikes later on, when objects start entering the scene.
+      instance_reconstructor_->PreallocateVolumes();
+    }
+  }
 
   /// \brief Reads in and processes the next frame from the data source.
   /// This is where most of the interesting stuff happens.
@@ -98,8 +143,14 @@ class DynSlam {
       const pangolin::OpenGlMatrix &model_view,
       PreviewType preview
   ) {
-    instance_reconstructor_->GetInstanceRaycastPreview(out_image_, object_idx, model_view, preview);
-    return out_image_->GetData(MEMORYDEVICE_CPU)->getValues();
+    if (! object_raycast_preview_cache_.Lookup(GetPreviewKey(preview, object_idx, false,
+                                                              model_view))) {
+      instance_reconstructor_->GetInstanceRaycastPreview(object_raycast_preview_.get(),
+                                                         object_idx,
+                                                         model_view,
+                                                         preview);
+    }
+    return object_raycast_preview_->GetData(MEMORYDEVICE_CPU)->getValues();
   }
 
   /// \brief Returns an RGBA preview of the reconstructed static map.
@@ -108,27 +159,67 @@ class DynSlam {
       PreviewType preview,
       bool enable_compositing
   ) {
-    static_scene_->GetImage(out_image_, preview, model_view);
-    static_scene_->GetFloatImage(out_image_float_, PreviewType::kDepth, model_view);
+    if (static_preview_cache_.Lookup(GetPreviewKey(preview, -1, enable_compositing, model_view))) {
+      return static_preview_->GetData(MEMORYDEVICE_CPU)->getValues();
+    }
+
+    ITMUChar4Image *color = static_preview_.get();
+    ITMFloatImage *depth = static_preview_depth_.get();
+    static_scene_->GetImage(color, preview, model_view);
+    static_scene_->GetFloatImage(depth, PreviewType::kDepth, model_view);
+    CompositeCoarseMap(color, depth, preview, model_view);
 
     if (dynamic_mode_ && enable_compositing) {
-      instance_reconstructor_->CompositeInstances(out_image_, out_image_float_, preview, model_view);
+      instance_reconstructor_->CompositeInstances(color, depth, preview, model_view);
     }
 
-    return out_image_->GetData(MEMORYDEVICE_CPU)->getValues();
+    return color->GetData(MEMORYDEVICE_CPU)->getValues();
   }
 
   /// \brief Returns a raycast from the specified pose.
   /// If dynamic mode is enabled, the raycast will also contain the current active reconstructions,
   /// if any.
   const float* GetStaticMapRaycastDepthPreview(const pangolin::OpenGlMatrix &model_view, bool enable_compositing) {
-    static_scene_->GetFloatImage(out_image_float_, PreviewType::kDepth, model_view);
+    ITMFloatImage *depth = static_depth_preview_.get();
+    if (static_depth_preview_cache_.Lookup(GetPreviewKey(PreviewType::kDepth, -1,
+                                                         enable_compositing, model_view))) {
+      return depth->GetData(MEMORYDEVICE_CPU);
+    }
+
+    static_scene_->GetFloatImage(depth, PreviewType::kDepth, model_view);
+    CompositeCoarseMap(nullptr, depth, PreviewType::kDepth, model_view);
 
     if (dynamic_mode_ && enable_compositing) {
-      instance_reconstructor_->CompositeInstanceDepthMaps(out_image_float_, model_view);
+      instance_reconstructor_->CompositeInstanceDepthMaps(depth, model_view);
+    }
+
+    return depth->GetData(MEMORYDEVICE_CPU);
+  }
+
+  /// \brief Whether 'GetStaticMapDepthAt' can be used, i.e., whether all maps are rendered with
+  ///        the CPU raycaster.
+  bool CanRaycastPixels() const {
+    return static_scene_->IsCpuRaycasterEnabled() &&
+           (! coarse_static_scene_ || coarse_static_scene_->IsCpuRaycasterEnabled());
+  }
+
+  /// \brief Like 'GetStaticMapRaycastDepthPreview', but only raycasts the given pixels, which is
+  ///        far cheaper when only a few of them are needed, e.g., for the evaluation.
+  /// \param out_depth Receives one depth per pixel, in meters, or zero where nothing was hit.
+  /// \see CanRaycastPixels
+  void GetStaticMapDepthAt(const pangolin::OpenGlMatrix &model_view,
+                           const std::vector<Eigen::Vector2i> &pixels,
+                           bool enable_compositing,
+                           std::vector<float> &out_depth) {
+    out_depth.assign(pixels.size(), 0.0f);
+    static_scene_->RenderDepthAtOnCpu(model_view, pixels, out_depth.data());
+    if (coarse_static_scene_) {
+      coarse_static_scene_->RenderDepthAtOnCpu(model_view, pixels, out_depth.data());
     }
 
-    return out_image_float_->GetData(MEMORYDEVICE_CPU);
+    if (dynamic_mode_ && enable_compositing) {
+      instance_reconstructor_->CompositeInstanceDepthsAt(model_view, pixels, out_depth.data());
+    }
   }
 
   /// \brief Returns an RGBA unsigned char frame containing the preview of the most recent frame's
@@ -215,14 +306,46 @@ class DynSlam {
     return pose_history_;
   }
 
+  /// \brief The memory used by the static map, including its compressed cold blocks and its
+  ///        coarse far-range part.
   size_t GetStaticMapMemoryBytes() const {
-    return static_scene_->GetUsedMemoryBytes();
+    return static_scene_->GetUsedMemoryBytes() + static_scene_->GetColdBlockMemoryBytes() +
+           GetCoarseStaticMapMemoryBytes();
+  }
+
+  size_t GetCoarseStaticMapMemoryBytes() const {
+    return coarse_static_scene_ ? coarse_static_scene_->GetUsedMemoryBytes() : 0;
+  }
+
+  /// \brief Returns null if the static map has no coarse far-range part.
+  const InfiniTamDriver *GetCoarseStaticMap() const {
+    return coarse_static_scene_.get();
+  }
+
+  size_t GetStaticMapColdMemoryBytes() const {
+    return static_scene_->GetColdBlockMemoryBytes();
+  }
+
+  size_t GetStaticMapSavedColdMemoryBytes() const {
+    return static_scene_->GetSavedColdMemoryBytes();
+  }
+
+  size_t GetStaticMapEvictedBlockCount() const {
+    return static_scene_->GetEvictedBlockCount();
   }
 
   size_t GetStaticMapSavedDecayMemoryBytes() const {
     return static_scene_->GetSavedDecayMemoryBytes();
   }
 
+  const std::vector<std::unique_ptr<DecayPolicy>>& GetStaticMapDecayPolicies() const {
+    return static_scene_->GetDecayPolicies();
+  }
+
+  size_t GetStaticMapBlockSizeBytes() const {
+    return static_scene_->GetVoxelSizeBytes() * SDF_BLOCK_SIZE3;
+  }
+
   const VoxelDecayParams& GetStaticMapDecayParams() const {
     return static_scene_->GetVoxelDecayParams();
   }
@@ -267,6 +390,14 @@ class DynSlam {
     static_scene_->DecayCatchup();
   }
 
+  /// \brief Writes the parts of the static map still in memory to the map store, so that it ends
+  ///        up containing the full map. Does nothing if map streaming is disabled.
+  void FlushStaticMapStore() {
+    if (static_map_streamer_) {
+      static_map_streamer_->Flush();
+    }
+  }
+
   SUPPORT_EIGEN_FIELDS;
 
 private:
@@ -280,6 +411,9 @@ private:
   ITMFloatImage *out_image_float_;
   cv::Mat3b *input_rgb_image_;
   cv::Mat1s *input_raw_depth_image_;
+  /// \brief The input depth including the far range, which only the coarse map gets to see, with
+  ///        the same dynamic objects cut out of it as out of the static scene's view.
+  cv::Mat1s input_far_depth_image_;
 
   int current_frame_no_;
   int input_width_;
@@ -317,9 +451,70 @@ private:
   /// data and get SSF at whatever intervals we would like.
   const int experimental_fusion_every_;
 
+  /// \brief Moves far-away parts of the static map to the disk. Null if this is disabled.
+  std::unique_ptr<StaticMapStreamer> static_map_streamer_;
+
+  /// \brief How often (in frames) to check which parts of the static map need to be streamed.
+  const int kStaticMapStreamEvery = 10;
+
+  /// \brief Coarser map which the far-range parts of the static scene are fused into. Null if
+  ///        the static map only has one resolution.
+  std::unique_ptr<InfiniTamDriver> coarse_static_scene_;
+  /// \brief Depth beyond which the static scene goes into the coarse map.
+  const float coarse_map_start_m_;
+  std::unique_ptr<ITMUChar4Image> coarse_out_image_;
+  std::unique_ptr<ITMFloatImage> coarse_out_image_float_;
+
+  /// \brief The near and far ranges overlap by this fraction of the coarse map's start depth,
+  ///        so that surfaces don't get torn at the boundary.
+  const float kCoarseMapOverlap = 0.1f;
+
+  /// \brief The raycast previews get their own buffers, so that they can be reused across redraws
+  ///        for as long as neither the maps nor the viewpoint change.
+  std::unique_ptr<ITMUChar4Image> static_preview_;
+  std::unique_ptr<ITMFloatImage> static_preview_depth_;
+  PreviewCache static_preview_cache_;
+  std::unique_ptr<ITMFloatImage> static_depth_preview_;
+  PreviewCache static_depth_preview_cache_;
+  std::unique_ptr<ITMUChar4Image> object_raycast_preview_;
+  PreviewCache object_raycast_preview_cache_;
+
+  PreviewKey GetPreviewKey(PreviewType type,
+                           int object_idx,
+                           bool compositing,
+                           const pangolin::OpenGlMatrix &model_view) const {
+    return PreviewKey(InfiniTamDriver::GetLatestMapVersion(),
+                      current_frame_no_,
+                      type,
+                      object_idx,
+                      compositing,
+                      model_view);
+  }
+
   /// \brief Returns a path to the folder where the dataset's meshes should be dumped, creating it
   ///        using a native system call if it does not exist.
   std::string EnsureDumpFolderExists(const string& dataset_name) const;
+
+  /// \brief Finds the static map blocks covered by the objects detected in the current frame, by
+  ///        back-projecting a subset of the pixels in their masks.
+  void ComputeDynamicBlocks(std::vector<Vector3s> &out) const;
+
+  /// \brief Cuts the objects which the instance reconstructor removed from the static scene's
+  ///        view out of the far depth as well, so they don't end up in the coarse map.
+  void RemoveDynamicFarDepth();
+
+  /// \brief Fuses the far range of the current frame into the coarse map, and removes it from
+  ///        the static scene's view.
+  void FuseCoarseMap();
+
+  /// \brief Renders the coarse map from the given viewpoint and merges it into a raycast of the
+  ///        fine map, keeping the nearest surface at every pixel. Does nothing if the static map
+  ///        has no coarse part.
+  /// \param color May be null if only the depth is needed.
+  void CompositeCoarseMap(ITMUChar4Image *color,
+                          ITMFloatImage *depth,
+                          PreviewType preview,
+                          const pangolin::OpenGlMatrix &model_view);
 };
 
 }
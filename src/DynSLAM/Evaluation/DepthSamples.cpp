@@ -0,0 +1,124 @@
+
+#include "DepthSamples.h"
+
+#include <cstdio>
+
+#include "../Utils.h"
+
+namespace dynslam {
+namespace eval {
+
+using namespace std;
+
+namespace {
+
+const uint32_t kMagic = 0x53445344;   // "DSDS"
+
+/// \brief Reads or writes 'count' elements, throwing if they don't fit the file.
+template<typename T>
+void WriteArray(FILE *out, const T *data, size_t count, const string &fpath) {
+  // Frames without samples have empty (null) arrays, which must not reach 'fwrite'.
+  if (count > 0 && fwrite(data, sizeof(T), count, out) != count) {
+    fclose(out);
+    throw runtime_error(utils::Format("Could not write depth samples to [%s].", fpath.c_str()));
+  }
+}
+
+template<typename T>
+void ReadArray(FILE *in, T *data, size_t count, const string &fpath) {
+  if (count > 0 && fread(data, sizeof(T), count, in) != count) {
+    fclose(in);
+    throw runtime_error(utils::Format("Truncated depth samples file [%s].", fpath.c_str()));
+  }
+}
+
+}
+
+void WriteDepthSamples(const string &fpath, const DepthSamples &samples) {
+  if (! samples.associations.empty() && samples.associations.size() != samples.GetSize()) {
+    throw runtime_error("Every depth sample needs an association, if any.");
+  }
+
+  FILE *out = fopen(fpath.c_str(), "wb");
+  if (nullptr == out) {
+    throw runtime_error(utils::Format("Could not open [%s] for writing.", fpath.c_str()));
+  }
+
+  uint32_t id_length = static_cast<uint32_t>(samples.dataset_id.size());
+  uint32_t count = static_cast<uint32_t>(samples.GetSize());
+  uint8_t has_associations = samples.associations.empty() ? 0 : 1;
+  int32_t frame_info[3] = { samples.frame_idx, samples.frame_width, samples.frame_height };
+  float camera_info[3] = { samples.baseline_m, samples.focal_length_px, samples.max_depth_m };
+
+  WriteArray(out, &kMagic, 1, fpath);
+  WriteArray(out, frame_info, 3, fpath);
+  WriteArray(out, &id_length, 1, fpath);
+  WriteArray(out, samples.dataset_id.data(), id_length, fpath);
+  WriteArray(out, samples.pose.data(), 16, fpath);
+  WriteArray(out, camera_info, 3, fpath);
+  WriteArray(out, &count, 1, fpath);
+  WriteArray(out, &has_associations, 1, fpath);
+  WriteArray(out, samples.indices.data(), count, fpath);
+  WriteArray(out, samples.left.data(), 2 * count, fpath);
+  WriteArray(out, samples.right.data(), 2 * count, fpath);
+  WriteArray(out, samples.rendered_depth_m.data(), count, fpath);
+  WriteArray(out, samples.input_depth_mm.data(), count, fpath);
+  if (has_associations) {
+    WriteArray(out, samples.associations.data(), count, fpath);
+  }
+
+  if (0 != fclose(out)) {
+    throw runtime_error(utils::Format("Could not write depth samples to [%s].", fpath.c_str()));
+  }
+}
+
+void ReadDepthSamples(const string &fpath, DepthSamples &out) {
+  FILE *in = fopen(fpath.c_str(), "rb");
+  if (nullptr == in) {
+    throw runtime_error(utils::Format("Could not open depth samples file [%s].", fpath.c_str()));
+  }
+
+  uint32_t magic = 0;
+  ReadArray(in, &magic, 1, fpath);
+  if (magic != kMagic) {
+    fclose(in);
+    throw runtime_error(utils::Format("Not a depth samples file: [%s].", fpath.c_str()));
+  }
+
+  int32_t frame_info[3];
+  uint32_t id_length = 0;
+  ReadArray(in, frame_info, 3, fpath);
+  ReadArray(in, &id_length, 1, fpath);
+  vector<char> dataset_id(id_length);
+  ReadArray(in, dataset_id.data(), id_length, fpath);
+  out.frame_idx = frame_info[0];
+  out.frame_width = frame_info[1];
+  out.frame_height = frame_info[2];
+  out.dataset_id.assign(dataset_id.begin(), dataset_id.end());
+
+  float camera_info[3];
+  ReadArray(in, out.pose.data(), 16, fpath);
+  ReadArray(in, camera_info, 3, fpath);
+  out.baseline_m = camera_info[0];
+  out.focal_length_px = camera_info[1];
+  out.max_depth_m = camera_info[2];
+
+  uint32_t count = 0;
+  uint8_t has_associations = 0;
+  ReadArray(in, &count, 1, fpath);
+  ReadArray(in, &has_associations, 1, fpath);
+  out.Resize(count);
+  ReadArray(in, out.indices.data(), count, fpath);
+  ReadArray(in, out.left.data(), 2 * count, fpath);
+  ReadArray(in, out.right.data(), 2 * count, fpath);
+  ReadArray(in, out.rendered_depth_m.data(), count, fpath);
+  ReadArray(in, out.input_depth_mm.data(), count, fpath);
+  out.associations.resize(has_associations ? count : 0);
+  if (has_associations) {
+    ReadArray(in, out.associations.data(), count, fpath);
+  }
+  fclose(in);
+}
+
+}
+}
@@ -0,0 +1,69 @@
+#ifndef DYNSLAM_DEPTHSAMPLES_H
+#define DYNSLAM_DEPTHSAMPLES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Eigen>
+
+#include "../Defines.h"
+
+namespace dynslam {
+namespace eval {
+
+/// \brief Everything the depth evaluation of a frame reads: the LIDAR points which project into
+///        the left camera's frame, together with the fused and the input depth at each of them.
+///
+/// Evaluating these requires neither the maps nor the input, so they can be dumped during a run
+/// and evaluated offline, e.g., with 'DynSLAMEval'.
+struct DepthSamples {
+  /// \brief The DynSLAM frame the samples are from.
+  int frame_idx = -1;
+  std::string dataset_id;
+  /// \brief The pose the fused depth was rendered from.
+  Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+
+  int frame_width = 0;
+  int frame_height = 0;
+  float baseline_m = 0.0f;
+  float focal_length_px = 0.0f;
+  /// \brief The maximum depth of the evaluated LIDAR points.
+  float max_depth_m = 0.0f;
+
+  /// \brief The index of every sample's point in the original Velodyne scan.
+  std::vector<int> indices;
+  /// \brief The pixel coordinates of every sample in the left and the right cameras.
+  Eigen::Matrix2Xd left;
+  Eigen::Matrix2Xd right;
+  std::vector<float> rendered_depth_m;
+  std::vector<int16_t> input_depth_mm;
+  /// \brief See 'SegmentedCallback::LidarAssociation'. Empty if not computed.
+  std::vector<uint8_t> associations;
+
+  size_t GetSize() const {
+    return indices.size();
+  }
+
+  /// \brief Resizes the per-sample fields, except for the associations.
+  void Resize(size_t size) {
+    indices.resize(size);
+    left.resize(2, size);
+    right.resize(2, size);
+    rendered_depth_m.resize(size);
+    input_depth_mm.resize(size);
+  }
+
+  SUPPORT_EIGEN_FIELDS;
+};
+
+/// \brief Writes the samples to a compact binary file, which 'ReadDepthSamples' can load.
+void WriteDepthSamples(const std::string &fpath, const DepthSamples &samples);
+
+/// \brief Loads samples written by 'WriteDepthSamples', throwing if the file is invalid.
+void ReadDepthSamples(const std::string &fpath, DepthSamples &out);
+
+}
+}
+
+#endif //DYNSLAM_DEPTHSAMPLES_H
@@ -2,23 +2,25 @@
 #include "Evaluation.h"
 #include "ILidarEvalCallback.h"
 #include "EvaluationCallback.h"
+#include "MultiThresholdEvaluationCallback.h"
+#include "SegmentedCallback.h"
 #include "SegmentedEvaluationCallback.h"
 
 namespace dynslam {
 namespace eval {
 
-void PrettyPrintStats(const string &label, const DepthFrameEvaluation &evals) {
+void PrettyPrintStats(const string &label, const DepthFrameEvaluation &evals, ostream &out) {
   // ...and print some quick info in real time as well.
-  cout << "Evaluation complete:" << endl;
+  out << "Evaluation complete:" << endl;
   bool missing_depths_are_errors = false;
   if(missing_depths_are_errors) {
-    cout << "(Missing = errors)" << endl;
+    out << "(Missing = errors)" << endl;
   }
   else {
-    cout << "(Not counting missing as errors.)" << endl;
+    out << "(Not counting missing as errors.)" << endl;
   }
   for (auto &eval : evals.evaluations) {
-    cout << "[" << label << "] Evaluation on frame #" << evals.meta.frame_idx << ", delta max = "
+    out << "[" << label << "] Evaluation on frame #" << evals.meta.frame_idx << ", delta max = "
          << setw(2) << eval.delta_max
          << "   Fusion accuracy = " << setw(7) << setprecision(3)
          << eval.fused_result.GetCorrectPixelRatio(missing_depths_are_errors)
@@ -60,15 +62,15 @@ void Evaluation::EvaluateFrame(Input *input,
   if (separate_static_and_dynamic_) {
     cout << "Evaluation of frame [" << frame_idx << "] will compute separate stats for static "
          << "and dynamic elements of the scene." << endl;
-    auto static_dynamic = EvaluateFrameSeparate(frame_idx, enable_compositing, input, dyn_slam);
-    auto static_evals = static_dynamic.first;
-    auto dynamic_evals = static_dynamic.second;
-
-    csv_static_depth_dump_.Write(static_evals);
-    csv_dynamic_depth_dump_.Write(dynamic_evals);
-
-    PrettyPrintStats("Static Map", static_evals);
-    PrettyPrintStats("Dynamic", dynamic_evals);
+    // Only the snapshot is taken here, since it needs the state the pipeline is about to change.
+    std::unique_ptr<DepthSnapshot> snapshot = SnapshotFrameSeparate(frame_idx, enable_compositing,
+                                                                    input, dyn_slam);
+    if (max_pending_frames_ > 0) {
+      EnqueueSnapshot(std::move(snapshot));
+    }
+    else {
+      EvaluateAndWriteSeparate(*snapshot, cout);
+    }
   } else {
     cout << "Evaluation of frame [" << frame_idx << "] will compute unified stats for both "
          << "static and dynamic parts of the scene." << endl;
@@ -76,18 +78,173 @@ void Evaluation::EvaluateFrame(Input *input,
     DepthFrameEvaluation evals = EvaluateFrame(frame_idx, enable_compositing, input, dyn_slam);
     csv_unified_depth_dump_.Write(evals);
 
-    PrettyPrintStats("Unified", evals);
+    PrettyPrintStats("Unified", evals, cout);
   }
 }
 
-// TODO(andrei): Deduplicate copypasta code.
+void Evaluation::EnableAsync(int max_pending_frames) {
+  if (max_pending_frames <= 0) {
+    throw runtime_error(utils::Format("Invalid number of pending frames [%d].",
+                                      max_pending_frames));
+  }
+  if (worker_.joinable()) {
+    throw runtime_error("The evaluation is already running asynchronously.");
+  }
+
+  max_pending_frames_ = static_cast<size_t>(max_pending_frames);
+  worker_ = std::thread(&Evaluation::EvaluateInBackground, this);
+  cout << "[Evaluation] Evaluating depth in the background, with at most " << max_pending_frames
+       << " pending frame(s)." << endl;
+}
+
+void Evaluation::WaitForPending() {
+  std::deque<std::string> reports;
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending_changed_.wait(lock, [this] { return 0 == unfinished_frames_; });
+    reports.swap(finished_reports_);
+    RethrowWorkerError();
+  }
+  PrintReports(reports);
+}
+
+void Evaluation::PrintReports(const std::deque<std::string> &reports) {
+  for (const std::string &report : reports) {
+    cout << report;
+  }
+}
+
+void Evaluation::StopWorker() {
+  if (! worker_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    stopping_ = true;
+  }
+  pending_changed_.notify_all();
+  // The worker finishes the pending frames first, so that none of them are lost.
+  worker_.join();
+  PrintReports(finished_reports_);
+  finished_reports_.clear();
+}
+
+void Evaluation::EnqueueSnapshot(std::unique_ptr<DepthSnapshot> snapshot) {
+  std::deque<std::string> reports;
+  {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    // Block the pipeline if the worker falls behind, so that the snapshots don't pile up.
+    pending_changed_.wait(lock, [this] { return pending_.size() < max_pending_frames_; });
+    reports.swap(finished_reports_);
+    RethrowWorkerError();
+    pending_.push_back(std::move(snapshot));
+    unfinished_frames_++;
+  }
+  pending_changed_.notify_all();
+  PrintReports(reports);
+}
+
+void Evaluation::EvaluateInBackground() {
+  while (true) {
+    std::unique_ptr<DepthSnapshot> snapshot;
+    {
+      std::unique_lock<std::mutex> lock(pending_mutex_);
+      pending_changed_.wait(lock, [this] { return stopping_ || ! pending_.empty(); });
+      if (pending_.empty()) {
+        return;
+      }
+      snapshot = std::move(pending_.front());
+      pending_.pop_front();
+    }
+    pending_changed_.notify_all();
+
+    // The stats are printed by the pipeline's thread, so they don't interleave with its output.
+    std::ostringstream report;
+    std::exception_ptr error;
+    try {
+      EvaluateAndWriteSeparate(*snapshot, report);
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex_);
+      // Keep the first error, which the pipeline rethrows the next time it hands over a frame.
+      if (error && ! worker_error_) {
+        worker_error_ = error;
+      }
+      finished_reports_.push_back(report.str());
+      unfinished_frames_--;
+    }
+    pending_changed_.notify_all();
+  }
+}
+
+void Evaluation::RethrowWorkerError() {
+  if (worker_error_) {
+    std::exception_ptr error = worker_error_;
+    worker_error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void Evaluation::EvaluateAndWriteSeparate(DepthSnapshot &snapshot, std::ostream &report) {
+  ReadInputDepthSamples(snapshot);
+  if (! depth_dump_folder_.empty()) {
+    WriteDepthSamples(utils::Format("%s/%06d.bin", depth_dump_folder_.c_str(),
+                                    snapshot.samples.frame_idx),
+                      snapshot.samples);
+  }
+
+  auto static_dynamic = EvaluateSamplesSeparate(snapshot.samples);
+  auto static_evals = static_dynamic.first;
+  auto dynamic_evals = static_dynamic.second;
+
+  csv_static_depth_dump_.Write(static_evals);
+  csv_dynamic_depth_dump_.Write(dynamic_evals);
+
+  PrettyPrintStats("Static Map", static_evals, report);
+  PrettyPrintStats("Dynamic", dynamic_evals, report);
+}
+
+void Evaluation::EnableDepthDumps(const std::string &root) {
+  // Named like the CSV files, without the suffix, which is how 'DynSLAMEval' names its output.
+  const std::string &static_csv_fpath = csv_static_depth_dump_.output_fpath_;
+  const std::string kSuffix = "-static-depth-result.csv";
+  size_t name_start = static_csv_fpath.rfind('/') + 1;
+  std::string name = static_csv_fpath.substr(
+      name_start, static_csv_fpath.size() - name_start - kSuffix.size());
+
+  depth_dump_folder_ = utils::Format("%s/%s", root.c_str(), name.c_str());
+  if (system(utils::Format("mkdir -p '%s'", depth_dump_folder_.c_str()).c_str())) {
+    throw runtime_error(utils::Format("Could not create the depth dump folder [%s].",
+                                      depth_dump_folder_.c_str()));
+  }
+  cout << "[Evaluation] Dumping the depth evaluation inputs to: " << depth_dump_folder_ << endl;
+}
+
 std::pair<DepthFrameEvaluation,
           DepthFrameEvaluation> Evaluation::EvaluateFrameSeparate(int dynslam_frame_idx,
                                                                   bool enable_compositing,
                                                                   Input *input,
                                                                   DynSlam *dyn_slam) {
+  std::unique_ptr<DepthSnapshot> snapshot = SnapshotFrameSeparate(dynslam_frame_idx,
+                                                                  enable_compositing,
+                                                                  input, dyn_slam);
+  ReadInputDepthSamples(*snapshot);
+  return EvaluateSamplesSeparate(snapshot->samples);
+}
+
+std::unique_ptr<Evaluation::DepthSnapshot> Evaluation::SnapshotFrameSeparate(
+    int dynslam_frame_idx,
+    bool enable_compositing,
+    Input *input,
+    DynSlam *dyn_slam
+) {
   int input_frame_idx = input->GetFrameOffset() + dynslam_frame_idx;
-  auto lidar_pointcloud = velodyne_->ReadFrame(input_frame_idx);
+  const ProjectedLidar &lidar_pointcloud = GetProjectedLidar(input_frame_idx);
   int pose_idx = dynslam_frame_idx + 1;
   Eigen::Matrix4f epose = dyn_slam->GetPoseHistory()[pose_idx];
   cout << "Getting DynSLAM pose[" << pose_idx << "] from a total history of length "
@@ -96,53 +253,84 @@ std::pair<DepthFrameEvaluation,
 
   auto pango_pose = pangolin::OpenGlMatrix::ColMajor4x4(epose.data());
 
-  const float *rendered_depthmap = dyn_slam->GetStaticMapRaycastDepthPreview(pango_pose, enable_compositing);
-  auto input_depthmap = shared_ptr<cv::Mat1s>(nullptr);
-  auto input_rgb = shared_ptr<cv::Mat3b>(nullptr);
-  input->GetFrameCvImages(input_frame_idx, input_rgb, input_depthmap);
+  const float *rendered_depthmap = RenderDepthAtLidarPoints(lidar_pointcloud, pango_pose,
+                                                            enable_compositing, dyn_slam);
+  auto seg = dyn_slam->GetLatestSeg();
+  auto reconstructor = dyn_slam->IsDynamicMode() ? dyn_slam->GetInstanceReconstructor() : nullptr;
+
+  // The input depth is read later, off the pipeline's thread.
+  std::unique_ptr<DepthSnapshot> snapshot(new DepthSnapshot);
+  snapshot->input = input;
+  snapshot->input_frame_idx = input_frame_idx;
+  DepthSamples &samples = snapshot->samples;
+  SampleDepth(lidar_pointcloud, rendered_depthmap, nullptr, samples);
+  samples.frame_idx = dynslam_frame_idx;
+  samples.dataset_id = input->GetDatasetIdentifier();
+  samples.pose = epose;
+
+  samples.associations.resize(samples.GetSize());
+  for (size_t i = 0; i < samples.GetSize(); ++i) {
+    Eigen::Vector3d velo_2d_left(samples.left(0, i), samples.left(1, i), 1.0);
+    samples.associations[i] = static_cast<uint8_t>(
+        SegmentedCallback::ComputePointAssociation(seg.get(), reconstructor, velo_2d_left));
+  }
+  return snapshot;
+}
+
+void Evaluation::ReadInputDepthSamples(DepthSnapshot &snapshot) const {
+  cv::Mat1s input_depthmap;
+  snapshot.input->ReadFrameDepth(snapshot.input_frame_idx, input_depthmap);
 
+  DepthSamples &samples = snapshot.samples;
+  for (size_t i = 0; i < samples.GetSize(); ++i) {
+    int row_left = static_cast<int>(round(samples.left(1, i)));
+    int col_left = static_cast<int>(round(samples.left(0, i)));
+    samples.input_depth_mm[i] = input_depthmap(row_left, col_left);
+  }
+}
+
+// TODO(andrei): Deduplicate copypasta code.
+std::pair<DepthFrameEvaluation,
+          DepthFrameEvaluation> Evaluation::EvaluateSamplesSeparate(const DepthSamples &samples) {
   const int kLargestMaxDelta = 12;
   bool compare_on_intersection = true;
   const bool kKittiStyle = true;
   const bool kNonKittiStyle = false;
   float kKittiDeltaMax = 3.0f;
 
-  auto seg = dyn_slam->GetLatestSeg();
-  auto reconstructor = dyn_slam->IsDynamicMode() ? dyn_slam->GetInstanceReconstructor() : nullptr;
-
-  std::vector<ILidarEvalCallback *> callbacks;
-  callbacks.push_back(new SegmentedEvaluationCallback(0.5f, compare_on_intersection,
-                                                      kNonKittiStyle, seg.get(), reconstructor));
-
+  // All thresholds are evaluated by a single callback, so that the association and the errors of
+  // every LIDAR point are only computed once.
+  using Threshold = MultiThresholdEvaluationCallback::Threshold;
+  std::vector<Threshold> thresholds;
+  thresholds.emplace_back(0.5f, kNonKittiStyle);
   for (int delta_max = 1; delta_max <= kLargestMaxDelta; ++delta_max) {
-    callbacks.push_back(new SegmentedEvaluationCallback(delta_max,
-                                               compare_on_intersection,
-                                               kNonKittiStyle, seg.get(), reconstructor));
+    thresholds.emplace_back(delta_max, kNonKittiStyle);
   }
 
   // Finally, perform the KITTI-style depth evaluation.
-  callbacks.push_back(new SegmentedEvaluationCallback(kKittiDeltaMax,
-                                             compare_on_intersection,
-                                             kKittiStyle, seg.get(), reconstructor));
+  thresholds.emplace_back(kKittiDeltaMax, kKittiStyle);
 
-  EvaluateDepth(lidar_pointcloud, rendered_depthmap, *input_depthmap, callbacks);
+  if (samples.associations.size() != samples.GetSize()) {
+    throw runtime_error("Separate static and dynamic evaluation requires the associations.");
+  }
+  // The callbacks look the associations up by the points' indices in the scan.
+  size_t scan_size = samples.GetSize() > 0 ? samples.indices.back() + 1 : 0;
+  std::vector<uint8_t> scan_associations(scan_size, SegmentedCallback::kNeither);
+  for (size_t i = 0; i < samples.GetSize(); ++i) {
+    scan_associations[samples.indices[i]] = samples.associations[i];
+  }
 
-  std::vector<DepthEvaluation> static_evals;
-  std::vector<DepthEvaluation> dynamic_evals;
-  // Forced dynamic casts because std::vector is not covariant, grumble, grumble...
-  for(ILidarEvalCallback *callback : callbacks) {
-    auto *eval_callback = dynamic_cast<SegmentedEvaluationCallback *>(callback);
-    assert(nullptr != eval_callback && "Only evaluation callbacks are supported at this point.");
+  MultiThresholdEvaluationCallback eval_callback(thresholds, compare_on_intersection,
+                                                 &scan_associations);
+  EvaluateSamples(samples, {&eval_callback});
 
-    static_evals.push_back(std::move(eval_callback->GetStaticEvaluation()));
-    dynamic_evals.push_back(std::move(eval_callback->GetDynamicEvaluation()));
-    delete callback;
-  }
+  std::vector<DepthEvaluation> static_evals = eval_callback.GetStaticEvaluations();
+  std::vector<DepthEvaluation> dynamic_evals = eval_callback.GetDynamicEvaluations();
 
-  DepthEvaluationMeta meta(dynslam_frame_idx, input->GetDatasetIdentifier());
+  DepthEvaluationMeta meta(samples.frame_idx, samples.dataset_id);
   return make_pair<DepthFrameEvaluation, DepthFrameEvaluation>(
-      DepthFrameEvaluation(meta, max_depth_m_, std::move(static_evals)),
-      DepthFrameEvaluation(meta, max_depth_m_, std::move(dynamic_evals)));
+      DepthFrameEvaluation(meta, samples.max_depth_m, std::move(static_evals)),
+      DepthFrameEvaluation(meta, samples.max_depth_m, std::move(dynamic_evals)));
 }
 
 DepthFrameEvaluation Evaluation::EvaluateFrame(int frame_idx,
@@ -150,7 +338,7 @@ DepthFrameEvaluation Evaluation::EvaluateFrame(int frame_idx,
                                                Input *input,
                                                DynSlam *dyn_slam) {
   throw std::runtime_error("Not supported at the moment.");
-  auto lidar_pointcloud = velodyne_->ReadFrame(frame_idx);
+  const ProjectedLidar &lidar_pointcloud = GetProjectedLidar(frame_idx);
 
   if (frame_idx != input->GetCurrentFrame() - 1) {
     throw runtime_error("Cannot yet access old poses for evaluation.");
@@ -237,27 +425,169 @@ bool Evaluation::ProjectLidar(const Eigen::Vector4f &velodyne_reading,
 }
 
 
-void Evaluation::EvaluateDepth(const Eigen::MatrixX4f &lidar_points,
+const float *Evaluation::RenderDepthAtLidarPoints(const ProjectedLidar &lidar_points,
+                                                  const pangolin::OpenGlMatrix &model_view,
+                                                  bool enable_compositing,
+                                                  DynSlam *dyn_slam) {
+  if (! dyn_slam->CanRaycastPixels()) {
+    return dyn_slam->GetStaticMapRaycastDepthPreview(model_view, enable_compositing);
+  }
+
+  // 'EvaluateDepth' only reads the depth at these pixels.
+  lidar_pixels_.clear();
+  for (size_t i = 0; i < lidar_points.GetSize(); ++i) {
+    int row_left = static_cast<int>(round(lidar_points.left(1, i)));
+    int col_left = static_cast<int>(round(lidar_points.left(0, i)));
+    if (col_left >= 0 && col_left < frame_width_ && row_left >= 0 && row_left < frame_height_) {
+      lidar_pixels_.emplace_back(col_left, row_left);
+    }
+  }
+
+  dyn_slam->GetStaticMapDepthAt(model_view, lidar_pixels_, enable_compositing,
+                                lidar_pixel_depths_);
+
+  // The other pixels are never read, so they don't need to be cleared.
+  sparse_depth_.resize(static_cast<size_t>(frame_width_ * frame_height_));
+  for (size_t i = 0; i < lidar_pixels_.size(); ++i) {
+    sparse_depth_[lidar_pixels_[i](1) * frame_width_ + lidar_pixels_[i](0)] = lidar_pixel_depths_[i];
+  }
+  return sparse_depth_.data();
+}
+
+const ProjectedLidar &Evaluation::GetProjectedLidar(int input_frame_idx) {
+  if (projection_cache_ && projection_cache_->Load(input_frame_idx, projected_lidar_)) {
+    return projected_lidar_;
+  }
+
+  ProjectLidarPoints(velodyne_->ReadFrame(input_frame_idx), projected_lidar_);
+  if (projection_cache_) {
+    projection_cache_->Store(input_frame_idx, projected_lidar_);
+  }
+  return projected_lidar_;
+}
+
+void Evaluation::EnableProjectionCache(const std::string &root) {
+  // Different sequences, calibrations or depth ranges lead to different projections, so each
+  // gets its own folder, named after a hash of everything which goes into the projection.
+  const string &sequence_id = velodyne_->GetFolder();
+  uint64_t hash = 14695981039346656037ULL;
+  auto hash_bytes = [&hash](const void *data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * 1099511628211ULL;
+    }
+  };
+  hash_bytes(velo_to_left_gray_cam_.data(), sizeof(double) * velo_to_left_gray_cam_.size());
+  hash_bytes(proj_left_color_.data(), sizeof(double) * proj_left_color_.size());
+  hash_bytes(proj_right_color_.data(), sizeof(double) * proj_right_color_.size());
+  hash_bytes(&min_depth_m_, sizeof(min_depth_m_));
+  hash_bytes(&max_depth_m_, sizeof(max_depth_m_));
+  hash_bytes(sequence_id.data(), sequence_id.size());
+
+  string setup_key = utils::Format("%016llx", static_cast<unsigned long long>(hash));
+  projection_cache_.reset(new ProjectedLidarCache(root, setup_key, sequence_id));
+  cout << "[Evaluation] Caching projected LIDAR points in: " << projection_cache_->GetFolder()
+       << endl;
+}
+
+void Evaluation::ProjectLidarPoints(const VelodyneIO::LidarFrame &lidar_points,
+                                    ProjectedLidar &out) const {
+  // Transform all the points with a few matrix products, which Eigen vectorizes, as opposed to
+  // one small product per point.
+  const long point_count = lidar_points.rows();
+  Eigen::Matrix4Xd velo_points(4, point_count);
+  velo_points.topRows<3>() = lidar_points.leftCols<3>().transpose().cast<double>();
+  // Ignore the reflectance; we only care about 3D homogeneous coordinates.
+  velo_points.row(3).setOnes();
+
+  Eigen::Matrix4Xd cam_points = velo_to_left_gray_cam_ * velo_points;
+  // The scale factors are copied out, since dividing a row by itself in place would alias.
+  Eigen::RowVectorXd scale = cam_points.row(3);
+  cam_points.array().rowwise() /= scale.array();
+  Eigen::Matrix3Xd velo_2d_left = proj_left_color_ * cam_points;
+  Eigen::Matrix3Xd velo_2d_right = proj_right_color_ * cam_points;
+  scale = velo_2d_left.row(2);
+  velo_2d_left.array().rowwise() /= scale.array();
+  scale = velo_2d_right.row(2);
+  velo_2d_right.array().rowwise() /= scale.array();
+
+  // Only keep the points within the evaluated depth range.
+  out.indices.clear();
+  for (long i = 0; i < point_count; ++i) {
+    double velo_z = cam_points(2, i);
+    if (velo_z >= min_depth_m_ && velo_z <= max_depth_m_) {
+      out.indices.push_back(static_cast<int>(i));
+    }
+  }
+  out.left.resize(3, out.GetSize());
+  out.right.resize(3, out.GetSize());
+  for (size_t i = 0; i < out.GetSize(); ++i) {
+    out.left.col(i) = velo_2d_left.col(out.indices[i]);
+    out.right.col(i) = velo_2d_right.col(out.indices[i]);
+  }
+}
+
+void Evaluation::EvaluateDepth(const VelodyneIO::LidarFrame &lidar_points,
+                               const float *const rendered_depth,
+                               const cv::Mat1s &input_depth_mm,
+                               const std::vector<ILidarEvalCallback *> &callbacks) const {
+  ProjectedLidar projected;
+  ProjectLidarPoints(lidar_points, projected);
+  EvaluateDepth(projected, rendered_depth, input_depth_mm, callbacks);
+}
+
+void Evaluation::EvaluateDepth(const ProjectedLidar &lidar_points,
                                           const float *const rendered_depth,
                                           const cv::Mat1s &input_depth_mm,
                                           const std::vector<ILidarEvalCallback *> &callbacks) const {
-  int valid_lidar_points = 0;
-  int epi_errors = 0;
-  for (int i = 0; i < lidar_points.rows(); ++i) {
-    Eigen::Vector3d velo_2d_left, velo_2d_right;
-    if (! ProjectLidar(lidar_points.row(i), velo_2d_left, velo_2d_right)) {
-      continue;
-    }
+  DepthSamples samples;
+  SampleDepth(lidar_points, rendered_depth, &input_depth_mm, samples);
+  EvaluateSamples(samples, callbacks);
+}
 
-    int row_left = static_cast<int>(round(velo_2d_left(1)));
-    int col_left = static_cast<int>(round(velo_2d_left(0)));
-    int row_right = static_cast<int>(round(velo_2d_right(1)));
+void Evaluation::SampleDepth(const ProjectedLidar &lidar_points,
+                             const float *const rendered_depth,
+                             const cv::Mat1s *input_depth_mm,
+                             DepthSamples &out) const {
+  out.frame_width = frame_width_;
+  out.frame_height = frame_height_;
+  out.baseline_m = baseline_m_;
+  out.focal_length_px = left_focal_length_px_;
+  out.max_depth_m = max_depth_m_;
+
+  out.Resize(lidar_points.GetSize());
+  size_t sample_count = 0;
+  for (size_t point_idx = 0; point_idx < lidar_points.GetSize(); ++point_idx) {
+    int row_left = static_cast<int>(round(lidar_points.left(1, point_idx)));
+    int col_left = static_cast<int>(round(lidar_points.left(0, point_idx)));
     if (col_left < 0 || col_left >= frame_width_ ||
         row_left < 0 || row_left >= frame_height_) {
       // We ignore LIDAR points which fall outside the left camera's frame.
       continue;
     }
 
+    out.indices[sample_count] = lidar_points.indices[point_idx];
+    out.left.col(sample_count) = lidar_points.left.col(point_idx).head<2>();
+    out.right.col(sample_count) = lidar_points.right.col(point_idx).head<2>();
+    out.rendered_depth_m[sample_count] = rendered_depth[row_left * frame_width_ + col_left];
+    out.input_depth_mm[sample_count] = (nullptr == input_depth_mm)
+        ? static_cast<int16_t>(0)
+        : input_depth_mm->at<short>(row_left, col_left);
+    sample_count++;
+  }
+  out.Resize(sample_count);
+}
+
+void Evaluation::EvaluateSamples(const DepthSamples &samples,
+                                 const std::vector<ILidarEvalCallback *> &callbacks) {
+  int valid_lidar_points = 0;
+  int epi_errors = 0;
+  for (size_t sample_idx = 0; sample_idx < samples.GetSize(); ++sample_idx) {
+    int i = samples.indices[sample_idx];
+    Eigen::Vector3d velo_2d_left(samples.left(0, sample_idx), samples.left(1, sample_idx), 1.0);
+    Eigen::Vector3d velo_2d_right(samples.right(0, sample_idx), samples.right(1, sample_idx), 1.0);
+
+    int row_left = static_cast<int>(round(velo_2d_left(1)));
+    int row_right = static_cast<int>(round(velo_2d_right(1)));
     if (row_left != row_right) {
       float fdelta = velo_2d_left(1) - velo_2d_right(1);
 
@@ -274,14 +604,13 @@ void Evaluation::EvaluateDepth(const Eigen::MatrixX4f &lidar_points,
     }
     valid_lidar_points++;
 
-    int idx_in_rendered = row_left * frame_width_ + col_left;
-    const float rendered_depth_m = rendered_depth[idx_in_rendered];
-    const float input_depth_m = input_depth_mm.at<short>(row_left, col_left) / 1000.0f;
-    assert(input_depth_mm.at<short>(row_left, col_left) >= 0 && "Negative depth found in input.");
+    const float rendered_depth_m = samples.rendered_depth_m[sample_idx];
+    const float input_depth_m = samples.input_depth_mm[sample_idx] / 1000.0f;
+    assert(samples.input_depth_mm[sample_idx] >= 0 && "Negative depth found in input.");
 
     // Units of measurement: px = (m * px) / m;
-    const float rendered_disp = baseline_m_ * left_focal_length_px_ / rendered_depth_m;
-    const float input_disp = baseline_m_ * left_focal_length_px_ / input_depth_m;
+    const float rendered_disp = samples.baseline_m * samples.focal_length_px / rendered_depth_m;
+    const float input_disp = samples.baseline_m * samples.focal_length_px / input_depth_m;
 
     for (ILidarEvalCallback *callback : callbacks) {
       callback->ProcessLidarPoint(i,
@@ -291,8 +620,8 @@ void Evaluation::EvaluateDepth(const Eigen::MatrixX4f &lidar_points,
                                   input_disp,
                                   input_depth_m,
                                   lidar_disp,
-                                  frame_width_,
-                                  frame_height_);
+                                  samples.frame_width,
+                                  samples.frame_height);
     }
   }
 
@@ -2,11 +2,19 @@
 #ifndef DYNSLAM_EVALUATION_H
 #define DYNSLAM_EVALUATION_H
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
 #include "../DynSlam.h"
 #include "../Input.h"
 
-#include "CsvWriter.h"
+#include "DepthSamples.h"
 #include "ILidarEvalCallback.h"
+#include "MetricsSink.h"
+#include "ProjectedLidarCache.h"
 #include "Records.h"
 #include "Tracklets.h"
 #include "VelodyneIO.h"
@@ -162,7 +170,8 @@ class Evaluation {
              bool direct_refinement,
              bool is_dynamic,
              bool use_depth_weighting,
-             bool separate_static_and_dynamic)
+             bool separate_static_and_dynamic,
+             int metrics_formats = MetricsSink::kCsv)
       : velo_to_left_gray_cam_(velo_to_left_gray_cam),
         proj_left_color_(proj_left_color),
         proj_right_color_(proj_right_color),
@@ -177,19 +186,20 @@ class Evaluation {
                                              input->GetConfig().velodyne_folder.c_str()),
                                 input->GetConfig().velodyne_fname_format)),
         csv_unified_depth_dump_(GetDepthCsvName(dataset_root, input, voxel_size_meters, direct_refinement,
-                                        is_dynamic, use_depth_weighting)),
+                                        is_dynamic, use_depth_weighting), metrics_formats),
         csv_tracking_dump_(GetTrackingCsvName(dataset_root, input, voxel_size_meters,
-                                              direct_refinement, is_dynamic, use_depth_weighting)),
+                                              direct_refinement, is_dynamic, use_depth_weighting),
+                           metrics_formats),
         separate_static_and_dynamic_(separate_static_and_dynamic),
         csv_static_depth_dump_(GetStaticDepthCsvName(dataset_root, input, voxel_size_meters,
                                                      direct_refinement, is_dynamic,
-                                                     use_depth_weighting)),
+                                                     use_depth_weighting), metrics_formats),
         csv_dynamic_depth_dump_(GetDynamicDepthCsvName(dataset_root, input, voxel_size_meters,
                                                        direct_refinement, is_dynamic,
-                                                       use_depth_weighting)),
+                                                       use_depth_weighting), metrics_formats),
         csv_memory_(GetMemoryCsvName(dataset_root, input, voxel_size_meters,
                                                        direct_refinement, is_dynamic,
-                                                       use_depth_weighting)),
+                                                       use_depth_weighting), metrics_formats),
         // This used to be required for evaluating the object tracking, but that
         // was dropped in the final version of the paper since our main focus is
         // the mapping performance.
@@ -222,6 +232,7 @@ class Evaluation {
   Evaluation& operator=(const Evaluation&&) = delete;
 
   virtual ~Evaluation() {
+    StopWorker();
     delete velodyne_;
   }
 
@@ -231,13 +242,52 @@ class Evaluation {
                      int frame_idx,
                      bool enable_compositing);
 
+  /// \brief Evaluates the depth of every frame on a background thread, so that the pipeline only
+  ///        waits for the fused depth to be rendered at the LIDAR points.
+  /// \param max_pending_frames How many frames may wait to be evaluated before 'EvaluateFrame'
+  ///                           blocks until the background thread catches up.
+  void EnableAsync(int max_pending_frames);
+
+  /// \brief Blocks until every frame handed to 'EvaluateFrame' is evaluated and written out.
+  void WaitForPending();
+
+  /// \brief Blocks until all the metrics logged so far are on disk.
+  void FlushMetrics() {
+    for (MetricsSink *sink : { &csv_unified_depth_dump_, &csv_tracking_dump_,
+                               &csv_static_depth_dump_, &csv_dynamic_depth_dump_, &csv_memory_ }) {
+      sink->Flush();
+    }
+  }
+
+  /// \brief Also writes the samples every frame's depth is evaluated on to the given folder, so
+  ///        that the metrics can be recomputed offline with 'DynSLAMEval'.
+  void EnableDepthDumps(const std::string &root);
+
+  /// \brief Computes the static and dynamic depth metrics of a frame. Only depends on the
+  ///        samples, which must include the associations, so this also works offline.
+  static std::pair<DepthFrameEvaluation,
+                   DepthFrameEvaluation> EvaluateSamplesSeparate(const DepthSamples &samples);
+
+  /// \brief Passes every sample to the callbacks, computing the disparities they compare.
+  static void EvaluateSamples(const DepthSamples &samples,
+                              const std::vector<ILidarEvalCallback *> &callbacks);
+
   void LogMemoryUse(const DynSlam *dyn_slam) {
     MemoryUsageEntry memory_usage(
         dyn_slam->GetCurrentFrameNo() - 1,
         dyn_slam->GetStaticMapMemoryBytes(),
         dyn_slam->GetStaticMapSavedDecayMemoryBytes(),
+        dyn_slam->GetStaticMapColdMemoryBytes(),
+        dyn_slam->GetStaticMapSavedColdMemoryBytes(),
+        dyn_slam->GetStaticMapEvictedBlockCount(),
         dyn_slam->GetStaticMapDecayParams()
     );
+    for (const auto &policy : dyn_slam->GetStaticMapDecayPolicies()) {
+      memory_usage.policy_reclaimed.emplace_back(
+          policy->GetName(),
+          policy->GetReclaimedBlockCount(),
+          policy->GetReclaimedBlockCount() * dyn_slam->GetStaticMapBlockSizeBytes());
+    }
 
     csv_memory_.Write(memory_usage);
   }
@@ -268,11 +318,21 @@ class Evaluation {
   /// those coordinates, computes their corresponding disparity as well, comparing it to the ground
   /// truth disparity. These values are then passed to a list of possible callbacks which can be
   /// tasked with, e.g., visualization, accuracy computations, etc.
-  void EvaluateDepth(const Eigen::MatrixX4f &lidar_points,
+  void EvaluateDepth(const ProjectedLidar &lidar_points,
                      const float *const rendered_depth,
                      const cv::Mat1s &input_depth_mm,
                      const std::vector<ILidarEvalCallback *> &callbacks) const;
 
+  /// \brief Projects the given LIDAR points and evaluates them, as above.
+  void EvaluateDepth(const VelodyneIO::LidarFrame &lidar_points,
+                     const float *const rendered_depth,
+                     const cv::Mat1s &input_depth_mm,
+                     const std::vector<ILidarEvalCallback *> &callbacks) const;
+
+  /// \brief Keeps the projected LIDAR points of every evaluated frame in the given folder, so
+  ///        that later runs over the same sequence can skip reading and projecting them.
+  void EnableProjectionCache(const std::string &root);
+
   /// \brief Simplistic evaluation of tracking performance, mostly meant to asses whether using the
   ///        direct refinement steps leads to any improvement.
   vector<TrackletEvaluation> EvaluateTracking(Input *input, DynSlam *dyn_slam);
@@ -292,16 +352,108 @@ class Evaluation {
                     Eigen::Vector3d& out_velo_2d_left,
                     Eigen::Vector3d& out_velo_2d_right) const;
 
+  /// \brief Projects all the given LIDAR points at once, with the same results as calling
+  ///        'ProjectLidar' on each of them, and keeps the ones for which it would succeed.
+  void ProjectLidarPoints(const VelodyneIO::LidarFrame &lidar_points, ProjectedLidar &out) const;
+
+  /// \brief Reads and projects the LIDAR points of the given input frame, or loads them from the
+  ///        projection cache, if enabled. The result is valid until the next call.
+  const ProjectedLidar &GetProjectedLidar(int input_frame_idx);
+
+  /// \brief Samples the given depth maps at the LIDAR points which fall within the frame.
+  /// \param input_depth_mm Can be null, leaving the input depth samples zero.
+  void SampleDepth(const ProjectedLidar &lidar_points,
+                   const float *const rendered_depth,
+                   const cv::Mat1s *input_depth_mm,
+                   DepthSamples &out) const;
+
+  /// \brief Renders the fused depth which 'EvaluateDepth' compares to the given LIDAR points.
+  ///
+  /// If all maps use the CPU raycaster, only the pixels which the LIDAR points project onto get
+  /// raycast, and the returned depth map is only valid at those pixels. Otherwise, this falls back
+  /// to rendering the full depth map.
+  const float *RenderDepthAtLidarPoints(const ProjectedLidar &lidar_points,
+                                        const pangolin::OpenGlMatrix &model_view,
+                                        bool enable_compositing,
+                                        DynSlam *dyn_slam);
+
  private:
+  /// \brief Everything the depth evaluation of a frame needs from the pipeline, captured before
+  ///        the pipeline moves on to the next frame.
+  struct DepthSnapshot {
+    /// \brief Only used to read the frame's input depth, which is not shared with the pipeline.
+    Input *input;
+    int input_frame_idx;
+    /// \brief Complete except for the input depth.
+    DepthSamples samples;
+
+    SUPPORT_EIGEN_FIELDS;
+  };
+
+  /// \brief Renders the fused depth at the LIDAR points of the given frame and works out which
+  ///        part of the scene each point belongs to. Must be called from the pipeline's thread.
+  std::unique_ptr<DepthSnapshot> SnapshotFrameSeparate(int dynslam_frame_idx,
+                                                       bool enable_compositing,
+                                                       Input *input,
+                                                       DynSlam *dyn_slam);
+
+  /// \brief Completes the samples with the input depth.
+  void ReadInputDepthSamples(DepthSnapshot &snapshot) const;
+
+  /// \brief Evaluates and writes out a snapshot's samples.
+  /// \param report Receives the human-readable stats.
+  void EvaluateAndWriteSeparate(DepthSnapshot &snapshot, std::ostream &report);
+
+  /// \brief Hands the snapshot over to the background thread, blocking while too many frames are
+  ///        already pending.
+  void EnqueueSnapshot(std::unique_ptr<DepthSnapshot> snapshot);
+
+  /// \brief The background thread's loop.
+  void EvaluateInBackground();
+
+  /// \brief Evaluates the pending frames and then stops the background thread, if running.
+  void StopWorker();
+
+  /// \brief Rethrows and clears the background thread's error, if any. Requires 'pending_mutex_'.
+  void RethrowWorkerError();
+
+  /// \brief Prints the stats of frames evaluated in the background. Only called by the pipeline's
+  ///        thread.
+  static void PrintReports(const std::deque<std::string> &reports);
+
   VelodyneIO *velodyne_;
   // CSV results are written here when static and dynamic parts are NOT evaluated separately.
-  CsvWriter csv_unified_depth_dump_;
-  CsvWriter csv_tracking_dump_;
+  MetricsSink csv_unified_depth_dump_;
+  MetricsSink csv_tracking_dump_;
 
   bool separate_static_and_dynamic_;
-  CsvWriter csv_static_depth_dump_;
-  CsvWriter csv_dynamic_depth_dump_;
-  CsvWriter csv_memory_;
+  MetricsSink csv_static_depth_dump_;
+  MetricsSink csv_dynamic_depth_dump_;
+  MetricsSink csv_memory_;
+
+  /// \brief Buffers for 'RenderDepthAtLidarPoints'.
+  ProjectedLidar projected_lidar_;
+  /// \brief Null if disabled.
+  std::unique_ptr<ProjectedLidarCache> projection_cache_;
+  std::vector<Eigen::Vector2i> lidar_pixels_;
+  std::vector<float> lidar_pixel_depths_;
+  std::vector<float> sparse_depth_;
+  /// \brief Empty if the samples are not dumped.
+  std::string depth_dump_folder_;
+
+  /// \brief Zero if the frames are evaluated synchronously.
+  size_t max_pending_frames_ = 0;
+  std::thread worker_;
+  /// \brief Guards the fields below, which are shared with the background thread.
+  std::mutex pending_mutex_;
+  std::condition_variable pending_changed_;
+  std::deque<std::unique_ptr<DepthSnapshot>> pending_;
+  /// \brief Includes the frame being evaluated, if any.
+  int unfinished_frames_ = 0;
+  bool stopping_ = false;
+  std::exception_ptr worker_error_;
+  /// \brief The stats of the frames evaluated in the background, which are yet to be printed.
+  std::deque<std::string> finished_reports_;
 
   const bool eval_tracklets_;
   std::map<int, std::vector<TrackletFrame, Eigen::aligned_allocator<TrackletFrame>>> frame_to_tracklets_;
@@ -0,0 +1,237 @@
+#include "MetricsSink.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+
+namespace dynslam {
+namespace eval {
+
+using namespace std;
+
+namespace {
+
+const uint32_t kColumnarMagic = 0x434d5344;   // "DSMC"
+
+vector<string> SplitColumns(const string &line) {
+  vector<string> columns;
+  stringstream ss(line);
+  string column;
+  while (getline(ss, column, ',')) {
+    columns.push_back(column);
+  }
+  return columns;
+}
+
+/// \brief Parses a value of a record, throwing if it is not entirely a number.
+double ParseValue(const string &value, const string &fpath) {
+  const char *begin = value.c_str();
+  char *end = nullptr;
+  double parsed = strtod(begin, &end);
+  if (end == begin || *end != '\0') {
+    throw runtime_error(utils::Format("Metrics value [%s] for [%s] is not a number.",
+                                      value.c_str(), fpath.c_str()));
+  }
+  return parsed;
+}
+
+template<typename T>
+void WriteBinary(ofstream &out, const T *data, size_t count) {
+  out.write(reinterpret_cast<const char *>(data), sizeof(T) * count);
+}
+
+}
+
+int MetricsSink::ParseFormats(const string &formats) {
+  if (formats == "csv") {
+    return kCsv;
+  }
+  else if (formats == "columnar") {
+    return kColumnar;
+  }
+  else if (formats == "both") {
+    return kCsv | kColumnar;
+  }
+  throw runtime_error(utils::Format("Unknown metrics format [%s]. Supported are 'csv', "
+                                    "'columnar', and 'both'.", formats.c_str()));
+}
+
+MetricsSink::MetricsSink(const string &output_fpath, int formats)
+    : output_fpath_(output_fpath),
+      formats_(formats)
+{
+  // The files are opened right away, so that a missing folder is reported on startup.
+  if (formats_ & kCsv) {
+    csv_output_.open(output_fpath_);
+    if (! csv_output_.is_open()) {
+      throw runtime_error("Could not open CSV file. Does the folder it should be in exist?");
+    }
+  }
+  if (formats_ & kColumnar) {
+    string columnar_fpath = utils::EndsWith(output_fpath_, ".csv")
+        ? output_fpath_.substr(0, output_fpath_.size() - 4) + ".cols"
+        : output_fpath_ + ".cols";
+    columnar_output_.open(columnar_fpath, ios::binary);
+    if (! columnar_output_.is_open()) {
+      throw runtime_error(utils::Format("Could not open the metrics file [%s]. Does the folder it "
+                                        "should be in exist?", columnar_fpath.c_str()));
+    }
+  }
+
+  writer_ = thread(&MetricsSink::WriteInBackground, this);
+}
+
+MetricsSink::~MetricsSink() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  // The writer finishes writing everything first.
+  writer_.join();
+}
+
+void MetricsSink::Write(const ICsvSerializable &data) {
+  string header = data.GetHeader();
+  string row = data.GetData();
+  vector<string> values = SplitColumns(row);
+  size_t column_count = SplitColumns(header).size();
+  if (values.size() != column_count) {
+    throw runtime_error(utils::Format("Metrics record with %zu values for %zu columns, for [%s].",
+                                      values.size(), column_count, output_fpath_.c_str()));
+  }
+
+  // Malformed records are caught here, on the caller's thread, instead of in the background.
+  vector<double> parsed_values;
+  if (formats_ & kColumnar) {
+    parsed_values.reserve(values.size());
+    for (const string &value : values) {
+      parsed_values.push_back(ParseValue(value, output_fpath_));
+    }
+  }
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (header_.empty()) {
+      header_ = header;
+    }
+    else if (header != header_) {
+      throw runtime_error(utils::Format("Metrics record with columns [%s] instead of [%s], for "
+                                        "[%s].", header.c_str(), header_.c_str(),
+                                        output_fpath_.c_str()));
+    }
+    pending_rows_.push_back(move(row));
+    if (formats_ & kColumnar) {
+      pending_values_.push_back(move(parsed_values));
+    }
+  }
+  changed_.notify_all();
+}
+
+void MetricsSink::Flush() {
+  unique_lock<mutex> lock(mutex_);
+  flush_requested_ = true;
+  changed_.notify_all();
+  changed_.wait(lock, [this] { return ! flush_requested_; });
+}
+
+void MetricsSink::WriteInBackground() {
+  vector<string> rows;
+  vector<vector<double>> values;
+  while (true) {
+    string header;
+    bool flush;
+    bool stop;
+    {
+      unique_lock<mutex> lock(mutex_);
+      changed_.wait(lock, [this] {
+        return stopping_ || flush_requested_ || ! pending_rows_.empty();
+      });
+      rows.swap(pending_rows_);
+      values.swap(pending_values_);
+      header = header_;
+      flush = flush_requested_;
+      stop = stopping_;
+    }
+
+    if (! rows.empty() && ! wrote_header_) {
+      WriteHeader(header);
+    }
+    WriteRows(rows, values);
+    rows.clear();
+    values.clear();
+
+    if (flush || stop || buffered_row_count_ >= kRowGroupSize) {
+      WriteRowGroup();
+    }
+    // Keep the CSV up to date as it goes, in case the run does not finish.
+    csv_output_.flush();
+    if (flush || stop) {
+      columnar_output_.flush();
+    }
+
+    if (flush) {
+      {
+        lock_guard<mutex> lock(mutex_);
+        flush_requested_ = false;
+      }
+      changed_.notify_all();
+    }
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void MetricsSink::WriteHeader(const string &header) {
+  wrote_header_ = true;
+  if (formats_ & kCsv) {
+    csv_output_ << header << "\n";
+  }
+  if (formats_ & kColumnar) {
+    vector<string> names = SplitColumns(header);
+    uint32_t column_count = static_cast<uint32_t>(names.size());
+    WriteBinary(columnar_output_, &kColumnarMagic, 1);
+    WriteBinary(columnar_output_, &column_count, 1);
+    for (const string &name : names) {
+      uint32_t length = static_cast<uint32_t>(name.size());
+      WriteBinary(columnar_output_, &length, 1);
+      WriteBinary(columnar_output_, name.data(), length);
+    }
+    columns_.resize(names.size());
+  }
+}
+
+void MetricsSink::WriteRows(const vector<string> &rows, const vector<vector<double>> &values) {
+  if (formats_ & kCsv) {
+    for (const string &row : rows) {
+      csv_output_ << row << "\n";
+    }
+  }
+  if (formats_ & kColumnar) {
+    // 'Write' already checked that every row has a value for every column.
+    for (const vector<double> &row_values : values) {
+      for (size_t i = 0; i < columns_.size(); ++i) {
+        columns_[i].push_back(row_values[i]);
+      }
+      buffered_row_count_++;
+    }
+  }
+}
+
+void MetricsSink::WriteRowGroup() {
+  if (0 == buffered_row_count_) {
+    return;
+  }
+
+  uint32_t row_count = static_cast<uint32_t>(buffered_row_count_);
+  WriteBinary(columnar_output_, &row_count, 1);
+  for (vector<double> &column : columns_) {
+    WriteBinary(columnar_output_, column.data(), column.size());
+    column.clear();
+  }
+  buffered_row_count_ = 0;
+}
+
+}
+}
@@ -0,0 +1,109 @@
+#ifndef DYNSLAM_METRICSSINK_H
+#define DYNSLAM_METRICSSINK_H
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Utils.h"
+
+namespace dynslam {
+namespace eval {
+
+/// \brief Interface for poor man's serialization.
+/// In the long run, it would be nice to use protobufs or something for this...
+class ICsvSerializable {
+ public:
+  virtual ~ICsvSerializable() = default;
+
+  // TODO-LOW(andrei): The correct C++ way of doing this is by just making this writable to an ostream.
+  /// \brief Should return the field names in the same order as GetData, without a newline.
+  virtual std::string GetHeader() const = 0;
+  virtual std::string GetData() const = 0;
+};
+
+/// \brief Collects records, such as evaluation results, and writes them to disk from a background
+///        thread, so that logging them never blocks on I/O.
+///
+/// The records can be written as CSV, as a columnar binary file, or both. The columnar file starts
+/// with the column names, followed by groups of rows, each of which stores every column as a
+/// contiguous array of doubles. This makes it cheap to load single metrics from long runs. All the
+/// records written to a sink must have the same columns.
+class MetricsSink {
+ public:
+  enum Format {
+    kCsv      = 1 << 0,
+    kColumnar = 1 << 1
+  };
+
+  /// \brief Parses "csv", "columnar", or "both" into a combination of 'Format' flags.
+  static int ParseFormats(const std::string &formats);
+
+  /// \brief The path of the CSV file. The columnar file has the same path, with a '.cols'
+  ///        extension instead of '.csv'.
+  const std::string output_fpath_;
+
+  /// \param formats A combination of 'Format' flags.
+  explicit MetricsSink(const std::string &output_fpath, int formats = kCsv);
+
+  MetricsSink(const MetricsSink &) = delete;
+  MetricsSink(MetricsSink &&) = delete;
+  MetricsSink& operator=(const MetricsSink &) = delete;
+  MetricsSink& operator=(MetricsSink &&) = delete;
+
+  /// \brief Queues the record to be written. Only formats and checks it on the calling thread.
+  /// \throws std::runtime_error If the record's columns differ from the previous records', if
+  ///         its number of values does not match its number of columns, or if a value is not a
+  ///         number while writing the columnar format.
+  void Write(const ICsvSerializable &data);
+
+  /// \brief Blocks until every record written so far is on disk.
+  void Flush();
+
+  virtual ~MetricsSink();
+
+ private:
+  /// \brief The columnar file gets written in groups of at most this many rows.
+  static const size_t kRowGroupSize = 256;
+
+  const int formats_;
+  std::ofstream csv_output_;
+  std::ofstream columnar_output_;
+
+  /// \brief Guards the fields below, which are shared with the background thread.
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::string header_;
+  std::vector<std::string> pending_rows_;
+  /// \brief The parsed values of the pending rows, if writing the columnar format.
+  std::vector<std::vector<double>> pending_values_;
+  bool flush_requested_ = false;
+  bool stopping_ = false;
+
+  /// \brief Only used by the background thread.
+  bool wrote_header_ = false;
+  std::vector<std::vector<double>> columns_;
+  size_t buffered_row_count_ = 0;
+
+  /// \brief Declared last, so that it starts once everything else is initialized.
+  std::thread writer_;
+
+  /// \brief The background thread's loop.
+  void WriteInBackground();
+
+  void WriteHeader(const std::string &header);
+
+  void WriteRows(const std::vector<std::string> &rows,
+                 const std::vector<std::vector<double>> &values);
+
+  /// \brief Writes the buffered columnar rows, if any.
+  void WriteRowGroup();
+};
+
+}
+}
+
+
+#endif //DYNSLAM_METRICSSINK_H
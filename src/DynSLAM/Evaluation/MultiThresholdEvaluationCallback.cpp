@@ -0,0 +1,135 @@
+
+#include "MultiThresholdEvaluationCallback.h"
+
+#include <algorithm>
+
+namespace dynslam {
+namespace eval {
+
+MultiThresholdEvaluationCallback::MultiThresholdEvaluationCallback(
+    const std::vector<Threshold> &thresholds,
+    bool compare_on_intersection,
+    const std::vector<uint8_t> *associations)
+    : SegmentedCallback(associations),
+      thresholds_(thresholds),
+      compare_on_intersection_(compare_on_intersection) {
+  for (const Threshold &threshold : thresholds_) {
+    sorted_deltas_[threshold.kitti_style].push_back(threshold.delta_max);
+  }
+
+  for (int style = 0; style < 2; ++style) {
+    std::sort(sorted_deltas_[style].begin(), sorted_deltas_[style].end());
+    size_t bin_count = sorted_deltas_[style].size() + 1;
+    for (PartStats *stats : {&static_stats_, &dynamic_stats_}) {
+      stats->input.bins[style].resize(bin_count, 0);
+      stats->rendered.bins[style].resize(bin_count, 0);
+    }
+  }
+}
+
+void MultiThresholdEvaluationCallback::ProcessLidarPoint(int idx,
+                                                         const Eigen::Vector3d &velo_2d_homo_px,
+                                                         float rendered_disp,
+                                                         float rendered_depth_m,
+                                                         float input_disp,
+                                                         float input_depth_m,
+                                                         float lidar_disp,
+                                                         int frame_width,
+                                                         int frame_height) {
+  LidarAssociation association = GetPointAssociation(idx, velo_2d_homo_px);
+  if (association == kNeither) {
+    return;
+  }
+  PartStats &stats = (association == kStaticMap) ? static_stats_ : dynamic_stats_;
+  stats.measurement_count++;
+
+  // Same logic as 'EvaluationCallback::ComputeAccuracy', minus the thresholding.
+  const float ren_disp_delta = fabs(rendered_disp - lidar_disp);
+  const float input_disp_delta = fabs(input_disp - lidar_disp);
+
+  bool missing_input = (fabs(input_depth_m) < 1e-5);
+  bool missing_rendered = (fabs(rendered_depth_m) < 1e-5);
+
+  if (missing_input) {
+    stats.input.missing_separate++;
+  }
+  if (missing_rendered) {
+    stats.rendered.missing_separate++;
+  }
+
+  if (compare_on_intersection_ && (missing_input || missing_rendered)) {
+    stats.input.missing++;
+    stats.rendered.missing++;
+  } else {
+    if (missing_input) {
+      stats.input.missing++;
+    } else {
+      AddError(input_disp_delta, lidar_disp, stats.input);
+    }
+
+    if (missing_rendered) {
+      stats.rendered.missing++;
+    } else {
+      AddError(ren_disp_delta, lidar_disp, stats.rendered);
+    }
+  }
+}
+
+void MultiThresholdEvaluationCallback::AddError(float disp_delta,
+                                                float lidar_disp,
+                                                ErrorHistogram &histogram) const {
+  for (int style = 0; style < 2; ++style) {
+    const std::vector<float> &deltas = sorted_deltas_[style];
+    // A point is an error w.r.t. every threshold its error exceeds, and the KITTI-style
+    // thresholds also require it to exceed 5% of the ground truth.
+    size_t exceeded = 0;
+    if (! style || disp_delta > 0.05 * lidar_disp) {
+      exceeded = static_cast<size_t>(
+          std::lower_bound(deltas.begin(), deltas.end(), disp_delta) - deltas.begin());
+    }
+    histogram.bins[style][exceeded]++;
+  }
+}
+
+std::vector<DepthEvaluation> MultiThresholdEvaluationCallback::GetEvaluations(
+    const PartStats &stats
+) const {
+  std::vector<DepthEvaluation> evaluations;
+  for (const Threshold &threshold : thresholds_) {
+    Stats rendered = GetThresholdStats(stats.rendered, threshold);
+    Stats input = GetThresholdStats(stats.input, threshold);
+    evaluations.emplace_back(
+        threshold.delta_max,
+        DepthResult(stats.measurement_count, rendered.error, rendered.missing, rendered.correct,
+                    rendered.missing_separate),
+        DepthResult(stats.measurement_count, input.error, input.missing, input.correct,
+                    input.missing_separate),
+        threshold.kitti_style);
+  }
+  return evaluations;
+}
+
+Stats MultiThresholdEvaluationCallback::GetThresholdStats(const ErrorHistogram &histogram,
+                                                          const Threshold &threshold) const {
+  const std::vector<float> &deltas = sorted_deltas_[threshold.kitti_style];
+  const std::vector<long> &bins = histogram.bins[threshold.kitti_style];
+  // The points whose errors exceed more thresholds than there are below this one are errors.
+  size_t rank = static_cast<size_t>(
+      std::lower_bound(deltas.begin(), deltas.end(), threshold.delta_max) - deltas.begin());
+
+  Stats result;
+  result.missing = histogram.missing;
+  result.missing_separate = histogram.missing_separate;
+  for (size_t i = 0; i < bins.size(); ++i) {
+    if (i > rank) {
+      result.error += bins[i];
+    }
+    else {
+      result.correct += bins[i];
+    }
+  }
+  return result;
+}
+
+}
+}
@@ -0,0 +1,93 @@
+#ifndef DYNSLAM_MULTITHRESHOLDEVALUATIONCALLBACK_H
+#define DYNSLAM_MULTITHRESHOLDEVALUATIONCALLBACK_H
+
+#include <vector>
+
+#include "SegmentedCallback.h"
+
+namespace dynslam {
+namespace eval {
+
+/// \brief Produces the same results as one 'SegmentedEvaluationCallback' per threshold, but only
+///        works out the association and the disparity errors of every LIDAR point once.
+///
+/// Instead of classifying each error against every threshold, the errors are binned into a
+/// histogram whose bins are delimited by the thresholds themselves, from which the error and
+/// correct counts for every threshold follow at the end. The associations of the LIDAR points are
+/// computed in advance, so that the evaluation can run after the pipeline moves on.
+class MultiThresholdEvaluationCallback : public SegmentedCallback {
+ public:
+  struct Threshold {
+    float delta_max;
+    bool kitti_style;
+
+    Threshold(float delta_max, bool kitti_style)
+        : delta_max(delta_max), kitti_style(kitti_style) {}
+  };
+
+  /// \param associations See 'SegmentedCallback'.
+  MultiThresholdEvaluationCallback(const std::vector<Threshold> &thresholds,
+                                   bool compare_on_intersection,
+                                   const std::vector<uint8_t> *associations);
+
+  void ProcessLidarPoint(int idx,
+                         const Eigen::Vector3d &velo_2d_homo_px,
+                         float rendered_disp,
+                         float rendered_depth_m,
+                         float input_disp,
+                         float input_depth_m,
+                         float lidar_disp,
+                         int frame_width,
+                         int frame_height) override;
+
+  /// \brief One evaluation per threshold, in the order they were specified in.
+  std::vector<DepthEvaluation> GetStaticEvaluations() const {
+    return GetEvaluations(static_stats_);
+  }
+
+  /// \brief One evaluation per threshold, in the order they were specified in.
+  std::vector<DepthEvaluation> GetDynamicEvaluations() const {
+    return GetEvaluations(dynamic_stats_);
+  }
+
+  long GetSkippedLidarPoints() const {
+    return skipped_lidar_points_;
+  }
+
+ private:
+  /// \brief The errors of either the input or the fused depth.
+  struct ErrorHistogram {
+    long missing = 0;
+    long missing_separate = 0;
+    /// \brief For both the regular and the KITTI-style thresholds, bin 'i' counts the points
+    ///        whose errors exceed exactly 'i' of the thresholds.
+    std::vector<long> bins[2];
+  };
+
+  struct PartStats {
+    long measurement_count = 0;
+    ErrorHistogram input;
+    ErrorHistogram rendered;
+  };
+
+  const std::vector<Threshold> thresholds_;
+  const bool compare_on_intersection_;
+  /// \brief The regular and the KITTI-style thresholds, sorted.
+  std::vector<float> sorted_deltas_[2];
+
+  PartStats static_stats_;
+  PartStats dynamic_stats_;
+
+  /// \brief Bins a non-missing disparity error.
+  void AddError(float disp_delta, float lidar_disp, ErrorHistogram &histogram) const;
+
+  std::vector<DepthEvaluation> GetEvaluations(const PartStats &stats) const;
+
+  /// \brief Works out the stats a single threshold would have produced from a histogram.
+  Stats GetThresholdStats(const ErrorHistogram &histogram, const Threshold &threshold) const;
+};
+
+}
+}
+
+#endif //DYNSLAM_MULTITHRESHOLDEVALUATIONCALLBACK_H
@@ -0,0 +1,133 @@
+
+#include "ProjectedLidarCache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Utils.h"
+
+namespace dynslam {
+namespace eval {
+
+using namespace std;
+
+namespace {
+
+const uint32_t kMagic = 0x324c5344;   // "DSL2"
+
+/// \brief Reads or writes the 'u' and 'v' rows of homogeneous pixel coordinates.
+bool ReadCoords(FILE *in, Eigen::Matrix3Xd &out, size_t count) {
+  Eigen::Matrix2Xd coords(2, count);
+  if (fread(coords.data(), sizeof(double), 2 * count, in) != 2 * count) {
+    return false;
+  }
+  out.resize(3, count);
+  out.topRows<2>() = coords;
+  out.row(2).setOnes();
+  return true;
+}
+
+bool WriteCoords(FILE *out, const Eigen::Matrix3Xd &coords) {
+  Eigen::Matrix2Xd uv = coords.topRows<2>();
+  return fwrite(uv.data(), sizeof(double), uv.size(), out) == static_cast<size_t>(uv.size());
+}
+
+}
+
+ProjectedLidarCache::ProjectedLidarCache(const string &root,
+                                         const string &setup_key,
+                                         const string &sequence_id)
+    : folder_(utils::Format("%s/%s", root.c_str(), setup_key.c_str())),
+      sequence_id_(sequence_id) {
+  if (system(utils::Format("mkdir -p '%s'", folder_.c_str()).c_str())) {
+    throw runtime_error(utils::Format("Could not create the LIDAR cache folder [%s].",
+                                      folder_.c_str()));
+  }
+}
+
+bool ProjectedLidarCache::Load(int frame_idx, ProjectedLidar &out) const {
+  FILE *in = fopen(GetFpath(frame_idx).c_str(), "rb");
+  if (nullptr == in) {
+    return false;
+  }
+  struct stat file_stat;
+  if (0 != fstat(fileno(in), &file_stat)) {
+    fclose(in);
+    return false;
+  }
+  const uint64_t file_bytes = static_cast<uint64_t>(file_stat.st_size);
+
+  // The header holds the magic number, the length of the sequence ID, the ID itself, and the
+  // point count. The lengths are checked against the file's size before anything is allocated
+  // for them, so that corrupt entries are simply ignored.
+  uint32_t header[2];
+  const uint64_t header_bytes = sizeof(header) + sizeof(uint32_t);
+  bool ok = (fread(header, sizeof(uint32_t), 2, in) == 2 && header[0] == kMagic &&
+             header_bytes + header[1] <= file_bytes);
+  string sequence_id;
+  if (ok) {
+    sequence_id.resize(header[1]);
+    ok = fread(&sequence_id[0], 1, header[1], in) == header[1];
+  }
+  bool right_sequence = (ok && sequence_id == sequence_id_);
+  uint32_t count = 0;
+  if (right_sequence) {
+    const uint64_t point_bytes = sizeof(int) + 4 * sizeof(double);
+    ok = fread(&count, sizeof(uint32_t), 1, in) == 1 &&
+         header_bytes + header[1] + count * point_bytes == file_bytes;
+  }
+  if (right_sequence && ok) {
+    out.indices.resize(count);
+    ok = fread(out.indices.data(), sizeof(int), count, in) == count &&
+         ReadCoords(in, out.left, count) &&
+         ReadCoords(in, out.right, count);
+  }
+  fclose(in);
+
+  if (! ok) {
+    cerr << "Ignoring corrupt LIDAR cache entry for frame " << frame_idx << "." << endl;
+  }
+  else if (! right_sequence) {
+    cerr << "Ignoring LIDAR cache entry for frame " << frame_idx << ", since it belongs to "
+         << "sequence [" << sequence_id << "] instead of [" << sequence_id_ << "]." << endl;
+  }
+  return ok && right_sequence;
+}
+
+void ProjectedLidarCache::Store(int frame_idx, const ProjectedLidar &points) const {
+  // Write to a temporary file first, so that concurrent experiments never see partial entries.
+  // Every process has its own, so that experiments storing the same entry don't interleave.
+  string fpath = GetFpath(frame_idx);
+  string tmp_fpath = utils::Format("%s.%d.tmp", fpath.c_str(), static_cast<int>(getpid()));
+  FILE *out = fopen(tmp_fpath.c_str(), "wb");
+  if (nullptr == out) {
+    cerr << "Could not write LIDAR cache entry [" << tmp_fpath << "]." << endl;
+    return;
+  }
+
+  uint32_t header[2] = { kMagic, static_cast<uint32_t>(sequence_id_.size()) };
+  uint32_t count = static_cast<uint32_t>(points.GetSize());
+  bool ok = fwrite(header, sizeof(uint32_t), 2, out) == 2 &&
+            fwrite(sequence_id_.data(), 1, sequence_id_.size(), out) == sequence_id_.size() &&
+            fwrite(&count, sizeof(uint32_t), 1, out) == 1 &&
+            fwrite(points.indices.data(), sizeof(int), points.GetSize(), out) == points.GetSize() &&
+            WriteCoords(out, points.left) &&
+            WriteCoords(out, points.right);
+  ok = (0 == fclose(out)) && ok;
+
+  if (! ok || 0 != rename(tmp_fpath.c_str(), fpath.c_str())) {
+    cerr << "Could not write LIDAR cache entry [" << fpath << "]." << endl;
+    remove(tmp_fpath.c_str());
+  }
+}
+
+string ProjectedLidarCache::GetFpath(int frame_idx) const {
+  return utils::Format("%s/%06d.bin", folder_.c_str(), frame_idx);
+}
+
+}
+}
@@ -0,0 +1,65 @@
+#ifndef DYNSLAM_PROJECTEDLIDARCACHE_H
+#define DYNSLAM_PROJECTEDLIDARCACHE_H
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Eigen>
+
+namespace dynslam {
+namespace eval {
+
+/// \brief The LIDAR points of a frame which fall within the evaluated depth range, projected into
+///        the left and the right cameras.
+struct ProjectedLidar {
+  /// \brief The index of every point in the original Velodyne scan.
+  std::vector<int> indices;
+  /// \brief Homogeneous pixel coordinates, normalized so that the last row is all ones.
+  Eigen::Matrix3Xd left;
+  Eigen::Matrix3Xd right;
+
+  size_t GetSize() const {
+    return indices.size();
+  }
+};
+
+/// \brief Stores projected LIDAR frames on disk, so that experiments which are run several times
+///        over the same sequence only need to read and project the Velodyne scans once.
+///
+/// The disparity, and therefore the depth, of every point follows from its coordinates in the two
+/// cameras. Since the projections depend on the sequence, the calibration and the evaluated depth
+/// range, every distinct setup gets its own folder within the cache. Every entry also records its
+/// sequence, so that an entry is never used for the wrong sequence, even if the keys collide.
+class ProjectedLidarCache {
+ public:
+  /// \param root The cache's folder, which is created if needed.
+  /// \param setup_key Identifies the sequence, the calibration and the depth range the points are
+  ///                  projected with.
+  /// \param sequence_id Identifies the sequence, e.g., by its LIDAR folder.
+  ProjectedLidarCache(const std::string &root,
+                      const std::string &setup_key,
+                      const std::string &sequence_id);
+
+  /// \brief Reads the given frame's projected points from the cache.
+  /// \returns False if the frame is not cached.
+  bool Load(int frame_idx, ProjectedLidar &out) const;
+
+  /// \brief Writes the given frame's projected points to the cache. Failures are only reported,
+  ///        since the cache is not essential.
+  void Store(int frame_idx, const ProjectedLidar &points) const;
+
+  const std::string &GetFolder() const {
+    return folder_;
+  }
+
+ private:
+  const std::string folder_;
+  const std::string sequence_id_;
+
+  std::string GetFpath(int frame_idx) const;
+};
+
+}
+}
+
+#endif //DYNSLAM_PROJECTEDLIDARCACHE_H
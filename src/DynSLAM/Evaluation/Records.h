@@ -4,8 +4,10 @@
 #define DYNSLAM_RECORDS_H
 
 #include <string>
+#include <tuple>
+#include <vector>
 
-#include "CsvWriter.h"
+#include "MetricsSink.h"
 
 namespace dynslam {
 namespace eval {
@@ -163,30 +165,72 @@ struct MemoryUsageEntry : public ICsvSerializable {
   int frame_id;
   size_t memory_usage_bytes;
   size_t saved_memory_cum_bytes;
+  /// \brief Memory used by the compressed cold blocks, which is included in 'memory_usage_bytes'.
+  size_t cold_memory_bytes;
+  /// \brief Memory saved by keeping cold blocks compressed.
+  size_t saved_cold_memory_bytes;
+  /// \brief Blocks evicted so far to keep the map within its memory limit.
+  size_t evicted_block_count;
   // Very wasteful and lazy, since they don't change.
   VoxelDecayParams decay_params;
+  /// \brief The name of every decay policy, and the blocks and bytes it reclaimed so far.
+  std::vector<std::tuple<std::string, size_t, size_t>> policy_reclaimed;
 
   MemoryUsageEntry(int frame_id,
                    size_t memory_usage_mb,
                    size_t saved_memory_cum_mb,
+                   size_t cold_memory_bytes,
+                   size_t saved_cold_memory_bytes,
+                   size_t evicted_block_count,
                    const VoxelDecayParams &decay_params)
       : frame_id(frame_id),
         memory_usage_bytes(memory_usage_mb),
         saved_memory_cum_bytes(saved_memory_cum_mb),
+        cold_memory_bytes(cold_memory_bytes),
+        saved_cold_memory_bytes(saved_cold_memory_bytes),
+        evicted_block_count(evicted_block_count),
         decay_params(decay_params) {}
 
   std::string GetHeader() const override {
-    return "frame_id,memory_usage_bytes,saved_memory_cum_bytes,decay_enabled,decay_min_age,decay_max_weight";
+    return "frame_id,memory_usage_bytes,saved_memory_cum_bytes,cold_memory_bytes,"
+           "saved_cold_memory_bytes,cold_compression_ratio,evicted_block_count,decay_enabled,"
+           "decay_min_age,decay_max_weight" + GetPolicyHeader();
   }
 
   std::string GetData() const override {
-    return utils::Format("%d,%zu,%zu,%d,%d,%d",
+    float cold_compression_ratio = (cold_memory_bytes > 0)
+        ? static_cast<float>(cold_memory_bytes + saved_cold_memory_bytes) / cold_memory_bytes
+        : 1.0f;
+    return utils::Format("%d,%zu,%zu,%zu,%zu,%.4f,%zu,%d,%d,%d",
                          frame_id,
                          memory_usage_bytes,
                          saved_memory_cum_bytes,
+                         cold_memory_bytes,
+                         saved_cold_memory_bytes,
+                         cold_compression_ratio,
+                         evicted_block_count,
                          static_cast<int>(decay_params.enabled),
                          decay_params.min_decay_age,
-                         decay_params.max_decay_weight);
+                         decay_params.max_decay_weight) + GetPolicyData();
+  }
+
+ private:
+  std::string GetPolicyHeader() const {
+    std::string header;
+    for (const auto &policy : policy_reclaimed) {
+      header += utils::Format(",%s_reclaimed_blocks,%s_reclaimed_bytes",
+                              std::get<0>(policy).c_str(),
+                              std::get<0>(policy).c_str());
+    }
+    return header;
+  }
+
+  std::string GetPolicyData() const {
+    std::string data;
+    for (const auto &policy : policy_reclaimed) {
+      data += utils::Format(",%zu,%zu", std::get<1>(policy), std::get<2>(policy));
+    }
+    return data;
   }
 };
 
@@ -8,15 +8,31 @@ DECLARE_int32(fusion_every);
 namespace dynslam {
 namespace eval {
 
-/// \brief Establishes if the given LIDAR point corresponds to a static part of the input, to a
-///        dynamic part being reconstructed by DynSLAM, or neither.
 SegmentedCallback::LidarAssociation SegmentedCallback::GetPointAssociation(
+    int idx,
+    const Eigen::Vector3d &velo_2d_homo_px
+) {
+  LidarAssociation association = (nullptr != associations_)
+      ? static_cast<LidarAssociation>((*associations_)[idx])
+      : ComputePointAssociation(frame_segmentation_, reconstructor_, velo_2d_homo_px);
+
+  // Only the points on dynamic objects which aren't being reconstructed are associated with
+  // neither, and those don't get evaluated.
+  if (association == kNeither) {
+    skipped_lidar_points_++;
+  }
+  return association;
+}
+
+SegmentedCallback::LidarAssociation SegmentedCallback::ComputePointAssociation(
+    const InstanceSegmentationResult *frame_segmentation,
+    const InstanceReconstructor *reconstructor,
     const Eigen::Vector3d &velo_2d_homo_px
 ) {
   int px = static_cast<int>(round(velo_2d_homo_px(0)));
   int py = static_cast<int>(round(velo_2d_homo_px(1)));
 
-  for (const InstanceDetection &det : frame_segmentation_->instance_detections) {
+  for (const InstanceDetection &det : frame_segmentation->instance_detections) {
     // Use the mask used for generating the reconstruction to establish if we're inside a dynamic
     // object.
     if (!det.copy_mask->ContainsPoint(px, py)) {
@@ -29,10 +45,10 @@ SegmentedCallback::LidarAssociation SegmentedCallback::GetPointAssociation(
         bool is_reconstructed = false;
 
         // Does not support dynamic object reconstruction evaluation when skipping frames.
-        if (reconstructor_ != nullptr && FLAGS_fusion_every == 1)
+        if (reconstructor != nullptr && FLAGS_fusion_every == 1)
         {
           /// TODO-LOW(andrei): This is dirty, but it works... It should nevertheless be improved.
-          const Track &track = reconstructor_->GetTrackAtPoint(px, py);
+          const Track &track = reconstructor->GetTrackAtPoint(px, py);
           is_reconstructed = track.GetState() != kUncertain;
         }
 
@@ -41,13 +57,11 @@ SegmentedCallback::LidarAssociation SegmentedCallback::GetPointAssociation(
         } else {
           // A car we aren't reconstructing, e.g. because it just entered the scene.
           // Do not evaluate this point.
-          skipped_lidar_points_++;
           return kNeither;
         }
       } else {
         // A dynamic but non-reconstructable object, like a pedestrian.
         // Do not evaluate this point.
-        skipped_lidar_points_++;
         return kNeither;
       }
     } else {
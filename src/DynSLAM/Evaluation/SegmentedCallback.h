@@ -1,6 +1,8 @@
 #ifndef DYNSLAM_SEGMENTEDCALLBACK_H
 #define DYNSLAM_SEGMENTEDCALLBACK_H
 
+#include <vector>
+
 #include "ILidarEvalCallback.h"
 #include "EvaluationCallback.h"
 
@@ -22,12 +24,30 @@ class SegmentedCallback : public ILidarEvalCallback {
                     InstanceReconstructor *reconstructor_)
       : frame_segmentation_(frame_segmentation_), reconstructor_(reconstructor_) {}
 
+  /// \brief Looks the associations up instead of working them out, for when the segmentation and
+  ///        the reconstructor have moved on since the evaluated frame was processed.
+  /// \param associations The association of every LIDAR point, by its index in the scan, as
+  ///                     computed by 'ComputePointAssociation'.
+  explicit SegmentedCallback(const std::vector<uint8_t> *associations)
+      : frame_segmentation_(nullptr), reconstructor_(nullptr), associations_(associations) {}
+
+  /// \brief Establishes if the given LIDAR point corresponds to a static part of the input, to a
+  ///        dynamic part being reconstructed by DynSLAM, or neither.
+  static LidarAssociation ComputePointAssociation(
+      const instreclib::segmentation::InstanceSegmentationResult *frame_segmentation,
+      const instreclib::reconstruction::InstanceReconstructor *reconstructor,
+      const Eigen::Vector3d &velo_2d_homo_px);
+
  protected:
   instreclib::segmentation::InstanceSegmentationResult *frame_segmentation_;
   instreclib::reconstruction::InstanceReconstructor* reconstructor_;
   long skipped_lidar_points_ = 0;
 
-  LidarAssociation GetPointAssociation(const Eigen::Vector3d &velo_2d_homo_px);
+  LidarAssociation GetPointAssociation(int idx, const Eigen::Vector3d &velo_2d_homo_px);
+
+ private:
+  /// \brief Null unless the associations were computed in advance.
+  const std::vector<uint8_t> *associations_ = nullptr;
 };
 
 }
@@ -15,7 +15,7 @@ void SegmentedEvaluationCallback::ProcessLidarPoint(int idx,
                                                     int frame_width,
                                                     int frame_height) {
 
-  LidarAssociation association = GetPointAssociation(velo_2d_homo_px);
+  LidarAssociation association = GetPointAssociation(idx, velo_2d_homo_px);
   if (association == kDynamicReconstructed) {
     dynamic_eval_.ProcessLidarPoint(idx,
                                     velo_2d_homo_px,
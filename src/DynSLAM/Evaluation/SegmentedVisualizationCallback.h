@@ -36,7 +36,7 @@ class SegmentedVisualizationCallback : public SegmentedCallback {
                          int frame_width,
                          int frame_height
   ) override {
-    LidarAssociation association = GetPointAssociation(velo_2d_homo);
+    LidarAssociation association = GetPointAssociation(idx, velo_2d_homo);
 
     if (association == mode_) {
       visualizer_.ProcessLidarPoint(idx, velo_2d_homo, rendered_disp, rendered_depth, input_disp, input_depth, velodyne_disp, frame_width, frame_height);
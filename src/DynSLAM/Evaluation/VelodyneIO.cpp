@@ -1,5 +1,10 @@
 
 #include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "VelodyneIO.h"
 
 namespace dynslam {
@@ -7,36 +12,66 @@ namespace eval {
 
 using namespace std;
 
+namespace {
+
+/// \brief Stands in for the data of empty scans, which cannot be mapped.
+const float kNoPoints[VelodyneIO::kMeasurementsPerPoint] = {};
+
+}
+
 bool VelodyneIO::FrameAvailable(int frame_idx) {
   return utils::FileExists(GetVeloFpath(frame_idx));
 }
 
-VelodyneIO::LidarReadings VelodyneIO::ReadFrame(int frame_idx) {
+VelodyneIO::LidarFrame VelodyneIO::ReadFrame(int frame_idx) {
   string fpath = GetVeloFpath(frame_idx);
-//  cout << "Reading LIDAR for frame " << frame_idx << endl;
+  Unmap();
 
-//    utils::Tic("Velodyne dump read");
-  FILE *velo_in = fopen(fpath.c_str(), "rb");
-  if (nullptr == velo_in) {
+  int fd = open(fpath.c_str(), O_RDONLY);
+  if (fd < 0) {
     throw std::runtime_error(utils::Format("Could not read Velodyne data from file: [%s]", fpath.c_str()));
   }
-  size_t read_floats = fread(data_buffer_, sizeof(float), kBufferSize, velo_in);
-  fclose(velo_in);
+  struct stat file_stat;
+  if (0 != fstat(fd, &file_stat)) {
+    close(fd);
+    throw std::runtime_error(utils::Format("Could not stat Velodyne data file: [%s]", fpath.c_str()));
+  }
 
-  latest_point_count_ = read_floats / kMeasurementsPerPoint;
-//    utils::Toc();
+  size_t file_bytes = static_cast<size_t>(file_stat.st_size);
+  if (0 == file_bytes) {
+    close(fd);
+    latest_frame_ = kNoPoints;
+    latest_point_count_ = 0;
+    return GetLatestFrame();
+  }
 
-  latest_frame_ = (float *) malloc(sizeof(float) * read_floats);
-  memcpy(latest_frame_, data_buffer_, sizeof(float) * read_floats);
+  void *data = mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (MAP_FAILED == data) {
+    throw std::runtime_error(utils::Format("Could not map Velodyne data file: [%s]", fpath.c_str()));
+  }
+  // Scans are read from start to end exactly once, so the kernel can read ahead aggressively.
+  madvise(data, file_bytes, MADV_SEQUENTIAL);
+  mapped_data_ = data;
+  mapped_bytes_ = file_bytes;
 
+  latest_frame_ = static_cast<const float *>(mapped_data_);
+  latest_point_count_ = file_bytes / (sizeof(float) * kMeasurementsPerPoint);
   return GetLatestFrame();
 }
 
-VelodyneIO::LidarReadings VelodyneIO::GetLatestFrame() {
+VelodyneIO::LidarFrame VelodyneIO::GetLatestFrame() const {
   assert(nullptr != latest_frame_ && "No frame read yet!");
-  LidarReadings points = Eigen::Map<LidarReadings>(
-      latest_frame_, latest_point_count_, kMeasurementsPerPoint);
-  return points;
+  return LidarFrame(latest_frame_, latest_point_count_, kMeasurementsPerPoint);
+}
+
+void VelodyneIO::Unmap() {
+  if (nullptr != mapped_data_) {
+    munmap(mapped_data_, mapped_bytes_);
+    mapped_data_ = nullptr;
+    mapped_bytes_ = 0;
+  }
 }
 
 }
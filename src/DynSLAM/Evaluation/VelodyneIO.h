@@ -21,13 +21,12 @@ namespace eval {
 class VelodyneIO {
  public:
   using LidarReadings = Eigen::Matrix<float, Eigen::Dynamic, 4, Eigen::RowMajor>;
+  /// \brief Readings which are read directly from the memory-mapped scan.
+  using LidarFrame = Eigen::Map<const LidarReadings>;
 
   /// \brief Each Velodyne reading has 4 components: X, Y, Z, and reflectance.
   static const unsigned short kMeasurementsPerPoint = 4;
 
-  /// \brief The size of the buffer into which we initially read the data.
-  static const size_t kBufferSize = 1000000;
-
   /// \brief 4x4 matrix which transforms 3D homogeneous coordinates from the Velodyne LIDAR's
   ///        coordinate frame to the (typically left gray) camera's coordinate frame.
 //  const Eigen::Matrix4d velodyne_to_cam_;
@@ -35,8 +34,10 @@ class VelodyneIO {
  private:
   const std::string folder_;
   const std::string fname_format_;
-  float * const data_buffer_;
-  float * latest_frame_;
+  /// \brief The memory-mapped scan file of the latest frame.
+  void *mapped_data_;
+  size_t mapped_bytes_;
+  const float *latest_frame_;
   size_t latest_point_count_;
 
  public:
@@ -45,13 +46,22 @@ class VelodyneIO {
   VelodyneIO(const std::string &folder, const std::string &fname_format)
       : folder_(folder),
         fname_format_(fname_format),
-        data_buffer_(new float[kBufferSize]),
+        mapped_data_(nullptr),
+        mapped_bytes_(0),
         latest_frame_(nullptr),
         latest_point_count_(0)
   {}
 
+  VelodyneIO(const VelodyneIO&) = delete;
+  VelodyneIO& operator=(const VelodyneIO&) = delete;
+
   virtual ~VelodyneIO() {
-    delete data_buffer_;
+    Unmap();
+  }
+
+  /// \brief The folder the scans are read from, which identifies the sequence.
+  const std::string &GetFolder() const {
+    return folder_;
   }
 
   /// \brief Checks if Velodyne data exists for the specified frame. Some frames do not have it
@@ -60,17 +70,21 @@ class VelodyneIO {
 
   /// \brief Returns an Nx4 **row-major** Eigen matrix containing the Velodyne readings from the
   ///        specified frame of the current dataset.
-  LidarReadings ReadFrame(int frame_idx);
+  /// The scan is memory-mapped, not copied, so the result is only valid until the next frame is
+  /// read.
+  LidarFrame ReadFrame(int frame_idx);
 
   /// \brief Returns an Nx4 **row-major** Eigen matrix containing the Velodyne readings from the
   ///        latest read frame.
-  LidarReadings GetLatestFrame();
+  LidarFrame GetLatestFrame() const;
 
   bool HasLatestFrame() const {
     return nullptr != latest_frame_;
   }
 
  private:
+  void Unmap();
+
   std::string GetVeloFpath(int frame_idx) const {
     std::string fpath_format = utils::Format("%s/%s", folder_.c_str(), fname_format_.c_str());
     return utils::Format(fpath_format, frame_idx);
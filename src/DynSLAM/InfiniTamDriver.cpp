@@ -2,6 +2,8 @@
 
 #include "InfiniTamDriver.h"
 
+#include <atomic>
+
 // TODO(andrei): Why not move to DynSLAM.cpp?
 DEFINE_bool(enable_evaluation, true, "Whether to enable evaluation mode for DynSLAM. This means "
     "the system will load in LIDAR ground truth and compare its maps with it, dumping the results "
@@ -12,6 +14,14 @@ namespace drivers {
 
 using namespace dynslam::utils;
 
+std::atomic<uint64_t> InfiniTamDriver::latest_map_version_(0);
+
+/// \brief Per-pixel host-side loops are split across threads in chunks of at least this many rows.
+const int kMinRowsPerWorker = 16;
+
+/// \brief How many times smaller the raycast preview is, when nothing else needs the raycast.
+const int kPreviewRaycastDownsample = 2;
+
 /// \brief Converts between the DynSlam preview type enums and the InfiniTAM ones.
 ITMMainEngine::GetImageType GetItmVisualization(PreviewType preview_type) {
   switch(preview_type) {
@@ -165,6 +175,8 @@ Matrix4f EigenToItm(const Eigen::Matrix4f &eigen_matrix) {
 void InfiniTamDriver::GetImage(ITMUChar4Image *out,
                                dynslam::PreviewType get_image_type,
                                const pangolin::OpenGlMatrix &model_view) {
+  RestoreColdBlocksInView(model_view);
+  CommitBlockMap();
   if (nullptr != this->view) {
     ITMPose itm_freeview_pose = PoseFromPangolin(model_view);
 
@@ -174,6 +186,19 @@ void InfiniTamDriver::GetImage(ITMUChar4Image *out,
       return;
     }
 
+    if (cpu_raycaster_ && TileRaycaster::Supports(get_image_type)) {
+      RenderOnCpu(out, nullptr, get_image_type, model_view);
+      return;
+    }
+
+    if (get_image_type == PreviewType::kLatestRaycast && raycast_stale_) {
+      if (cpu_raycaster_ && ! (raycast_consumers_ & kTracker) && (raycast_consumers_ & kPreview)) {
+        RenderLatestRaycastOnCpu(out);
+        return;
+      }
+      PrepareRaycast();
+    }
+
     ITMIntrinsics intrinsics = this->viewBuilder->GetCalib()->intrinsics_d;
     ITMMainEngine::GetImage(
         out,
@@ -190,6 +215,8 @@ void InfiniTamDriver::GetFloatImage(
     dynslam::PreviewType get_image_type,
     const pangolin::OpenGlMatrix &model_view
 ) {
+  RestoreColdBlocksInView(model_view);
+  CommitBlockMap();
   if (nullptr != this->view) {
     ITMPose itm_freeview_pose = PoseFromPangolin(model_view);
 
@@ -198,6 +225,11 @@ void InfiniTamDriver::GetFloatImage(
       return;
     }
 
+    if (cpu_raycaster_) {
+      RenderOnCpu(nullptr, out, get_image_type, model_view);
+      return;
+    }
+
     ITMIntrinsics intrinsics = this->viewBuilder->GetCalib()->intrinsics_d;
     ITMMainEngine::GetImage(
         nullptr,
@@ -208,6 +240,530 @@ void InfiniTamDriver::GetFloatImage(
   }
 }
 
+void InfiniTamDriver::RenderOnCpu(ITMUChar4Image *out_color,
+                                  ITMFloatImage *out_depth,
+                                  dynslam::PreviewType type,
+                                  const pangolin::OpenGlMatrix &model_view) {
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  Eigen::Vector4f intrinsics(proj.x, proj.y, proj.z, proj.w);
+  Eigen::Matrix4f world_to_camera = Eigen::Map<const Eigen::Matrix4d>(model_view.m).cast<float>();
+  Vector2i size = (nullptr != out_color) ? out_color->noDims : out_depth->noDims;
+  float *depth = (nullptr != out_depth) ? out_depth->GetData(MEMORYDEVICE_CPU) : nullptr;
+  Vector4u *color = (nullptr != out_color) ? out_color->GetData(MEMORYDEVICE_CPU) : nullptr;
+
+  if (! preview_reprojector_ || size.x != depth_size_.x || size.y != depth_size_.y) {
+    cpu_raycaster_->Render(*planar_mirror_, world_to_camera, intrinsics, size.x, size.y, type,
+                           depth, color);
+  }
+  else {
+    // Render into the reprojector's buffers, and copy the results over.
+    PreviewType color_type = (nullptr != out_color) ? type : PreviewType::kDepth;
+    PreviewReprojector &reprojector = *preview_reprojector_;
+    if (reprojector.CanReproject(map_version_, color_type)) {
+      // Keep whatever color the reprojector has, so that it can be reused later on.
+      color_type = reprojector.GetType();
+      reprojector.Reproject(world_to_camera, intrinsics, reprojection_holes_);
+      cpu_raycaster_->Render(*planar_mirror_, world_to_camera, intrinsics, size.x, size.y,
+                             color_type, reprojector.GetDepth(), reprojector.GetColor(),
+                             reprojection_holes_.data());
+      reprojector.SetRendered(world_to_camera, map_version_, color_type, false);
+    }
+    else {
+      cpu_raycaster_->Render(*planar_mirror_, world_to_camera, intrinsics, size.x, size.y,
+                             color_type, reprojector.GetDepth(), reprojector.GetColor());
+      reprojector.SetRendered(world_to_camera, map_version_, color_type, true);
+    }
+
+    size_t pixel_count = static_cast<size_t>(size.x) * size.y;
+    if (nullptr != depth) {
+      copy(reprojector.GetDepth(), reprojector.GetDepth() + pixel_count, depth);
+    }
+    if (nullptr != color) {
+      copy(reprojector.GetColor(), reprojector.GetColor() + pixel_count, color);
+    }
+  }
+
+  if (nullptr != out_color) {
+    out_color->UpdateDeviceFromHost();
+  }
+  if (nullptr != out_depth) {
+    out_depth->UpdateDeviceFromHost();
+  }
+}
+
+void InfiniTamDriver::PrepareRaycast() {
+  CommitBlockMap();
+  ITMRenderState_VH *renderState_vh = (ITMRenderState_VH*)this->renderState_live;
+  if (renderState_vh->noVisibleBlocks > 0) {
+    this->trackingController->Prepare(this->trackingState, this->view, this->renderState_live);
+  }
+  raycast_stale_ = false;
+}
+
+void InfiniTamDriver::RenderLatestRaycastOnCpu(ITMUChar4Image *out) {
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  Eigen::Vector4f intrinsics(proj.x / kPreviewRaycastDownsample,
+                             proj.y / kPreviewRaycastDownsample,
+                             proj.z / kPreviewRaycastDownsample,
+                             proj.w / kPreviewRaycastDownsample);
+  int width = out->noDims.x;
+  int height = out->noDims.y;
+  int small_width = (width + kPreviewRaycastDownsample - 1) / kPreviewRaycastDownsample;
+  int small_height = (height + kPreviewRaycastDownsample - 1) / kPreviewRaycastDownsample;
+  latest_raycast_preview_.resize(static_cast<size_t>(small_width * small_height));
+
+  // Shaded like InfiniTAM's raycast preview.
+  cpu_raycaster_->Render(*planar_mirror_, GetPose().inverse(), intrinsics, small_width,
+                         small_height, PreviewType::kGray, nullptr, latest_raycast_preview_.data());
+
+  Vector4u *out_data = out->GetData(MEMORYDEVICE_CPU);
+  for (int y = 0; y < height; ++y) {
+    const Vector4u *small_row =
+        &latest_raycast_preview_[(y / kPreviewRaycastDownsample) * small_width];
+    for (int x = 0; x < width; ++x) {
+      out_data[y * width + x] = small_row[x / kPreviewRaycastDownsample];
+    }
+  }
+  out->UpdateDeviceFromHost();
+}
+
+void InfiniTamDriver::UpdateCvPreviews() const {
+  if (! cv_previews_stale_ || nullptr == this->view) {
+    return;
+  }
+
+  ItmToCv(*this->view->rgb, rgb_cv_);
+  ItmDepthToCv(*this->view->depth, raw_depth_cv_);
+  cv_previews_stale_ = false;
+}
+
+void InfiniTamDriver::RenderOverOnCpu(ITMFloatImage *depth,
+                                      dynslam::PreviewType type,
+                                      const pangolin::OpenGlMatrix &model_view,
+                                      const std::function<void(int, const Vector4u &)> &on_top) {
+  if (nullptr == this->view) {
+    // Nothing was fused yet.
+    return;
+  }
+  if (! cpu_raycaster_ || ! TileRaycaster::Supports(type)) {
+    throw runtime_error(Format("Cannot render preview type %d over another preview, "
+                               "since it needs the CPU raycaster.",
+                               static_cast<int>(type)));
+  }
+  RestoreColdBlocksInView(model_view);
+
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  Eigen::Vector4f intrinsics(proj.x, proj.y, proj.z, proj.w);
+  Eigen::Matrix4f world_to_camera = Eigen::Map<const Eigen::Matrix4d>(model_view.m).cast<float>();
+  cpu_raycaster_->RenderOver(*planar_mirror_, world_to_camera, intrinsics, depth->noDims.x,
+                             depth->noDims.y, type, depth->GetData(MEMORYDEVICE_CPU), on_top);
+}
+
+void InfiniTamDriver::RenderDepthAtOnCpu(const pangolin::OpenGlMatrix &model_view,
+                                         const std::vector<Eigen::Vector2i> &pixels,
+                                         float *depth) {
+  if (nullptr == this->view) {
+    return;
+  }
+  if (! cpu_raycaster_) {
+    throw runtime_error("Cannot raycast individual pixels without the CPU raycaster.");
+  }
+  RestoreColdBlocksInView(model_view);
+
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  Eigen::Vector4f intrinsics(proj.x, proj.y, proj.z, proj.w);
+  Eigen::Matrix4f world_to_camera = Eigen::Map<const Eigen::Matrix4d>(model_view.m).cast<float>();
+  cpu_raycaster_->RenderAt(*planar_mirror_, world_to_camera, intrinsics, pixels, depth);
+}
+
+void InfiniTamDriver::ExportBlocks(std::vector<VoxelBlock> &out) {
+  HostVoxelBlockMap &block_map = GetBlockMap();
+  vector<int> entries = block_map.GetAllocatedEntries();
+
+  size_t offset = out.size();
+  out.resize(offset + entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    block_map.ReadBlock(entries[i], out[offset + i]);
+  }
+}
+
+size_t InfiniTamDriver::ImportBlocks(const std::vector<VoxelBlock> &blocks, int frame_idx) {
+  HostVoxelBlockMap &block_map = GetBlockMap();
+
+  size_t failed = 0;
+  vector<Vector3s> imported;
+  for (const VoxelBlock &block : blocks) {
+    if (block_map.InsertBlock(block)) {
+      imported.push_back(block.pos);
+    }
+    else {
+      failed++;
+    }
+  }
+  TouchBudgetBlocks(imported, frame_idx);
+
+  // This also mirrors the imported blocks, which may not get fused into for a while.
+  CommitBlockMap();
+  return failed;
+}
+
+void InfiniTamDriver::TouchBudgetBlocks(const std::vector<Vector3s> &block_positions,
+                                        int frame_idx) {
+  if (! block_budget_) {
+    return;
+  }
+
+  for (const Vector3s &pos : block_positions) {
+    block_budget_->Touch(pos, frame_idx);
+  }
+}
+
+void InfiniTamDriver::CommitBlockMap() {
+  if (! block_map_) {
+    return;
+  }
+
+  if (block_map_->HasChanges()) {
+    if (planar_mirror_) {
+      vector<Vector3s> removed;
+      vector<VoxelBlock> written;
+      block_map_->GetChanges(removed, written);
+      planar_mirror_->Apply(removed, written);
+    }
+    block_map_->Commit();
+    BumpMapVersion();
+  }
+  block_map_.reset();
+}
+
+void InfiniTamDriver::FetchFusedEntries() {
+  if (! fused_entries_stale_) {
+    return;
+  }
+
+  vector<int> visible_entry_ids;
+  GetVisibleEntryIds(visible_entry_ids);
+  HostVoxelBlockMap &block_map = GetBlockMap();
+  block_map.PrefetchEntries(visible_entry_ids);
+
+  fused_entry_ids_.clear();
+  fused_block_positions_.clear();
+  for (int entry_id : visible_entry_ids) {
+    const ITMHashEntry &entry = block_map.GetEntry(entry_id);
+    if (entry.ptr >= 0) {
+      fused_entry_ids_.push_back(entry_id);
+      fused_block_positions_.push_back(entry.pos);
+    }
+  }
+  fused_entries_stale_ = false;
+}
+
+void InfiniTamDriver::Decay() {
+  if (! voxel_decay_params_.enabled) {
+    return;
+  }
+
+  for (const Vector3s &pos : GetFusedBlockPositions()) {
+    decay_wheel_.Touch(pos, decay_frame_idx_);
+  }
+
+  vector<Vector3s> expired;
+  decay_wheel_.PopExpired(decay_frame_idx_, expired);
+  BeginDecayPolicyFrame();
+  if (! expired.empty()) {
+    DecayBlocks(GetBlockMap(), expired);
+  }
+
+  decay_frame_idx_++;
+}
+
+void InfiniTamDriver::BeginDecayPolicyFrame() {
+  DecayContext context(decay_frame_idx_,
+                       GetPose().block(0, 3, 3, 1),
+                       GetVoxelSize() * SDF_BLOCK_SIZE,
+                       GetUsedMemoryBytes(),
+                       &dynamic_blocks_);
+  for (auto &policy : decay_policies_) {
+    policy->BeginFrame(context);
+  }
+  dynamic_blocks_.clear();
+}
+
+void InfiniTamDriver::DecayCatchup() {
+  if (! voxel_decay_params_.enabled) {
+    return;
+  }
+
+  vector<Vector3s> pending;
+  decay_wheel_.DrainAll(pending);
+  BeginDecayPolicyFrame();
+  DecayBlocks(GetBlockMap(), pending);
+  CommitBlockMap();
+}
+
+void InfiniTamDriver::GetVisibleEntryIds(vector<int> &out) const {
+  auto *render_state_vh = (ITMRenderState_VH*) this->renderState_live;
+  out.resize(static_cast<size_t>(render_state_vh->noVisibleBlocks));
+  if (out.empty()) {
+    return;
+  }
+
+  const int *visible_entry_ids = render_state_vh->GetVisibleEntryIDs();
+  size_t bytes = out.size() * sizeof(int);
+  if (IsOnGpu()) {
+#ifndef COMPILE_WITHOUT_CUDA
+    ITMSafeCall(cudaMemcpy(out.data(), visible_entry_ids, bytes, cudaMemcpyDeviceToHost));
+#else
+    throw runtime_error("Cannot access GPU visible lists in a build without CUDA support.");
+#endif
+  }
+  else {
+    memcpy(out.data(), visible_entry_ids, bytes);
+  }
+}
+
+void InfiniTamDriver::DecayBlocks(HostVoxelBlockMap &block_map,
+                                  const vector<Vector3s> &block_positions) {
+  const int default_max_weight = voxel_decay_params_.max_decay_weight;
+  VoxelBlock block;
+  for (const Vector3s &pos : block_positions) {
+    int entry_id = block_map.FindEntry(pos);
+    if (entry_id < 0) {
+      // Already gone, e.g., moved to the cold store.
+      continue;
+    }
+
+    int max_weight = default_max_weight;
+    DecayPolicy *deciding_policy = nullptr;
+    for (auto &policy : decay_policies_) {
+      int policy_max_weight = policy->GetMaxDecayWeight(pos, default_max_weight);
+      if (policy_max_weight > max_weight) {
+        max_weight = policy_max_weight;
+        deciding_policy = policy.get();
+      }
+    }
+
+    block_map.ReadBlock(entry_id, block);
+    bool changed = false;
+    bool observed = false;
+    for (ITMVoxel &voxel : block.voxels) {
+      if (voxel.w_depth == 0) {
+        continue;
+      }
+
+      if (voxel.w_depth <= max_weight) {
+        voxel = ITMVoxel();
+        changed = true;
+      }
+      else {
+        observed = true;
+      }
+    }
+
+    if (! observed) {
+      block_map.RemoveBlock(entry_id);
+      decayed_block_count_++;
+      if (nullptr != deciding_policy) {
+        deciding_policy->CountReclaimedBlock();
+      }
+    }
+    else if (changed) {
+      block_map.InsertBlock(block);
+    }
+  }
+}
+
+void InfiniTamDriver::UpdatePlanarMirror() {
+  if (! planar_mirror_) {
+    return;
+  }
+
+  // Blocks which change in any other way get mirrored on commit.
+  planar_mirror_->Update(GetBlockMap(), GetFusedEntryIds());
+}
+
+void InfiniTamDriver::SkipConvergedBlocks(int frame_idx) {
+  skipped_pixel_count_ = 0;
+  if (! convergence_tracker_ || convergence_tracker_->IsFullFusionFrame(frame_idx)) {
+    return;
+  }
+
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  const float block_size_m = GetVoxelSize() * SDF_BLOCK_SIZE;
+  const Eigen::Matrix4f pose = GetPose();
+
+  view->depth->UpdateHostFromDevice();
+  float *depth = view->depth->GetData(MEMORYDEVICE_CPU);
+  int width = view->depth->noDims.x;
+  int height = view->depth->noDims.y;
+
+  atomic<size_t> skipped_pixel_count(0);
+  utils::ParallelFor(0, height, [&](int row_begin, int row_end) {
+    // Neighboring pixels tend to fall into the same block, so we remember the last lookup.
+    int64_t last_block_key = -1;
+    bool last_block_converged = false;
+    size_t skipped = 0;
+    for (int i = row_begin; i < row_end; ++i) {
+      for (int j = 0; j < width; ++j) {
+        float &depth_m = depth[i * width + j];
+        if (depth_m <= 0) {
+          continue;
+        }
+
+        Eigen::Vector4f point_cam((j - proj.z) * depth_m / proj.x,
+                                  (i - proj.w) * depth_m / proj.y,
+                                  depth_m,
+                                  1.0f);
+        Eigen::Vector4f point = pose * point_cam;
+        Vector3s block_pos(static_cast<short>(floor(point(0) / block_size_m)),
+                           static_cast<short>(floor(point(1) / block_size_m)),
+                           static_cast<short>(floor(point(2) / block_size_m)));
+        int64_t block_key = PackBlockPos(block_pos);
+        if (block_key != last_block_key) {
+          last_block_key = block_key;
+          last_block_converged = convergence_tracker_->IsConverged(block_pos);
+        }
+
+        if (last_block_converged) {
+          depth_m = 0.0f;
+          skipped++;
+        }
+      }
+    }
+    skipped_pixel_count += skipped;
+  }, kMinRowsPerWorker);
+  skipped_pixel_count_ = skipped_pixel_count;
+
+  view->depth->UpdateDeviceFromHost();
+}
+
+void InfiniTamDriver::UpdateBlockConvergence(int frame_idx) {
+  if (! convergence_tracker_ || ! convergence_tracker_->IsFullFusionFrame(frame_idx)) {
+    return;
+  }
+
+  convergence_tracker_->Update(GetBlockMap(), GetFusedEntryIds(), frame_idx);
+}
+
+void InfiniTamDriver::EnforceBlockBudget(int frame_idx) {
+  if (! block_budget_) {
+    return;
+  }
+
+  for (const Vector3s &pos : GetFusedBlockPositions()) {
+    block_budget_->Touch(pos, frame_idx);
+  }
+
+  auto is_in_frustum = [this](const Eigen::Vector3f &center, float radius) {
+    return IsInViewFrustum(center, radius);
+  };
+  const float block_size_m = GetVoxelSize() * SDF_BLOCK_SIZE;
+  auto is_visible = [&](const Vector3s &pos) {
+    if (cold_store_) {
+      // The cold store would bring the block back as soon as its chunk is visible.
+      return cold_store_->TestChunk(pos, is_in_frustum);
+    }
+    Eigen::Vector3f center(pos.x + 0.5f, pos.y + 0.5f, pos.z + 0.5f);
+    return IsInViewFrustum(center * block_size_m, block_size_m * sqrt(3.0f) * 0.5f);
+  };
+
+  // The number of evicted blocks ends up in the memory log, so we don't report it here.
+  block_budget_->Enforce(GetBlockMap(), frame_idx, is_visible,
+                         [this](const vector<VoxelBlock> &blocks) {
+    if (cold_store_) {
+      cold_store_->Insert(blocks);
+    }
+    else if (block_eviction_sink_) {
+      block_eviction_sink_(blocks);
+    }
+  });
+}
+
+void InfiniTamDriver::RestoreColdBlocks(int frame_idx) {
+  if (! cold_store_) {
+    return;
+  }
+
+  auto is_visible = [this](const Eigen::Vector3f &center, float radius) {
+    return IsInViewFrustum(center, radius);
+  };
+  vector<Vector3s> restored;
+  cold_frame_idx_ = frame_idx;
+  cold_store_->Restore(GetBlockMap(), frame_idx, is_visible, &restored);
+  if (block_budget_) {
+    // Restored blocks are about to be fused into, so they must not be the first to go.
+    for (const Vector3s &pos : restored) {
+      block_budget_->Touch(pos, frame_idx);
+    }
+  }
+}
+
+void InfiniTamDriver::RestoreColdBlocksInView(const pangolin::OpenGlMatrix &model_view) {
+  if (! cold_store_ || 0 == cold_store_->GetBlockCount()) {
+    return;
+  }
+
+  Eigen::Matrix4f world_to_camera = Eigen::Map<const Eigen::Matrix4d>(model_view.m).cast<float>();
+  auto is_visible = [&](const Eigen::Vector3f &center, float radius) {
+    return IsInFrustum(world_to_camera, center, radius);
+  };
+  vector<Vector3s> restored;
+  cold_store_->Restore(GetBlockMap(), cold_frame_idx_, is_visible, &restored);
+  if (restored.empty()) {
+    return;
+  }
+
+  if (block_budget_) {
+    // Otherwise, the budget would never evict them if they are not fused into again.
+    for (const Vector3s &pos : restored) {
+      block_budget_->Touch(pos, cold_frame_idx_);
+    }
+  }
+  // The raycasters only see committed blocks.
+  CommitBlockMap();
+}
+
+void InfiniTamDriver::CompressIdleBlocks(int frame_idx) {
+  if (! cold_store_) {
+    return;
+  }
+
+  auto is_visible = [this](const Eigen::Vector3f &center, float radius) {
+    return IsInViewFrustum(center, radius);
+  };
+  cold_store_->Compress(GetBlockMap(), GetFusedBlockPositions(), frame_idx, is_visible);
+}
+
+bool InfiniTamDriver::IsInViewFrustum(const Eigen::Vector3f &center, float radius) const {
+  return IsInFrustum(ItmToEigen(trackingState->pose_d->GetM()), center, radius);
+}
+
+bool InfiniTamDriver::IsInFrustum(const Eigen::Matrix4f &world_to_camera,
+                                  const Eigen::Vector3f &center,
+                                  float radius) const {
+  Eigen::Vector4f center_h(center(0), center(1), center(2), 1.0f);
+  Eigen::Vector4f cam = world_to_camera * center_h;
+  if (cam(2) + radius < settings->sceneParams.viewFrustum_min ||
+      cam(2) - radius > settings->sceneParams.viewFrustum_max) {
+    return false;
+  }
+
+  if (cam(2) <= radius) {
+    // The sphere contains the camera, or is very close to it.
+    return true;
+  }
+
+  const Vector4f &proj = GetCalib()->intrinsics_d.projectionParamsSimple.all;
+  float u = proj.x * cam(0) / cam(2) + proj.z;
+  float v = proj.y * cam(1) / cam(2) + proj.w;
+  // Overestimates the sphere's projection, which is fine for our purposes.
+  float margin_u = proj.x * radius / (cam(2) - radius);
+  float margin_v = proj.y * radius / (cam(2) - radius);
+
+  return u + margin_u >= 0 && u - margin_u < depth_size_.width &&
+         v + margin_v >= 0 && v - margin_v < depth_size_.height;
+}
+
 void InfiniTamDriver::UpdateView(const cv::Mat3b &rgb_image,
                                  const cv::Mat1s &raw_depth_image) {
   CvToItm(rgb_image, rgb_itm_);
@@ -223,5 +779,39 @@ void InfiniTamDriver::UpdateView(const cv::Mat3b &rgb_image,
                                 settings->modelSensorNoise);
 }
 
+void InfiniTamDriver::SplitViewDepth(const cv::Mat1s &full_depth_mm,
+                                     float far_start_m,
+                                     float near_end_m,
+                                     cv::Mat1s &far_depth_mm) {
+  const float kMetersToMillimeters = 1000.0f;
+
+  view->depth->UpdateHostFromDevice();
+  float *depth = view->depth->GetData(MEMORYDEVICE_CPU);
+  int width = view->depth->noDims.x;
+  int height = view->depth->noDims.y;
+  if (full_depth_mm.rows != height || full_depth_mm.cols != width) {
+    throw runtime_error(Format("The full depth map (%dx%d) does not match the view (%dx%d).",
+                               full_depth_mm.cols, full_depth_mm.rows, width, height));
+  }
+  far_depth_mm.create(height, width);
+  int16_t far_start_mm = static_cast<int16_t>(far_start_m * kMetersToMillimeters);
+
+  utils::ParallelFor(0, height, [&](int row_begin, int row_end) {
+    for (int i = row_begin; i < row_end; ++i) {
+      for (int j = 0; j < width; ++j) {
+        int16_t full_mm = full_depth_mm(i, j);
+        far_depth_mm(i, j) = (full_mm >= far_start_mm) ? full_mm : static_cast<int16_t>(0);
+
+        float &depth_m = depth[i * width + j];
+        if (depth_m > near_end_m) {
+          depth_m = 0.0f;
+        }
+      }
+    }
+  }, kMinRowsPerWorker);
+
+  view->depth->UpdateDeviceFromHost();
+}
+
 } // namespace drivers
 } // namespace dynslam
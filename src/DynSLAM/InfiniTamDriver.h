@@ -3,7 +3,9 @@
 #ifndef DYNSLAM_INFINITAMDRIVER_H
 #define DYNSLAM_INFINITAMDRIVER_H
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 
 #include <opencv/cv.h>
 #include <pangolin/pangolin.h>
@@ -11,9 +13,18 @@
 #include <gflags/gflags.h>
 
 #include "../InfiniTAM/InfiniTAM/ITMLib/Engine/ITMMainEngine.h"
+#include "BlockBudget.h"
+#include "BlockConvergence.h"
+#include "ColdBlockStore.h"
+#include "DecayPolicy.h"
+#include "DecayWheel.h"
 #include "Defines.h"
 #include "Input.h"
+#include "PlanarVoxelMap.h"
+#include "PreviewReprojector.h"
 #include "PreviewType.h"
+#include "TileRaycaster.h"
+#include "VoxelBlocks.h"
 #include "VoxelDecayParams.h"
 
 DECLARE_bool(enable_evaluation);
@@ -94,7 +105,18 @@ public:
         rgb_cv_(new cv::Mat3b(img_size_rgb.height, img_size_rgb.width)),
         raw_depth_cv_(new cv::Mat1s(img_size_d.height, img_size_d.width)),
         last_egomotion_(new Eigen::Matrix4f),
-        voxel_decay_params_(voxel_decay_params)
+        depth_size_(img_size_d),
+        cold_frame_idx_(0),
+        skipped_pixel_count_(0),
+        voxel_decay_params_(voxel_decay_params),
+        decay_wheel_(voxel_decay_params.min_decay_age),
+        decay_frame_idx_(0),
+        decayed_block_count_(0),
+        fused_entries_stale_(true),
+        map_version_(0),
+        raycast_consumers_(0),
+        raycast_stale_(true),
+        cv_previews_stale_(true)
   {
     last_egomotion_->setIdentity();
     fusion_weight_params_.depthWeighting = use_depth_weighting;
@@ -110,12 +132,29 @@ public:
 
   void UpdateView(const cv::Mat3b &rgb_image, const cv::Mat1s &raw_depth_image);
 
+  /// \brief Splits the depth into near and far range, e.g., for fusing the far range into a
+  ///        coarser map. The two ranges may overlap.
+  /// \param full_depth_mm The input depth, in millimeters, which may extend further than the
+  ///                      current view's.
+  /// \param far_start_m Depth values at least this large are copied into 'far_depth_mm'.
+  /// \param near_end_m Depth values larger than this are removed from the current view.
+  /// \param far_depth_mm Receives the far range, in millimeters, with zeros elsewhere.
+  void SplitViewDepth(const cv::Mat1s &full_depth_mm,
+                      float far_start_m,
+                      float near_end_m,
+                      cv::Mat1s &far_depth_mm);
+
   // used by the instance reconstruction
   void SetView(ITMView *view) {
     this->view = view;
   }
 
   void Track() {
+    if (raycast_stale_) {
+      // Nobody told us the tracker needs the raycast, so we produce it now.
+      PrepareRaycast();
+    }
+
     // TODO(andrei): Compute the latest relative motion in a more direct manner.
     Matrix4f old_pose = this->trackingState->pose_d->GetInvM();
     Matrix4f old_pose_inv;
@@ -135,6 +174,9 @@ public:
   }
 
   void Integrate() {
+    CommitBlockMap();
+    BumpMapVersion();
+    fused_entries_stale_ = true;
     this->denseMapper->SetFusionWeightParams(fusion_weight_params_);
 
     this->denseMapper->ProcessFrame(
@@ -145,15 +187,33 @@ public:
       this->view, this->trackingState, this->scene, this->renderState_live);
   }
 
+  /// \brief The parts of the system which may need the raycast of the map from the current pose,
+  ///        which InfiniTAM's tracker aligns the next frame to.
+  enum RaycastConsumer {
+    /// \brief Dense (ICP) tracking, i.e., 'Track'.
+    kTracker = 1 << 0,
+    /// \brief The 'kLatestRaycast' preview, for which a reduced resolution is good enough.
+    kPreview = 1 << 1
+  };
+
+  void AddRaycastConsumer(RaycastConsumer consumer) {
+    raycast_consumers_ |= consumer;
+  }
+
+  void RemoveRaycastConsumer(RaycastConsumer consumer) {
+    raycast_consumers_ &= ~consumer;
+  }
+
+  /// \brief Marks the end of the current frame's fusion.
+  ///
+  /// The raycast for the next frame's tracking is only produced right away if the tracker was
+  /// registered as a consumer. Otherwise, it is produced on demand, if at all, e.g., when the pose
+  /// comes from sparse visual odometry via 'SetPose', and nobody looks at the raycast preview.
   void PrepareNextStep() {
-    ITMRenderState_VH *renderState_vh = (ITMRenderState_VH*)this->renderState_live;
-    if (renderState_vh->noVisibleBlocks > 0) {
-      // This may not be necessary if we're using ground truth VO.
-      this->trackingController->Prepare(this->trackingState, this->view, this->renderState_live);
-
-      // Keep the OpenCV previews up to date.
-      ItmToCv(*this->view->rgb, rgb_cv_);
-      ItmDepthToCv(*this->view->depth, raw_depth_cv_);
+    raycast_stale_ = true;
+    cv_previews_stale_ = true;
+    if (raycast_consumers_ & kTracker) {
+      PrepareRaycast();
     }
   }
 
@@ -177,12 +237,14 @@ public:
   /// \brief Returns the RGB "seen" by this particular InfiniTAM instance.
   /// This may not be the full original RGB frame due to, e.g., masking.
   const cv::Mat3b* GetRgbPreview() const {
+    UpdateCvPreviews();
     return rgb_cv_;
   }
 
   /// \brief Returns the depth "seen" by this particular InfiniTAM instance.
   /// This may not be the full original depth frame due to, e.g., masking.
   const cv::Mat1s* GetDepthPreview() const {
+    UpdateCvPreviews();
     return raw_depth_cv_;
   }
 
@@ -196,33 +258,42 @@ public:
   }
 
   /// \brief Regularizes the map by pruning low-weight voxels which are old enough.
-  /// Very useful for, e.g., reducing artifacts caused by noisy depth maps.
-  /// \note This implementation is only supported on the GPU, and for voxel hashing.
-  void Decay() {
-    if (voxel_decay_params_.enabled) {
-      denseMapper->Decay(scene, renderState_live, voxel_decay_params_.max_decay_weight,
-                         voxel_decay_params_.min_decay_age, false);
-    }
+  /// Very useful for, e.g., reducing artifacts caused by noisy depth maps. Should be called once
+  /// after every fused frame.
+  ///
+  /// The blocks updated by the latest fusion are scheduled in a timing wheel, and only the ones
+  /// which have not been updated for 'min_decay_age' frames are examined. Only their hash entries
+  /// and voxels are transferred, and only the blocks which actually change are written back, so
+  /// frames in which no blocks expire leave the map, and its version, untouched.
+  void Decay();
+
+  /// \brief Decays all the blocks which are still waiting to become old enough, in one go.
+  /// Should not be used mid-sequence, since continuing to fuse afterwards may lead to artifacts.
+  void DecayCatchup();
+
+  /// \brief Adds a policy which can make decay more aggressive for some blocks. Takes ownership.
+  void AddDecayPolicy(DecayPolicy *policy) {
+    decay_policies_.emplace_back(policy);
   }
 
-  /// \brief Goes through all remaining visible lists until present time, triggering garbage
-  /// collection for all of them. Should not be used mid-sequence.
-  void DecayCatchup() {
-    if (voxel_decay_params_.enabled) {
-      cout << "Will perform voxel decay (GC) for all remaining frames up to the present. "
-           << "Continuing to reconstruct past this point may lead to artifacts!" << endl;
-
-      for (int i = 0; i < voxel_decay_params_.min_decay_age; ++i) {
-        denseMapper->Decay(scene,
-                           renderState_live,
-                           voxel_decay_params_.max_decay_weight,
-                           // Set the actual min age to 0 to clean everything up real good.
-                           0,
-                           false);
-      }
+  const std::vector<std::unique_ptr<DecayPolicy>>& GetDecayPolicies() const {
+    return decay_policies_;
+  }
 
-      cout << "Decay (GC) catchup complete." << endl;
+  /// \brief Whether any decay policy needs to know where the dynamic objects are.
+  bool NeedsDynamicBlocks() const {
+    for (const auto &policy : decay_policies_) {
+      if (policy->NeedsDynamicBlocks()) {
+        return true;
+      }
     }
+    return false;
+  }
+
+  /// \brief Sets the blocks covered by potentially dynamic objects in the current frame, which are
+  ///        passed on to the decay policies at the next decay step.
+  void SetDynamicBlocks(std::vector<Vector3s> &&dynamic_blocks) {
+    dynamic_blocks_ = std::move(dynamic_blocks);
   }
 
   /// \brief Aggressive decay which ignores the minimum age requirement and acts on ALL voxels.
@@ -230,7 +301,13 @@ public:
   /// a few orders of magnitude if used on the full static map.
   void Reap(int max_decay_weight) {
     if (voxel_decay_params_.enabled) {
+      CommitBlockMap();
+      BumpMapVersion();
       denseMapper->Decay(scene, renderState_live, max_decay_weight, 0, true);
+      if (planar_mirror_) {
+        // InfiniTAM does not tell us which blocks it removed, but reaping is rare.
+        planar_mirror_->Rebuild(GetBlockMap());
+      }
     }
   }
 
@@ -238,17 +315,278 @@ public:
     return sizeof(ITMVoxel);
   }
 
+  /// \brief The number of voxel blocks currently in use by the map.
+  int GetUsedBlockCount() const {
+    return scene->index.getNumAllocatedVoxelBlocks() - scene->localVBA.lastFreeBlockId;
+  }
+
+  /// \brief The maximum number of voxel blocks the map can hold.
+  int GetBlockCapacity() const {
+    return scene->index.getNumAllocatedVoxelBlocks();
+  }
+
   size_t GetUsedMemoryBytes() const {
-    int num_used_blocks = (scene->index.getNumAllocatedVoxelBlocks() - scene->localVBA.lastFreeBlockId);
-    return GetVoxelSizeBytes() * SDF_BLOCK_SIZE3 * num_used_blocks;
+    return GetVoxelSizeBytes() * SDF_BLOCK_SIZE3 * GetUsedBlockCount();
+  }
+
+  /// \brief The memory used by a map's hash table, including the excess list's allocation list
+  ///        and the render state's per-entry visibility information. Unlike the voxel block
+  ///        array, this does not depend on the size of the map.
+  static size_t GetHashTableBytes() {
+    size_t entry_count = SDF_BUCKET_NUM + SDF_EXCESS_LIST_SIZE;
+    return entry_count * (sizeof(ITMHashEntry) + sizeof(int) + sizeof(uchar)) +
+           SDF_EXCESS_LIST_SIZE * sizeof(int);
+  }
+
+  /// \brief The memory used by every block in a map's voxel block array, including its entry in
+  ///        the allocation list.
+  static size_t GetBlockFootprintBytes() {
+    return SDF_BLOCK_SIZE3 * sizeof(ITMVoxel) + sizeof(int);
+  }
+
+  /// \brief Whether the map lives in GPU memory.
+  bool IsOnGpu() const {
+    return settings->deviceType == ITMLibSettings::DEVICE_CUDA;
+  }
+
+  float GetVoxelSize() const {
+    return settings->sceneParams.voxelSize;
+  }
+
+  /// \brief Provides host-side access to the map's voxel blocks, e.g., for moving them in and out
+  ///        of memory.
+  ///
+  /// The same object is shared by everything which works on the blocks between two fusions, so
+  /// that the parts of the map they need are transferred at most once, and written back at most
+  /// once, by 'CommitBlockMap'. This happens automatically before InfiniTAM touches the map.
+  HostVoxelBlockMap &GetBlockMap() {
+    if (! block_map_) {
+      block_map_.reset(new HostVoxelBlockMap(this->scene, IsOnGpu()));
+    }
+    return *block_map_;
   }
 
+  /// \brief Writes the changes made through 'GetBlockMap' back to InfiniTAM. Only counts as a
+  ///        change to the map if any blocks were actually added or removed.
+  void CommitBlockMap();
+
+  /// \brief Copies all the voxel blocks in the map to host memory.
+  void ExportBlocks(std::vector<VoxelBlock> &out);
+
+  /// \brief Adds the given blocks to the map, overwriting any existing ones at the same positions.
+  /// \param frame_idx The frame the blocks count as observed in, for the block budget.
+  /// \returns The number of blocks which could not be added because the map is full.
+  size_t ImportBlocks(const std::vector<VoxelBlock> &blocks, int frame_idx);
+
+  /// \brief Tells the block budget about blocks which entered the map without being fused into,
+  ///        e.g., ones paged back in from the disk, since it only ever evicts the blocks it knows
+  ///        about. Does nothing if the budget is not enabled.
+  void TouchBudgetBlocks(const std::vector<Vector3s> &block_positions, int frame_idx);
+
   size_t GetSavedDecayMemoryBytes() const {
     size_t block_size_bytes = GetVoxelSizeBytes() * SDF_BLOCK_SIZE3;
-    size_t decayed_block_count = denseMapper->GetDecayedBlockCount();
+    // Reaping is still done by InfiniTAM, which keeps its own count.
+    size_t decayed_block_count = denseMapper->GetDecayedBlockCount() + decayed_block_count_;
     return decayed_block_count * block_size_bytes;
   }
 
+  /// \brief Enables keeping the blocks which have not been visible for 'idle_frames' frames
+  ///        compressed in host memory, instead of in the voxel block array.
+  /// \param max_bytes How much memory the compressed blocks may use. Once they use more, the
+  ///                  oldest ones go to the eviction sink. 0 = no limit.
+  void EnableColdBlockStore(int idle_frames,
+                            VoxelFormat format = VoxelFormat::kFull,
+                            size_t max_bytes = 0) {
+    cold_store_.reset(new ColdBlockStore(idle_frames, GetVoxelSize() * SDF_BLOCK_SIZE, format,
+                                         max_bytes));
+    cold_store_->SetOverflowSink([this](const std::vector<VoxelBlock> &blocks) {
+      if (block_eviction_sink_) {
+        block_eviction_sink_(blocks);
+      }
+    });
+  }
+
+  /// \brief Restores the cold blocks which became visible. Does nothing if the cold store is not
+  ///        enabled. Should be called after the pose is updated, but before integrating the new
+  ///        frame. Renders from other viewpoints restore the blocks they need themselves.
+  void RestoreColdBlocks(int frame_idx);
+
+  /// \brief Moves the blocks which have been out of view for a while to the cold store. Does
+  ///        nothing if the store is not enabled. Should be called after integrating a frame.
+  void CompressIdleBlocks(int frame_idx);
+
+  /// \brief Returns null if the cold block store is not enabled.
+  ColdBlockStore *GetColdBlockStore() {
+    return cold_store_.get();
+  }
+
+  /// \brief The memory used by the compressed cold blocks.
+  size_t GetColdBlockMemoryBytes() const {
+    return cold_store_ ? cold_store_->GetCompressedBytes() : 0;
+  }
+
+  /// \brief The memory saved by keeping cold blocks compressed.
+  size_t GetSavedColdMemoryBytes() const {
+    return cold_store_ ? cold_store_->GetRawBytes() - cold_store_->GetCompressedBytes() : 0;
+  }
+
+  float GetColdBlockCompressionRatio() const {
+    return cold_store_ ? cold_store_->GetCompressionRatio() : 1.0f;
+  }
+
+  /// \brief Enables evicting the least recently observed blocks once fewer than 'headroom_blocks'
+  ///        blocks are free. Evicted blocks go to the cold store if it is enabled, and to the
+  ///        eviction sink otherwise. Blocks which are in view, or which would be restored from the
+  ///        cold store right away, are never evicted.
+  void EnableBlockBudget(int headroom_blocks) {
+    block_budget_.reset(new BlockBudget(headroom_blocks, kBudgetProtectedFrames));
+  }
+
+  /// \brief Sets what happens to evicted blocks when the cold store is not enabled, and to the
+  ///        blocks which no longer fit in the cold store when it is. By default, they are
+  ///        discarded.
+  void SetBlockEvictionSink(const BlockBudget::EvictionSink &sink) {
+    block_eviction_sink_ = sink;
+  }
+
+  /// \brief Records which blocks were observed in the latest fusion, and evicts old blocks if the
+  ///        map is running out of free blocks. Does nothing if the budget is not enabled.
+  void EnforceBlockBudget(int frame_idx);
+
+  /// \brief The total number of blocks evicted to keep the map within its budget.
+  size_t GetEvictedBlockCount() const {
+    return block_budget_ ? block_budget_->GetEvictedBlockCount() : 0;
+  }
+
+  /// \brief Whether the map has no more room for new blocks.
+  bool IsFull() const {
+    return GetUsedBlockCount() >= GetBlockCapacity();
+  }
+
+  /// \brief Enables skipping the fusion into blocks which have converged, except for every
+  ///        'fuse_every' frames, when all blocks are fused into and re-evaluated.
+  /// \param residual_threshold See 'BlockConvergenceTracker'.
+  void EnableConvergenceTracking(float residual_threshold, int fuse_every) {
+    convergence_tracker_.reset(new BlockConvergenceTracker(
+        static_cast<int>(settings->sceneParams.maxW), residual_threshold, fuse_every));
+  }
+
+  /// \brief Removes the pixels which would be fused into converged blocks from the current view,
+  ///        unless this is a full fusion frame. Does nothing if convergence tracking is disabled.
+  /// Should be called right before 'Integrate'.
+  void SkipConvergedBlocks(int frame_idx);
+
+  /// \brief Re-evaluates the convergence of the blocks fused into in a full fusion frame. Should
+  ///        be called right after 'Integrate'.
+  /// \note Transfers the visible blocks to host memory, which is why this only happens every few
+  ///       frames.
+  void UpdateBlockConvergence(int frame_idx);
+
+  size_t GetConvergedBlockCount() const {
+    return convergence_tracker_ ? convergence_tracker_->GetConvergedBlockCount() : 0;
+  }
+
+  /// \brief The number of depth pixels not fused into the map in the latest frame because they
+  ///        belonged to converged blocks.
+  size_t GetSkippedPixelCount() const {
+    return skipped_pixel_count_;
+  }
+
+  /// \brief Enables keeping a host-side copy of the map in planar voxel blocks, for CPU code which
+  ///        reads the SDF in bulk.
+  /// The mirror is opt-in, since it duplicates the map's voxels in host memory. Only the CPU
+  /// raycaster needs it. It is kept in sync incrementally: fusion and decay update the touched
+  /// blocks, and other changes are applied from the block map's change log when it is committed.
+  void EnablePlanarMirror() {
+    planar_mirror_.reset(new PlanarVoxelMap());
+  }
+
+  /// \brief Refreshes the blocks touched by the latest fusion in the planar mirror. Blocks added
+  ///        to or removed from the map in other ways are mirrored when the block map is
+  ///        committed. Does nothing if the mirror is not enabled.
+  void UpdatePlanarMirror();
+
+  /// \brief Increases whenever the map may have changed, e.g., after fusion or decay, so anything
+  ///        derived from the map, such as a rendering, can tell whether it is stale.
+  /// Versions come from a counter shared by all maps, so a change to any map yields a version
+  /// higher than every previous one.
+  uint64_t GetMapVersion() const {
+    return map_version_;
+  }
+
+  /// \brief The version of the most recently changed map, out of all of them.
+  static uint64_t GetLatestMapVersion() {
+    return latest_map_version_;
+  }
+
+  /// \brief Returns null if the planar mirror is not enabled.
+  const PlanarVoxelMap *GetPlanarMirror() const {
+    return planar_mirror_.get();
+  }
+
+  /// \brief Makes 'GetImage' and 'GetFloatImage' render the planar mirror with a tiled,
+  ///        multi-threaded CPU raycaster, instead of going through InfiniTAM, for the preview
+  ///        types it supports. Also enables the planar mirror.
+  void EnableCpuRaycaster() {
+    if (! planar_mirror_) {
+      EnablePlanarMirror();
+    }
+    const ITMSceneParams &params = settings->sceneParams;
+    cpu_raycaster_.reset(new TileRaycaster(params.voxelSize,
+                                           params.mu,
+                                           params.viewFrustum_min,
+                                           params.viewFrustum_max));
+  }
+
+  bool IsCpuRaycasterEnabled() const {
+    return nullptr != cpu_raycaster_;
+  }
+
+  /// \brief Renders the map on top of an existing preview, e.g., of another map, only where this
+  ///        map's surface is nearer, with the CPU raycaster, which must be enabled.
+  /// \param depth The preview's depth, which gets updated where this map is on top.
+  /// \param on_top Gets the index and the 'type' visualization of the pixels where this map is on
+  ///               top, and may be called from several threads at once. Can be empty.
+  /// \see TileRaycaster::RenderOver
+  void RenderOverOnCpu(ITMFloatImage *depth,
+                       dynslam::PreviewType type,
+                       const pangolin::OpenGlMatrix &model_view,
+                       const std::function<void(int, const Vector4u &)> &on_top);
+
+  /// \brief Raycasts the map's depth at the given pixels only, with the CPU raycaster, which must
+  ///        be enabled.
+  /// \param depth One depth per pixel, which gets updated where this map is nearer, as in
+  ///              'RenderOverOnCpu'.
+  void RenderDepthAtOnCpu(const pangolin::OpenGlMatrix &model_view,
+                          const std::vector<Eigen::Vector2i> &pixels,
+                          float *depth);
+
+  /// \brief Makes the CPU raycaster reuse its previous preview for the next one, as long as the
+  ///        map did not change, by reprojecting it to the new viewpoint and only raycasting the
+  ///        pixels left without data. Also enables the CPU raycaster.
+  /// \param refresh_every How many consecutive previews can be reprojected before a full one.
+  void EnablePreviewReprojection(int refresh_every) {
+    if (! cpu_raycaster_) {
+      EnableCpuRaycaster();
+    }
+    preview_reprojector_.reset(new PreviewReprojector(depth_size_.width,
+                                                      depth_size_.height,
+                                                      refresh_every));
+  }
+
+  /// \brief Conservatively checks whether any part of a sphere in world coordinates could be
+  ///        seen from the current pose, within InfiniTAM's maximum depth.
+  bool IsInViewFrustum(const Eigen::Vector3f &center, float radius) const;
+
+  /// \brief Like 'IsInViewFrustum', but from an arbitrary viewpoint.
+  bool IsInFrustum(const Eigen::Matrix4f &world_to_camera,
+                   const Eigen::Vector3f &center,
+                   float radius) const;
+
+  /// \brief Brings back the cold blocks which a render from the given viewpoint could hit, and
+  ///        commits them, so that free-view previews and evaluation renders have no holes.
+  void RestoreColdBlocksInView(const pangolin::OpenGlMatrix &model_view);
+
   void WaitForMeshDump() {
     if (write_result.valid()) {
       write_result.wait();
@@ -280,7 +618,37 @@ public:
   }
 
   void Reset() {
+    // Whatever was changed through the block map is about to be cleared anyway.
+    block_map_.reset();
+    BumpMapVersion();
     this->denseMapper->ResetScene(this->scene);
+    fused_entries_stale_ = true;
+    if (planar_mirror_) {
+      planar_mirror_.reset(new PlanarVoxelMap());
+    }
+  }
+
+  /// \brief Clears the map, pose, and view of this engine, so that it can be reused for an
+  ///        entirely different reconstruction without being reallocated.
+  void ResetForReuse() {
+    // The view is owned by whoever set it (e.g., an instance track), so we must not delete it.
+    SetView(nullptr);
+    Reset();
+    decay_wheel_.Clear();
+
+    Matrix4f identity;
+    identity.setIdentity();
+    this->trackingState->pose_d->SetInvM(identity);
+    last_egomotion_->setIdentity();
+
+    // The visible block list refers to the old map, so it should not be used for anything.
+    ((ITMRenderState_VH*) this->renderState_live)->noVisibleBlocks = 0;
+    raycast_stale_ = true;
+    cv_previews_stale_ = true;
+  }
+
+  const ITMRGBDCalib* GetCalib() const {
+    return this->viewBuilder->GetCalib();
   }
 
   SUPPORT_EIGEN_FIELDS;
@@ -295,8 +663,109 @@ public:
 
   Eigen::Matrix4f *last_egomotion_;
 
+  Vector2i depth_size_;
+
+  /// \brief Compressed voxel blocks which have been out of view for a while. Null if disabled.
+  std::unique_ptr<ColdBlockStore> cold_store_;
+  /// \brief The frame of the latest 'RestoreColdBlocks', which the chunks restored for rendering
+  ///        count as last seen in.
+  int cold_frame_idx_;
+
+  /// \brief Blocks observed this recently are never evicted to make room for new ones.
+  static const int kBudgetProtectedFrames = 5;
+
+  /// \brief Keeps the map from filling up. Null if disabled.
+  std::unique_ptr<BlockBudget> block_budget_;
+  BlockBudget::EvictionSink block_eviction_sink_;
+  std::unique_ptr<PlanarVoxelMap> planar_mirror_;
+  /// \brief Renders the planar mirror for previews. Null if disabled.
+  std::unique_ptr<TileRaycaster> cpu_raycaster_;
+  /// \brief Null if preview reprojection is disabled.
+  std::unique_ptr<PreviewReprojector> preview_reprojector_;
+  std::vector<uint8_t> reprojection_holes_;
+  /// \brief The reduced-resolution raycast preview, before being scaled up.
+  std::vector<Vector4u> latest_raycast_preview_;
+  std::unique_ptr<BlockConvergenceTracker> convergence_tracker_;
+  /// \brief The number of depth pixels skipped in the latest frame because of convergence.
+  size_t skipped_pixel_count_;
+
   // Parameters for voxel decay (map regularization).
   VoxelDecayParams voxel_decay_params_;
+
+  /// \brief Schedules the decay of the blocks touched by fusion.
+  DecayWheel decay_wheel_;
+  /// \brief The number of calls to 'Decay' so far, which is what block ages are measured in.
+  int decay_frame_idx_;
+  /// \brief The number of blocks freed by 'Decay' and 'DecayCatchup'.
+  size_t decayed_block_count_;
+
+  std::vector<std::unique_ptr<DecayPolicy>> decay_policies_;
+  std::vector<Vector3s> dynamic_blocks_;
+
+  /// \brief Host-side view of the map, shared until the next commit. Null if not in use.
+  std::unique_ptr<HostVoxelBlockMap> block_map_;
+  /// \brief The hash entries touched by the latest fusion, and their blocks' positions, which are
+  ///        fetched once per fusion, and used by all the passes over the fused blocks.
+  std::vector<int> fused_entry_ids_;
+  std::vector<Vector3s> fused_block_positions_;
+  bool fused_entries_stale_;
+
+  uint64_t map_version_;
+  /// \brief Atomic, since independent maps can change in parallel, e.g., during instance fusion.
+  static std::atomic<uint64_t> latest_map_version_;
+
+  void BumpMapVersion() {
+    map_version_ = ++latest_map_version_;
+  }
+
+  /// \brief Bitmask of 'RaycastConsumer's.
+  int raycast_consumers_;
+  /// \brief Whether the tracker's raycast does not reflect the latest fusion yet.
+  bool raycast_stale_;
+  /// \brief Whether the OpenCV previews of the view were not converted since the latest fusion.
+  mutable bool cv_previews_stale_;
+
+  /// \brief Raycasts the map from the current pose, for the tracker.
+  void PrepareRaycast();
+
+  /// \brief Renders the 'kLatestRaycast' preview with the CPU raycaster, at a reduced resolution.
+  void RenderLatestRaycastOnCpu(ITMUChar4Image *out);
+
+  /// \brief Converts the current view to the OpenCV previews, if they're out of date.
+  void UpdateCvPreviews() const;
+
+  /// \brief Renders the planar mirror from the given viewpoint into either, or both, of the
+  ///        output images.
+  void RenderOnCpu(ITMUChar4Image *out_color,
+                   ITMFloatImage *out_depth,
+                   dynslam::PreviewType type,
+                   const pangolin::OpenGlMatrix &model_view);
+
+  /// \brief Passes the current frame's information to the decay policies.
+  void BeginDecayPolicyFrame();
+
+  /// \brief Copies the IDs of the hash entries touched by the latest fusion to host memory.
+  void GetVisibleEntryIds(std::vector<int> &out) const;
+
+  /// \brief The IDs of the allocated hash entries touched by the latest fusion.
+  const std::vector<int>& GetFusedEntryIds() {
+    FetchFusedEntries();
+    return fused_entry_ids_;
+  }
+
+  /// \brief The positions of the blocks touched by the latest fusion.
+  const std::vector<Vector3s>& GetFusedBlockPositions() {
+    FetchFusedEntries();
+    return fused_block_positions_;
+  }
+
+  /// \brief Transfers the visible list and the entries in it to host memory, unless that was
+  ///        already done since the latest fusion.
+  void FetchFusedEntries();
+
+  /// \brief Clears the voxels in the given blocks with weights of at most 'max_decay_weight', and
+  ///        removes the blocks which end up with no observed voxels.
+  void DecayBlocks(HostVoxelBlockMap &block_map, const std::vector<Vector3s> &block_positions);
 };
 
 } // namespace drivers
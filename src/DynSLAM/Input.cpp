@@ -6,6 +6,13 @@ namespace dynslam {
 
 using namespace std;
 
+/// \brief Removes the depth beyond 'max_depth_m' from the given depth map, in millimeters.
+static void ClipDepth(cv::Mat1s &depth_mm, float max_depth_m) {
+  const float kMetersToMillimeters = 1000.0f;
+  int max_depth_mm = static_cast<int>(round(max_depth_m * kMetersToMillimeters));
+  depth_mm.setTo(0, depth_mm > max_depth_mm);
+}
+
 void Input::GetFrameCvImages(
     int frame_idx,
     std::shared_ptr<cv::Mat3b> &rgb,
@@ -17,17 +24,33 @@ void Input::GetFrameCvImages(
   raw_depth.reset(new cv::Mat1s(GetDepthSize()));
 
   ReadLeftColor(frame_idx, *rgb);
-  ReadRightColor(frame_idx, rgb_right_temp);
 
   PrecomputedDepthProvider *pdp = dynamic_cast<PrecomputedDepthProvider*>(GetDepthProvider());
   if (nullptr == pdp) {
     throw runtime_error("Currently not fully supported.");
+    ReadRightColor(frame_idx, rgb_right_temp);
     GetDepthProvider()->DepthFromStereo(*rgb, rgb_right_temp, stereo_calibration_, *raw_depth, input_scale_);
   }
   else {
-    // If we're using precomputed depth, make sure you tell it exactly which frame we are evaluating.
-    pdp->GetDepth(frame_idx, this->stereo_calibration_, depth_buf_small_, input_scale_);
-    cv::resize(depth_buf_small_, *raw_depth, cv::Size(), 1.0/input_scale_, 1.0/input_scale_, cv::INTER_NEAREST);
+    ReadFrameDepth(frame_idx, *raw_depth);
+  }
+}
+
+void Input::ReadFrameDepth(int frame_idx, cv::Mat1s &out_depth) {
+  PrecomputedDepthProvider *pdp = dynamic_cast<PrecomputedDepthProvider*>(GetDepthProvider());
+  if (nullptr == pdp) {
+    throw runtime_error("Reading the depth of arbitrary frames requires precomputed depth.");
+  }
+
+  // If we're using precomputed depth, make sure you tell it exactly which frame we are evaluating.
+  // Unlike 'depth_buf_small_', this buffer is not shared with 'ReadNextFrame'. Its size comes from
+  // the (constant) frame size, since 'ReadNextFrame' may reallocate 'depth_buf_small_' meanwhile.
+  cv::Mat1s depth_small(static_cast<int>(round(frame_height_ * input_scale_)),
+                        static_cast<int>(round(frame_width_ * input_scale_)));
+  pdp->GetDepth(frame_idx, this->stereo_calibration_, depth_small, input_scale_);
+  cv::resize(depth_small, out_depth, cv::Size(), 1.0/input_scale_, 1.0/input_scale_, cv::INTER_NEAREST);
+  if (HasFarDepth()) {
+    ClipDepth(out_depth, depth_provider_->GetMaxDepthMeters());
   }
 }
 
@@ -90,6 +113,13 @@ bool Input::ReadNextFrame() {
     return false;
   }
 
+  if (HasFarDepth()) {
+    // The far range is only meant for the coarse map, so everything else, e.g., the instances,
+    // keeps seeing the regular depth range.
+    depth_buf_.copyTo(far_depth_buf_);
+    ClipDepth(depth_buf_, depth_provider_->GetMaxDepthMeters());
+  }
+
   frame_idx_++;
   return true;
 }
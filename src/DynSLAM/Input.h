@@ -193,6 +193,17 @@ class Input {
   /// \note The caller does not take ownership.
   void GetCvImages(cv::Mat3b **rgb, cv::Mat1s **raw_depth);
 
+  /// \brief Returns the latest depth, including the far range beyond the depth provider's
+  ///        maximum depth. Same as the raw depth if no far range is being read.
+  const cv::Mat1s *GetFarDepth() const {
+    return HasFarDepth() ? &far_depth_buf_ : &depth_buf_;
+  }
+
+  /// \brief Whether depth beyond the maximum is read for a coarse far-range map.
+  bool HasFarDepth() const {
+    return depth_provider_->GetFarMaxDepthMeters() > depth_provider_->GetMaxDepthMeters();
+  }
+
   /// \brief Returns pointers to the latest grayscale input frames.
   void GetCvStereoGray(cv::Mat1b **left, cv::Mat1b **right);
 
@@ -234,6 +245,10 @@ class Input {
   /// \brief Sets the out parameters to the RGB and depth images from the specified frame.
   void GetFrameCvImages(int frame_idx, std::shared_ptr<cv::Mat3b> &rgb, std::shared_ptr<cv::Mat1s> &raw_depth);
 
+  /// \brief Reads the depth of the specified frame, which must be precomputed.
+  /// \note Safe to call from other threads while new frames are being read.
+  void ReadFrameDepth(int frame_idx, cv::Mat1s &out_depth);
+
   const Config& GetConfig() const {
     return config_;
   }
@@ -256,6 +271,8 @@ class Input {
   cv::Mat3b left_frame_color_buf_;
   cv::Mat3b right_frame_color_buf_;
   cv::Mat1s depth_buf_;
+  /// \brief The unclipped depth, only used when reading the far range.
+  cv::Mat1s far_depth_buf_;
 
   // Store the grayscale information necessary for scene flow computation using libviso2, and
   // on-the-fly depth map computation using libelas.
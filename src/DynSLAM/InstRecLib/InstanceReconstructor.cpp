@@ -1,9 +1,11 @@
 
 #include <algorithm>
+#include <sstream>
 
 #include "InstanceReconstructor.h"
 #include "InstanceView.h"
 #include "../DynSlam.h"
+#include "../VoxelBlockCodec.h"
 #include "../../libviso2/src/viso.h"
 // #include "../Direct/frame/device/cpu/frame_cpu.h"
 // #include "../Direct/frame/frame.hpp"
@@ -21,6 +23,18 @@ using namespace instreclib::utils;
 
 using namespace ITMLib::Objects;
 
+/// \brief Instance volumes get moved to a larger tier once more than this fraction of their voxel
+///        blocks is in use.
+const float kVolumeGrowThreshold = 0.85f;
+
+/// \brief Number of voxel blocks allocated for every block-sized patch of an object's surface.
+/// Accounts for the truncation band spanning multiple blocks, as well as for noisy depth.
+const float kBlocksPerSurfaceBlock = 3.0f;
+
+/// \brief Offloaded reconstructions only need to be good enough to continue fusing into, so we
+///        can afford to drop some SDF precision.
+const int kOffloadSdfDropBits = 6;
+
 
 const vector<string> InstanceReconstructor::kClassesToReconstructVoc2012 = { "car", "bus" };
 // Note: for a real self-driving cars, you definitely want a completely generic obstacle detector.
@@ -106,8 +120,7 @@ void ProcessSilhouette_CPU(Vector4u *source_rgb,
       }
 
       int copy_idx = copy_row * frame_width + copy_col;
-      u_char copy_mask_val = copy_mask.GetData()->at<u_char>(row, col);
-      if (copy_mask_val == 1) {
+      if (copy_mask.ContainsLocal(row, col)) {
         dest_rgb[copy_idx].r = source_rgb[copy_idx].r;
         dest_rgb[copy_idx].g = source_rgb[copy_idx].g;
         dest_rgb[copy_idx].b = source_rgb[copy_idx].b;
@@ -156,8 +169,7 @@ void RemoveSilhouette_CPU(ORUtils::Vector4<unsigned char> *source_rgb,
       }
 
       int frame_idx = frame_row * frame_width + frame_col;
-      u_char mask_val = mask.GetData()->at<u_char>(row, col);
-      if (mask_val == 1) {
+      if (mask.ContainsLocal(row, col)) {
         source_rgb[frame_idx].r = 0;
         source_rgb[frame_idx].g = 0;
         source_rgb[frame_idx].b = 0;
@@ -180,6 +192,8 @@ void InstanceReconstructor::ProcessFrame(
   main_view->rgb->UpdateHostFromDevice();
   main_view->depth->UpdateHostFromDevice();
 
+  removed_masks_.clear();
+
   Vector2i frame_size_itm = main_view->rgb->noDims;
   Eigen::Vector2i frame_size(frame_size_itm.x, frame_size_itm.y);
   vector<InstanceView, Eigen::aligned_allocator<InstanceView>> new_instance_views =
@@ -187,6 +201,12 @@ void InstanceReconstructor::ProcessFrame(
 
   // Associate this frame's detection(s) with those from previous frames.
   this->instance_tracker_->ProcessInstanceViews(frame_idx_, new_instance_views, dyn_slam->GetPose());
+  // Offloaded reconstructions of pruned tracks are no longer needed.
+  for (int track_id : offload_store_->GetTrackIds()) {
+    if (! instance_tracker_->HasTrack(track_id)) {
+      offload_store_->Discard(track_id);
+    }
+  }
   // Estimate relative object motion and update track states.
   this->UpdateTracks(dyn_slam, scene_flow, ssf_provider, always_separate, main_view, frame_size);
   // Update 3D models for tracks undergoing reconstruction.
@@ -211,7 +231,7 @@ void InstanceReconstructor::UpdateTracks(const dynslam::DynSlam *dyn_slam,
                                          const SparseSFProvider &ssf_provider,
                                          bool always_separate,
                                          ITMLib::Objects::ITMView *main_view,
-                                         const Eigen::Vector2i &frame_size) const
+                                         const Eigen::Vector2i &frame_size)
 {
   for (const auto &pair : instance_tracker_->GetActiveTracks()) {
     Track &track = instance_tracker_->GetTrack(pair.first);
@@ -223,11 +243,20 @@ void InstanceReconstructor::UpdateTracks(const dynslam::DynSlam *dyn_slam,
   }
 }
 
+void InstanceReconstructor::RemoveSilhouette(ORUtils::Vector4<unsigned char> *rgb_data_h,
+                                             float *depth_data_h,
+                                             const Eigen::Vector2i &frame_size,
+                                             const shared_ptr<Mask> &mask) {
+  RemoveSilhouette_CPU(rgb_data_h, depth_data_h, frame_size, *mask);
+  // The coarse map also needs the object cut out of its (unclipped) input.
+  removed_masks_.push_back(mask);
+}
+
 void InstanceReconstructor::ProcessSilhouette(Track &track,
                                               ITMLib::Objects::ITMView *main_view,
                                               const Eigen::Vector2i &frame_size,
                                               const SparseSceneFlow &scene_flow,
-                                              bool always_separate) const
+                                              bool always_separate)
 {
   bool should_reconstruct = ShouldReconstruct(track.GetClassName());
   bool possibly_dynamic = IsPossiblyDynamic(track.GetClassName());
@@ -243,8 +272,7 @@ void InstanceReconstructor::ProcessSilhouette(Track &track,
       if (possibly_dynamic) {
         printf("Unknown motion for possibly dynamic object of class %s; cutting away!\n",
                track.GetClassName().c_str());
-        RemoveSilhouette_CPU(rgb_data_h, depth_data_h, frame_size,
-                             *(latest_detection.delete_mask));
+        RemoveSilhouette(rgb_data_h, depth_data_h, frame_size, latest_detection.delete_mask);
       }
       // else: Static class with unknown motion. Likely safe to put in main map.
     }
@@ -258,7 +286,7 @@ void InstanceReconstructor::ProcessSilhouette(Track &track,
                               frame_size,
                               *(latest_detection.copy_mask), *(latest_detection.delete_mask));
         // TODO(andrei): Really think whether there's a clean way of doing these two operations together.
-        RemoveSilhouette_CPU(rgb_data_h, depth_data_h, frame_size, *(latest_detection.delete_mask));
+        RemoveSilhouette(rgb_data_h, depth_data_h, frame_size, latest_detection.delete_mask);
         instance_view->rgb->UpdateDeviceFromHost();
         instance_view->depth->UpdateDeviceFromHost();
       }
@@ -266,8 +294,7 @@ void InstanceReconstructor::ProcessSilhouette(Track &track,
         cout << "Dynamic object with known motion we can't reconstruct. Removing." << endl;
         // Dynamic object which we can't or don't want to reconstruct, such as a pedestrian.
         // In this case, we simply remove the object from view.
-        RemoveSilhouette_CPU(rgb_data_h, depth_data_h, frame_size,
-                             *(latest_detection.delete_mask));
+        RemoveSilhouette(rgb_data_h, depth_data_h, frame_size, latest_detection.delete_mask);
       }
       else {
         // Warn if we detect a moving potted plant.
@@ -313,6 +340,7 @@ ITMFloatImage *InstanceReconstructor::GetInstancePreviewDepth(size_t track_idx)
 }
 
 void InstanceReconstructor::ProcessReconstructions(bool always_separate) {
+  vector<Track*> to_fuse;
   for (const auto &pair : instance_tracker_->GetActiveTracks()) {
     Track& track = instance_tracker_->GetTrack(pair.first);
     if (! ShouldReconstruct(track.GetClassName())) {
@@ -332,11 +360,17 @@ void InstanceReconstructor::ProcessReconstructions(bool always_separate) {
                    gap_size));
 
         track.ReapReconstruction();
+        CompactReconstruction(track);
         TocMicro();
 
         track.SetNeedsCleanup(false);
       }
 
+      if (offload_params_.idle_frames > 0 && track.HasReconstruction() &&
+          gap_size >= offload_params_.idle_frames) {
+        OffloadReconstruction(track);
+      }
+
       continue;
     }
 
@@ -354,39 +388,169 @@ void InstanceReconstructor::ProcessReconstructions(bool always_separate) {
         continue;
       }
     } else {
-      // Fuse the latest frame into the volume.
-      FuseFrame(track, track.GetSize() - 1);
+      to_fuse.push_back(&track);
     }
   }
+
+  // Every object has its own volume, so on the CPU, they can all be fused into in parallel. On the
+  // GPU, the kernels would end up serialized anyway.
+  // The fusion logs are buffered per object and printed here, so they don't get interleaved.
+  vector<ostringstream> fusion_logs(to_fuse.size());
+  auto fuse_latest = [this, &to_fuse, &fusion_logs](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      FuseFrame(*to_fuse[i], to_fuse[i]->GetSize() - 1, fusion_logs[i]);
+    }
+  };
+  if (driver_->IsOnGpu()) {
+    fuse_latest(0, static_cast<int>(to_fuse.size()));
+  }
+  else {
+    ParallelFor(0, static_cast<int>(to_fuse.size()), fuse_latest);
+  }
+  for (const ostringstream &fusion_log : fusion_logs) {
+    cout << fusion_log.str();
+  }
+
+  // Growing moves reconstructions between volumes, so it's not safe to do in parallel.
+  for (Track *track : to_fuse) {
+    GrowReconstructionIfNeeded(*track);
+  }
 }
 
-void InstanceReconstructor::InitializeReconstruction(Track &track) const {
-  cout << endl << "Starting to reconstruct instance with ID: " << track.GetId() << endl << endl;
-  ITMLibSettings *settings = new ITMLibSettings(*driver_->GetSettings());
+ITMLibSettings InstanceReconstructor::CreateInstanceSettings(const ITMLibSettings &static_settings) {
+  ITMLibSettings settings(static_settings);
 
   // Set a much smaller voxel block number for the reconstruction, since individual objects
   // occupy a limited amount of space in the scene.
   // We don't want to create an (expensive) meshing engine for every instance.
-  settings->createMeshingEngine = false;
+  settings.createMeshingEngine = false;
 
-  settings->sceneParams.mu = 1.00f;
-  settings->sceneParams.voxelSize = 0.035f;
-//  settings->sceneParams.voxelSize = 0.250f;
+  settings.sceneParams.mu = 1.00f;
+  settings.sceneParams.voxelSize = 0.035f;
+//  settings.sceneParams.voxelSize = 0.250f;
 
   // Can fix spurious hole issues (rare)
-//  settings->sceneParams.voxelSize = 0.030f;
+//  settings.sceneParams.voxelSize = 0.030f;
   // Volume approximated in meters.
-  settings->sdfLocalBlockNum = static_cast<long>(5 * 5 * 10 / settings->sceneParams.voxelSize);
-//  settings->sdfLocalBlockNum = static_cast<long>(4 * 4 * 10 / settings->sceneParams.voxelSize);
-
-  track.GetReconstruction() = make_shared<InfiniTamDriver>(
-          settings,
-          driver_->GetView()->calib,
-          driver_->GetView()->rgb->noDims,
-          driver_->GetView()->rgb->noDims,
-          driver_->GetVoxelDecayParams(),
-          driver_->IsUsingDepthWeights()
-  );
+  settings.sdfLocalBlockNum = static_cast<long>(5 * 5 * 10 / settings.sceneParams.voxelSize);
+//  settings.sdfLocalBlockNum = static_cast<long>(4 * 4 * 10 / settings.sceneParams.voxelSize);
+
+  return settings;
+}
+
+InstanceVolumePool* InstanceReconstructor::CreateVolumePool(InfiniTamDriver *driver, int pool_size) {
+  ITMLibSettings settings = CreateInstanceSettings(*driver->GetSettings());
+  long regular_block_count = settings.sdfLocalBlockNum;
+  vector<long> tier_block_counts = {
+      regular_block_count / 4,
+      regular_block_count / 2,
+      regular_block_count,
+      regular_block_count * 2
+  };
+
+  size_t regular_volume_bytes = InstanceVolumePool::EstimateVolumeBytes(
+      settings, driver->GetImageSize(), driver->IsCpuRaycasterEnabled());
+
+  return new InstanceVolumePool(settings,
+                                driver->GetCalib(),
+                                driver->GetImageSize(),
+                                driver->GetVoxelDecayParams(),
+                                driver->IsUsingDepthWeights(),
+                                tier_block_counts,
+                                pool_size * regular_volume_bytes,
+                                driver->IsCpuRaycasterEnabled());
+}
+
+void InstanceReconstructor::PreallocateVolumes() {
+  // Most objects are far enough from the camera to fit in the smallest volumes, so we use up half
+  // of the budget on those. Larger ones are allocated on demand.
+  size_t small_volume_bytes = volume_pool_->GetVolumeBytes(0);
+  int count = static_cast<int>(volume_pool_->GetBudgetBytes() / (2 * small_volume_bytes));
+  volume_pool_->Preallocate(0, count);
+}
+
+/// \brief Rough dimensions (length, width, height) of the objects we reconstruct, in meters.
+Eigen::Vector3f GetClassDimensions(const string &class_name) {
+  if (class_name == "bus") {
+    return Eigen::Vector3f(12.0f, 2.6f, 3.2f);
+  }
+  else {
+    return Eigen::Vector3f(4.5f, 1.8f, 1.5f);
+  }
+}
+
+/// \brief Back-projects the instance's bounding box using its median depth.
+/// \returns The metric size of the bounding box's larger side, or zero if no depth is available.
+float EstimateMetricExtent(const InstanceView &instance_view, float focal_length) {
+  const ITMView *view = instance_view.GetView();
+  if (nullptr == view) {
+    return 0.0f;
+  }
+
+  const BoundingBox &bbox = instance_view.GetInstanceDetection().GetCopyBoundingBox();
+  const float *depth = view->depth->GetData(MEMORYDEVICE_CPU);
+  int width = view->depth->noDims.x;
+  int height = view->depth->noDims.y;
+
+  vector<float> depths;
+  for (int y = max(0, bbox.r.y0); y <= min(height - 1, bbox.r.y1); ++y) {
+    for (int x = max(0, bbox.r.x0); x <= min(width - 1, bbox.r.x1); ++x) {
+      float d = depth[y * width + x];
+      if (d > 0.0f) {
+        depths.push_back(d);
+      }
+    }
+  }
+
+  if (depths.empty()) {
+    return 0.0f;
+  }
+
+  auto median = depths.begin() + depths.size() / 2;
+  nth_element(depths.begin(), median, depths.end());
+  return max(bbox.GetWidth(), bbox.GetHeight()) * (*median) / focal_length;
+}
+
+long InstanceReconstructor::EstimateRequiredBlocks(const Track &track) const {
+  Eigen::Vector3f dims = GetClassDimensions(track.GetClassName());
+
+  // Detections much larger than expected (e.g., trucks labeled as cars) get scaled up.
+  float focal_length = driver_->GetCalib()->intrinsics_d.projectionParamsSimple.fx;
+  float extent_m = EstimateMetricExtent(track.GetLastFrame().instance_view, focal_length);
+  if (extent_m > dims(0)) {
+    dims *= extent_m / dims(0);
+  }
+
+  float surface_area_m2 = 2.0f * (dims(0) * dims(1) + dims(0) * dims(2) + dims(1) * dims(2));
+  float block_side_m = SDF_BLOCK_SIZE * volume_pool_->GetVoxelSize();
+  return static_cast<long>(kBlocksPerSurfaceBlock * surface_area_m2 / (block_side_m * block_side_m));
+}
+
+bool InstanceReconstructor::InitializeReconstruction(Track &track) const {
+  if (offload_store_->Has(track.GetId())) {
+    return RestoreReconstruction(track);
+  }
+
+  long required_blocks = EstimateRequiredBlocks(track);
+  int tier = volume_pool_->FindTier(required_blocks);
+
+  // If there's no room for a volume of the right size, a smaller one will do for now, since it can
+  // grow later on.
+  for (int t = tier; t >= 0 && ! track.HasReconstruction(); --t) {
+    track.GetReconstruction() = volume_pool_->Acquire(t);
+  }
+
+  if (! track.HasReconstruction()) {
+    // Degrade gracefully: the track keeps accumulating frames, and all of them get fused once a
+    // volume frees up, e.g., when an older track gets pruned.
+    cerr << "Warning: No free instance volume for track " << track.GetId() << " ("
+         << volume_pool_->GetInUseCount() << " already in use). Will retry later." << endl;
+    return false;
+  }
+
+  cout << endl << "Starting to reconstruct instance with ID: " << track.GetId() << " (estimated "
+       << required_blocks << " blocks, using a volume of "
+       << track.GetReconstruction()->GetBlockCapacity() << ")." << endl << endl;
 
   // TODO(andrei): This may not work for the (Stat/dyn) -> Unc -> (stat/dyn) situation!
   // If we already have some frames, integrate them into the new volume.
@@ -396,6 +560,121 @@ void InstanceReconstructor::InitializeReconstruction(Track &track) const {
     cout << "Camera pose for that index:" << endl << track.GetFrame(first_idx).camera_pose << endl << endl;
     for (size_t i = first_idx; i < track.GetSize(); ++i) {
       FuseFrame(track, i);
+      GrowReconstructionIfNeeded(track);
+    }
+  }
+
+  return true;
+}
+
+void InstanceReconstructor::OffloadReconstruction(Track &track) {
+  Tic(Format("Offloading reconstruction of track %d", track.GetId()));
+  InfiniTamDriver &volume = *track.GetReconstruction();
+  vector<VoxelBlock> blocks;
+  volume.ExportBlocks(blocks);
+
+  OffloadedReconstruction offloaded;
+  offloaded.pose = volume.GetPose();
+  offloaded.processed_frame_count = track.GetSize();
+  offloaded.block_count = blocks.size();
+  offloaded.raw_size_bytes = blocks.size() * sizeof(VoxelBlock);
+  VoxelQuantization quantization(kOffloadSdfDropBits, true, offload_params_.voxel_format);
+  EncodeVoxelBlocks(blocks, quantization, offloaded.data);
+
+  cout << "Offloading reconstruction of track " << track.GetId() << ": " << blocks.size()
+       << " blocks, " << offloaded.raw_size_bytes / 1024 << " KiB -> "
+       << offloaded.data.size() / 1024 << " KiB." << endl;
+  offload_store_->Put(track.GetId(), std::move(offloaded));
+
+  // This returns the volume to the pool.
+  track.GetReconstruction().reset();
+  TocMicro();
+}
+
+bool InstanceReconstructor::RestoreReconstruction(Track &track) const {
+  const OffloadedReconstruction &offloaded = offload_store_->Peek(track.GetId());
+  int tier = volume_pool_->FindTier(static_cast<long>(offloaded.block_count / kVolumeGrowThreshold));
+  track.GetReconstruction() = volume_pool_->Acquire(tier);
+  if (! track.HasReconstruction()) {
+    cerr << "Warning: No free instance volume for restoring the reconstruction of track "
+         << track.GetId() << ". Will retry later." << endl;
+    return false;
+  }
+
+  OffloadedReconstruction restored = offload_store_->Take(track.GetId());
+  vector<VoxelBlock> blocks;
+  DecodeVoxelBlocks(restored.data, blocks);
+  size_t lost_blocks = track.GetReconstruction()->ImportBlocks(blocks, frame_idx_);
+  if (lost_blocks > 0) {
+    cerr << "Warning: Lost " << lost_blocks << " voxel blocks while restoring the reconstruction "
+         << "of track " << track.GetId() << "." << endl;
+  }
+  track.GetReconstruction()->SetPose(restored.pose);
+
+  cout << "Restored reconstruction of track " << track.GetId() << " (" << blocks.size()
+       << " blocks)." << endl;
+
+  // Catch up on whatever the track saw while its reconstruction was offloaded.
+  for (size_t i = restored.processed_frame_count; i < track.GetSize(); ++i) {
+    FuseFrame(track, i);
+    GrowReconstructionIfNeeded(track);
+  }
+
+  return true;
+}
+
+bool InstanceReconstructor::MigrateReconstruction(Track &track,
+                                                  int tier,
+                                                  bool allow_allocation) const {
+  shared_ptr<InfiniTamDriver> &old_volume = track.GetReconstruction();
+  shared_ptr<InfiniTamDriver> new_volume = volume_pool_->Acquire(tier, allow_allocation);
+  if (nullptr == new_volume) {
+    return false;
+  }
+
+  vector<VoxelBlock> blocks;
+  old_volume->ExportBlocks(blocks);
+  size_t lost_blocks = new_volume->ImportBlocks(blocks, frame_idx_);
+  if (lost_blocks > 0) {
+    cerr << "Warning: Lost " << lost_blocks << " voxel blocks while moving the reconstruction of "
+         << "track " << track.GetId() << "." << endl;
+  }
+
+  new_volume->SetPose(old_volume->GetPose());
+  new_volume->SetView(old_volume->GetView());
+
+  cout << "Moved reconstruction of track " << track.GetId() << " (" << blocks.size()
+       << " blocks) from a volume of " << old_volume->GetBlockCapacity() << " blocks to one of "
+       << new_volume->GetBlockCapacity() << "." << endl;
+
+  // This returns the old volume to the pool.
+  old_volume = new_volume;
+  return true;
+}
+
+void InstanceReconstructor::GrowReconstructionIfNeeded(Track &track) const {
+  const InfiniTamDriver &volume = *track.GetReconstruction();
+  float fill = static_cast<float>(volume.GetUsedBlockCount()) / volume.GetBlockCapacity();
+  int tier = volume_pool_->GetTier(volume);
+
+  if (fill > kVolumeGrowThreshold && tier + 1 < volume_pool_->GetTierCount()) {
+    if (! MigrateReconstruction(track, tier + 1)) {
+      cerr << "Warning: Instance volume of track " << track.GetId() << " is " << fill * 100.0f
+           << "% full, but no larger volume is available." << endl;
+    }
+  }
+}
+
+void InstanceReconstructor::CompactReconstruction(Track &track) const {
+  const InfiniTamDriver &volume = *track.GetReconstruction();
+  long required_blocks = static_cast<long>(volume.GetUsedBlockCount() / kVolumeGrowThreshold);
+  int current_tier = volume_pool_->GetTier(volume);
+
+  // Only volumes which are already in the pool are used, since allocating one whenever a track
+  // ends would bring back the allocation spikes the pool is there to avoid.
+  for (int tier = volume_pool_->FindTier(required_blocks); tier < current_tier; ++tier) {
+    if (MigrateReconstruction(track, tier, false)) {
+      return;
     }
   }
 }
@@ -566,14 +845,14 @@ bool ExperimentalDirectRefine(Track &track,
 */
 
 
-void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
+void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx, ostream &log) const {
   if (track.GetState() == TrackState::kUncertain) {
     // We can't deal with tracks of uncertain state, because there's no available relative
     // transforms between frames, so we can't register measurements.
     return;
   }
 
-  cout << "Processing reconstruction of instance with ID: " << track.GetId() << endl;
+  log << "Processing reconstruction of instance with ID: " << track.GetId() << endl;
   InfiniTamDriver &instance_driver = *track.GetReconstruction();
 
   TrackFrame &frame = track.GetFrame(frame_idx);
@@ -586,7 +865,7 @@ void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
   // still try to estimate it from k to k+2.
   if (rel_dyn_pose.IsPresent()) {
     Eigen::Matrix4f rel_dyn_pose_f = (*rel_dyn_pose).cast<float>();
-    cout << "Fusing frame " << frame_idx << "/ #" << track.GetId() << "." << endl << rel_dyn_pose_f << endl;
+    log << "Fusing frame " << frame_idx << "/ #" << track.GetId() << "." << endl << rel_dyn_pose_f << endl;
     instance_driver.SetPose(rel_dyn_pose_f.inverse());
 
     if (enable_direct_refinement_ && enable_itm_refinement_) {
@@ -634,7 +913,7 @@ void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
         Eigen::Matrix4d delta = new_pose * rel_dyn_pose.Get();
         Eigen::Matrix4d refined_matrix = old_rel_pose * delta;
 
-        cout << "Refined matrix inv: " << refined_matrix.inverse();
+        log << "Refined matrix inv: " << refined_matrix.inverse();
 
         // TODO(andrei): The improvement may not be significant, but we should also update the se3 form
         delete frame.relative_pose;
@@ -644,17 +923,17 @@ void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
 //          old_rel_pose
         ));
 
-        cout << "Frame " << frame_idx << ": Refined relative pose only. " << endl
+        log << "Frame " << frame_idx << ": Refined relative pose only. " << endl
              << "Old relative: " << endl
              << old_rel_pose << endl << "New relative, refined by ICP: " << endl
              << refined_matrix << endl;
-        cout << "Sanity checks:" << endl << frame.relative_pose->Get().matrix_form << endl;
+        log << "Sanity checks:" << endl << frame.relative_pose->Get().matrix_form << endl;
         for (int i = 0; i < 6; ++i) {
-          cout << frame.relative_pose->Get().se3_form[i] << ", ";
+          log << frame.relative_pose->Get().se3_form[i] << ", ";
         }
-        cout << endl;
+        log << endl;
       } else {
-        cout << "Frame " << frame_idx << " had no relative pose, so it could not be refined."
+        log << "Frame " << frame_idx << " had no relative pose, so it could not be refined."
              << endl;
       }
     }
@@ -666,16 +945,22 @@ void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
       // TODO(andrei): Custom dynslam allocation exception we can catch here to avoid fatal errors.
       // This happens when we run out of memory on the GPU for this volume. We should prolly have a
       // custom exception/error code for this.
-      cerr << "Caught runtime error while integrating new data into an instance volume: "
+      log << "Caught runtime error while integrating new data into an instance volume: "
            << error.what() << endl << "Will continue regular operation." << endl;
     }
 
+    if (enable_itm_refinement_) {
+      // The next frame's ICP refinement aligns to the map as it is now, before the decay.
+      instance_driver.AddRaycastConsumer(InfiniTamDriver::kTracker);
+    }
     instance_driver.PrepareNextStep();
 
     // TODO(andrei): Make this sync with the similar flag in 'DynSlam'.
     if (use_decay_) {
       instance_driver.Decay();
     }
+    instance_driver.UpdatePlanarMirror();
+    instance_driver.CommitBlockMap();
 
     track.SetNeedsCleanup(true);
     track.CountFusedFrame();
@@ -694,7 +979,7 @@ void InstanceReconstructor::FuseFrame(Track &track, size_t frame_idx) const {
     }
   }
   else {
-    cout << "Could not fuse instance data for track #" << track.GetId() << " due to missing pose "
+    log << "Could not fuse instance data for track #" << track.GetId() << " due to missing pose "
          << "information." << endl;
   }
 }
@@ -767,6 +1052,8 @@ vector<InstanceView, Eigen::aligned_allocator<InstanceView>> InstanceReconstruct
     ITMLib::Objects::ITMView *main_view,
     const SparseSceneFlow &scene_flow
 ) {
+  removed_masks_.clear();
+
   Vector2i frame_size_itm = main_view->rgb->noDims;
   Eigen::Vector2i frame_size(frame_size_itm.x, frame_size_itm.y);
 
@@ -837,8 +1124,7 @@ void InstanceReconstructor::ExtractSceneFlow(const SparseSceneFlow &scene_flow,
         continue;
       }
 
-      u_char mask_val = flow_mask->GetData()->at<u_char>(cons_row, cons_col);
-      if (mask_val == 1) {
+      if (flow_mask->ContainsLocal(cons_row, cons_col)) {
         auto coord_pair = pair<int, int>(const_frame_col, cons_frame_row);
         if (coord_to_flow.find(coord_pair) != coord_to_flow.cend()) {
           out_instance_flow_vectors.push_back(coord_to_flow.find(coord_pair)->second);
@@ -870,6 +1156,18 @@ void CompositeDepth(ITMFloatImage *target, const ITMFloatImage *source) {
   }
 }
 
+/// \brief Highlights an object instance's color in the reconstruction preview.
+Vector4u TintInstanceColor(const Vector4u &color, const Eigen::Vector4i &tint,
+                           const float tint_strength) {
+  const float kColorBoost = 0.50f;
+  double col_strength = 1.0 + kColorBoost - tint_strength;
+  Vector4u result = color;
+  result.r = static_cast<uchar>(min(255.0, color.r * col_strength + tint(0) * tint_strength));
+  result.g = static_cast<uchar>(min(255.0, color.g * col_strength + tint(1) * tint_strength));
+  result.b = static_cast<uchar>(min(255.0, color.b * col_strength + tint(2) * tint_strength));
+  return result;
+}
+
 /// \brief Adds an object instance to the reconstruction previeww.
 /// Z-buffering in software as a first prototype (yes, very slow and silly).
 void CompositeColor(ITMUChar4Image *target_color, ITMFloatImage *target_depth,
@@ -887,7 +1185,6 @@ void CompositeColor(ITMUChar4Image *target_color, ITMFloatImage *target_depth,
   const float *s_depth_data = instance_depth->GetData(MEMORYDEVICE_CPU);
   Vector4u *t_color_data = target_color->GetData(MEMORYDEVICE_CPU);
   const Vector4u *s_color_data = instance_color->GetData(MEMORYDEVICE_CPU);
-  const float kColorBoost = 0.50f;
 
   for(int i = 0; i < height; i++) {
     for(int j = 0; j < width; j++) {
@@ -898,10 +1195,7 @@ void CompositeColor(ITMUChar4Image *target_color, ITMFloatImage *target_depth,
 
       if (instance_on_top) {
         t_depth_data[idx] = s_depth_data[idx];
-        double col_strength = 1.0 + kColorBoost - tint_strength;
-        t_color_data[idx].r = static_cast<uchar>(min(255.0, s_color_data[idx].r * col_strength + tint(0) * tint_strength));
-        t_color_data[idx].g = static_cast<uchar>(min(255.0, s_color_data[idx].g * col_strength + tint(1) * tint_strength));
-        t_color_data[idx].b = static_cast<uchar>(min(255.0, s_color_data[idx].b * col_strength + tint(2) * tint_strength));
+        t_color_data[idx] = TintInstanceColor(s_color_data[idx], tint, tint_strength);
       }
     }
   }
@@ -921,15 +1215,40 @@ void InstanceReconstructor::CompositeInstanceDepthMaps(ITMFloatImage *out,
       if (pose.IsPresent()) {
         /// XXX: experimental freeview fused code. This works but may wreck the evaluation a little. Care is needed.
         auto pango_object_pose = model_view * pangolin::OpenGlMatrix::ColMajor4x4(pose.Get().data());
-        t.GetReconstruction()->GetFloatImage(&instance_depth_buffer_,
-                                             dynslam::PreviewType::kDepth,
-                                             pango_object_pose);
+        auto *reconstruction = t.GetReconstruction();
+        if (reconstruction->IsCpuRaycasterEnabled()) {
+          // Only marches the pixels the instance covers, up to the depth already in 'out'.
+          reconstruction->RenderOverOnCpu(out, dynslam::PreviewType::kDepth, pango_object_pose,
+                                          nullptr);
+          continue;
+        }
+
+        reconstruction->GetFloatImage(&instance_depth_buffer_,
+                                      dynslam::PreviewType::kDepth,
+                                      pango_object_pose);
         CompositeDepth(out, &instance_depth_buffer_);
       }
     }
   }
 }
 
+void InstanceReconstructor::CompositeInstanceDepthsAt(const pangolin::OpenGlMatrix &model_view,
+                                                      const vector<Eigen::Vector2i> &pixels,
+                                                      float *depth) {
+  int current_frame_idx = this->frame_idx_;
+  for (auto &entry : instance_tracker_->GetActiveTracks()) {
+    Track &t = instance_tracker_->GetTrack(entry.first);
+
+    if (t.GetLastFrame().frame_idx == current_frame_idx - 1 && t.HasReconstruction()) {
+      Option<Eigen::Matrix4d> pose = t.GetFramePoseDeprecated(t.GetSize() - 1);
+      if (pose.IsPresent()) {
+        auto pango_object_pose = model_view * pangolin::OpenGlMatrix::ColMajor4x4(pose.Get().data());
+        t.GetReconstruction()->RenderDepthAtOnCpu(pango_object_pose, pixels, depth);
+      }
+    }
+  }
+}
+
 void InstanceReconstructor::CompositeInstances(ITMUChar4Image *out_color,
                                                ITMFloatImage *out_depth,
                                                dynslam::PreviewType preview_type,
@@ -966,15 +1285,32 @@ void InstanceReconstructor::CompositeInstances(ITMUChar4Image *out_color,
 
       if (pose.IsPresent()) {
         auto pangolin_pose = model_view * pangolin::OpenGlMatrix::ColMajor4x4(pose.Get().data());
-        track.GetReconstruction()->GetImage(
+        const Eigen::Vector4i &tint = kMatplotlib2Palette[track.GetId() % kMatplotlib2Palette.size()];
+        auto *reconstruction = track.GetReconstruction();
+
+        if (reconstruction->IsCpuRaycasterEnabled() &&
+            dynslam::drivers::TileRaycaster::Supports(preview_type)) {
+          // Resolve the occlusions while raycasting, instead of raycasting the whole frame and
+          // compositing it afterwards. Each ray only goes up to the surface already in the
+          // preview, and only the pixels the instance's bounding box covers get raycast.
+          reconstruction->RenderOverOnCpu(
+              out_depth,
+              preview_type,
+              pangolin_pose,
+              [color_vals, &tint, kTintStrength](int idx, const Vector4u &instance_color) {
+                color_vals[idx] = TintInstanceColor(instance_color, tint, kTintStrength);
+              });
+          continue;
+        }
+
+        reconstruction->GetImage(
             &instance_color_buffer_,
             preview_type,
             pangolin_pose);
-        track.GetReconstruction()->GetFloatImage(&instance_depth_buffer_,
-                                                 dynslam::PreviewType::kDepth,
-                                                 pangolin_pose);
+        reconstruction->GetFloatImage(&instance_depth_buffer_,
+                                      dynslam::PreviewType::kDepth,
+                                      pangolin_pose);
 
-        const Eigen::Vector4i &tint = kMatplotlib2Palette[track.GetId() % kMatplotlib2Palette.size()];
         CompositeColor(out_color,
                        out_depth,
                        &instance_color_buffer_,
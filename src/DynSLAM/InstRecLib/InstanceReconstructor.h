@@ -3,11 +3,14 @@
 
 #include <Eigen/StdVector>
 
+#include <iostream>
 #include <map>
 #include <memory>
 
 #include "InstanceSegmentationResult.h"
 #include "InstanceTracker.h"
+#include "InstanceVolumePool.h"
+#include "OffloadedReconstructionStore.h"
 
 #include "../InfiniTamDriver.h"
 #include "SparseSFProvider.h"
@@ -45,8 +48,15 @@ class InstanceReconstructor {
         class_name) != kPossiblyDynamicClassesVoc2012.cend());
   }
 
-  explicit InstanceReconstructor(InfiniTamDriver *driver, bool use_decay, bool enable_direct_refinement)
-      : instance_tracker_(new InstanceTracker()),
+  explicit InstanceReconstructor(InfiniTamDriver *driver,
+                                 bool use_decay,
+                                 bool enable_direct_refinement,
+                                 int volume_pool_size = kDefaultInstanceVolumePoolSize,
+                                 const OffloadParams &offload_params = OffloadParams::Disabled())
+      : volume_pool_(CreateVolumePool(driver, volume_pool_size)),
+        offload_params_(offload_params),
+        offload_store_(new OffloadedReconstructionStore(offload_params.spill_dir)),
+        instance_tracker_(new InstanceTracker()),
         frame_idx_(0),
         driver_(driver),
         use_decay_(use_decay),
@@ -111,6 +121,12 @@ class InstanceReconstructor {
   /// TODO(andrei): Improve performance.
   void CompositeInstanceDepthMaps(ITMFloatImage *out, const pangolin::OpenGlMatrix &model_view);
 
+  /// \brief Like 'CompositeInstanceDepthMaps', but only raycasts the given pixels.
+  /// \param depth One depth per pixel. Requires the instance volumes to use the CPU raycaster.
+  void CompositeInstanceDepthsAt(const pangolin::OpenGlMatrix &model_view,
+                                 const std::vector<Eigen::Vector2i> &pixels,
+                                 float *depth);
+
   /// \brief Adds instance color and depth onto the indicated buffers, using 'out_depth' as a
   ///        software Z-buffer.
   void CompositeInstances(ITMUChar4Image *out_color,
@@ -123,12 +139,34 @@ class InstanceReconstructor {
     return instance_tracker_->GetTrackAtPoint(x, y, frame_idx_);
   }
 
+  /// \brief Allocates all the instance volumes up front, so that no large allocations need to be
+  ///        performed when new objects start being reconstructed.
+  void PreallocateVolumes();
+
+  const InstanceVolumePool &GetVolumePool() const { return *volume_pool_; }
+
+  const OffloadedReconstructionStore &GetOffloadedReconstructions() const { return *offload_store_; }
+
+  /// \brief The masks of the objects which the latest 'ProcessFrame' cut out of the main view.
+  const std::vector<std::shared_ptr<instreclib::utils::Mask>> &GetRemovedMasks() const {
+    return removed_masks_;
+  }
+
   /// Only for 'dynslam::eval' use.
   int GetFrameIdx_Evaluation() const {
     return frame_idx_;
   }
 
  private:
+  /// \brief Provides the volumes used to reconstruct individual objects.
+  /// Declared before the tracker, since the tracks hold references to the pool's volumes.
+  std::shared_ptr<InstanceVolumePool> volume_pool_;
+
+  OffloadParams offload_params_;
+
+  /// \brief Holds the compressed reconstructions of tracks which have been idle for a while.
+  std::shared_ptr<OffloadedReconstructionStore> offload_store_;
+
   std::shared_ptr<InstanceTracker> instance_tracker_;
 
   // TODO(andrei): Consider keeping track of this in centralized manner in DynSLAM, and having
@@ -153,6 +191,9 @@ class InstanceReconstructor {
   /// \brief Alternative approach based on semidense direct image alignment.
   bool enable_direct_refinement_;
 
+  /// \brief See 'GetRemovedMasks'.
+  std::vector<std::shared_ptr<instreclib::utils::Mask>> removed_masks_;
+
   /// \brief Used for rendering instance-specific depth and color maps.
   ITMFloatImage instance_depth_buffer_;
   ITMUChar4Image instance_color_buffer_;
@@ -161,7 +202,8 @@ class InstanceReconstructor {
   void ProcessReconstructions(bool always_separate);
 
   /// \brief Fuses the frame with the specified ID into the track's 3D reconstruction.
-  void FuseFrame(Track &track, size_t frame_idx) const;
+  /// \param log Receives the progress messages, so that parallel fusions can print them in order.
+  void FuseFrame(Track &track, size_t frame_idx, std::ostream &log = std::cout) const;
 
   /// \brief Processes the latest frame of the given track, copying it to the appropriate
   ///        instance-specific frame if necessary.
@@ -169,7 +211,13 @@ class InstanceReconstructor {
                          ITMLib::Objects::ITMView *main_view,
                          const Eigen::Vector2i &frame_size,
                          const SparseSceneFlow &scene_flow,
-                         bool always_separate) const;
+                         bool always_separate);
+
+  /// \brief Cuts the mask out of the main view, and records it in 'removed_masks_'.
+  void RemoveSilhouette(ORUtils::Vector4<unsigned char> *rgb_data_h,
+                        float *depth_data_h,
+                        const Eigen::Vector2i &frame_size,
+                        const std::shared_ptr<instreclib::utils::Mask> &mask);
 
   /// \brief Estimates object motion for every track, and populates instance views.
   /// The instance view are populated with RGB, depth, and scene flow information based on the
@@ -179,11 +227,45 @@ class InstanceReconstructor {
                     const SparseSFProvider &ssf_provider,
                     bool always_separate,
                     ITMLib::Objects::ITMView *main_view,
-                    const Eigen::Vector2i &frame_size) const;
+                    const Eigen::Vector2i &frame_size);
+
+  /// \brief Derives the settings used for the individual object reconstructions from those of
+  ///        the static map.
+  static ITMLibSettings CreateInstanceSettings(const ITMLibSettings &static_settings);
+
+  /// \brief Sets up size tiers for the instance volumes, with a memory budget equivalent to
+  ///        'pool_size' regular-size volumes.
+  static InstanceVolumePool* CreateVolumePool(InfiniTamDriver *driver, int pool_size);
+
+  /// \brief Estimates how many voxel blocks the reconstruction of the given track will need,
+  ///        based on its class and the metric size of its latest detection.
+  long EstimateRequiredBlocks(const Track &track) const;
+
+  /// \brief Moves the track's reconstruction to a volume from the given tier, preserving all its
+  ///        voxel blocks (or as many as will fit).
+  /// \param allow_allocation Whether a new volume may be allocated if none is free.
+  /// \returns Whether the move could be performed.
+  bool MigrateReconstruction(Track &track, int tier, bool allow_allocation = true) const;
+
+  /// \brief Compresses the track's reconstruction and releases its volume.
+  void OffloadReconstruction(Track &track);
+
+  /// \brief Brings back a previously offloaded reconstruction into a fresh volume, and fuses any
+  ///        frames the track received in the meantime.
+  /// \returns Whether a volume was available for the restored reconstruction.
+  bool RestoreReconstruction(Track &track) const;
+
+  /// \brief Moves the track's reconstruction to a larger volume if it's nearly full.
+  void GrowReconstructionIfNeeded(Track &track) const;
+
+  /// \brief Moves the track's reconstruction to the smallest free volume in the pool which can
+  ///        hold it, e.g., once the track ends and its reconstruction gets cleaned up.
+  void CompactReconstruction(Track &track) const;
 
-  /// \brief Allocates and InfiniTAM instance for reconstructing the given object and fuses all the
-  ///        available frames in the track.
-  void InitializeReconstruction(Track &track) const;
+  /// \brief Grabs an InfiniTAM instance from the pool for reconstructing the given object and fuses
+  ///        all the available frames in the track.
+  /// \returns Whether a volume was available. If not, the caller can simply try again later.
+  bool InitializeReconstruction(Track &track) const;
 
   /// \brief Masks the scene flow using the (smaller) conservative mask of the instance detection.
   void ExtractSceneFlow(
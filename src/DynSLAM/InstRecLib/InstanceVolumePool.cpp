@@ -0,0 +1,173 @@
+#include "InstanceVolumePool.h"
+
+namespace instreclib {
+namespace reconstruction {
+
+using namespace std;
+using namespace dynslam::drivers;
+
+InstanceVolumePool::InstanceVolumePool(const ITMLibSettings &settings,
+                                       const ITMRGBDCalib *calib,
+                                       const Vector2i &img_size,
+                                       const dynslam::VoxelDecayParams &voxel_decay_params,
+                                       bool use_depth_weighting,
+                                       const vector<long> &tier_block_counts,
+                                       size_t budget_bytes,
+                                       bool use_cpu_raycaster)
+    : state_(make_shared<State>(calib,
+                                img_size,
+                                voxel_decay_params,
+                                use_depth_weighting,
+                                use_cpu_raycaster,
+                                budget_bytes))
+{
+  assert(! tier_block_counts.empty());
+  for (long block_count : tier_block_counts) {
+    assert((state_->tiers.empty() || state_->tiers.back()->block_count < block_count) &&
+           "Volume tiers must be sorted by size.");
+    state_->tiers.emplace_back(new Tier(settings, block_count, img_size, use_cpu_raycaster));
+  }
+}
+
+size_t InstanceVolumePool::EstimateVolumeBytes(const ITMLibSettings &settings,
+                                               const Vector2i &img_size,
+                                               bool use_cpu_raycaster) {
+  size_t block_count = static_cast<size_t>(settings.sdfLocalBlockNum);
+  size_t pixel_count = static_cast<size_t>(img_size.x) * img_size.y;
+
+  size_t bytes = block_count * InfiniTamDriver::GetBlockFootprintBytes() +
+                 InfiniTamDriver::GetHashTableBytes();
+  // The per-pixel buffers, most of which InfiniTAM keeps both in host and in device memory: the
+  // raycast, its forward projection and preview, the tracker's point cloud, and the view and
+  // input images.
+  size_t pixel_bytes = 4 * sizeof(Vector4f) + 3 * sizeof(Vector4u) + sizeof(float) +
+                       sizeof(int) + sizeof(short);
+  bytes += 2 * pixel_count * pixel_bytes;
+
+  if (use_cpu_raycaster) {
+    // The planar mirror keeps a host copy of every block.
+    bytes += block_count * sizeof(PlanarVoxelBlock);
+  }
+  return bytes;
+}
+
+void InstanceVolumePool::Preallocate(int tier, int count) {
+  int allocated = 0;
+  while (allocated < count) {
+    InfiniTamDriver *volume = state_->Allocate(tier);
+    if (nullptr == volume) {
+      break;
+    }
+
+    state_->tiers[tier]->free_volumes.push_back(volume);
+    allocated++;
+  }
+
+  cout << "Preallocated " << allocated << " instance reconstruction volumes of "
+       << GetTierBlockCount(tier) << " blocks each." << endl;
+}
+
+shared_ptr<InfiniTamDriver> InstanceVolumePool::Acquire(int tier, bool allow_allocation) {
+  vector<InfiniTamDriver*> &free_volumes = state_->tiers[tier]->free_volumes;
+  InfiniTamDriver *volume = nullptr;
+  if (! free_volumes.empty()) {
+    volume = free_volumes.back();
+    free_volumes.pop_back();
+  }
+  else {
+    if (! allow_allocation) {
+      return nullptr;
+    }
+    volume = state_->Allocate(tier);
+    if (nullptr == volume) {
+      return nullptr;
+    }
+  }
+
+  // The deleter keeps the shared state alive, so volumes can be safely released after the pool
+  // itself is gone.
+  shared_ptr<State> state = state_;
+  return shared_ptr<InfiniTamDriver>(volume, [state, tier](InfiniTamDriver *released) {
+    released->ResetForReuse();
+    state->tiers[tier]->free_volumes.push_back(released);
+  });
+}
+
+int InstanceVolumePool::FindTier(long block_count) const {
+  for (int tier = 0; tier < GetTierCount(); ++tier) {
+    if (GetTierBlockCount(tier) >= block_count) {
+      return tier;
+    }
+  }
+
+  return GetTierCount() - 1;
+}
+
+int InstanceVolumePool::GetTier(const InfiniTamDriver &volume) const {
+  for (int tier = 0; tier < GetTierCount(); ++tier) {
+    if (GetTierBlockCount(tier) == volume.GetBlockCapacity()) {
+      return tier;
+    }
+  }
+
+  throw runtime_error("Volume was not allocated by this pool.");
+}
+
+int InstanceVolumePool::GetInUseCount() const {
+  int in_use = 0;
+  for (const auto &tier : state_->tiers) {
+    in_use += tier->allocated_count - static_cast<int>(tier->free_volumes.size());
+  }
+  return in_use;
+}
+
+InstanceVolumePool::State::~State() {
+  for (const auto &tier : tiers) {
+    assert(tier->free_volumes.size() == static_cast<size_t>(tier->allocated_count) &&
+           "All volumes must be back in the pool when it is destroyed.");
+
+    for (InfiniTamDriver *volume : tier->free_volumes) {
+      delete volume;
+    }
+  }
+}
+
+InfiniTamDriver* InstanceVolumePool::State::Allocate(int tier_idx) {
+  Tier &tier = *tiers[tier_idx];
+
+  // If we're over budget, make room by dropping idle volumes from the other tiers, starting with
+  // the largest ones.
+  for (int other_idx = static_cast<int>(tiers.size()) - 1;
+       other_idx >= 0 && allocated_bytes + tier.volume_bytes > budget_bytes;
+       --other_idx) {
+    Tier &other = *tiers[other_idx];
+    while (other_idx != tier_idx &&
+           ! other.free_volumes.empty() &&
+           allocated_bytes + tier.volume_bytes > budget_bytes) {
+      delete other.free_volumes.back();
+      other.free_volumes.pop_back();
+      other.allocated_count--;
+      allocated_bytes -= other.volume_bytes;
+    }
+  }
+
+  if (allocated_bytes + tier.volume_bytes > budget_bytes) {
+    return nullptr;
+  }
+
+  tier.allocated_count++;
+  allocated_bytes += tier.volume_bytes;
+  InfiniTamDriver *volume = new InfiniTamDriver(&tier.settings,
+                                                calib,
+                                                img_size,
+                                                img_size,
+                                                voxel_decay_params,
+                                                use_depth_weighting);
+  if (use_cpu_raycaster) {
+    volume->EnableCpuRaycaster();
+  }
+  return volume;
+}
+
+}  // namespace reconstruction
+}  // namespace instreclib
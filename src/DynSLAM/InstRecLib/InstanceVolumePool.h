@@ -0,0 +1,156 @@
+#ifndef INSTRECLIB_INSTANCEVOLUMEPOOL_H
+#define INSTRECLIB_INSTANCEVOLUMEPOOL_H
+
+#include <memory>
+#include <vector>
+
+#include "../InfiniTamDriver.h"
+
+namespace instreclib {
+namespace reconstruction {
+
+/// \brief Default memory budget of the instance volume pool, expressed as the number of full-size
+///        instance volumes it could hold.
+const int kDefaultInstanceVolumePoolSize = 8;
+
+/// \brief Manages the InfiniTAM instances used for reconstructing individual objects.
+///
+/// Allocating a voxel block array and hash table for every new track (and freeing it again once
+/// the track gets pruned) leads to large allocation spikes when many objects enter the view at the
+/// same time. Instead, volumes are allocated once, handed out to tracks, and reset and returned to
+/// the pool once the last reference to them goes away.
+///
+/// Volumes come in several size tiers, differing in the size of their voxel block array, so that
+/// small or distant objects don't need to reserve as much memory as, e.g., a bus right next to the
+/// camera. The total size of all allocated volumes is bounded by a memory budget, which accounts
+/// for everything a volume allocates, and not just its voxel blocks.
+///
+/// Volumes are handed out as regular shared pointers with a custom deleter, so tracks need not be
+/// aware of the pool. The pool's internal state is shared with the deleters, so it is safe to
+/// destroy the pool before the last of its volumes is released.
+///
+/// \note The size of InfiniTAM's hash table is a compile-time constant, so the tiers only scale the
+/// voxel block array. For the smaller tiers, the hash table is as large as the block array or
+/// larger, so they save much less memory than their block count suggests. 'EstimateVolumeBytes'
+/// accounts for this.
+class InstanceVolumePool {
+ public:
+  /// \brief Sets up a pool whose tiers have the given voxel block counts, in increasing order.
+  /// No volumes are allocated until either 'Preallocate' or 'Acquire' are called.
+  /// \param budget_bytes The maximum total memory used by all the volumes, as estimated by
+  ///                     'EstimateVolumeBytes'.
+  /// \param use_cpu_raycaster Whether the volumes should render their previews on the CPU.
+  InstanceVolumePool(const ITMLibSettings &settings,
+                     const ITMRGBDCalib *calib,
+                     const Vector2i &img_size,
+                     const dynslam::VoxelDecayParams &voxel_decay_params,
+                     bool use_depth_weighting,
+                     const std::vector<long> &tier_block_counts,
+                     size_t budget_bytes,
+                     bool use_cpu_raycaster = false);
+
+  /// \brief Estimates the host and device memory used by a volume with the given settings: its
+  ///        voxel block array, hash table, and the buffers InfiniTAM allocates for rendering and
+  ///        tracking.
+  static size_t EstimateVolumeBytes(const ITMLibSettings &settings,
+                                    const Vector2i &img_size,
+                                    bool use_cpu_raycaster);
+
+  InstanceVolumePool(const InstanceVolumePool&) = delete;
+  InstanceVolumePool& operator=(const InstanceVolumePool&) = delete;
+
+  /// \brief Allocates up to 'count' volumes from the specified tier, so that no (expensive)
+  ///        allocations need to be performed while processing frames.
+  void Preallocate(int tier, int count);
+
+  /// \brief Returns a clean volume from the given tier, allocating it if needed, or nullptr if
+  ///        the memory budget does not allow it. The volume returns to the pool once its last
+  ///        reference is released.
+  /// \param allow_allocation If false, only volumes which are already allocated are handed out.
+  std::shared_ptr<dynslam::drivers::InfiniTamDriver> Acquire(int tier,
+                                                             bool allow_allocation = true);
+
+  /// \brief Returns the smallest tier whose volumes can hold the given number of blocks, or the
+  ///        largest tier if none of them can.
+  int FindTier(long block_count) const;
+
+  /// \brief Returns the tier of the given volume, which must have been allocated by this pool.
+  int GetTier(const dynslam::drivers::InfiniTamDriver &volume) const;
+
+  int GetTierCount() const { return static_cast<int>(state_->tiers.size()); }
+
+  long GetTierBlockCount(int tier) const { return state_->tiers[tier]->block_count; }
+
+  /// \brief The memory used by every volume of the given tier.
+  size_t GetVolumeBytes(int tier) const { return state_->tiers[tier]->volume_bytes; }
+
+  float GetVoxelSize() const { return state_->tiers[0]->settings.sceneParams.voxelSize; }
+
+  /// \brief The maximum total memory used by all the volumes.
+  size_t GetBudgetBytes() const { return state_->budget_bytes; }
+
+  /// \brief The memory used by all allocated volumes, both free and in use.
+  size_t GetAllocatedBytes() const { return state_->allocated_bytes; }
+
+  /// \brief The number of volumes currently used by tracks.
+  int GetInUseCount() const;
+
+ private:
+  struct Tier {
+    /// The InfiniTAM engine only keeps a pointer to its settings, so we own them here.
+    ITMLibSettings settings;
+    long block_count;
+    size_t volume_bytes;
+    int allocated_count;
+    std::vector<dynslam::drivers::InfiniTamDriver*> free_volumes;
+
+    Tier(const ITMLibSettings &settings,
+         long block_count,
+         const Vector2i &img_size,
+         bool use_cpu_raycaster)
+        : settings(settings), block_count(block_count), volume_bytes(0), allocated_count(0) {
+      this->settings.sdfLocalBlockNum = block_count;
+      volume_bytes = EstimateVolumeBytes(this->settings, img_size, use_cpu_raycaster);
+    }
+  };
+
+  /// \brief Everything the pool's volumes need, which must outlive all of them.
+  struct State {
+    const ITMRGBDCalib *calib;
+    Vector2i img_size;
+    dynslam::VoxelDecayParams voxel_decay_params;
+    bool use_depth_weighting;
+    bool use_cpu_raycaster;
+    size_t budget_bytes;
+    size_t allocated_bytes;
+    /// Owned through pointers, since the volumes point to the tiers' settings.
+    std::vector<std::unique_ptr<Tier>> tiers;
+
+    State(const ITMRGBDCalib *calib,
+          const Vector2i &img_size,
+          const dynslam::VoxelDecayParams &voxel_decay_params,
+          bool use_depth_weighting,
+          bool use_cpu_raycaster,
+          size_t budget_bytes)
+        : calib(calib),
+          img_size(img_size),
+          voxel_decay_params(voxel_decay_params),
+          use_depth_weighting(use_depth_weighting),
+          use_cpu_raycaster(use_cpu_raycaster),
+          budget_bytes(budget_bytes),
+          allocated_bytes(0) {}
+
+    ~State();
+
+    /// \brief Allocates a new volume from the given tier, if the budget allows it, possibly
+    ///        releasing unused volumes from other tiers to make room.
+    dynslam::drivers::InfiniTamDriver* Allocate(int tier);
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace reconstruction
+}  // namespace instreclib
+
+#endif  // INSTRECLIB_INSTANCEVOLUMEPOOL_H
@@ -0,0 +1,93 @@
+#include "OffloadedReconstructionStore.h"
+
+#include <cstdio>
+
+#include "../Utils.h"
+#include "../VoxelBlockCodec.h"
+
+namespace instreclib {
+namespace reconstruction {
+
+using namespace std;
+using namespace dynslam::utils;
+
+OffloadedReconstructionStore::~OffloadedReconstructionStore() {
+  while (! entries_.empty()) {
+    Remove(entries_.begin());
+  }
+}
+
+void OffloadedReconstructionStore::Put(int track_id, OffloadedReconstruction &&reconstruction) {
+  if (Has(track_id)) {
+    Discard(track_id);
+  }
+
+  reconstruction.encoded_size_bytes = reconstruction.data.size();
+  raw_bytes_ += reconstruction.raw_size_bytes;
+
+  if (IsSpilling()) {
+    if (system(Format("mkdir -p '%s'", spill_dir_.c_str()).c_str())) {
+      throw runtime_error(Format("Could not create directory: %s", spill_dir_.c_str()));
+    }
+
+    dynslam::drivers::WriteBytes(GetSpillPath(track_id), reconstruction.data);
+    spilled_bytes_ += reconstruction.encoded_size_bytes;
+    reconstruction.data.clear();
+    reconstruction.data.shrink_to_fit();
+  }
+  else {
+    resident_bytes_ += reconstruction.encoded_size_bytes;
+  }
+
+  entries_.emplace(track_id, std::move(reconstruction));
+}
+
+OffloadedReconstruction OffloadedReconstructionStore::Take(int track_id) {
+  auto it = entries_.find(track_id);
+  if (it == entries_.end()) {
+    throw runtime_error(Format("No offloaded reconstruction for track %d.", track_id));
+  }
+
+  OffloadedReconstruction reconstruction = std::move(it->second);
+  if (IsSpilling()) {
+    dynslam::drivers::ReadBytes(GetSpillPath(track_id), reconstruction.data);
+  }
+
+  Remove(it);
+  return reconstruction;
+}
+
+void OffloadedReconstructionStore::Discard(int track_id) {
+  auto it = entries_.find(track_id);
+  if (it != entries_.end()) {
+    Remove(it);
+  }
+}
+
+vector<int> OffloadedReconstructionStore::GetTrackIds() const {
+  vector<int> ids;
+  for (const auto &pair : entries_) {
+    ids.push_back(pair.first);
+  }
+  return ids;
+}
+
+string OffloadedReconstructionStore::GetSpillPath(int track_id) const {
+  return Format("%s/instance-%06d.vblocks", spill_dir_.c_str(), track_id);
+}
+
+void OffloadedReconstructionStore::Remove(EntryMap::iterator it) {
+  raw_bytes_ -= it->second.raw_size_bytes;
+  if (IsSpilling()) {
+    spilled_bytes_ -= it->second.encoded_size_bytes;
+    remove(GetSpillPath(it->first).c_str());
+  }
+  else {
+    resident_bytes_ -= it->second.encoded_size_bytes;
+  }
+
+  entries_.erase(it);
+}
+
+}  // namespace reconstruction
+}  // namespace instreclib
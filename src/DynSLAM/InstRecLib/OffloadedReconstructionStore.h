@@ -0,0 +1,117 @@
+#ifndef INSTRECLIB_OFFLOADEDRECONSTRUCTIONSTORE_H
+#define INSTRECLIB_OFFLOADEDRECONSTRUCTIONSTORE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Eigen/StdVector>
+
+#include "../Defines.h"
+#include "../VoxelBlockCodec.h"
+
+namespace instreclib {
+namespace reconstruction {
+
+/// \brief Controls when and where idle instance reconstructions get offloaded.
+struct OffloadParams {
+  /// \brief Reconstructions of tracks which have not been seen for this many frames are compressed
+  ///        and moved out of their volume. Zero disables offloading.
+  int idle_frames;
+  /// \brief Directory where offloaded reconstructions are written. If empty, they are kept in
+  ///        (host) memory instead.
+  std::string spill_dir;
+  /// \brief The format offloaded reconstructions are stored in.
+  dynslam::drivers::VoxelFormat voxel_format;
+
+  OffloadParams(int idle_frames,
+                const std::string &spill_dir,
+                dynslam::drivers::VoxelFormat voxel_format = dynslam::drivers::VoxelFormat::kFull)
+      : idle_frames(idle_frames), spill_dir(spill_dir), voxel_format(voxel_format) {}
+
+  static OffloadParams Disabled() {
+    return OffloadParams(0, "");
+  }
+};
+
+/// \brief A compressed snapshot of an instance reconstruction, which no longer occupies a volume.
+struct OffloadedReconstruction {
+  /// \brief The volume's pose at the time it was offloaded.
+  Eigen::Matrix4f pose;
+  /// \brief The number of frames in the track which had been processed when it was offloaded.
+  size_t processed_frame_count;
+  size_t block_count;
+  size_t raw_size_bytes;
+  /// \brief The encoded voxel blocks. Empty if the reconstruction was spilled to disk.
+  std::vector<uint8_t> data;
+  size_t encoded_size_bytes;
+
+  SUPPORT_EIGEN_FIELDS;
+};
+
+/// \brief Holds the reconstructions of idle tracks, either in memory or in a spill directory, until
+///        their tracks become active again or get pruned.
+class OffloadedReconstructionStore {
+ public:
+  explicit OffloadedReconstructionStore(const std::string &spill_dir)
+      : spill_dir_(spill_dir), resident_bytes_(0), spilled_bytes_(0), raw_bytes_(0) {}
+
+  OffloadedReconstructionStore(const OffloadedReconstructionStore&) = delete;
+  OffloadedReconstructionStore& operator=(const OffloadedReconstructionStore&) = delete;
+
+  virtual ~OffloadedReconstructionStore();
+
+  bool Has(int track_id) const {
+    return entries_.find(track_id) != entries_.cend();
+  }
+
+  /// \brief Returns the stored reconstruction's metadata. Its data may be on disk.
+  const OffloadedReconstruction& Peek(int track_id) const {
+    return entries_.at(track_id);
+  }
+
+  /// \brief Stores the reconstruction, spilling its data to disk if applicable.
+  void Put(int track_id, OffloadedReconstruction &&reconstruction);
+
+  /// \brief Removes the reconstruction from the store and returns it, with its data loaded.
+  OffloadedReconstruction Take(int track_id);
+
+  /// \brief Removes the reconstruction from the store, without loading it.
+  void Discard(int track_id);
+
+  std::vector<int> GetTrackIds() const;
+
+  /// \brief The memory used by reconstructions held in memory.
+  size_t GetResidentBytes() const { return resident_bytes_; }
+
+  /// \brief The disk space used by reconstructions spilled to the disk.
+  size_t GetSpilledBytes() const { return spilled_bytes_; }
+
+  /// \brief The memory all stored reconstructions would have taken up in uncompressed form.
+  size_t GetRawBytes() const { return raw_bytes_; }
+
+ private:
+  using EntryMap = std::map<int, OffloadedReconstruction, std::less<int>,
+                            Eigen::aligned_allocator<std::pair<const int, OffloadedReconstruction>>>;
+
+  std::string spill_dir_;
+  EntryMap entries_;
+  size_t resident_bytes_;
+  size_t spilled_bytes_;
+  size_t raw_bytes_;
+
+  bool IsSpilling() const {
+    return ! spill_dir_.empty();
+  }
+
+  std::string GetSpillPath(int track_id) const;
+
+  /// \brief Removes the entry from the bookkeeping and deletes its spill file, if any.
+  void Remove(EntryMap::iterator it);
+};
+
+}  // namespace reconstruction
+}  // namespace instreclib
+
+#endif  // INSTRECLIB_OFFLOADEDRECONSTRUCTIONSTORE_H
@@ -124,20 +124,20 @@ vector<InstanceDetection> PrecomputedSegmentationProvider::ReadInstanceInfo(
   //    dynslam::utils::Tic("Read mask");
       uint8_t *mask_pixels = ReadMask(mask_in, bounding_box.GetWidth(), bounding_box.GetHeight());
   //    dynslam::utils::Toc();
-      cv::Mat1b *mask_cv_mat = new cv::Mat1b(
-          bounding_box.GetHeight(),
-          bounding_box.GetWidth(),
-          mask_pixels
-      );
+      // The mask packs the pixels into its own (bit-level) storage.
+      Mask base_mask(bounding_box, mask_pixels);
+      delete[] mask_pixels;
 
       bounding_box.r.x0 = static_cast<int>(round(bounding_box.r.x0 / input_scale_));
       bounding_box.r.y0 = static_cast<int>(round(bounding_box.r.y0 / input_scale_));
       bounding_box.r.x1 = static_cast<int>(round(bounding_box.r.x1 / input_scale_));
       bounding_box.r.y1 = static_cast<int>(round(bounding_box.r.y1 / input_scale_));
+      base_mask.GetBoundingBox() = bounding_box;
 
-      auto copy_mask = make_shared<Mask>(bounding_box, mask_cv_mat);
-      auto delete_mask = make_shared<Mask>(*copy_mask);
-      auto conservative_mask = make_shared<Mask>(*copy_mask);
+      // All three masks are views sharing the same pixel data, so these copies are cheap.
+      auto copy_mask = make_shared<Mask>(base_mask);
+      auto delete_mask = make_shared<Mask>(base_mask);
+      auto conservative_mask = make_shared<Mask>(base_mask);
   //    dynslam::utils::Toc();
 
       copy_mask->Rescale(kCopyMaskRescaleFactor);
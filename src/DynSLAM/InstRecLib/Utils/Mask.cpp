@@ -7,15 +7,50 @@ namespace utils {
 
 using namespace std;
 
-void Mask::Set(const Mask &rhs) {
-  // Handle the bounding box
-  this->bounding_box_ = rhs.bounding_box_;
+namespace {
 
-  // Handle the detailed pixel-wise mask
-  if (nullptr != mask_data_) {
-    delete mask_data_;
+inline int Popcount(uint64_t word) {
+  return __builtin_popcountll(word);
+}
+
+/// \brief Copies 'count' bits starting at (possibly negative) bit 'start' of a padded row into
+///        'out'. Bits before the row start or past its end read as zero.
+void ExtractBits(const uint64_t *row, int words_per_row, int start, int word_count, uint64_t *out) {
+  const int kBits = MaskBits::kBitsPerWord;
+  for (int i = 0; i < word_count; ++i) {
+    int bit = start + i * kBits;
+    // Floor division, so that negative offsets work as expected.
+    int word_idx = (bit >= 0) ? bit / kBits : -((-bit + kBits - 1) / kBits);
+    int shift = bit - word_idx * kBits;
+
+    uint64_t lo = (word_idx >= 0 && word_idx < words_per_row) ? row[word_idx] : 0ULL;
+    uint64_t hi = (word_idx + 1 >= 0 && word_idx + 1 < words_per_row) ? row[word_idx + 1] : 0ULL;
+    out[i] = (shift == 0) ? lo : ((lo >> shift) | (hi << (kBits - shift)));
+  }
+}
+
+}
+
+MaskBits::MaskBits(const uint8_t *pixels, int width, int height)
+    : width_(width),
+      height_(height),
+      words_per_row_((width + kBitsPerWord - 1) / kBitsPerWord),
+      area_(0),
+      words_(static_cast<size_t>(words_per_row_) * height, 0ULL)
+{
+  for (int row = 0; row < height; ++row) {
+    uint64_t *row_words = words_.data() + row * words_per_row_;
+    const uint8_t *row_pixels = pixels + row * width;
+    for (int col = 0; col < width; ++col) {
+      if (row_pixels[col] != 0) {
+        row_words[col / kBitsPerWord] |= (1ULL << (col % kBitsPerWord));
+      }
+    }
+  }
+
+  for (uint64_t word : words_) {
+    area_ += Popcount(word);
   }
-  mask_data_ = new cv::Mat1b(*rhs.mask_data_);
 }
 
 void Mask::Rescale(float amount) {
@@ -33,16 +68,87 @@ void Mask::Rescale(float amount) {
   int new_x1 = bounding_box_.r.x1 + static_cast<int>(ceil(delta_width / 2.0));
   int new_y1 = bounding_box_.r.y1 + static_cast<int>(ceil(delta_height / 2.0));
 
-  cv::Size new_size(new_width, new_height);
-  cv::Mat1b *tmp = new cv::Mat1b(new_size);
-  cv::resize(*mask_data_, *tmp, tmp->size());
-
+  // The pixel data stays untouched; lookups get mapped onto it based on the new box size.
   bounding_box_ = BoundingBox(new_x0, new_y0, new_x1, new_y1);
   assert(bounding_box_.GetWidth() == new_width);
   assert(bounding_box_.GetHeight() == new_height);
+}
+
+long Mask::GetArea() const {
+  if (IsIdentityView()) {
+    return bits_->GetArea();
+  }
+
+  long area = 0;
+  for (int row = 0; row < GetHeight(); ++row) {
+    for (int col = 0; col < GetWidth(); ++col) {
+      if (ContainsLocal(row, col)) {
+        area++;
+      }
+    }
+  }
+  return area;
+}
+
+void Mask::GetRowBits(int y, int x0, int word_count, uint64_t *out) const {
+  const BoundingBox &bbox = bounding_box_;
+  if (y < bbox.r.y0 || y > bbox.r.y1) {
+    memset(out, 0, word_count * sizeof(uint64_t));
+    return;
+  }
+
+  int row = y - bbox.r.y0;
+  if (IsIdentityView()) {
+    // Fast path: shift whole words out of the packed data.
+    ExtractBits(bits_->GetRow(row), bits_->GetWordsPerRow(), x0 - bbox.r.x0, word_count, out);
+    return;
+  }
+
+  memset(out, 0, word_count * sizeof(uint64_t));
+  int first = max(x0, bbox.r.x0);
+  int last = min(x0 + word_count * MaskBits::kBitsPerWord - 1, bbox.r.x1);
+  for (int x = first; x <= last; ++x) {
+    if (ContainsLocal(row, x - bbox.r.x0)) {
+      int bit = x - x0;
+      out[bit / MaskBits::kBitsPerWord] |= (1ULL << (bit % MaskBits::kBitsPerWord));
+    }
+  }
+}
+
+long Mask::IntersectionArea(const Mask &other) const {
+  if (! bounding_box_.Intersects(other.bounding_box_)) {
+    return 0;
+  }
+
+  BoundingBox overlap = bounding_box_.IntersectWith(other.bounding_box_);
+
+  // Process the overlap in fixed-size chunks, so we never need to allocate.
+  const int kChunkWords = 16;
+  const int kChunkPixels = kChunkWords * MaskBits::kBitsPerWord;
+  uint64_t mine[kChunkWords];
+  uint64_t theirs[kChunkWords];
+
+  long area = 0;
+  for (int y = overlap.r.y0; y <= overlap.r.y1; ++y) {
+    for (int x0 = overlap.r.x0; x0 <= overlap.r.x1; x0 += kChunkPixels) {
+      int pixels = min(kChunkPixels, overlap.r.x1 - x0 + 1);
+      int words = (pixels + MaskBits::kBitsPerWord - 1) / MaskBits::kBitsPerWord;
+      GetRowBits(y, x0, words, mine);
+      other.GetRowBits(y, x0, words, theirs);
+
+      // Ignore whatever lies past the end of the overlap in the last word.
+      int tail_bits = pixels % MaskBits::kBitsPerWord;
+      if (tail_bits != 0) {
+        mine[words - 1] &= (1ULL << tail_bits) - 1;
+      }
+
+      for (int i = 0; i < words; ++i) {
+        area += Popcount(mine[i] & theirs[i]);
+      }
+    }
+  }
 
-  delete mask_data_;
-  mask_data_ = tmp;
+  return area;
 }
 
 }   // namespace utils
@@ -3,9 +3,13 @@
 #ifndef INSTRECLIB_MASK_H
 #define INSTRECLIB_MASK_H
 
+#include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <vector>
 
+// Not needed by the mask itself anymore, but many users rely on getting OpenCV through this header.
 #include <opencv/cv.h>
 #include <opencv/highgui.h>
 
@@ -14,27 +18,71 @@
 namespace instreclib {
 namespace utils {
 
+/// \brief Immutable, bit-packed 2D binary image. Every row starts on a fresh 64-bit word, and the
+///        padding bits at the end of each row are always zero.
+/// Shared between a mask and all of its rescaled views, so it never needs to be copied.
+class MaskBits {
+ public:
+  static const int kBitsPerWord = 64;
+
+  /// \brief Packs a row-major array of pixels, where every non-zero value is considered set.
+  MaskBits(const uint8_t *pixels, int width, int height);
+
+  int GetWidth() const { return width_; }
+
+  int GetHeight() const { return height_; }
+
+  int GetWordsPerRow() const { return words_per_row_; }
+
+  const uint64_t *GetRow(int row) const {
+    assert(row >= 0 && row < height_);
+    return words_.data() + row * words_per_row_;
+  }
+
+  bool Get(int row, int col) const {
+    assert(col >= 0 && col < width_);
+    return ((GetRow(row)[col / kBitsPerWord] >> (col % kBitsPerWord)) & 1ULL) != 0;
+  }
+
+  /// \brief The number of set pixels. Precomputed, since the data never changes.
+  long GetArea() const { return area_; }
+
+  size_t GetSizeBytes() const { return words_.size() * sizeof(uint64_t); }
+
+ private:
+  int width_;
+  int height_;
+  int words_per_row_;
+  long area_;
+  std::vector<uint64_t> words_;
+};
+
 // TODO-LOW(andrei): CUDA methods for computing mask intersection and the overlap area.
 //
 /// \brief An image mask consisting of a bounding box and a detailed boolean mask array.
 /// Used to model semantic segmentation results.
 /// A bounding box's (0, 0) is the top-left, in accordance with the rest of InfiniTAM.
+///
+/// The pixel data is stored once, one bit per pixel, and is shared by all copies of a mask.
+/// Rescaling a mask only changes its bounding box: pixel queries are mapped back onto the original
+/// data using nearest-neighbor lookups, so masks are cheap to copy and rescale.
 class Mask {
  public:
-  /// \brief Initializes this object, taking ownership of the given mask*.
-  Mask(const BoundingBox& bounding_box, cv::Mat1b* mask)
-      : bounding_box_(bounding_box), mask_data_(mask) {}
+  /// \brief Initializes this object by packing the given row-major pixel data, whose dimensions
+  ///        are those of the bounding box. Does not take ownership of 'pixels'.
+  Mask(const BoundingBox& bounding_box, const uint8_t *pixels)
+      : bounding_box_(bounding_box),
+        bits_(std::make_shared<MaskBits>(pixels,
+                                         bounding_box.GetWidth(),
+                                         bounding_box.GetHeight())) {}
 
-  /// \brief Initializes this object, copying the other's data.
-  Mask(const Mask& other) { this->Set(other); }
+  /// \brief Initializes this object, sharing the other's (immutable) pixel data.
+  Mask(const Mask& other) = default;
 
-  /// \brief Assigns to this object, copying the other's data.
-  Mask& operator=(const Mask& other) {
-    this->Set(other);
-    return *this;
-  }
+  /// \brief Assigns to this object, sharing the other's (immutable) pixel data.
+  Mask& operator=(const Mask& other) = default;
 
-  virtual ~Mask() { delete mask_data_; }
+  virtual ~Mask() = default;
 
   int GetWidth() const { return bounding_box_.GetWidth(); }
 
@@ -44,33 +92,62 @@ class Mask {
 
   BoundingBox& GetBoundingBox() { return bounding_box_; }
 
-  const cv::Mat* GetData() const { return mask_data_; }
+  /// \brief Returns the underlying pixel data, which may have a different size than the mask if
+  ///        the mask was rescaled.
+  const MaskBits& GetBits() const { return *bits_; }
+
+  /// \brief Checks whether the given pixel, expressed in bounding box coordinates, is set.
+  bool ContainsLocal(int row, int col) const {
+    assert(col >= 0 && row >= 0 && col < GetWidth() && row < GetHeight());
+    return bits_->Get(SourceRow(row), SourceCol(col));
+  }
 
+  /// \brief Checks whether the given pixel, expressed in frame coordinates, is set.
   bool ContainsPoint(int x, int y) const {
     if (! bounding_box_.ContainsPoint(x, y)) {
       return false;
     }
 
-    int x_loc = x - bounding_box_.r.x0;
-    int y_loc = y - bounding_box_.r.y0;
-    assert(x_loc >= 0 && y_loc >= 0 && x_loc < bounding_box_.GetWidth() && y_loc < bounding_box_.GetHeight());
-
-    return mask_data_->at<uchar>(y_loc, x_loc) == 1;
+    return ContainsLocal(y - bounding_box_.r.y0, x - bounding_box_.r.x0);
   }
 
   /// \brief Resizes the mask and its bounding box, maintaining its aspect ratio.
   /// \param amount A value greater than zero. Values smaller than one cause the mask to shrink in
   /// size, while those greater than one increase its size.
+  /// \note This does not touch the pixel data, and never allocates.
   void Rescale(float amount);
 
+  /// \brief Returns the number of set pixels in the mask.
+  long GetArea() const;
+
+  /// \brief Returns the number of pixels set in both this and the other mask.
+  long IntersectionArea(const Mask& other) const;
+
+  /// \brief Packs the mask's values from frame row 'y', starting at column 'x0', into 'word_count'
+  ///        64-bit words. Pixels outside the mask are reported as unset.
+  void GetRowBits(int y, int x0, int word_count, uint64_t *out) const;
+
  private:
   BoundingBox bounding_box_;
 
   /// 2D binary matrix indicating the instance's occupancy pixels, within the bounding box.
-  /// The mask has the same dimensions as the bounding box.
-  cv::Mat1b *mask_data_ = nullptr;
+  /// If the mask was rescaled, this has the dimensions of the *original* bounding box.
+  std::shared_ptr<const MaskBits> bits_;
+
+  bool IsIdentityView() const {
+    return GetWidth() == bits_->GetWidth() && GetHeight() == bits_->GetHeight();
+  }
 
-  void Set(const Mask& rhs);
+  /// \brief Maps a view column onto the nearest column in the source data (pixel centers aligned).
+  int SourceCol(int col) const {
+    int src = static_cast<int>((2L * col + 1) * bits_->GetWidth() / (2L * GetWidth()));
+    return std::min(src, bits_->GetWidth() - 1);
+  }
+
+  int SourceRow(int row) const {
+    int src = static_cast<int>((2L * row + 1) * bits_->GetHeight() / (2L * GetHeight()));
+    return std::min(src, bits_->GetHeight() - 1);
+  }
 };
 
 }   // namespace utils
@@ -0,0 +1,245 @@
+#include "PlanarVoxelMap.h"
+
+#include <cmath>
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+namespace {
+
+/// \brief Maps InfiniTAM's linear voxel indices to Morton indices.
+struct MortonTable {
+  int linear_to_morton[SDF_BLOCK_SIZE3];
+
+  MortonTable() {
+    for (int z = 0; z < SDF_BLOCK_SIZE; ++z) {
+      for (int y = 0; y < SDF_BLOCK_SIZE; ++y) {
+        for (int x = 0; x < SDF_BLOCK_SIZE; ++x) {
+          linear_to_morton[x + y * SDF_BLOCK_SIZE + z * SDF_BLOCK_SIZE * SDF_BLOCK_SIZE] =
+              GetMortonVoxelIndex(x, y, z);
+        }
+      }
+    }
+  }
+};
+
+const MortonTable kMortonTable;
+
+/// \brief Floor division, so that blocks don't straddle the origin.
+int ToBlockCoord(int voxel_coord) {
+  return (voxel_coord >= 0) ? voxel_coord / SDF_BLOCK_SIZE
+                            : -((-voxel_coord + SDF_BLOCK_SIZE - 1) / SDF_BLOCK_SIZE);
+}
+
+}
+
+void ToPlanarBlock(const VoxelBlock &block, PlanarVoxelBlock &out) {
+  out.pos = block.pos;
+  for (int i = 0; i < SDF_BLOCK_SIZE3; ++i) {
+    const ITMVoxel &voxel = block.voxels[i];
+    int m = kMortonTable.linear_to_morton[i];
+    out.sdf[m] = voxel.sdf;
+    out.w_depth[m] = voxel.w_depth;
+    out.clr[m] = voxel.clr;
+    out.w_color[m] = voxel.w_color;
+  }
+}
+
+void FromPlanarBlock(const PlanarVoxelBlock &block, VoxelBlock &out) {
+  out.pos = block.pos;
+  for (int i = 0; i < SDF_BLOCK_SIZE3; ++i) {
+    ITMVoxel &voxel = out.voxels[i];
+    int m = kMortonTable.linear_to_morton[i];
+    voxel.sdf = block.sdf[m];
+    voxel.w_depth = block.w_depth[m];
+    voxel.clr = block.clr[m];
+    voxel.w_color = block.w_color[m];
+  }
+}
+
+void PlanarVoxelMap::Update(const HostVoxelBlockMap &block_map, const vector<int> &dirty_entries) {
+  for (int entry_id : dirty_entries) {
+    // The block may have been removed since, e.g., by decay.
+    if (block_map.GetEntry(entry_id).ptr >= 0) {
+      Put(block_map, entry_id);
+    }
+  }
+}
+
+void PlanarVoxelMap::Apply(const vector<Vector3s> &removed, const vector<VoxelBlock> &written) {
+  for (const Vector3s &pos : removed) {
+    auto it = index_.find(PackBlockPos(pos));
+    if (it != index_.end()) {
+      Remove(it->second);
+    }
+  }
+
+  for (const VoxelBlock &block : written) {
+    Put(block);
+  }
+}
+
+void PlanarVoxelMap::Rebuild(const HostVoxelBlockMap &block_map) {
+  blocks_.clear();
+  index_.clear();
+  for (int entry_id : block_map.GetAllocatedEntries()) {
+    Put(block_map, entry_id);
+  }
+}
+
+const PlanarVoxelBlock *PlanarVoxelMap::FindBlock(const Vector3s &block_pos,
+                                                  LookupCache *cache) const {
+  int64_t key = PackBlockPos(block_pos);
+  int slot = 0;
+  if (nullptr != cache) {
+    // The same spatial hash as InfiniTAM's, which spreads out neighboring blocks well.
+    slot = static_cast<int>(((block_pos.x * 73856093u) ^ (block_pos.y * 19349669u) ^
+                             (block_pos.z * 83492791u)) & (LookupCache::kSlotCount - 1));
+    if (cache->keys_[slot] == key) {
+      return cache->blocks_[slot];
+    }
+  }
+
+  auto it = index_.find(key);
+  const PlanarVoxelBlock *block = (it == index_.end()) ? nullptr : &blocks_[it->second];
+  if (nullptr != cache) {
+    cache->keys_[slot] = key;
+    cache->blocks_[slot] = block;
+  }
+  return block;
+}
+
+const PlanarVoxelBlock *PlanarVoxelMap::FindVoxel(const Eigen::Vector3i &voxel_pos,
+                                                  int &morton_idx,
+                                                  LookupCache *cache) const {
+  Vector3s block_pos(static_cast<short>(ToBlockCoord(voxel_pos(0))),
+                     static_cast<short>(ToBlockCoord(voxel_pos(1))),
+                     static_cast<short>(ToBlockCoord(voxel_pos(2))));
+  morton_idx = GetMortonVoxelIndex(voxel_pos(0) - block_pos.x * SDF_BLOCK_SIZE,
+                                   voxel_pos(1) - block_pos.y * SDF_BLOCK_SIZE,
+                                   voxel_pos(2) - block_pos.z * SDF_BLOCK_SIZE);
+  return FindBlock(block_pos, cache);
+}
+
+bool PlanarVoxelMap::ReadSdf(const Eigen::Vector3i &voxel_pos,
+                             float &out,
+                             LookupCache *cache) const {
+  int m;
+  const PlanarVoxelBlock *block = FindVoxel(voxel_pos, m, cache);
+  if (nullptr == block || block->w_depth[m] == 0) {
+    return false;
+  }
+
+  out = ITMVoxel::SDF_valueToFloat(block->sdf[m]);
+  return true;
+}
+
+bool PlanarVoxelMap::ReadColor(const Eigen::Vector3i &voxel_pos,
+                               Vector3u &out,
+                               LookupCache *cache) const {
+  int m;
+  const PlanarVoxelBlock *block = FindVoxel(voxel_pos, m, cache);
+  if (nullptr == block || block->w_color[m] == 0) {
+    return false;
+  }
+
+  out = block->clr[m];
+  return true;
+}
+
+bool PlanarVoxelMap::GetBounds(Eigen::Vector3f &min_corner, Eigen::Vector3f &max_corner) const {
+  if (blocks_.empty()) {
+    return false;
+  }
+
+  Eigen::Vector3i min_block(blocks_[0].pos.x, blocks_[0].pos.y, blocks_[0].pos.z);
+  Eigen::Vector3i max_block = min_block;
+  for (const PlanarVoxelBlock &block : blocks_) {
+    Eigen::Vector3i pos(block.pos.x, block.pos.y, block.pos.z);
+    min_block = min_block.cwiseMin(pos);
+    max_block = max_block.cwiseMax(pos);
+  }
+
+  min_corner = (min_block * SDF_BLOCK_SIZE).cast<float>();
+  max_corner = ((max_block + Eigen::Vector3i::Ones()) * SDF_BLOCK_SIZE).cast<float>();
+  return true;
+}
+
+bool PlanarVoxelMap::SampleSdf(const Eigen::Vector3f &voxel_point,
+                               float &out,
+                               LookupCache *cache) const {
+  Eigen::Vector3i base(static_cast<int>(floor(voxel_point(0))),
+                       static_cast<int>(floor(voxel_point(1))),
+                       static_cast<int>(floor(voxel_point(2))));
+  Eigen::Vector3f t = voxel_point - base.cast<float>();
+  Vector3s block_pos(static_cast<short>(ToBlockCoord(base(0))),
+                     static_cast<short>(ToBlockCoord(base(1))),
+                     static_cast<short>(ToBlockCoord(base(2))));
+  Eigen::Vector3i local(base(0) - block_pos.x * SDF_BLOCK_SIZE,
+                        base(1) - block_pos.y * SDF_BLOCK_SIZE,
+                        base(2) - block_pos.z * SDF_BLOCK_SIZE);
+
+  float corners[8];
+  if (local.maxCoeff() < SDF_BLOCK_SIZE - 1) {
+    // Common case: all the corners are in the same block, so we only look it up once.
+    const PlanarVoxelBlock *block = FindBlock(block_pos, cache);
+    if (nullptr == block) {
+      return false;
+    }
+    for (int c = 0; c < 8; ++c) {
+      int m = GetMortonVoxelIndex(local(0) + (c & 1), local(1) + ((c >> 1) & 1),
+                                  local(2) + ((c >> 2) & 1));
+      if (block->w_depth[m] == 0) {
+        return false;
+      }
+      corners[c] = ITMVoxel::SDF_valueToFloat(block->sdf[m]);
+    }
+  }
+  else {
+    for (int c = 0; c < 8; ++c) {
+      Eigen::Vector3i offset(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+      if (! ReadSdf(base + offset, corners[c], cache)) {
+        return false;
+      }
+    }
+  }
+
+  float x00 = corners[0] * (1.0f - t(0)) + corners[1] * t(0);
+  float x10 = corners[2] * (1.0f - t(0)) + corners[3] * t(0);
+  float x01 = corners[4] * (1.0f - t(0)) + corners[5] * t(0);
+  float x11 = corners[6] * (1.0f - t(0)) + corners[7] * t(0);
+  float y0 = x00 * (1.0f - t(1)) + x10 * t(1);
+  float y1 = x01 * (1.0f - t(1)) + x11 * t(1);
+  out = y0 * (1.0f - t(2)) + y1 * t(2);
+  return true;
+}
+
+void PlanarVoxelMap::Put(const HostVoxelBlockMap &block_map, int entry_id) {
+  VoxelBlock block;
+  block_map.ReadBlock(entry_id, block);
+  Put(block);
+}
+
+void PlanarVoxelMap::Put(const VoxelBlock &block) {
+  int64_t key = PackBlockPos(block.pos);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    it = index_.emplace(key, blocks_.size()).first;
+    blocks_.emplace_back();
+  }
+  ToPlanarBlock(block, blocks_[it->second]);
+}
+
+void PlanarVoxelMap::Remove(size_t block_idx) {
+  index_.erase(PackBlockPos(blocks_[block_idx].pos));
+  if (block_idx + 1 < blocks_.size()) {
+    blocks_[block_idx] = blocks_.back();
+    index_[PackBlockPos(blocks_[block_idx].pos)] = block_idx;
+  }
+  blocks_.pop_back();
+}
+
+}  // namespace drivers
+}  // namespace dynslam
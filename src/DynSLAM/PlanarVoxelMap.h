@@ -0,0 +1,135 @@
+#ifndef DYNSLAM_PLANARVOXELMAP_H
+#define DYNSLAM_PLANARVOXELMAP_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Returns the Morton (Z-order) index of the voxel at the given coordinates within a block.
+/// Neighboring voxels end up close to each other in memory along all three axes, and not just
+/// along x, which is what InfiniTAM's linear indexing favors.
+inline int GetMortonVoxelIndex(int x, int y, int z) {
+  static_assert(SDF_BLOCK_SIZE == 8, "Morton indexing assumes 8x8x8 voxel blocks.");
+  auto spread = [](int v) { return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4); };
+  return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+/// \brief A voxel block with every voxel field in its own plane, and the voxels within each plane
+///        in Morton order.
+///
+/// Loops which only need the SDF, such as raycasting or surface extraction, touch two bytes per
+/// voxel, instead of the full 'ITMVoxel'.
+struct PlanarVoxelBlock {
+  Vector3s pos;
+  short sdf[SDF_BLOCK_SIZE3];
+  uint8_t w_depth[SDF_BLOCK_SIZE3];
+  Vector3u clr[SDF_BLOCK_SIZE3];
+  uint8_t w_color[SDF_BLOCK_SIZE3];
+};
+
+void ToPlanarBlock(const VoxelBlock &block, PlanarVoxelBlock &out);
+
+void FromPlanarBlock(const PlanarVoxelBlock &block, VoxelBlock &out);
+
+/// \brief A host-side mirror of an InfiniTAM map, using planar voxel blocks, for CPU code which
+///        walks through the map's SDF.
+///
+/// The mirror is kept up to date incrementally, by refreshing the blocks which were fused into, and
+/// applying the blocks added to and removed from the map in other ways, e.g., by decay.
+class PlanarVoxelMap {
+ public:
+  /// \brief Remembers the most recently looked up blocks, including missing ones, so that nearby
+  ///        lookups, e.g., by neighboring rays, can skip the hash table.
+  /// A cache must not be used across changes to the map.
+  class LookupCache {
+   public:
+    LookupCache() {
+      for (int i = 0; i < kSlotCount; ++i) {
+        keys_[i] = kEmptyKey;
+      }
+    }
+
+   private:
+    friend class PlanarVoxelMap;
+
+    static const int kSlotCount = 64;
+    /// \brief Not a valid packed block position, since these only use the lower 48 bits.
+    static const int64_t kEmptyKey = -1;
+
+    int64_t keys_[kSlotCount];
+    const PlanarVoxelBlock *blocks_[kSlotCount];
+  };
+
+  PlanarVoxelMap() = default;
+
+  PlanarVoxelMap(const PlanarVoxelMap&) = delete;
+  PlanarVoxelMap& operator=(const PlanarVoxelMap&) = delete;
+
+  /// \brief Refreshes the given blocks from the map.
+  /// \param dirty_entries Hash entry IDs of the blocks which may have changed.
+  void Update(const HostVoxelBlockMap &block_map, const std::vector<int> &dirty_entries);
+
+  /// \brief Drops the removed blocks, and then copies over the written ones.
+  /// \see HostVoxelBlockMap::GetChanges
+  void Apply(const std::vector<Vector3s> &removed, const std::vector<VoxelBlock> &written);
+
+  /// \brief Copies over every block in the map, discarding the current contents.
+  void Rebuild(const HostVoxelBlockMap &block_map);
+
+  /// \brief Returns null if the block is not in the mirror.
+  const PlanarVoxelBlock *FindBlock(const Vector3s &block_pos, LookupCache *cache = nullptr) const;
+
+  /// \brief Reads the SDF at the given voxel coordinates, normalized to [-1, 1].
+  /// \returns False if the voxel's block is not allocated, or if the voxel was never observed.
+  bool ReadSdf(const Eigen::Vector3i &voxel_pos, float &out, LookupCache *cache = nullptr) const;
+
+  /// \brief Trilinearly interpolates the SDF at the given point, expressed in voxel coordinates.
+  /// \returns False if any of the eight voxels involved is missing or unobserved.
+  bool SampleSdf(const Eigen::Vector3f &voxel_point,
+                 float &out,
+                 LookupCache *cache = nullptr) const;
+
+  /// \brief Reads the color of the voxel at the given voxel coordinates.
+  /// \returns False if the voxel's block is not allocated, or if the voxel has no color yet.
+  bool ReadColor(const Eigen::Vector3i &voxel_pos,
+                 Vector3u &out,
+                 LookupCache *cache = nullptr) const;
+
+  size_t GetBlockCount() const { return blocks_.size(); }
+
+  /// \brief Computes the bounding box of the map, in voxel coordinates.
+  /// \returns False if the map is empty.
+  bool GetBounds(Eigen::Vector3f &min_corner, Eigen::Vector3f &max_corner) const;
+
+  size_t GetMemoryBytes() const { return blocks_.capacity() * sizeof(PlanarVoxelBlock); }
+
+ private:
+  std::vector<PlanarVoxelBlock> blocks_;
+  /// \brief Indices into 'blocks_', keyed by packed block position.
+  std::unordered_map<int64_t, size_t> index_;
+
+  void Put(const HostVoxelBlockMap &block_map, int entry_id);
+
+  void Put(const VoxelBlock &block);
+
+  /// \brief Returns the block containing the given voxel, or null if there is none.
+  /// \param morton_idx Set to the voxel's index within the block.
+  const PlanarVoxelBlock *FindVoxel(const Eigen::Vector3i &voxel_pos,
+                                    int &morton_idx,
+                                    LookupCache *cache) const;
+
+  /// \brief Removes the block at the given index, filling the gap with the last block.
+  void Remove(size_t block_idx);
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_PLANARVOXELMAP_H
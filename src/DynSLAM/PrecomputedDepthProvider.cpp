@@ -51,8 +51,9 @@ void PrecomputedDepthProvider::ReadPrecomputed(int frame_idx, cv::Mat &out) cons
   }
 
   if (this->input_is_depth_) {
-    // We're reading depth directly, so we need to ensure the max depth here.
-    float max_depth_mm_f = GetMaxDepthMeters() * kMetersToMillimeters;
+    // We're reading depth directly, so we need to ensure the max depth here. 'Input' separates
+    // out anything beyond the regular max depth if the far range is being read as well.
+    float max_depth_mm_f = GetFarMaxDepthMeters() * kMetersToMillimeters;
     int16_t max_depth_mm_s = static_cast<int16_t>(round(max_depth_mm_f));
 
     for(int i = 0; i < out.rows; ++i) {
@@ -42,25 +42,26 @@ class PrecomputedDepthProvider : public DepthProvider {
 
   /// \brief Loads the precomputed depth map for the specified frame into 'out_depth'.
   void GetDepth(int frame_idx, StereoCalibration &calibration, cv::Mat1s &out_depth, float scale) {
+    // Does not print anything, since the evaluation calls this from its background thread.
     if (input_is_depth_) {
-      std::cout << "Will read precomputed depth..." << std::endl;
       ReadPrecomputed(frame_idx, out_depth);
-      std::cout << "Done reading precomputed depth for specific frame [" << frame_idx << "]." << std::endl;
       return;
     }
 
-    ReadPrecomputed(frame_idx, out_disparity_);
+    // Not using 'out_disparity_', since the evaluation reads old frames from its own thread.
+    cv::Mat disparity;
+    ReadPrecomputed(frame_idx, disparity);
 
     // TODO(andrei): Remove code duplication between this and 'DepthProvider'.
-    if (out_disparity_.type() == CV_32FC1) {
-      DepthFromDisparityMap<float>(out_disparity_, calibration, out_depth, scale);
-    } else if (out_disparity_.type() == CV_16SC1) {
+    if (disparity.type() == CV_32FC1) {
+      DepthFromDisparityMap<float>(disparity, calibration, out_depth, scale);
+    } else if (disparity.type() == CV_16SC1) {
       throw std::runtime_error("Unsupported.");
 //      DepthFromDisparityMap<uint16_t>(out_disparity_, calibration, out_depth);
     } else {
       throw std::runtime_error(utils::Format(
           "Unknown data type for disparity matrix [%s]. Supported are CV_32FC1 and CV_16SC1.",
-          utils::Type2Str(out_disparity_.type()).c_str()
+          utils::Type2Str(disparity.type()).c_str()
       ));
     }
   }
@@ -0,0 +1,76 @@
+#ifndef DYNSLAM_PREVIEWCACHE_H
+#define DYNSLAM_PREVIEWCACHE_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include <pangolin/pangolin.h>
+
+#include "PreviewType.h"
+
+namespace dynslam {
+
+/// \brief Everything a map preview depends on. Two renderings with equal keys are identical.
+struct PreviewKey {
+  /// \brief The latest map version, out of all the maps involved.
+  uint64_t map_version;
+  /// \brief Object poses and visibility only change between frames.
+  int frame_idx;
+  PreviewType type;
+  /// \brief -1 for previews which are not of a specific object.
+  int object_idx;
+  bool compositing;
+  GLprecision model_view[16];
+
+  PreviewKey(uint64_t map_version,
+             int frame_idx,
+             PreviewType type,
+             int object_idx,
+             bool compositing,
+             const pangolin::OpenGlMatrix &model_view)
+      : map_version(map_version),
+        frame_idx(frame_idx),
+        type(type),
+        object_idx(object_idx),
+        compositing(compositing) {
+    std::copy(model_view.m, model_view.m + 16, this->model_view);
+  }
+
+  bool operator==(const PreviewKey &other) const {
+    return map_version == other.map_version &&
+           frame_idx == other.frame_idx &&
+           type == other.type &&
+           object_idx == other.object_idx &&
+           compositing == other.compositing &&
+           std::equal(model_view, model_view + 16, other.model_view);
+  }
+};
+
+/// \brief Remembers what was last rendered into a preview buffer, so that the rendering can be
+///        skipped when nothing changed, e.g., while the sequence is paused.
+class PreviewCache {
+ public:
+  PreviewCache()
+      : valid_(false),
+        last_key_(0, 0, PreviewType::kEnd, -1, false, pangolin::IdentityMatrix()) {}
+
+  /// \brief Checks whether the buffer already holds the preview with the given key. If not, the
+  ///        caller is expected to render it, since the key is remembered either way.
+  bool Lookup(const PreviewKey &key) {
+    if (valid_ && key == last_key_) {
+      return true;
+    }
+
+    valid_ = true;
+    last_key_ = key;
+    return false;
+  }
+
+ private:
+  bool valid_;
+  PreviewKey last_key_;
+};
+
+}  // namespace dynslam
+
+#endif  // DYNSLAM_PREVIEWCACHE_H
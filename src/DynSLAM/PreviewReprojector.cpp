@@ -0,0 +1,107 @@
+#include "PreviewReprojector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+/// \brief Reprojected pixels farther than this fraction beyond one of their neighbours are
+///        treated as seeing through a crack in a nearer surface.
+const float kCrackDepthRatio = 0.1f;
+
+void PreviewReprojector::Reproject(const Eigen::Matrix4f &world_to_camera,
+                                   const Eigen::Vector4f &intrinsics,
+                                   vector<uint8_t> &holes) {
+  holes.resize(depth_.size());
+  reprojection_count_++;
+  if (world_to_camera == world_to_camera_) {
+    // E.g., when the depth is requested right after the color, there's nothing to do.
+    fill(holes.begin(), holes.end(), 0);
+    return;
+  }
+
+  const float fx = intrinsics(0);
+  const float fy = intrinsics(1);
+  const float cx = intrinsics(2);
+  const float cy = intrinsics(3);
+  const Eigen::Matrix4f key_to_new = world_to_camera * key_world_to_camera_.inverse();
+  const Eigen::Matrix3f rotation = key_to_new.block<3, 3>(0, 0);
+  const Eigen::Vector3f translation = key_to_new.block<3, 1>(0, 3);
+
+  fill(depth_.begin(), depth_.end(), 0.0f);
+  fill(color_.begin(), color_.end(), Vector4u(0, 0, 0, 0));
+
+  // Splat every key pixel onto the new view, keeping the nearest one where several collide.
+  for (int y = 0; y < height_; ++y) {
+    for (int x = 0; x < width_; ++x) {
+      int key_idx = y * width_ + x;
+      float depth = key_depth_[key_idx];
+      if (depth <= 0.0f) {
+        continue;
+      }
+
+      Eigen::Vector3f key_point((x - cx) / fx * depth, (y - cy) / fy * depth, depth);
+      Eigen::Vector3f point = rotation * key_point + translation;
+      if (point(2) <= 0.0f) {
+        continue;
+      }
+
+      int u = static_cast<int>(round(fx * point(0) / point(2) + cx));
+      int v = static_cast<int>(round(fy * point(1) / point(2) + cy));
+      if (u < 0 || u >= width_ || v < 0 || v >= height_) {
+        continue;
+      }
+
+      int idx = v * width_ + u;
+      if (depth_[idx] == 0.0f || point(2) < depth_[idx]) {
+        depth_[idx] = point(2);
+        color_[idx] = key_color_[key_idx];
+      }
+    }
+  }
+
+  // Everything which got no data gets raycast, which covers disocclusions, and the pixels which
+  // saw nothing before. The splats are only one pixel large, so moving closer to a surface also
+  // cracks it, and the surfaces behind it show through the cracks. Those pixels are much farther
+  // away than one of their neighbours, so they get raycast as well. This also catches the
+  // background along the edges of foreground surfaces, which is a little wasteful, but harmless.
+  for (int y = 0; y < height_; ++y) {
+    for (int x = 0; x < width_; ++x) {
+      int idx = y * width_ + x;
+      float depth = depth_[idx];
+      bool hole = (depth == 0.0f);
+      for (int ny = max(y - 1, 0); ! hole && ny <= min(y + 1, height_ - 1); ++ny) {
+        for (int nx = max(x - 1, 0); nx <= min(x + 1, width_ - 1); ++nx) {
+          float neighbour_depth = depth_[ny * width_ + nx];
+          if (neighbour_depth > 0.0f && depth > neighbour_depth * (1.0f + kCrackDepthRatio)) {
+            hole = true;
+            break;
+          }
+        }
+      }
+      holes[idx] = hole ? 1 : 0;
+    }
+  }
+}
+
+void PreviewReprojector::SetRendered(const Eigen::Matrix4f &world_to_camera,
+                                     uint64_t map_version,
+                                     PreviewType type,
+                                     bool full) {
+  valid_ = true;
+  world_to_camera_ = world_to_camera;
+  map_version_ = map_version;
+  type_ = type;
+  if (full) {
+    key_depth_ = depth_;
+    key_color_ = color_;
+    key_world_to_camera_ = world_to_camera;
+    reprojection_count_ = 0;
+  }
+}
+
+}  // namespace drivers
+}  // namespace dynslam
@@ -0,0 +1,97 @@
+#ifndef DYNSLAM_PREVIEWREPROJECTOR_H
+#define DYNSLAM_PREVIEWREPROJECTOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "../InfiniTAM/InfiniTAM/ITMLib/Engine/ITMMainEngine.h"
+#include "Defines.h"
+#include "PreviewType.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Keeps the latest full preview rendering of a map, so that the next ones, from nearby
+///        viewpoints, can be produced by warping it, and only raycasting the pixels which end up
+///        with no data, such as disocclusions.
+///
+/// The reprojected previews are approximate (e.g., the shading does not follow the camera), so
+/// a full rendering is required every 'refresh_every' previews, as well as whenever the map
+/// changes. Previews are always warped from the latest full rendering, so that the errors don't
+/// accumulate.
+class PreviewReprojector {
+ public:
+  PreviewReprojector(int width, int height, int refresh_every)
+      : width_(width),
+        height_(height),
+        refresh_every_(refresh_every),
+        depth_(static_cast<size_t>(width * height)),
+        color_(static_cast<size_t>(width * height)),
+        key_depth_(static_cast<size_t>(width * height)),
+        key_color_(static_cast<size_t>(width * height)),
+        valid_(false),
+        map_version_(0),
+        type_(PreviewType::kDepth),
+        world_to_camera_(Eigen::Matrix4f::Identity()),
+        key_world_to_camera_(Eigen::Matrix4f::Identity()),
+        reprojection_count_(0) {}
+
+  /// \brief Whether the latest rendering can be reused for the given preview.
+  /// \param type The preview type, or 'kDepth' if only the depth is needed.
+  bool CanReproject(uint64_t map_version, PreviewType type) const {
+    return valid_ && map_version == map_version_ && reprojection_count_ < refresh_every_ &&
+           (type == PreviewType::kDepth || type == type_);
+  }
+
+  /// \brief Warps the latest full rendering to the given viewpoint, into the preview buffers.
+  /// \param holes Receives a mask of the pixels which still need to be raycast.
+  void Reproject(const Eigen::Matrix4f &world_to_camera,
+                 const Eigen::Vector4f &intrinsics,
+                 std::vector<uint8_t> &holes);
+
+  /// \brief Marks the preview buffer contents as a rendering of the map with the given version,
+  ///        as seen from the given viewpoint.
+  /// \param full Whether the buffers were fully raycast, as opposed to reprojected, in which
+  ///             case they become the source of the following reprojections.
+  void SetRendered(const Eigen::Matrix4f &world_to_camera,
+                   uint64_t map_version,
+                   PreviewType type,
+                   bool full);
+
+  /// \brief The type of the preview in the color buffers, or 'kDepth' if they only hold depth.
+  PreviewType GetType() const { return type_; }
+
+  /// \brief The preview's depth buffer, which previews get rendered into.
+  float *GetDepth() { return depth_.data(); }
+
+  /// \brief The preview's color buffer, which previews get rendered into.
+  Vector4u *GetColor() { return color_.data(); }
+
+  SUPPORT_EIGEN_FIELDS;
+
+ private:
+  int width_;
+  int height_;
+  int refresh_every_;
+
+  std::vector<float> depth_;
+  std::vector<Vector4u> color_;
+  /// \brief The latest full rendering.
+  std::vector<float> key_depth_;
+  std::vector<Vector4u> key_color_;
+
+  bool valid_;
+  uint64_t map_version_;
+  PreviewType type_;
+  Eigen::Matrix4f world_to_camera_;
+  Eigen::Matrix4f key_world_to_camera_;
+  /// \brief The number of reprojections since the latest full rendering.
+  int reprojection_count_;
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_PREVIEWREPROJECTOR_H
@@ -0,0 +1,232 @@
+#include "StaticMapStreamer.h"
+
+#include <cstdio>
+
+#include "Utils.h"
+
+namespace dynslam {
+
+using namespace std;
+using namespace dynslam::drivers;
+using namespace dynslam::utils;
+
+/// \brief Chunks get paged in once they are entirely within this fraction of the eviction radius.
+const float kPageInRadiusFactor = 0.85f;
+
+StaticMapStreamer::StaticMapStreamer(InfiniTamDriver *driver,
+                                     const string &store_dir,
+                                     float evict_radius_m,
+                                     VoxelFormat format)
+    : driver_(driver),
+      store_dir_(store_dir),
+      evict_radius_m_(evict_radius_m),
+      page_in_radius_m_(evict_radius_m * kPageInRadiusFactor),
+      block_size_m_(driver->GetVoxelSize() * SDF_BLOCK_SIZE),
+      stored_block_count_(0),
+      stored_bytes_(0),
+      // Unobserved voxels are ignored by InfiniTAM, so clearing them loses no information.
+      store_quantization_(0, true, format)
+{
+  if (system(Format("mkdir -p '%s'", store_dir_.c_str()).c_str())) {
+    throw runtime_error(Format("Could not create directory: %s", store_dir_.c_str()));
+  }
+}
+
+void StaticMapStreamer::Update(const Eigen::Vector3f &camera_position, int frame_idx) {
+  HostVoxelBlockMap &block_map = driver_->GetBlockMap();
+
+  // Page in the chunks we're getting close to.
+  vector<BlockChunkKey> to_page_in;
+  for (const auto &pair : chunks_) {
+    if (GetMaxChunkDistance(pair.first, camera_position) < page_in_radius_m_) {
+      to_page_in.push_back(pair.first);
+    }
+  }
+
+  vector<Vector3s> paged_in;
+  for (const BlockChunkKey &key : to_page_in) {
+    vector<VoxelBlock> blocks;
+    ReadChunk(key, blocks);
+    DeleteChunk(key);
+
+    vector<VoxelBlock> leftovers;
+    for (const VoxelBlock &block : blocks) {
+      // Blocks allocated since the chunk was written out (e.g., observed from afar) are newer, so
+      // they take precedence.
+      if (block_map.FindEntry(block.pos) >= 0) {
+        continue;
+      }
+
+      if (block_map.InsertBlock(block)) {
+        paged_in.push_back(block.pos);
+      }
+      else {
+        leftovers.push_back(block);
+      }
+    }
+
+    if (! leftovers.empty()) {
+      cerr << "Warning: Static map is full; could not page in " << leftovers.size()
+           << " blocks." << endl;
+      WriteChunk(key, leftovers);
+    }
+  }
+  // Otherwise, the budget could never evict the paged-in blocks which don't get fused into again.
+  driver_->TouchBudgetBlocks(paged_in, frame_idx);
+
+  // Write out the blocks which are far away.
+  map<BlockChunkKey, vector<VoxelBlock>> to_write;
+  size_t evicted = 0;
+  for (int entry_id : block_map.GetAllocatedEntries()) {
+    const Vector3s &pos = block_map.GetEntry(entry_id).pos;
+    if ((GetBlockCenter(pos) - camera_position).norm() > evict_radius_m_) {
+      vector<VoxelBlock> &chunk_blocks = to_write[GetBlockChunk(pos)];
+      chunk_blocks.emplace_back();
+      block_map.ReadBlock(entry_id, chunk_blocks.back());
+      block_map.RemoveBlock(entry_id);
+      evicted++;
+    }
+  }
+
+  ColdBlockStore *cold_store = driver_->GetColdBlockStore();
+  if (nullptr != cold_store) {
+    // Far away blocks are likely to be cold already, in which case they're not in the map.
+    vector<VoxelBlock> cold_blocks;
+    auto is_far = [this, &camera_position](const Eigen::Vector3f &center, float radius) {
+      return (center - camera_position).norm() - radius > evict_radius_m_;
+    };
+    cold_store->ExtractChunks(is_far, cold_blocks);
+
+    for (VoxelBlock &block : cold_blocks) {
+      to_write[GetBlockChunk(block.pos)].push_back(block);
+    }
+    evicted += cold_blocks.size();
+  }
+
+  for (const auto &pair : to_write) {
+    WriteChunk(pair.first, pair.second);
+  }
+
+  if (! paged_in.empty() || evicted > 0) {
+    cout << "Static map streaming: paged in " << paged_in.size() << " blocks, wrote out " << evicted
+         << " blocks. " << stored_block_count_ << " blocks (" << stored_bytes_ / 1024 / 1024
+         << " MiB) on disk in " << chunks_.size() << " chunks." << endl;
+  }
+}
+
+void StaticMapStreamer::Spill(const vector<VoxelBlock> &blocks) {
+  map<BlockChunkKey, vector<VoxelBlock>> to_write;
+  for (const VoxelBlock &block : blocks) {
+    to_write[GetBlockChunk(block.pos)].push_back(block);
+  }
+
+  for (const auto &pair : to_write) {
+    WriteChunk(pair.first, pair.second);
+  }
+}
+
+void StaticMapStreamer::Flush() {
+  HostVoxelBlockMap &block_map = driver_->GetBlockMap();
+
+  map<BlockChunkKey, vector<VoxelBlock>> to_write;
+  for (int entry_id : block_map.GetAllocatedEntries()) {
+    const Vector3s &pos = block_map.GetEntry(entry_id).pos;
+    vector<VoxelBlock> &chunk_blocks = to_write[GetBlockChunk(pos)];
+    chunk_blocks.emplace_back();
+    block_map.ReadBlock(entry_id, chunk_blocks.back());
+  }
+
+  ColdBlockStore *cold_store = driver_->GetColdBlockStore();
+  if (nullptr != cold_store) {
+    vector<VoxelBlock> cold_blocks;
+    cold_store->CopyAll(cold_blocks);
+    for (VoxelBlock &block : cold_blocks) {
+      to_write[GetBlockChunk(block.pos)].push_back(block);
+    }
+  }
+
+  for (const auto &pair : to_write) {
+    WriteChunk(pair.first, pair.second);
+  }
+
+  cout << "Wrote the full static map to [" << store_dir_ << "]: " << stored_block_count_
+       << " blocks in " << chunks_.size() << " chunks." << endl;
+}
+
+string StaticMapStreamer::GetChunkPath(const BlockChunkKey &key) const {
+  return Format("%s/chunk_%d_%d_%d.vblocks",
+                store_dir_.c_str(),
+                get<0>(key),
+                get<1>(key),
+                get<2>(key));
+}
+
+Eigen::Vector3f StaticMapStreamer::GetBlockCenter(const Vector3s &block_pos) const {
+  Eigen::Vector3f center(block_pos.x + 0.5f, block_pos.y + 0.5f, block_pos.z + 0.5f);
+  return center * block_size_m_;
+}
+
+float StaticMapStreamer::GetMaxChunkDistance(const BlockChunkKey &key,
+                                             const Eigen::Vector3f &point) const {
+  float chunk_size_m = kBlockChunkSize * block_size_m_;
+  Eigen::Vector3f chunk_min(get<0>(key), get<1>(key), get<2>(key));
+  chunk_min *= chunk_size_m;
+
+  // The farthest corner is the one on the other side of the chunk's center, along every axis.
+  Eigen::Vector3f farthest;
+  for (int i = 0; i < 3; ++i) {
+    float center = chunk_min(i) + chunk_size_m * 0.5f;
+    farthest(i) = (point(i) < center) ? chunk_min(i) + chunk_size_m : chunk_min(i);
+  }
+
+  return (farthest - point).norm();
+}
+
+void StaticMapStreamer::WriteChunk(const BlockChunkKey &key, const vector<VoxelBlock> &blocks) {
+  vector<VoxelBlock> merged;
+  if (chunks_.find(key) != chunks_.end()) {
+    vector<VoxelBlock> existing;
+    ReadChunk(key, existing);
+    DeleteChunk(key);
+
+    map<tuple<short, short, short>, size_t> new_positions;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      new_positions[make_tuple(blocks[i].pos.x, blocks[i].pos.y, blocks[i].pos.z)] = i;
+    }
+    for (const VoxelBlock &block : existing) {
+      auto pos = make_tuple(block.pos.x, block.pos.y, block.pos.z);
+      if (new_positions.find(pos) == new_positions.end()) {
+        merged.push_back(block);
+      }
+    }
+  }
+  merged.insert(merged.end(), blocks.begin(), blocks.end());
+
+  vector<uint8_t> encoded;
+  EncodeVoxelBlocks(merged, store_quantization_, encoded);
+  WriteBytes(GetChunkPath(key), encoded);
+
+  chunks_[key] = ChunkInfo{ merged.size(), encoded.size() };
+  stored_block_count_ += merged.size();
+  stored_bytes_ += encoded.size();
+}
+
+void StaticMapStreamer::ReadChunk(const BlockChunkKey &key, vector<VoxelBlock> &out) const {
+  vector<uint8_t> encoded;
+  ReadBytes(GetChunkPath(key), encoded);
+  DecodeVoxelBlocks(encoded, out);
+}
+
+void StaticMapStreamer::DeleteChunk(const BlockChunkKey &key) {
+  auto it = chunks_.find(key);
+  if (it == chunks_.end()) {
+    return;
+  }
+
+  stored_block_count_ -= it->second.block_count;
+  stored_bytes_ -= it->second.size_bytes;
+  remove(GetChunkPath(key).c_str());
+  chunks_.erase(it);
+}
+
+}  // namespace dynslam
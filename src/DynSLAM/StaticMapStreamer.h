@@ -0,0 +1,97 @@
+#ifndef DYNSLAM_STATICMAPSTREAMER_H
+#define DYNSLAM_STATICMAPSTREAMER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "InfiniTamDriver.h"
+#include "VoxelBlockCodec.h"
+
+namespace dynslam {
+
+/// \brief Bounds the memory used by the static map on long sequences by moving voxel blocks which
+///        are far away from the camera to a disk-backed block store.
+///
+/// Blocks are grouped into cubic chunks, and every chunk is stored in its own compressed file.
+/// Chunks are paged back into the map once the camera gets close enough to them again. The page-in
+/// radius is smaller than the eviction one, so that chunks don't keep bouncing in and out of memory
+/// when the camera hovers around the boundary.
+class StaticMapStreamer {
+ public:
+  /// \param driver The InfiniTAM instance holding the static map.
+  /// \param store_dir Where to write the chunk files. Gets created if necessary.
+  /// \param evict_radius_m Blocks farther than this from the camera get moved to the disk.
+  /// \param format The format the blocks are stored in.
+  StaticMapStreamer(drivers::InfiniTamDriver *driver,
+                    const std::string &store_dir,
+                    float evict_radius_m,
+                    drivers::VoxelFormat format = drivers::VoxelFormat::kFull);
+
+  StaticMapStreamer(const StaticMapStreamer&) = delete;
+  StaticMapStreamer& operator=(const StaticMapStreamer&) = delete;
+
+  virtual ~StaticMapStreamer() = default;
+
+  /// \brief Pages in the chunks close to the camera, and writes out the blocks far away from it.
+  /// \param camera_position The camera's position in the map's coordinate frame.
+  /// \param frame_idx The current frame, which the paged-in blocks count as observed in.
+  /// \note The changes are made through the driver's shared block map, and not committed.
+  void Update(const Eigen::Vector3f &camera_position, int frame_idx);
+
+  /// \brief Writes blocks which have already been removed from the map to the store.
+  /// They get paged back in once the camera comes within the page-in radius of their chunks.
+  void Spill(const std::vector<drivers::VoxelBlock> &blocks);
+
+  /// \brief Writes all the blocks still in memory to the store, without removing them from the
+  ///        map, so that the store ends up containing the full map.
+  void Flush();
+
+  const std::string& GetStoreDir() const { return store_dir_; }
+
+  /// \brief The number of blocks currently held on disk.
+  size_t GetStoredBlockCount() const { return stored_block_count_; }
+
+  /// \brief The size of all the chunk files currently on disk.
+  size_t GetStoredBytes() const { return stored_bytes_; }
+
+ private:
+  struct ChunkInfo {
+    size_t block_count;
+    size_t size_bytes;
+  };
+
+  drivers::InfiniTamDriver *driver_;
+  std::string store_dir_;
+  float evict_radius_m_;
+  float page_in_radius_m_;
+  /// \brief The side of a voxel block, in meters.
+  float block_size_m_;
+
+  std::map<drivers::BlockChunkKey, ChunkInfo> chunks_;
+  size_t stored_block_count_;
+  size_t stored_bytes_;
+  drivers::VoxelQuantization store_quantization_;
+
+  std::string GetChunkPath(const drivers::BlockChunkKey &key) const;
+
+  Eigen::Vector3f GetBlockCenter(const Vector3s &block_pos) const;
+
+  /// \brief The distance from the given point to the farthest corner of the chunk.
+  float GetMaxChunkDistance(const drivers::BlockChunkKey &key, const Eigen::Vector3f &point) const;
+
+  /// \brief Writes the blocks to their chunk's file, merging them with the ones already there.
+  /// Blocks which are already in the file get overwritten.
+  void WriteChunk(const drivers::BlockChunkKey &key,
+                  const std::vector<drivers::VoxelBlock> &blocks);
+
+  void ReadChunk(const drivers::BlockChunkKey &key, std::vector<drivers::VoxelBlock> &out) const;
+
+  void DeleteChunk(const drivers::BlockChunkKey &key);
+};
+
+}  // namespace dynslam
+
+#endif  // DYNSLAM_STATICMAPSTREAMER_H
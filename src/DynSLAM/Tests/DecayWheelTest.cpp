@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "TestUtils.h"
+#include "../DecayWheel.h"
+
+namespace dynslam {
+namespace tests {
+
+using namespace std;
+using namespace dynslam::drivers;
+
+namespace {
+
+vector<int64_t> Sorted(const vector<Vector3s> &blocks) {
+  vector<int64_t> keys;
+  for (const Vector3s &block : blocks) {
+    keys.push_back(PackBlockPos(block));
+  }
+  sort(keys.begin(), keys.end());
+  return keys;
+}
+
+void CheckSimpleSchedule() {
+  const Vector3s a(0, 0, 0), b(1, 2, 3), c(-1, -2, -3), d(100, -100, 5);
+  DecayWheel wheel(3);
+  vector<Vector3s> expired;
+
+  wheel.Touch(a, 0);
+  wheel.Touch(b, 1);
+  wheel.Touch(c, 1);
+  wheel.Touch(a, 2);
+  CHECK(wheel.GetPendingBlockCount() == 3);
+
+  wheel.PopExpired(2, expired);
+  CHECK(expired.empty());
+  // 'a' was updated since it was enqueued, so it's not old enough yet.
+  wheel.PopExpired(3, expired);
+  CHECK(expired.empty());
+  wheel.PopExpired(4, expired);
+  CHECK(Sorted(expired) == Sorted({ b, c }));
+
+  expired.clear();
+  wheel.Touch(d, 5);
+  wheel.PopExpired(5, expired);
+  CHECK(Sorted(expired) == Sorted({ a }));
+
+  // Skipping frames expires everything which was due in between.
+  expired.clear();
+  wheel.PopExpired(20, expired);
+  CHECK(Sorted(expired) == Sorted({ d }));
+  CHECK(wheel.GetPendingBlockCount() == 0);
+
+  expired.clear();
+  wheel.Touch(a, 21);
+  wheel.Touch(b, 21);
+  wheel.DrainAll(expired);
+  CHECK(Sorted(expired) == Sorted({ a, b }));
+  CHECK(wheel.GetPendingBlockCount() == 0);
+}
+
+/// \brief Compares the wheel to directly checking the age of every block.
+void CheckAgainstBruteForce() {
+  const int min_age = 5;
+  mt19937 rng(99);
+  uniform_int_distribution<int> coord_dist(-8, 8);
+  uniform_int_distribution<int> touch_count_dist(0, 20);
+  uniform_int_distribution<int> pop_dist(0, 2);
+
+  DecayWheel wheel(min_age);
+  map<int64_t, int> last_update_frame;
+  for (int frame = 0; frame < 300; ++frame) {
+    int touch_count = touch_count_dist(rng);
+    for (int i = 0; i < touch_count; ++i) {
+      Vector3s pos(static_cast<short>(coord_dist(rng)), static_cast<short>(coord_dist(rng)),
+                   static_cast<short>(coord_dist(rng)));
+      wheel.Touch(pos, frame);
+      last_update_frame[PackBlockPos(pos)] = frame;
+    }
+
+    // Like decay which does not run every frame.
+    if (pop_dist(rng) != 0) {
+      continue;
+    }
+    vector<Vector3s> expired;
+    wheel.PopExpired(frame, expired);
+
+    vector<int64_t> expected;
+    for (auto it = last_update_frame.begin(); it != last_update_frame.end();) {
+      if (it->second <= frame - min_age) {
+        expected.push_back(it->first);
+        it = last_update_frame.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+    CHECK(Sorted(expired) == expected);
+    CHECK(wheel.GetPendingBlockCount() == last_update_frame.size());
+  }
+}
+
+}
+
+void TestDecayWheel() {
+  CheckSimpleSchedule();
+  CheckAgainstBruteForce();
+}
+
+}
+}
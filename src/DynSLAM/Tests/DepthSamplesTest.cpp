@@ -0,0 +1,106 @@
+#include <cstdio>
+
+#include "TestUtils.h"
+#include "../Evaluation/DepthSamples.h"
+
+namespace dynslam {
+namespace tests {
+
+using namespace std;
+using namespace dynslam::eval;
+
+namespace {
+
+DepthSamples GenerateSamples(size_t count, bool with_associations) {
+  DepthSamples samples;
+  samples.frame_idx = 42;
+  samples.dataset_id = "kitti-odometry-06";
+  samples.pose = Eigen::Matrix4f::Random();
+  samples.frame_width = 1242;
+  samples.frame_height = 375;
+  samples.baseline_m = 0.537f;
+  samples.focal_length_px = 721.5377f;
+  samples.max_depth_m = 20.0f;
+
+  samples.Resize(count);
+  samples.left = Eigen::Matrix2Xd::Random(2, count);
+  samples.right = Eigen::Matrix2Xd::Random(2, count);
+  for (size_t i = 0; i < count; ++i) {
+    samples.indices[i] = static_cast<int>(3 * i + 1);
+    samples.rendered_depth_m[i] = (i % 5 == 0) ? 0.0f : 0.25f * i;
+    samples.input_depth_mm[i] = static_cast<int16_t>(i * 17 - 400);
+    if (with_associations) {
+      samples.associations.push_back(static_cast<uint8_t>(i % 3));
+    }
+  }
+  return samples;
+}
+
+void CheckRoundTrip(const DepthSamples &samples) {
+  const string fpath = GetTempPath("depth-samples.bin");
+  WriteDepthSamples(fpath, samples);
+
+  // Start from stale data, which reading should entirely replace.
+  DepthSamples read = GenerateSamples(7, true);
+  ReadDepthSamples(fpath, read);
+  remove(fpath.c_str());
+
+  CHECK(read.frame_idx == samples.frame_idx);
+  CHECK(read.dataset_id == samples.dataset_id);
+  CHECK(read.pose == samples.pose);
+  CHECK(read.frame_width == samples.frame_width);
+  CHECK(read.frame_height == samples.frame_height);
+  CHECK(read.baseline_m == samples.baseline_m);
+  CHECK(read.focal_length_px == samples.focal_length_px);
+  CHECK(read.max_depth_m == samples.max_depth_m);
+  CHECK(read.GetSize() == samples.GetSize());
+  CHECK(read.indices == samples.indices);
+  CHECK(read.left == samples.left);
+  CHECK(read.right == samples.right);
+  CHECK(read.rendered_depth_m == samples.rendered_depth_m);
+  CHECK(read.input_depth_mm == samples.input_depth_mm);
+  CHECK(read.associations == samples.associations);
+}
+
+void CheckInvalidFiles(const DepthSamples &samples) {
+  const string fpath = GetTempPath("depth-samples-invalid.bin");
+  DepthSamples read;
+  CHECK_THROWS(ReadDepthSamples(fpath, read));
+
+  // Cut the file off in the middle of the per-sample data.
+  WriteDepthSamples(fpath, samples);
+  FILE *file = fopen(fpath.c_str(), "rb");
+  CHECK(file != nullptr);
+  vector<char> contents(1 << 16);
+  contents.resize(fread(contents.data(), 1, contents.size(), file));
+  fclose(file);
+  file = fopen(fpath.c_str(), "wb");
+  CHECK(file != nullptr);
+  fwrite(contents.data(), 1, contents.size() - 10, file);
+  fclose(file);
+  CHECK_THROWS(ReadDepthSamples(fpath, read));
+
+  file = fopen(fpath.c_str(), "wb");
+  CHECK(file != nullptr);
+  fputs("Not depth samples at all.", file);
+  fclose(file);
+  CHECK_THROWS(ReadDepthSamples(fpath, read));
+  remove(fpath.c_str());
+
+  DepthSamples mismatched = samples;
+  mismatched.associations.pop_back();
+  CHECK_THROWS(WriteDepthSamples(fpath, mismatched));
+  remove(fpath.c_str());
+}
+
+}
+
+void TestDepthSamples() {
+  CheckRoundTrip(GenerateSamples(100, true));
+  CheckRoundTrip(GenerateSamples(100, false));
+  CheckRoundTrip(GenerateSamples(0, false));
+  CheckInvalidFiles(GenerateSamples(100, true));
+}
+
+}
+}
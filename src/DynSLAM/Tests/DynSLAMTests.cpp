@@ -0,0 +1,44 @@
+// Runs the library's self-checking tests. Every test aborts as soon as one of its checks fails.
+
+#include <functional>
+#include <map>
+
+#include "TestUtils.h"
+
+using namespace std;
+using namespace dynslam::tests;
+
+int main(int argc, char **argv) {
+  const map<string, function<void()>> tests = {
+      { "VoxelBlockCodec", TestVoxelBlockCodec },
+      { "DepthSamples", TestDepthSamples },
+      { "MultiThresholdEvaluation", TestMultiThresholdEvaluation },
+      { "DecayWheel", TestDecayWheel },
+      { "MetricsSink", TestMetricsSink }
+  };
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [test name]\n", argv[0]);
+    return 1;
+  }
+
+  // Run the test given as an argument, so that CTest can report each one separately, or all of
+  // them otherwise.
+  for (const auto &test : tests) {
+    if (argc == 2 && test.first != argv[1]) {
+      continue;
+    }
+    printf("Running %s...\n", test.first.c_str());
+    test.second();
+    printf("%s passed.\n", test.first.c_str());
+    if (argc == 2) {
+      return 0;
+    }
+  }
+
+  if (argc == 2) {
+    fprintf(stderr, "Unknown test: %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
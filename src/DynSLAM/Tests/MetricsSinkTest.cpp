@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <fstream>
+
+#include "TestUtils.h"
+#include "../Evaluation/MetricsSink.h"
+
+namespace dynslam {
+namespace tests {
+
+using namespace std;
+using namespace dynslam::eval;
+
+namespace {
+
+class TestRecord : public ICsvSerializable {
+ public:
+  TestRecord(const string &header, const string &data) : header_(header), data_(data) {}
+
+  string GetHeader() const override {
+    return header_;
+  }
+
+  string GetData() const override {
+    return data_;
+  }
+
+ private:
+  const string header_;
+  const string data_;
+};
+
+template<typename T>
+T ReadValue(ifstream &in) {
+  T value;
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  CHECK(in.good());
+  return value;
+}
+
+string ReadFile(const string &fpath) {
+  ifstream in(fpath, ios::binary);
+  CHECK(in.is_open());
+  return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+void CheckBothFormats() {
+  const string csv_fpath = GetTempPath("metrics.csv");
+  const string columnar_fpath = GetTempPath("metrics.cols");
+  {
+    MetricsSink sink(csv_fpath, MetricsSink::ParseFormats("both"));
+    sink.Write(TestRecord("frame,error", "0,0.5"));
+    sink.Write(TestRecord("frame,error", "1,-2.25"));
+    // Rows written after a flush go into a new row group.
+    sink.Flush();
+    sink.Write(TestRecord("frame,error", "2,1e3"));
+  }
+
+  CHECK(ReadFile(csv_fpath) == "frame,error\n0,0.5\n1,-2.25\n2,1e3\n");
+
+  ifstream in(columnar_fpath, ios::binary);
+  CHECK(in.is_open());
+  CHECK(ReadValue<uint32_t>(in) == 0x434d5344);
+  CHECK(ReadValue<uint32_t>(in) == 2);
+  for (const char *expected_name : { "frame", "error" }) {
+    uint32_t length = ReadValue<uint32_t>(in);
+    string name(length, '\0');
+    in.read(&name[0], length);
+    CHECK(name == expected_name);
+  }
+
+  CHECK(ReadValue<uint32_t>(in) == 2);
+  CHECK(ReadValue<double>(in) == 0.0);
+  CHECK(ReadValue<double>(in) == 1.0);
+  CHECK(ReadValue<double>(in) == 0.5);
+  CHECK(ReadValue<double>(in) == -2.25);
+
+  CHECK(ReadValue<uint32_t>(in) == 1);
+  CHECK(ReadValue<double>(in) == 2.0);
+  CHECK(ReadValue<double>(in) == 1000.0);
+  CHECK(in.peek() == EOF);
+
+  in.close();
+  remove(csv_fpath.c_str());
+  remove(columnar_fpath.c_str());
+}
+
+void CheckMalformedRecords() {
+  const string fpath = GetTempPath("metrics-malformed.csv");
+  {
+    MetricsSink sink(fpath, MetricsSink::kCsv | MetricsSink::kColumnar);
+    sink.Write(TestRecord("a,b", "1,2"));
+    CHECK_THROWS(sink.Write(TestRecord("a,b", "1")));
+    CHECK_THROWS(sink.Write(TestRecord("a,b", "1,2,3")));
+    CHECK_THROWS(sink.Write(TestRecord("a,b", "1,oops")));
+    CHECK_THROWS(sink.Write(TestRecord("a,c", "1,2")));
+  }
+  // Nothing was written for the rejected records.
+  CHECK(ReadFile(fpath) == "a,b\n1,2\n");
+  remove(fpath.c_str());
+  remove(GetTempPath("metrics-malformed.cols").c_str());
+
+  CHECK_THROWS(MetricsSink::ParseFormats("parquet"));
+}
+
+}
+
+void TestMetricsSink() {
+  CheckBothFormats();
+  CheckMalformedRecords();
+}
+
+}
+}
@@ -0,0 +1,148 @@
+#include <memory>
+#include <random>
+
+#include "TestUtils.h"
+#include "../Evaluation/MultiThresholdEvaluationCallback.h"
+
+namespace dynslam {
+namespace tests {
+
+using namespace std;
+using namespace dynslam::eval;
+
+namespace {
+
+struct LidarPoint {
+  float rendered_disp;
+  float rendered_depth_m;
+  float input_disp;
+  float input_depth_m;
+  float lidar_disp;
+};
+
+/// \brief Points with errors all over the thresholds' range, including errors which are exactly
+///        equal to a threshold, and points with missing input and/or fused depth.
+vector<LidarPoint> GeneratePoints(mt19937 &rng, const vector<float> &deltas, size_t count) {
+  uniform_real_distribution<float> disp_dist(1.0f, 120.0f);
+  uniform_real_distribution<float> error_dist(-15.0f, 15.0f);
+  uniform_int_distribution<int> kind_dist(0, 9);
+  uniform_int_distribution<size_t> delta_dist(0, deltas.size() - 1);
+
+  vector<LidarPoint> points;
+  for (size_t i = 0; i < count; ++i) {
+    LidarPoint point;
+    point.lidar_disp = disp_dist(rng);
+    point.rendered_disp = point.lidar_disp + error_dist(rng);
+    point.input_disp = point.lidar_disp + error_dist(rng);
+    point.rendered_depth_m = 10.0f;
+    point.input_depth_m = 10.0f;
+
+    int kind = kind_dist(rng);
+    if (kind == 0) {
+      point.rendered_depth_m = 0.0f;
+    }
+    else if (kind == 1) {
+      point.input_depth_m = 0.0f;
+    }
+    else if (kind == 2) {
+      point.rendered_depth_m = 0.0f;
+      point.input_depth_m = 0.0f;
+    }
+    else if (kind == 3) {
+      // Whole disparities, so that the errors are exactly equal to the (whole) thresholds.
+      point.lidar_disp = static_cast<float>(static_cast<int>(point.lidar_disp));
+      point.rendered_disp = point.lidar_disp + deltas[delta_dist(rng)];
+      point.input_disp = point.lidar_disp - deltas[delta_dist(rng)];
+    }
+    points.push_back(point);
+  }
+  return points;
+}
+
+void CheckResult(const DepthResult &expected, const DepthResult &actual) {
+  CHECK(actual.measurement_count == expected.measurement_count);
+  CHECK(actual.error_count == expected.error_count);
+  CHECK(actual.missing_count == expected.missing_count);
+  CHECK(actual.correct_count == expected.correct_count);
+  CHECK(actual.missing_separate_count == expected.missing_separate_count);
+}
+
+void CheckAgainstBaseline(const vector<MultiThresholdEvaluationCallback::Threshold> &thresholds,
+                          const vector<LidarPoint> &points,
+                          const vector<uint8_t> &associations,
+                          bool compare_on_intersection) {
+  MultiThresholdEvaluationCallback multi(thresholds, compare_on_intersection, &associations);
+
+  // The baseline is one plain evaluation per threshold and per part of the map.
+  vector<unique_ptr<EvaluationCallback>> static_baselines;
+  vector<unique_ptr<EvaluationCallback>> dynamic_baselines;
+  for (const auto &threshold : thresholds) {
+    static_baselines.emplace_back(new EvaluationCallback(
+        threshold.delta_max, compare_on_intersection, threshold.kitti_style));
+    dynamic_baselines.emplace_back(new EvaluationCallback(
+        threshold.delta_max, compare_on_intersection, threshold.kitti_style));
+  }
+
+  const Eigen::Vector3d velo_2d_homo_px(100.0, 100.0, 1.0);
+  for (size_t i = 0; i < points.size(); ++i) {
+    const LidarPoint &p = points[i];
+    multi.ProcessLidarPoint(static_cast<int>(i), velo_2d_homo_px, p.rendered_disp,
+                            p.rendered_depth_m, p.input_disp, p.input_depth_m, p.lidar_disp,
+                            1242, 375);
+
+    if (associations[i] == SegmentedCallback::kNeither) {
+      continue;
+    }
+    auto &baselines = (associations[i] == SegmentedCallback::kStaticMap) ? static_baselines
+                                                                         : dynamic_baselines;
+    for (auto &baseline : baselines) {
+      baseline->ProcessLidarPoint(static_cast<int>(i), velo_2d_homo_px, p.rendered_disp,
+                                  p.rendered_depth_m, p.input_disp, p.input_depth_m,
+                                  p.lidar_disp, 1242, 375);
+    }
+  }
+
+  vector<DepthEvaluation> static_evals = multi.GetStaticEvaluations();
+  vector<DepthEvaluation> dynamic_evals = multi.GetDynamicEvaluations();
+  CHECK(static_evals.size() == thresholds.size());
+  CHECK(dynamic_evals.size() == thresholds.size());
+  for (size_t t = 0; t < thresholds.size(); ++t) {
+    DepthEvaluation expected_static = static_baselines[t]->GetEvaluation();
+    DepthEvaluation expected_dynamic = dynamic_baselines[t]->GetEvaluation();
+
+    CHECK(static_evals[t].delta_max == thresholds[t].delta_max);
+    CHECK(static_evals[t].kitti_style == thresholds[t].kitti_style);
+    CheckResult(expected_static.input_result, static_evals[t].input_result);
+    CheckResult(expected_static.fused_result, static_evals[t].fused_result);
+    CheckResult(expected_dynamic.input_result, dynamic_evals[t].input_result);
+    CheckResult(expected_dynamic.fused_result, dynamic_evals[t].fused_result);
+  }
+}
+
+}
+
+void TestMultiThresholdEvaluation() {
+  // Same thresholds as the evaluation itself uses, deliberately not in order.
+  vector<MultiThresholdEvaluationCallback::Threshold> thresholds;
+  vector<float> deltas;
+  for (float delta : { 3.0f, 0.5f, 1.0f, 2.0f, 5.0f, 4.0f, 8.0f, 12.0f }) {
+    thresholds.emplace_back(delta, false);
+    thresholds.emplace_back(delta, true);
+    deltas.push_back(delta);
+  }
+
+  mt19937 rng(4321);
+  const size_t point_count = 20000;
+  vector<LidarPoint> points = GeneratePoints(rng, deltas, point_count);
+  vector<uint8_t> associations(point_count);
+  uniform_int_distribution<int> association_dist(0, 2);
+  for (uint8_t &association : associations) {
+    association = static_cast<uint8_t>(association_dist(rng));
+  }
+
+  CheckAgainstBaseline(thresholds, points, associations, false);
+  CheckAgainstBaseline(thresholds, points, associations, true);
+}
+
+}
+}
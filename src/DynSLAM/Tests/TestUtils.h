@@ -0,0 +1,52 @@
+#ifndef DYNSLAM_TESTUTILS_H
+#define DYNSLAM_TESTUTILS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+/// \brief Like 'assert', but also checks in release builds, and reports the failed expression.
+#define CHECK(condition)                                                                         \
+  do {                                                                                           \
+    if (! (condition)) {                                                                         \
+      fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #condition);              \
+      abort();                                                                                   \
+    }                                                                                            \
+  } while (false)
+
+/// \brief Checks that the statement throws a 'std::runtime_error'.
+#define CHECK_THROWS(statement)                                                                  \
+  do {                                                                                           \
+    bool threw = false;                                                                          \
+    try {                                                                                        \
+      statement;                                                                                 \
+    }                                                                                            \
+    catch (const std::runtime_error &) {                                                         \
+      threw = true;                                                                              \
+    }                                                                                            \
+    CHECK(threw && "Expected: " #statement);                                                     \
+  } while (false)
+
+namespace dynslam {
+namespace tests {
+
+/// \brief A path in the temporary folder, unique to this process, for tests writing files.
+inline std::string GetTempPath(const std::string &name) {
+  const char *tmp_dir = getenv("TMPDIR");
+  return std::string(tmp_dir == nullptr ? "/tmp" : tmp_dir) + "/dynslam-test-" +
+         std::to_string(getpid()) + "-" + name;
+}
+
+void TestVoxelBlockCodec();
+void TestDepthSamples();
+void TestMultiThresholdEvaluation();
+void TestDecayWheel();
+void TestMetricsSink();
+
+}
+}
+
+#endif //DYNSLAM_TESTUTILS_H
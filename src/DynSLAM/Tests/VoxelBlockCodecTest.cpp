@@ -0,0 +1,186 @@
+#include <cstdlib>
+#include <random>
+
+#include "TestUtils.h"
+#include "../VoxelBlockCodec.h"
+
+namespace dynslam {
+namespace tests {
+
+using namespace std;
+using namespace dynslam::drivers;
+
+namespace {
+
+/// \brief Blocks with a mix of unobserved voxels, saturated weights, and SDF values at the limits
+///        of their range, which are the cases the compact formats need to handle specially.
+vector<VoxelBlock> GenerateBlocks(mt19937 &rng, int count) {
+  uniform_int_distribution<int> sdf_dist(numeric_limits<short>::min(),
+                                         numeric_limits<short>::max());
+  uniform_int_distribution<int> byte_dist(0, 255);
+  uniform_int_distribution<int> kind_dist(0, 9);
+
+  vector<VoxelBlock> blocks(static_cast<size_t>(count));
+  for (int b = 0; b < count; ++b) {
+    VoxelBlock &block = blocks[b];
+    block.pos = Vector3s(static_cast<short>(b - count / 2), static_cast<short>(3 * b),
+                         static_cast<short>(-b));
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      ITMVoxel &voxel = block.voxels[v];
+      int kind = kind_dist(rng);
+      voxel.sdf = static_cast<short>(sdf_dist(rng));
+      voxel.w_depth = static_cast<uint8_t>(byte_dist(rng));
+      voxel.w_color = static_cast<uint8_t>(byte_dist(rng));
+      voxel.clr = Vector3u(static_cast<uint8_t>(byte_dist(rng)),
+                           static_cast<uint8_t>(byte_dist(rng)),
+                           static_cast<uint8_t>(byte_dist(rng)));
+      if (kind == 0) {
+        voxel.w_depth = 0;
+      }
+      else if (kind == 1) {
+        voxel.sdf = numeric_limits<short>::max();
+      }
+      else if (kind == 2) {
+        voxel.sdf = numeric_limits<short>::min();
+      }
+    }
+  }
+  return blocks;
+}
+
+vector<VoxelBlock> RoundTrip(const vector<VoxelBlock> &blocks,
+                             const VoxelQuantization &quantization) {
+  vector<uint8_t> encoded;
+  EncodeVoxelBlocks(blocks, quantization, encoded);
+  vector<VoxelBlock> decoded;
+  DecodeVoxelBlocks(encoded, decoded);
+  CHECK(decoded.size() == blocks.size());
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    CHECK(decoded[b].pos == blocks[b].pos);
+  }
+  return decoded;
+}
+
+bool IsCanonical(const ITMVoxel &voxel) {
+  const ITMVoxel canonical;
+  return voxel.sdf == canonical.sdf && voxel.w_depth == canonical.w_depth &&
+         voxel.clr == canonical.clr && voxel.w_color == canonical.w_color;
+}
+
+void CheckLossless(const vector<VoxelBlock> &blocks) {
+  vector<VoxelBlock> decoded = RoundTrip(blocks, VoxelQuantization::Lossless());
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      const ITMVoxel &expected = blocks[b].voxels[v];
+      const ITMVoxel &actual = decoded[b].voxels[v];
+      CHECK(actual.sdf == expected.sdf);
+      CHECK(actual.w_depth == expected.w_depth);
+      CHECK(actual.clr == expected.clr);
+      CHECK(actual.w_color == expected.w_color);
+    }
+  }
+
+  // Decoding appends, so restoring several batches into the same buffer keeps the earlier ones.
+  vector<uint8_t> encoded;
+  EncodeVoxelBlocks(blocks, VoxelQuantization::Lossless(), encoded);
+  vector<VoxelBlock> appended(1);
+  DecodeVoxelBlocks(encoded, appended);
+  CHECK(appended.size() == blocks.size() + 1);
+  if (! blocks.empty()) {
+    CHECK(appended.back().pos == blocks.back().pos);
+  }
+}
+
+void CheckSdfDropBits(const vector<VoxelBlock> &blocks) {
+  const int drop_bits = 6;
+  vector<VoxelBlock> decoded = RoundTrip(blocks, VoxelQuantization(drop_bits, true));
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      const ITMVoxel &expected = blocks[b].voxels[v];
+      const ITMVoxel &actual = decoded[b].voxels[v];
+      if (expected.w_depth == 0) {
+        CHECK(IsCanonical(actual));
+        continue;
+      }
+
+      // Rounding to nearest, except at the top of the range, which gets rounded down instead.
+      int error = abs(actual.sdf - expected.sdf);
+      int max_error = (expected.sdf > numeric_limits<short>::max() - (1 << drop_bits))
+                      ? (1 << drop_bits) - 1
+                      : 1 << (drop_bits - 1);
+      CHECK(error <= max_error);
+      CHECK(actual.sdf % (1 << drop_bits) == 0);
+      CHECK(actual.w_depth == expected.w_depth);
+      CHECK(actual.clr == expected.clr);
+      CHECK(actual.w_color == expected.w_color);
+    }
+  }
+}
+
+void CheckCompact(const vector<VoxelBlock> &blocks, VoxelFormat format) {
+  vector<VoxelBlock> decoded = RoundTrip(blocks, VoxelQuantization(0, false, format));
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      const ITMVoxel &expected = blocks[b].voxels[v];
+      const ITMVoxel &actual = decoded[b].voxels[v];
+      if (expected.w_depth == 0) {
+        CHECK(IsCanonical(actual));
+        continue;
+      }
+
+      // 8 bits of SDF, with the top bucket also absorbing the values which would overflow it.
+      int error = abs(actual.sdf - expected.sdf);
+      CHECK(error <= (expected.sdf >= 127 * 256 + 128 ? 255 : 128));
+      CHECK(actual.w_depth == min(static_cast<int>(expected.w_depth), 15));
+
+      if (format == VoxelFormat::kCompactNoColor) {
+        CHECK(actual.w_color == ITMVoxel().w_color);
+        CHECK(actual.clr == ITMVoxel().clr);
+      }
+      else {
+        CHECK(actual.w_color == min(static_cast<int>(expected.w_color), 15));
+        CHECK(abs(actual.clr.x - expected.clr.x) <= 7);
+        CHECK(abs(actual.clr.y - expected.clr.y) <= 3);
+        CHECK(abs(actual.clr.z - expected.clr.z) <= 7);
+      }
+    }
+  }
+}
+
+void CheckCorruptData(const vector<VoxelBlock> &blocks) {
+  vector<uint8_t> encoded;
+  EncodeVoxelBlocks(blocks, VoxelQuantization(0, false, VoxelFormat::kCompact), encoded);
+
+  vector<VoxelBlock> decoded;
+  vector<uint8_t> truncated(encoded.begin(), encoded.begin() + encoded.size() / 2);
+  CHECK_THROWS(DecodeVoxelBlocks(truncated, decoded));
+
+  vector<uint8_t> bad_magic = encoded;
+  bad_magic[0] ^= 0xFF;
+  CHECK_THROWS(DecodeVoxelBlocks(bad_magic, decoded));
+
+  CHECK_THROWS(DecodeVoxelBlocks(vector<uint8_t>(), decoded));
+}
+
+}
+
+void TestVoxelBlockCodec() {
+  mt19937 rng(1234);
+  vector<VoxelBlock> blocks = GenerateBlocks(rng, 16);
+
+  CheckLossless(blocks);
+  CheckLossless(vector<VoxelBlock>());
+  CheckSdfDropBits(blocks);
+  CheckCompact(blocks, VoxelFormat::kCompact);
+  CheckCompact(blocks, VoxelFormat::kCompactNoColor);
+  CheckCorruptData(blocks);
+
+  for (VoxelFormat format : { VoxelFormat::kFull, VoxelFormat::kCompact,
+                              VoxelFormat::kCompactNoColor }) {
+    CHECK(ParseVoxelFormat(GetVoxelFormatName(format)) == format);
+  }
+  CHECK_THROWS(ParseVoxelFormat("lossy"));
+}
+
+}
+}
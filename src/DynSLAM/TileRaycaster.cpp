@@ -0,0 +1,393 @@
+#include "TileRaycaster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Utils.h"
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+
+namespace {
+
+/// \brief The smallest step taken outside of empty blocks, in voxels, so that rays which graze
+///        a surface still make progress.
+const float kMinStepVoxels = 0.5f;
+
+const Vector4u kNoHitColor(0, 0, 0, 0);
+
+Vector3s ToBlockPos(const Eigen::Vector3f &voxel_point) {
+  return Vector3s(static_cast<short>(floor(voxel_point(0) / SDF_BLOCK_SIZE)),
+                  static_cast<short>(floor(voxel_point(1) / SDF_BLOCK_SIZE)),
+                  static_cast<short>(floor(voxel_point(2) / SDF_BLOCK_SIZE)));
+}
+
+/// \brief Narrows down the [start, end] depth range of a ray to the part inside the given box.
+/// \returns False if the ray misses the box.
+bool ClipToBox(const Eigen::Vector3f &origin,
+               const Eigen::Vector3f &direction,
+               const Eigen::Vector3f &min_corner,
+               const Eigen::Vector3f &max_corner,
+               float &start,
+               float &end) {
+  for (int axis = 0; axis < 3; ++axis) {
+    if (direction(axis) == 0.0f) {
+      if (origin(axis) < min_corner(axis) || origin(axis) > max_corner(axis)) {
+        return false;
+      }
+      continue;
+    }
+
+    float t_min = (min_corner(axis) - origin(axis)) / direction(axis);
+    float t_max = (max_corner(axis) - origin(axis)) / direction(axis);
+    start = max(start, min(t_min, t_max));
+    end = min(end, max(t_min, t_max));
+  }
+  return start < end;
+}
+
+/// \brief Computes the pixel rectangle [x_begin, x_end) x [y_begin, y_end) of a width x height
+///        image covered by the given box, in meters, as seen from the given camera.
+/// \returns False if the box is not in view. The rectangle spans the whole image if the box
+///          straddles the near plane.
+bool ProjectBox(const Eigen::Vector3f &min_corner,
+                const Eigen::Vector3f &max_corner,
+                const Eigen::Matrix4f &world_to_camera,
+                const Eigen::Vector4f &intrinsics,
+                float min_depth,
+                int width,
+                int height,
+                int &x_begin,
+                int &y_begin,
+                int &x_end,
+                int &y_end) {
+  float min_x = numeric_limits<float>::max(), min_y = min_x;
+  float max_x = numeric_limits<float>::lowest(), max_y = max_x;
+  int behind_count = 0;
+  for (int i = 0; i < 8; ++i) {
+    Eigen::Vector3f corner((i & 1) ? max_corner(0) : min_corner(0),
+                           (i & 2) ? max_corner(1) : min_corner(1),
+                           (i & 4) ? max_corner(2) : min_corner(2));
+    Eigen::Vector3f point = world_to_camera.block<3, 3>(0, 0) * corner +
+                            world_to_camera.block<3, 1>(0, 3);
+    if (point(2) < min_depth) {
+      behind_count++;
+      continue;
+    }
+
+    float u = intrinsics(0) * point(0) / point(2) + intrinsics(2);
+    float v = intrinsics(1) * point(1) / point(2) + intrinsics(3);
+    min_x = min(min_x, u);
+    min_y = min(min_y, v);
+    max_x = max(max_x, u);
+    max_y = max(max_y, v);
+  }
+
+  if (behind_count == 8) {
+    return false;
+  }
+  if (behind_count > 0) {
+    x_begin = y_begin = 0;
+    x_end = width;
+    y_end = height;
+    return true;
+  }
+
+  // Clip in floating point, since corners close to the near plane can project very far away.
+  x_begin = static_cast<int>(floor(max(min_x, 0.0f)));
+  y_begin = static_cast<int>(floor(max(min_y, 0.0f)));
+  x_end = static_cast<int>(ceil(min(max_x + 1.0f, static_cast<float>(width))));
+  y_end = static_cast<int>(ceil(min(max_y + 1.0f, static_cast<float>(height))));
+  return x_begin < x_end && y_begin < y_end;
+}
+
+uchar ToColorChannel(float value) {
+  return static_cast<uchar>(max(0.0f, min(255.0f, value * 255.0f)));
+}
+
+}
+
+void TileRaycaster::Render(const PlanarVoxelMap &map,
+                           const Eigen::Matrix4f &world_to_camera,
+                           const Eigen::Vector4f &intrinsics,
+                           int width,
+                           int height,
+                           PreviewType type,
+                           float *out_depth,
+                           Vector4u *out_color,
+                           const uint8_t *mask) const {
+  const bool render_color = (nullptr != out_color && type != PreviewType::kDepth);
+
+  // Rays only need to be marched through the part of the map's bounding box within range.
+  Eigen::Vector3f min_corner, max_corner;
+  bool map_empty = ! map.GetBounds(min_corner, max_corner);
+
+  ForEachRay(world_to_camera, intrinsics, width, 0, 0, width, height,
+             [&](int idx,
+                 const Eigen::Vector3f &origin,
+                 const Eigen::Vector3f &direction,
+                 PlanarVoxelMap::LookupCache &cache) {
+    if (nullptr != mask && 0 == mask[idx]) {
+      return;
+    }
+
+    float start_depth = min_depth_;
+    float end_depth = max_depth_;
+    float depth = 0.0f;
+    if (! map_empty &&
+        ClipToBox(origin, direction, min_corner, max_corner, start_depth, end_depth)) {
+      depth = March(map, origin, direction, start_depth, end_depth, cache);
+    }
+
+    if (nullptr != out_depth) {
+      out_depth[idx] = depth;
+    }
+    if (render_color) {
+      out_color[idx] = (depth > 0)
+                       ? Shade(map, origin + direction * depth, direction, type, cache)
+                       : kNoHitColor;
+    }
+  });
+}
+
+void TileRaycaster::RenderOver(const PlanarVoxelMap &map,
+                               const Eigen::Matrix4f &world_to_camera,
+                               const Eigen::Vector4f &intrinsics,
+                               int width,
+                               int height,
+                               PreviewType type,
+                               float *depth,
+                               const std::function<void(int, const Vector4u &)> &on_top) const {
+  Eigen::Vector3f min_corner, max_corner;
+  if (! map.GetBounds(min_corner, max_corner)) {
+    return;
+  }
+
+  // Only the pixels the map's bounding box projects onto can see it.
+  int x_begin, y_begin, x_end, y_end;
+  if (! ProjectBox(min_corner * voxel_size_, max_corner * voxel_size_, world_to_camera, intrinsics,
+                   min_depth_, width, height, x_begin, y_begin, x_end, y_end)) {
+    return;
+  }
+
+  const bool render_color = (on_top && type != PreviewType::kDepth);
+  ForEachRay(world_to_camera, intrinsics, width, x_begin, y_begin, x_end, y_end,
+             [&](int idx,
+                 const Eigen::Vector3f &origin,
+                 const Eigen::Vector3f &direction,
+                 PlanarVoxelMap::LookupCache &cache) {
+    // Whatever is already there occludes everything behind it, so the ray can stop there.
+    float start_depth = min_depth_;
+    float end_depth = (depth[idx] > 0) ? min(depth[idx], max_depth_) : max_depth_;
+    if (! ClipToBox(origin, direction, min_corner, max_corner, start_depth, end_depth)) {
+      return;
+    }
+
+    float hit_depth = March(map, origin, direction, start_depth, end_depth, cache);
+    if (hit_depth <= 0 || (depth[idx] > 0 && hit_depth >= depth[idx])) {
+      return;
+    }
+
+    depth[idx] = hit_depth;
+    if (on_top) {
+      on_top(idx, render_color
+                  ? Shade(map, origin + direction * hit_depth, direction, type, cache)
+                  : kNoHitColor);
+    }
+  });
+}
+
+void TileRaycaster::RenderAt(const PlanarVoxelMap &map,
+                             const Eigen::Matrix4f &world_to_camera,
+                             const Eigen::Vector4f &intrinsics,
+                             const vector<Eigen::Vector2i> &pixels,
+                             float *depth) const {
+  Eigen::Vector3f min_corner, max_corner;
+  if (! map.GetBounds(min_corner, max_corner)) {
+    return;
+  }
+
+  const Eigen::Matrix4f camera_to_world = world_to_camera.inverse();
+  const Eigen::Matrix3f rotation = camera_to_world.block<3, 3>(0, 0) / voxel_size_;
+  const Eigen::Vector3f origin = camera_to_world.block<3, 1>(0, 3) / voxel_size_;
+  const float fx = intrinsics(0);
+  const float fy = intrinsics(1);
+  const float cx = intrinsics(2);
+  const float cy = intrinsics(3);
+
+  utils::ParallelFor(0, static_cast<int>(pixels.size()), [&](int begin, int end) {
+    // Consecutive pixels tend to be close to each other, e.g., along a LIDAR scan line.
+    PlanarVoxelMap::LookupCache cache;
+    for (int i = begin; i < end; ++i) {
+      Eigen::Vector3f direction = rotation * Eigen::Vector3f((pixels[i](0) - cx) / fx,
+                                                             (pixels[i](1) - cy) / fy,
+                                                             1.0f);
+      float start_depth = min_depth_;
+      float end_depth = (depth[i] > 0) ? min(depth[i], max_depth_) : max_depth_;
+      if (! ClipToBox(origin, direction, min_corner, max_corner, start_depth, end_depth)) {
+        continue;
+      }
+
+      float hit_depth = March(map, origin, direction, start_depth, end_depth, cache);
+      if (hit_depth > 0 && (depth[i] == 0 || hit_depth < depth[i])) {
+        depth[i] = hit_depth;
+      }
+    }
+  }, kTileSize * kTileSize);
+}
+
+template<typename TraceFn>
+void TileRaycaster::ForEachRay(const Eigen::Matrix4f &world_to_camera,
+                               const Eigen::Vector4f &intrinsics,
+                               int width,
+                               int x_begin,
+                               int y_begin,
+                               int x_end,
+                               int y_end,
+                               TraceFn trace) const {
+  // Work in voxel coordinates, so that sampling needs no extra scaling.
+  const Eigen::Matrix4f camera_to_world = world_to_camera.inverse();
+  const Eigen::Matrix3f rotation = camera_to_world.block<3, 3>(0, 0) / voxel_size_;
+  const Eigen::Vector3f origin = camera_to_world.block<3, 1>(0, 3) / voxel_size_;
+  const float fx = intrinsics(0);
+  const float fy = intrinsics(1);
+  const float cx = intrinsics(2);
+  const float cy = intrinsics(3);
+
+  const int tiles_x = (x_end - x_begin + kTileSize - 1) / kTileSize;
+  const int tiles_y = (y_end - y_begin + kTileSize - 1) / kTileSize;
+  utils::ParallelFor(0, tiles_x * tiles_y, [&](int begin, int end) {
+    PlanarVoxelMap::LookupCache cache;
+    float dir_x[kTileSize * kTileSize];
+    float dir_y[kTileSize * kTileSize];
+    float dir_z[kTileSize * kTileSize];
+
+    for (int tile = begin; tile < end; ++tile) {
+      int tile_x_begin = x_begin + (tile % tiles_x) * kTileSize;
+      int tile_y_begin = y_begin + (tile / tiles_x) * kTileSize;
+      int tile_x_end = min(tile_x_begin + kTileSize, x_end);
+      int tile_y_end = min(tile_y_begin + kTileSize, y_end);
+
+      // Set up all the tile's ray directions in one go. This loop has no branches, so it gets
+      // vectorized, unlike the marching itself, whose step sizes and block lookups differ from
+      // ray to ray. The directions are scaled to advance by one meter along the camera's z axis.
+      int ray_count = 0;
+      for (int y = tile_y_begin; y < tile_y_end; ++y) {
+        float cam_y = (y - cy) / fy;
+        for (int x = tile_x_begin; x < tile_x_end; ++x) {
+          float cam_x = (x - cx) / fx;
+          dir_x[ray_count] = rotation(0, 0) * cam_x + rotation(0, 1) * cam_y + rotation(0, 2);
+          dir_y[ray_count] = rotation(1, 0) * cam_x + rotation(1, 1) * cam_y + rotation(1, 2);
+          dir_z[ray_count] = rotation(2, 0) * cam_x + rotation(2, 1) * cam_y + rotation(2, 2);
+          ray_count++;
+        }
+      }
+
+      int ray_idx = 0;
+      for (int y = tile_y_begin; y < tile_y_end; ++y) {
+        for (int x = tile_x_begin; x < tile_x_end; ++x, ++ray_idx) {
+          Eigen::Vector3f direction(dir_x[ray_idx], dir_y[ray_idx], dir_z[ray_idx]);
+          trace(y * width + x, origin, direction, cache);
+        }
+      }
+    }
+  });
+}
+
+float TileRaycaster::March(const PlanarVoxelMap &map,
+                           const Eigen::Vector3f &origin,
+                           const Eigen::Vector3f &direction,
+                           float start_depth,
+                           float end_depth,
+                           PlanarVoxelMap::LookupCache &cache) const {
+  // How many voxels the ray travels through while advancing one meter in depth.
+  const float voxels_per_meter = direction.norm();
+  const float mu_voxels = mu_ / voxel_size_;
+
+  float depth = start_depth;
+  float prev_depth = depth;
+  float prev_sdf = 1.0f;
+  bool prev_valid = false;
+  while (depth < end_depth) {
+    Eigen::Vector3f point = origin + direction * depth;
+    float sdf;
+    if (! map.SampleSdf(point, sdf, &cache)) {
+      // Skip empty blocks in one go. Like InfiniTAM, treat unobserved voxels as free space.
+      bool in_block = (nullptr != map.FindBlock(ToBlockPos(point), &cache));
+      float step_voxels = in_block ? mu_voxels : SDF_BLOCK_SIZE;
+      depth += step_voxels / voxels_per_meter;
+      prev_valid = false;
+      continue;
+    }
+
+    if (sdf <= 0.0f) {
+      if (prev_valid) {
+        // Interpolate the zero crossing between the last two samples.
+        return prev_depth + (depth - prev_depth) * prev_sdf / (prev_sdf - sdf);
+      }
+      if (sdf > -1.0f) {
+        // We skipped over the crossing, e.g., when stepping into a block, but we're still within
+        // the truncation band, so the SDF tells us how far back the surface is.
+        return depth + sdf * mu_voxels / voxels_per_meter;
+      }
+    }
+
+    prev_valid = (sdf > 0.0f);
+    prev_sdf = sdf;
+    prev_depth = depth;
+    depth += max(sdf * mu_voxels, kMinStepVoxels) / voxels_per_meter;
+  }
+
+  return 0.0f;
+}
+
+Vector4u TileRaycaster::Shade(const PlanarVoxelMap &map,
+                              const Eigen::Vector3f &point,
+                              const Eigen::Vector3f &direction,
+                              PreviewType type,
+                              PlanarVoxelMap::LookupCache &cache) const {
+  if (type == PreviewType::kColor) {
+    Eigen::Vector3i voxel_pos(static_cast<int>(round(point(0))),
+                              static_cast<int>(round(point(1))),
+                              static_cast<int>(round(point(2))));
+    Vector3u color;
+    if (! map.ReadColor(voxel_pos, color, &cache)) {
+      return kNoHitColor;
+    }
+    return Vector4u(color.x, color.y, color.z, 255);
+  }
+
+  // The SDF gradient points away from the surface, i.e., it is the surface normal.
+  Eigen::Vector3f normal;
+  for (int axis = 0; axis < 3; ++axis) {
+    Eigen::Vector3f offset = Eigen::Vector3f::Unit(axis);
+    float before, after;
+    if (! map.SampleSdf(point - offset, before, &cache) ||
+        ! map.SampleSdf(point + offset, after, &cache)) {
+      return kNoHitColor;
+    }
+    normal(axis) = after - before;
+  }
+  if (normal.squaredNorm() == 0.0f) {
+    return kNoHitColor;
+  }
+  normal.normalize();
+
+  if (type == PreviewType::kNormal) {
+    return Vector4u(ToColorChannel((1.0f - normal(0)) * 0.35f + 0.3f),
+                    ToColorChannel((1.0f - normal(1)) * 0.35f + 0.3f),
+                    ToColorChannel((1.0f - normal(2)) * 0.35f + 0.3f),
+                    255);
+  }
+
+  // Gray: Lambertian shading, with the light at the camera, like InfiniTAM's.
+  float lambertian = max(0.0f, -normal.dot(direction.normalized()));
+  uchar gray = ToColorChannel(0.8f * lambertian + 0.2f);
+  return Vector4u(gray, gray, gray, 255);
+}
+
+}  // namespace drivers
+}  // namespace dynslam
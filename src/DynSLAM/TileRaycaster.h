@@ -0,0 +1,127 @@
+#ifndef DYNSLAM_TILERAYCASTER_H
+#define DYNSLAM_TILERAYCASTER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "PlanarVoxelMap.h"
+#include "PreviewType.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief Renders a planar mirror of a map on the CPU.
+///
+/// The image is split into square tiles, which are processed in parallel. The rays of a tile share
+/// a block lookup cache, since neighboring rays mostly walk through the same blocks, and their
+/// directions are set up in bulk, in a form the compiler can vectorize.
+class TileRaycaster {
+ public:
+  /// \param voxel_size The map's voxel size, in meters.
+  /// \param mu The map's truncation band, in meters.
+  /// \param min_depth Rays start this far from the camera, in meters.
+  /// \param max_depth Rays stop this far from the camera, in meters.
+  TileRaycaster(float voxel_size, float mu, float min_depth, float max_depth)
+      : voxel_size_(voxel_size),
+        mu_(mu),
+        min_depth_(min_depth),
+        max_depth_(max_depth) {}
+
+  static bool Supports(PreviewType type) {
+    return type == PreviewType::kDepth || type == PreviewType::kGray ||
+           type == PreviewType::kColor || type == PreviewType::kNormal;
+  }
+
+  /// \brief Renders the map as seen from the given camera.
+  /// \param world_to_camera The camera pose, as a world-to-camera transform.
+  /// \param intrinsics The camera's (fx, fy, cx, cy).
+  /// \param out_depth Receives the depth along the camera's z axis, in meters, or zero where no
+  ///                  surface was hit. Must hold width * height floats. Can be null.
+  /// \param out_color Receives the 'type' visualization. Must hold width * height pixels. Can be
+  ///                  null, and is ignored if 'type' is 'kDepth'.
+  /// \param mask If not null, only the pixels where this is nonzero get rendered, and the others
+  ///             are left untouched.
+  void Render(const PlanarVoxelMap &map,
+              const Eigen::Matrix4f &world_to_camera,
+              const Eigen::Vector4f &intrinsics,
+              int width,
+              int height,
+              PreviewType type,
+              float *out_depth,
+              Vector4u *out_color,
+              const uint8_t *mask = nullptr) const;
+
+  /// \brief Renders the map over an existing rendering, wherever the map's surface is nearer.
+  ///
+  /// Rays are only cast for the pixels within the map's projected bounding box, and stop at the
+  /// existing surface, so the cost scales with how much of the image the map covers.
+  /// \param depth The existing rendering's depth, which gets updated where the map is on top.
+  /// \param on_top If not empty, gets called with the index and the 'type' visualization of every
+  ///               pixel where the map is on top. It may be called from several threads at once,
+  ///               but never twice for the same pixel.
+  void RenderOver(const PlanarVoxelMap &map,
+                  const Eigen::Matrix4f &world_to_camera,
+                  const Eigen::Vector4f &intrinsics,
+                  int width,
+                  int height,
+                  PreviewType type,
+                  float *depth,
+                  const std::function<void(int, const Vector4u &)> &on_top) const;
+
+  /// \brief Raycasts the depth of the map only at the given pixels, e.g., where the ground truth
+  ///        is known, keeping whichever surface is nearest, like 'RenderOver'.
+  /// \param depth Holds one depth per pixel, in the same order, or zero for no surface yet.
+  void RenderAt(const PlanarVoxelMap &map,
+                const Eigen::Matrix4f &world_to_camera,
+                const Eigen::Vector4f &intrinsics,
+                const std::vector<Eigen::Vector2i> &pixels,
+                float *depth) const;
+
+ private:
+  /// \brief Side length of the tiles, in pixels.
+  static const int kTileSize = 16;
+
+  float voxel_size_;
+  float mu_;
+  float min_depth_;
+  float max_depth_;
+
+  /// \brief Sets up the rays for the pixels in [x_begin, x_end) x [y_begin, y_end), tile by tile,
+  ///        in parallel, and calls 'trace(idx, origin, direction, cache)' for each of them, with
+  ///        the ray in the form 'March' expects.
+  template<typename TraceFn>
+  void ForEachRay(const Eigen::Matrix4f &world_to_camera,
+                  const Eigen::Vector4f &intrinsics,
+                  int width,
+                  int x_begin,
+                  int y_begin,
+                  int x_end,
+                  int y_end,
+                  TraceFn trace) const;
+
+  /// \brief Marches a single ray, whose direction is scaled so that it has unit length along the
+  ///        camera's z axis, and which is expressed in voxels.
+  /// \param start_depth, end_depth The depth range to search, in meters.
+  /// \returns The depth of the first zero crossing, in meters, or zero if there is none.
+  float March(const PlanarVoxelMap &map,
+              const Eigen::Vector3f &origin,
+              const Eigen::Vector3f &direction,
+              float start_depth,
+              float end_depth,
+              PlanarVoxelMap::LookupCache &cache) const;
+
+  /// \brief Computes the visualization of the surface at the given point, in voxel coordinates.
+  Vector4u Shade(const PlanarVoxelMap &map,
+                 const Eigen::Vector3f &point,
+                 const Eigen::Vector3f &direction,
+                 PreviewType type,
+                 PlanarVoxelMap::LookupCache &cache) const;
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_TILERAYCASTER_H
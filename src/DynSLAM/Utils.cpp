@@ -8,6 +8,11 @@
 #include <memory>
 #include <sys/time.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
 #include <opencv/cv.h>
 #include <mutex>
 
@@ -152,6 +157,165 @@ Eigen::Vector2f PixelsToGl(const Eigen::Vector2f &px, const Eigen::Vector2f &px_
   return Eigen::Vector2f(gl_x, gl_y);
 }
 
+namespace {
+
+int worker_count_override = 0;
+
+/// \brief The chunks of a single 'ParallelFor' call, which both the workers and the calling
+///        thread claim until none are left.
+struct ParallelBatch {
+  const function<void(int, int)> *fn;
+  int begin;
+  int end;
+  int chunk_size;
+  int chunk_count;
+  atomic<int> next_chunk;
+
+  mutex done_mutex;
+  condition_variable done_cv;
+  int done_chunks;
+  /// \brief The first exception thrown by 'fn', if any.
+  exception_ptr error;
+
+  ParallelBatch(const function<void(int, int)> &fn, int begin, int end, int chunk_size,
+                int chunk_count)
+      : fn(&fn),
+        begin(begin),
+        end(end),
+        chunk_size(chunk_size),
+        chunk_count(chunk_count),
+        next_chunk(0),
+        done_chunks(0) {}
+
+  /// \brief Processes unclaimed chunks until there are none left.
+  void RunChunks() {
+    int chunk;
+    while ((chunk = next_chunk.fetch_add(1)) < chunk_count) {
+      int chunk_begin = begin + chunk * chunk_size;
+      exception_ptr chunk_error;
+      try {
+        (*fn)(chunk_begin, min(chunk_begin + chunk_size, end));
+      }
+      catch (...) {
+        chunk_error = current_exception();
+      }
+
+      lock_guard<mutex> lock(done_mutex);
+      if (chunk_error && ! error) {
+        error = chunk_error;
+      }
+      if (++done_chunks == chunk_count) {
+        done_cv.notify_all();
+      }
+    }
+  }
+
+  void WaitUntilDone() {
+    unique_lock<mutex> lock(done_mutex);
+    done_cv.wait(lock, [this] { return done_chunks == chunk_count; });
+  }
+};
+
+/// \brief Long-lived threads which help out with 'ParallelFor' calls, so that the calls do not
+///        start new threads every time.
+class WorkerPool {
+ public:
+  ~WorkerPool() {
+    {
+      lock_guard<mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  /// \brief Asks 'helper_count' workers to help with the batch, starting more threads if needed.
+  /// The workers only ever claim chunks which are left, so nested calls cannot deadlock: the
+  /// calling thread finishes its own batch if all the workers are busy.
+  void Submit(const shared_ptr<ParallelBatch> &batch, int helper_count) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      while (static_cast<int>(workers_.size()) < helper_count) {
+        workers_.emplace_back([this] { Work(); });
+      }
+      for (int i = 0; i < helper_count; ++i) {
+        pending_.push_back(batch);
+      }
+    }
+    work_cv_.notify_all();
+  }
+
+ private:
+  void Work() {
+    while (true) {
+      shared_ptr<ParallelBatch> batch;
+      {
+        unique_lock<mutex> lock(mutex_);
+        work_cv_.wait(lock, [this] { return stopping_ || ! pending_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        batch = pending_.front();
+        pending_.pop_front();
+      }
+      batch->RunChunks();
+    }
+  }
+
+  mutex mutex_;
+  condition_variable work_cv_;
+  deque<shared_ptr<ParallelBatch>> pending_;
+  vector<thread> workers_;
+  bool stopping_ = false;
+};
+
+WorkerPool &GetWorkerPool() {
+  static WorkerPool pool;
+  return pool;
+}
+
+}
+
+int GetWorkerCount() {
+  if (worker_count_override > 0) {
+    return worker_count_override;
+  }
+  return max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+
+void SetWorkerCount(int worker_count) {
+  worker_count_override = worker_count;
+}
+
+void ParallelFor(int begin, int end, const function<void(int, int)> &fn, int min_chunk_size) {
+  int size = end - begin;
+  if (size <= 0) {
+    return;
+  }
+
+  int chunk_count = min(GetWorkerCount(), max(1, size / max(1, min_chunk_size)));
+  int chunk_size = (size + chunk_count - 1) / chunk_count;
+  chunk_count = (size + chunk_size - 1) / chunk_size;
+  if (chunk_count == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  // Shared, since workers may still dequeue the (by then finished) batch after we return.
+  auto batch = make_shared<ParallelBatch>(fn, begin, end, chunk_size, chunk_count);
+  GetWorkerPool().Submit(batch, chunk_count - 1);
+
+  // Make sure every chunk is done before propagating any exceptions, since they may reference
+  // the caller's stack.
+  batch->RunChunks();
+  batch->WaitUntilDone();
+  if (batch->error) {
+    rethrow_exception(batch->error);
+  }
+}
+
 } // namespace utils
 } // namespace dynslam
 
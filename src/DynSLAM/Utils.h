@@ -2,6 +2,7 @@
 #define DYNSLAM_UTILS_H
 
 #include <cmath>
+#include <functional>
 #include <map>
 #include <string>
 #include <sys/stat.h>
@@ -268,6 +269,21 @@ inline float TranslationError(const Eigen::Matrix4f &pose_error) {
 Eigen::Vector2f PixelsToGl(const Eigen::Vector2f &px, const Eigen::Vector2f &px_range,
                            const Eigen::Vector2f &view_bounds);
 
+/// \brief The number of threads used by 'ParallelFor'. Defaults to the number of cores.
+int GetWorkerCount();
+
+/// \brief Overrides the number of threads used by 'ParallelFor'. Zero restores the default.
+void SetWorkerCount(int worker_count);
+
+/// \brief Splits [begin, end) into contiguous chunks and processes them in parallel, calling
+///        'fn(chunk_begin, chunk_end)' once per chunk.
+/// Returns once all chunks are done, rethrowing the first exception thrown by 'fn', if any. The
+/// chunks are shared between the calling thread and a pool of long-lived worker threads, so it
+/// is safe to call this from within 'fn'.
+/// \param min_chunk_size Ranges are not split into chunks smaller than this, since handing a
+///                       chunk to another thread is not free.
+void ParallelFor(int begin, int end, const std::function<void(int, int)> &fn,
+                 int min_chunk_size = 1);
 
 } // namespace utils
 } // namespace dynslam
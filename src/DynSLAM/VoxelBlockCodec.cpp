@@ -0,0 +1,356 @@
+#include "VoxelBlockCodec.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "Utils.h"
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+using namespace dynslam::utils;
+
+namespace {
+
+const uint32_t kMagic = 0x42565344;     // "DSVB"
+/// \brief Version 2 added the voxel format. Version 1 data is always in the full format.
+const uint32_t kVersion = 2;
+
+struct CodecHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t block_count;
+  /// \brief The size of InfiniTAM's voxel type, which must match, whatever the format.
+  uint32_t voxel_bytes;
+  uint32_t format;
+};
+
+/// \brief The size of the version 1 header, which lacks the format.
+const size_t kV1HeaderBytes = 4 * sizeof(uint32_t);
+
+// Run-length coding: a control byte c < 128 is followed by (c + 1) literal bytes, while c >= 128
+// stands for (c - 127) zeros.
+const int kMaxRun = 128;
+
+void AppendRle(const uint8_t *data, size_t size, vector<uint8_t> &out) {
+  size_t i = 0;
+  while (i < size) {
+    size_t zeros = 0;
+    while (i + zeros < size && data[i + zeros] == 0 && zeros < kMaxRun) {
+      zeros++;
+    }
+
+    // Short zero runs are cheaper to store as part of a literal.
+    if (zeros >= 2 || (zeros == 1 && i + 1 == size)) {
+      out.push_back(static_cast<uint8_t>(127 + zeros));
+      i += zeros;
+      continue;
+    }
+
+    size_t start = i;
+    size_t count = 0;
+    while (i < size && count < kMaxRun) {
+      if (data[i] == 0 && i + 1 < size && data[i + 1] == 0) {
+        break;
+      }
+      i++;
+      count++;
+    }
+
+    out.push_back(static_cast<uint8_t>(count - 1));
+    out.insert(out.end(), data + start, data + start + count);
+  }
+}
+
+/// \returns The position in 'in' right after the decoded data.
+size_t ReadRle(const vector<uint8_t> &in, size_t pos, uint8_t *out, size_t size) {
+  size_t i = 0;
+  while (i < size) {
+    if (pos >= in.size()) {
+      throw runtime_error("Truncated voxel block data.");
+    }
+
+    uint8_t control = in[pos++];
+    size_t count = (control < kMaxRun) ? control + 1u : control - 127u;
+    if (i + count > size) {
+      throw runtime_error("Corrupt voxel block data (run overflow).");
+    }
+
+    if (control < kMaxRun) {
+      if (pos + count > in.size()) {
+        throw runtime_error("Truncated voxel block data.");
+      }
+      memcpy(out + i, in.data() + pos, count);
+      pos += count;
+    }
+    else {
+      memset(out + i, 0, count);
+    }
+    i += count;
+  }
+
+  return pos;
+}
+
+size_t GetFormatVoxelBytes(VoxelFormat format) {
+  switch (format) {
+    case VoxelFormat::kFull:
+      return sizeof(ITMVoxel);
+    case VoxelFormat::kCompact:
+      return 4;
+    case VoxelFormat::kCompactNoColor:
+      return 2;
+    default:
+      throw runtime_error(Format("Unknown voxel format: %d", static_cast<int>(format)));
+  }
+}
+
+uint8_t ClampWeight(int weight) {
+  return static_cast<uint8_t>(min(weight, 15));
+}
+
+/// \brief Converts the voxel to the given format, writing 'GetFormatVoxelBytes' bytes.
+void PackVoxel(const ITMVoxel &voxel, VoxelFormat format, uint8_t *out) {
+  if (format == VoxelFormat::kFull) {
+    memcpy(out, &voxel, sizeof(ITMVoxel));
+    return;
+  }
+
+  // Round to nearest, with the top bucket absorbing the values which would overflow.
+  int sdf = (voxel.sdf + 128) >> 8;
+  out[0] = static_cast<uint8_t>(static_cast<int8_t>(min(sdf, 127)));
+
+  if (format == VoxelFormat::kCompactNoColor) {
+    out[1] = ClampWeight(voxel.w_depth);
+    return;
+  }
+
+  out[1] = static_cast<uint8_t>(ClampWeight(voxel.w_depth) | (ClampWeight(voxel.w_color) << 4));
+  uint16_t rgb565 = static_cast<uint16_t>(((voxel.clr.x >> 3) << 11) |
+                                          ((voxel.clr.y >> 2) << 5) |
+                                          (voxel.clr.z >> 3));
+  out[2] = static_cast<uint8_t>(rgb565 & 0xFF);
+  out[3] = static_cast<uint8_t>(rgb565 >> 8);
+}
+
+void UnpackVoxel(const uint8_t *in, VoxelFormat format, ITMVoxel &voxel) {
+  if (format == VoxelFormat::kFull) {
+    memcpy(&voxel, in, sizeof(ITMVoxel));
+    return;
+  }
+
+  voxel = ITMVoxel();
+  voxel.w_depth = static_cast<uint8_t>(in[1] & 0x0F);
+  if (voxel.w_depth == 0) {
+    // Keep unobserved voxels canonical.
+    return;
+  }
+  voxel.sdf = static_cast<short>(static_cast<int8_t>(in[0]) * 256);
+
+  if (format == VoxelFormat::kCompact) {
+    voxel.w_color = static_cast<uint8_t>(in[1] >> 4);
+    uint16_t rgb565 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+    uint8_t r = static_cast<uint8_t>((rgb565 >> 11) & 0x1F);
+    uint8_t g = static_cast<uint8_t>((rgb565 >> 5) & 0x3F);
+    uint8_t b = static_cast<uint8_t>(rgb565 & 0x1F);
+    voxel.clr.x = static_cast<uint8_t>((r << 3) | (r >> 2));
+    voxel.clr.y = static_cast<uint8_t>((g << 2) | (g >> 4));
+    voxel.clr.z = static_cast<uint8_t>((b << 3) | (b >> 2));
+  }
+}
+
+void Quantize(const VoxelQuantization &quantization, ITMVoxel &voxel) {
+  if (quantization.clear_unobserved && voxel.w_depth == 0) {
+    voxel = ITMVoxel();
+    return;
+  }
+
+  if (quantization.sdf_drop_bits > 0) {
+    int shift = quantization.sdf_drop_bits;
+    // Round to nearest, keeping the value within the range of a short.
+    int sdf = voxel.sdf + (1 << (shift - 1));
+    sdf = min(sdf, static_cast<int>(numeric_limits<short>::max()));
+    // Multiplying instead of shifting back, since negative values must not be shifted left.
+    voxel.sdf = static_cast<short>((sdf >> shift) * (1 << shift));
+  }
+}
+
+}
+
+VoxelFormat ParseVoxelFormat(const string &name) {
+  if (name == "full") {
+    return VoxelFormat::kFull;
+  }
+  else if (name == "compact") {
+    return VoxelFormat::kCompact;
+  }
+  else if (name == "compact-nocolor") {
+    return VoxelFormat::kCompactNoColor;
+  }
+
+  throw runtime_error(Format("Unknown voxel format: [%s]. Expected one of [full, compact, "
+                             "compact-nocolor].", name.c_str()));
+}
+
+string GetVoxelFormatName(VoxelFormat format) {
+  switch (format) {
+    case VoxelFormat::kFull:
+      return "full";
+    case VoxelFormat::kCompact:
+      return "compact";
+    case VoxelFormat::kCompactNoColor:
+      return "compact-nocolor";
+    default:
+      throw runtime_error(Format("Unknown voxel format: %d", static_cast<int>(format)));
+  }
+}
+
+void EncodeVoxelBlocks(const vector<VoxelBlock> &blocks,
+                       const VoxelQuantization &quantization,
+                       vector<uint8_t> &out) {
+  const size_t voxel_bytes = GetFormatVoxelBytes(quantization.format);
+  const size_t voxel_count = blocks.size() * SDF_BLOCK_SIZE3;
+
+  CodecHeader header;
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.block_count = static_cast<uint32_t>(blocks.size());
+  header.voxel_bytes = static_cast<uint32_t>(sizeof(ITMVoxel));
+  header.format = static_cast<uint32_t>(quantization.format);
+
+  out.clear();
+  out.insert(out.end(),
+             reinterpret_cast<const uint8_t*>(&header),
+             reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+
+  // Block positions are stored as-is; they are a tiny fraction of the data.
+  for (const VoxelBlock &block : blocks) {
+    const short pos[3] = { block.pos.x, block.pos.y, block.pos.z };
+    out.insert(out.end(),
+               reinterpret_cast<const uint8_t*>(pos),
+               reinterpret_cast<const uint8_t*>(pos) + sizeof(pos));
+  }
+
+  // Convert everything up front, so that every voxel is only quantized once.
+  vector<uint8_t> packed(voxel_count * voxel_bytes);
+  size_t packed_idx = 0;
+  for (const VoxelBlock &block : blocks) {
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      ITMVoxel voxel = block.voxels[v];
+      Quantize(quantization, voxel);
+      PackVoxel(voxel, quantization.format, &packed[packed_idx]);
+      packed_idx += voxel_bytes;
+    }
+  }
+
+  vector<uint8_t> plane(voxel_count);
+  for (size_t b = 0; b < voxel_bytes; ++b) {
+    for (size_t i = 0; i < voxel_count; ++i) {
+      plane[i] = packed[i * voxel_bytes + b];
+    }
+
+    // Delta coding turns smooth regions into zeros, which the RLE can then remove.
+    uint8_t prev = 0;
+    for (size_t i = 0; i < voxel_count; ++i) {
+      uint8_t cur = plane[i];
+      plane[i] = static_cast<uint8_t>(cur - prev);
+      prev = cur;
+    }
+
+    AppendRle(plane.data(), plane.size(), out);
+  }
+}
+
+void DecodeVoxelBlocks(const vector<uint8_t> &encoded, vector<VoxelBlock> &out) {
+  CodecHeader header;
+  if (encoded.size() < kV1HeaderBytes) {
+    throw runtime_error("Truncated voxel block data.");
+  }
+  memcpy(&header, encoded.data(), kV1HeaderBytes);
+
+  size_t pos = kV1HeaderBytes;
+  if (header.magic != kMagic || header.version < 1 || header.version > kVersion) {
+    throw runtime_error("Unknown voxel block data format.");
+  }
+  if (header.version == 1) {
+    header.format = static_cast<uint32_t>(VoxelFormat::kFull);
+  }
+  else {
+    if (encoded.size() < sizeof(header)) {
+      throw runtime_error("Truncated voxel block data.");
+    }
+    memcpy(&header, encoded.data(), sizeof(header));
+    pos = sizeof(header);
+  }
+  if (header.voxel_bytes != sizeof(ITMVoxel)) {
+    throw runtime_error(Format("Voxel block data was encoded with a different voxel type "
+                               "(%d bytes instead of %d).",
+                               static_cast<int>(header.voxel_bytes),
+                               static_cast<int>(sizeof(ITMVoxel))));
+  }
+
+  const VoxelFormat format = static_cast<VoxelFormat>(header.format);
+  size_t offset = out.size();
+  const size_t voxel_bytes = GetFormatVoxelBytes(format);
+  const size_t voxel_count = header.block_count * static_cast<size_t>(SDF_BLOCK_SIZE3);
+
+  if (encoded.size() < pos + header.block_count * 3 * sizeof(short)) {
+    throw runtime_error("Truncated voxel block data.");
+  }
+  out.resize(offset + header.block_count);
+  for (size_t i = 0; i < header.block_count; ++i) {
+    short block_pos[3];
+    memcpy(block_pos, encoded.data() + pos, sizeof(block_pos));
+    pos += sizeof(block_pos);
+    out[offset + i].pos = Vector3s(block_pos[0], block_pos[1], block_pos[2]);
+  }
+
+  vector<uint8_t> packed(voxel_count * voxel_bytes);
+  vector<uint8_t> plane(voxel_count);
+  for (size_t b = 0; b < voxel_bytes; ++b) {
+    pos = ReadRle(encoded, pos, plane.data(), plane.size());
+
+    uint8_t prev = 0;
+    for (size_t i = 0; i < voxel_count; ++i) {
+      prev = static_cast<uint8_t>(prev + plane[i]);
+      packed[i * voxel_bytes + b] = prev;
+    }
+  }
+
+  size_t packed_idx = 0;
+  for (size_t i = 0; i < header.block_count; ++i) {
+    for (int v = 0; v < SDF_BLOCK_SIZE3; ++v) {
+      UnpackVoxel(&packed[packed_idx], format, out[offset + i].voxels[v]);
+      packed_idx += voxel_bytes;
+    }
+  }
+}
+
+void WriteBytes(const string &fpath, const vector<uint8_t> &data) {
+  ofstream out(fpath, ios::out | ios::binary);
+  if (! out.is_open()) {
+    throw runtime_error(Format("Could not open file [%s] for writing.", fpath.c_str()));
+  }
+  out.write(reinterpret_cast<const char*>(data.data()), data.size());
+  if (! out) {
+    throw runtime_error(Format("Could not write to file [%s].", fpath.c_str()));
+  }
+}
+
+void ReadBytes(const string &fpath, vector<uint8_t> &out) {
+  ifstream in(fpath, ios::in | ios::binary | ios::ate);
+  if (! in.is_open()) {
+    throw runtime_error(Format("Could not open file [%s] for reading.", fpath.c_str()));
+  }
+
+  streamsize size = in.tellg();
+  in.seekg(0, ios::beg);
+  out.resize(static_cast<size_t>(size));
+  if (! in.read(reinterpret_cast<char*>(out.data()), size)) {
+    throw runtime_error(Format("Could not read file [%s].", fpath.c_str()));
+  }
+}
+
+}  // namespace drivers
+}  // namespace dynslam
@@ -0,0 +1,73 @@
+#ifndef DYNSLAM_VOXELBLOCKCODEC_H
+#define DYNSLAM_VOXELBLOCKCODEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VoxelBlocks.h"
+
+namespace dynslam {
+namespace drivers {
+
+/// \brief The layout voxels are converted to before being compressed.
+enum class VoxelFormat : uint32_t {
+  /// \brief InfiniTAM's own voxel layout, unchanged.
+  kFull = 0,
+  /// \brief 8-bit SDF, 4-bit depth and color weights, and RGB565 color, for 4 bytes per voxel.
+  kCompact,
+  /// \brief 8-bit SDF and 4-bit depth weight, without color, for 2 bytes per voxel.
+  kCompactNoColor
+};
+
+/// \brief Parses "full", "compact", or "compact-nocolor".
+/// \throws std::runtime_error if the name is not a known format.
+VoxelFormat ParseVoxelFormat(const std::string &name);
+
+std::string GetVoxelFormatName(VoxelFormat format);
+
+/// \brief Controls the lossy part of the voxel block compression.
+struct VoxelQuantization {
+  /// \brief Number of low-order bits of the (short) SDF values to discard. At 6, the remaining
+  ///        resolution is still ~1/500 of the truncation band.
+  int sdf_drop_bits;
+  /// \brief Whether to canonicalize voxels which were never observed (zero depth weight), whose
+  ///        contents are ignored by InfiniTAM anyway.
+  bool clear_unobserved;
+  /// \brief The compact formats are lossy regardless of 'sdf_drop_bits'. Weights are clamped to
+  ///        15, so restored voxels adapt to new measurements more quickly than before.
+  VoxelFormat format;
+
+  VoxelQuantization(int sdf_drop_bits,
+                    bool clear_unobserved,
+                    VoxelFormat format = VoxelFormat::kFull)
+      : sdf_drop_bits(sdf_drop_bits), clear_unobserved(clear_unobserved), format(format) {}
+
+  static VoxelQuantization Lossless() {
+    return VoxelQuantization(0, false);
+  }
+};
+
+/// \brief Compresses voxel blocks into a compact byte buffer.
+///
+/// The voxels are split into byte planes (all the first bytes of every voxel, then all the second
+/// bytes, etc.), which are delta-coded and then run-length coded. Surfaces are smooth and most
+/// voxels in a block are either unobserved or saturated, so most of the delta-coded bytes are zero,
+/// and the whole thing is much cheaper than running a general-purpose compressor.
+void EncodeVoxelBlocks(const std::vector<VoxelBlock> &blocks,
+                       const VoxelQuantization &quantization,
+                       std::vector<uint8_t> &out);
+
+/// \brief Decompresses blocks encoded using 'EncodeVoxelBlocks', in any format, appending them
+///        to 'out'.
+/// \throws std::runtime_error if the data is corrupt or was encoded with a different voxel type.
+void DecodeVoxelBlocks(const std::vector<uint8_t> &encoded, std::vector<VoxelBlock> &out);
+
+void WriteBytes(const std::string &fpath, const std::vector<uint8_t> &data);
+
+void ReadBytes(const std::string &fpath, std::vector<uint8_t> &out);
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_VOXELBLOCKCODEC_H
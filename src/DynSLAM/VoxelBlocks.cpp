@@ -0,0 +1,241 @@
+#include "VoxelBlocks.h"
+
+#include <cstring>
+#include <unordered_set>
+
+#include "Utils.h"
+
+namespace dynslam {
+namespace drivers {
+
+using namespace std;
+using namespace dynslam::utils;
+
+namespace {
+
+/// \brief Entries with a pointer smaller than this are unused. A value of -1 indicates blocks
+///        swapped out by InfiniTAM, which we leave alone.
+const int kUnusedEntry = -2;
+
+/// \brief The same hash function as the one used by InfiniTAM.
+int HashIndex(const Vector3s &pos) {
+  return static_cast<int>((((unsigned int) pos.x * 73856093u) ^
+                           ((unsigned int) pos.y * 19349669u) ^
+                           ((unsigned int) pos.z * 83492791u)) & (unsigned int) SDF_HASH_MASK);
+}
+
+bool SamePos(const Vector3s &a, const Vector3s &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+int NextInChain(const ITMHashEntry &entry) {
+  return (entry.offset >= 1) ? SDF_BUCKET_NUM + entry.offset - 1 : -1;
+}
+
+}
+
+BlockChunkKey GetBlockChunk(const Vector3s &block_pos) {
+  // Floor division, so that chunks don't straddle the origin.
+  auto chunk_coord = [](int block_coord) {
+    return (block_coord >= 0) ? block_coord / kBlockChunkSize
+                              : -((-block_coord + kBlockChunkSize - 1) / kBlockChunkSize);
+  };
+
+  return BlockChunkKey(chunk_coord(block_pos.x),
+                       chunk_coord(block_pos.y),
+                       chunk_coord(block_pos.z));
+}
+
+void CopyFromMap(void *dst, const void *src, size_t bytes, bool on_gpu) {
+  if (on_gpu) {
+#ifndef COMPILE_WITHOUT_CUDA
+    ITMSafeCall(cudaMemcpy(dst, src, bytes, cudaMemcpyDeviceToHost));
+#else
+    throw runtime_error("Cannot access GPU voxel blocks in a build without CUDA support.");
+#endif
+  }
+  else {
+    memcpy(dst, src, bytes);
+  }
+}
+
+void CopyToMap(void *dst, const void *src, size_t bytes, bool on_gpu) {
+  if (on_gpu) {
+#ifndef COMPILE_WITHOUT_CUDA
+    ITMSafeCall(cudaMemcpy(dst, src, bytes, cudaMemcpyHostToDevice));
+#else
+    throw runtime_error("Cannot access GPU voxel blocks in a build without CUDA support.");
+#endif
+  }
+  else {
+    memcpy(dst, src, bytes);
+  }
+}
+
+HostVoxelBlockMap::HostVoxelBlockMap(ItmScene *scene, bool on_gpu)
+    : scene_(scene),
+      on_gpu_(on_gpu),
+      hash_entries_(scene->index.GetEntries(),
+                    static_cast<size_t>(scene->index.noTotalEntries),
+                    on_gpu),
+      allocation_list_(scene->localVBA.GetAllocationList(),
+                       static_cast<size_t>(scene->index.getNumAllocatedVoxelBlocks()),
+                       on_gpu),
+      excess_allocation_list_(scene->index.GetExcessAllocationList(),
+                              SDF_EXCESS_LIST_SIZE,
+                              on_gpu),
+      last_free_block_id_(scene->localVBA.lastFreeBlockId),
+      last_free_excess_id_(scene->index.GetLastFreeExcessListId()) {}
+
+vector<int> HostVoxelBlockMap::GetAllocatedEntries() const {
+  hash_entries_.PrefetchAll();
+  vector<int> entries;
+  for (int i = 0; i < static_cast<int>(hash_entries_.size()); ++i) {
+    if (hash_entries_[i].ptr >= 0) {
+      entries.push_back(i);
+    }
+  }
+  return entries;
+}
+
+int HostVoxelBlockMap::FindEntry(const Vector3s &pos) const {
+  int entry_id = HashIndex(pos);
+  while (entry_id >= 0) {
+    const ITMHashEntry &entry = hash_entries_[entry_id];
+    if (entry.ptr >= 0 && SamePos(entry.pos, pos)) {
+      return entry_id;
+    }
+    entry_id = NextInChain(entry);
+  }
+
+  return -1;
+}
+
+void HostVoxelBlockMap::ReadBlock(int entry_id, VoxelBlock &out) const {
+  const ITMHashEntry &entry = hash_entries_[entry_id];
+  if (entry.ptr < 0) {
+    throw runtime_error(Format("Cannot read unallocated block from hash entry %d.", entry_id));
+  }
+
+  out.pos = entry.pos;
+  auto it = pending_writes_.find(entry.ptr);
+  if (it != pending_writes_.end()) {
+    memcpy(out.voxels, it->second.data(), sizeof(out.voxels));
+  }
+  else {
+    const ITMVoxel *block_data = scene_->localVBA.GetVoxelBlocks() + entry.ptr * SDF_BLOCK_SIZE3;
+    CopyFromMap(out.voxels, block_data, sizeof(out.voxels), on_gpu_);
+  }
+}
+
+bool HostVoxelBlockMap::InsertBlock(const VoxelBlock &block) {
+  int entry_id = FindEntry(block.pos);
+
+  if (entry_id < 0) {
+    if (last_free_block_id_ < 0) {
+      return false;
+    }
+
+    int bucket_id = HashIndex(block.pos);
+    if (hash_entries_[bucket_id].ptr < -1) {
+      // The bucket itself is free. Note that it may still be part of a chain, so we must preserve
+      // its offset.
+      entry_id = bucket_id;
+    }
+    else {
+      if (last_free_excess_id_ < 0) {
+        return false;
+      }
+
+      int tail_id = bucket_id;
+      while (NextInChain(hash_entries_[tail_id]) >= 0) {
+        tail_id = NextInChain(hash_entries_[tail_id]);
+      }
+
+      int excess_offset = excess_allocation_list_[last_free_excess_id_--];
+      entry_id = SDF_BUCKET_NUM + excess_offset;
+      hash_entries_.Mutable(tail_id).offset = excess_offset + 1;
+      hash_entries_.Mutable(entry_id).offset = 0;
+    }
+
+    ITMHashEntry &entry = hash_entries_.Mutable(entry_id);
+    entry.pos = block.pos;
+    entry.ptr = allocation_list_[last_free_block_id_--];
+  }
+
+  int ptr = hash_entries_[entry_id].ptr;
+  pending_writes_[ptr].assign(block.voxels, block.voxels + SDF_BLOCK_SIZE3);
+  written_blocks_.push_back(block.pos);
+  return true;
+}
+
+void HostVoxelBlockMap::RemoveBlock(int entry_id) {
+  if (hash_entries_[entry_id].ptr < 0) {
+    return;
+  }
+  ITMHashEntry &entry = hash_entries_.Mutable(entry_id);
+
+  // Return the block's memory, and make sure it's clean when it gets reused.
+  allocation_list_.Mutable(++last_free_block_id_) = entry.ptr;
+  pending_writes_[entry.ptr].assign(SDF_BLOCK_SIZE3, ITMVoxel());
+  removed_blocks_.push_back(entry.pos);
+
+  if (entry_id < SDF_BUCKET_NUM) {
+    // Bucket entries keep their offset, since they may head a chain of excess entries.
+    entry.ptr = kUnusedEntry;
+    return;
+  }
+
+  // Excess entries get unlinked from their chain, and their slot is returned to the excess list.
+  int prev_id = HashIndex(entry.pos);
+  while (NextInChain(hash_entries_[prev_id]) != entry_id) {
+    prev_id = NextInChain(hash_entries_[prev_id]);
+    assert(prev_id >= 0 && "Excess entry must be chained to its bucket.");
+  }
+  hash_entries_.Mutable(prev_id).offset = entry.offset;
+  excess_allocation_list_.Mutable(++last_free_excess_id_) = entry_id - SDF_BUCKET_NUM;
+
+  entry.ptr = kUnusedEntry;
+  entry.offset = 0;
+}
+
+void HostVoxelBlockMap::GetChanges(vector<Vector3s> &removed,
+                                   vector<VoxelBlock> &written) const {
+  removed.insert(removed.end(), removed_blocks_.begin(), removed_blocks_.end());
+
+  unordered_set<int64_t> seen;
+  for (const Vector3s &pos : written_blocks_) {
+    if (! seen.insert(PackBlockPos(pos)).second) {
+      continue;
+    }
+
+    int entry_id = FindEntry(pos);
+    if (entry_id >= 0) {
+      written.emplace_back();
+      ReadBlock(entry_id, written.back());
+    }
+  }
+}
+
+void HostVoxelBlockMap::Commit() {
+  ITMVoxel *voxel_blocks = scene_->localVBA.GetVoxelBlocks();
+  for (const auto &pair : pending_writes_) {
+    CopyToMap(voxel_blocks + pair.first * SDF_BLOCK_SIZE3,
+              pair.second.data(),
+              SDF_BLOCK_SIZE3 * sizeof(ITMVoxel),
+              on_gpu_);
+  }
+  pending_writes_.clear();
+  removed_blocks_.clear();
+  written_blocks_.clear();
+
+  hash_entries_.Commit();
+  allocation_list_.Commit();
+  excess_allocation_list_.Commit();
+
+  scene_->localVBA.lastFreeBlockId = last_free_block_id_;
+  scene_->index.SetLastFreeExcessListId(last_free_excess_id_);
+}
+
+}  // namespace drivers
+}  // namespace dynslam
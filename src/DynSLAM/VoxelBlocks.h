@@ -0,0 +1,253 @@
+#ifndef DYNSLAM_VOXELBLOCKS_H
+#define DYNSLAM_VOXELBLOCKS_H
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "../InfiniTAM/InfiniTAM/ITMLib/Engine/ITMMainEngine.h"
+
+namespace dynslam {
+namespace drivers {
+
+using ItmScene = ITMLib::Objects::ITMScene<ITMVoxel, ITMVoxelIndex>;
+
+/// \brief A voxel block copied out of an InfiniTAM map, together with its position in block
+///        coordinates. Used for moving map data between volumes, and to and from storage.
+struct VoxelBlock {
+  Vector3s pos;
+  ITMVoxel voxels[SDF_BLOCK_SIZE3];
+};
+
+/// \brief Packs block coordinates into a single integer, e.g., for use as a hash key.
+inline int64_t PackBlockPos(const Vector3s &pos) {
+  return (static_cast<int64_t>(static_cast<uint16_t>(pos.x)) << 32) |
+         (static_cast<int64_t>(static_cast<uint16_t>(pos.y)) << 16) |
+         static_cast<int64_t>(static_cast<uint16_t>(pos.z));
+}
+
+inline Vector3s UnpackBlockPos(int64_t packed) {
+  return Vector3s(static_cast<short>(static_cast<uint16_t>(packed >> 32)),
+                  static_cast<short>(static_cast<uint16_t>(packed >> 16)),
+                  static_cast<short>(static_cast<uint16_t>(packed)));
+}
+
+/// \brief Voxel blocks are grouped into cubic chunks with this many blocks per side when they are
+///        moved out of a map in bulk.
+const int kBlockChunkSize = 8;
+
+using BlockChunkKey = std::tuple<int, int, int>;
+
+/// \brief Returns the chunk which contains the block at the given (block) coordinates.
+BlockChunkKey GetBlockChunk(const Vector3s &block_pos);
+
+/// \brief Copies between a map's memory, which may be on the GPU, and host memory.
+void CopyFromMap(void *dst, const void *src, size_t bytes, bool on_gpu);
+void CopyToMap(void *dst, const void *src, size_t bytes, bool on_gpu);
+
+/// \brief Host-side copy of an array in a map's memory, which is transferred one page at a time
+///        when first accessed, and of which only the modified pages get written back.
+template<typename T>
+class PagedMapArray {
+ public:
+  PagedMapArray(T *data, size_t size, bool on_gpu)
+      : data_(data),
+        size_(size),
+        on_gpu_(on_gpu),
+        pages_((size + kPageSize - 1) / kPageSize),
+        dirty_pages_(pages_.size(), false) {}
+
+  size_t size() const { return size_; }
+
+  const T& operator[](size_t idx) const {
+    return LoadPage(idx / kPageSize)[idx % kPageSize];
+  }
+
+  /// \brief Like 'operator[]', but also marks the element's page for writing back.
+  T& Mutable(size_t idx) {
+    size_t page_idx = idx / kPageSize;
+    dirty_pages_[page_idx] = true;
+    return LoadPage(page_idx)[idx % kPageSize];
+  }
+
+  /// \brief Loads the pages holding the given elements, merging neighboring pages into single
+  ///        transfers, which is much faster than loading them one by one when there are many.
+  void Prefetch(const std::vector<int> &indices) const {
+    std::vector<bool> wanted(pages_.size(), false);
+    for (int idx : indices) {
+      wanted[idx / kPageSize] = true;
+    }
+
+    size_t page_idx = 0;
+    while (page_idx < pages_.size()) {
+      if (! wanted[page_idx] || ! pages_[page_idx].empty()) {
+        page_idx++;
+        continue;
+      }
+
+      // Short gaps get transferred as well, since that is cheaper than starting a new transfer.
+      size_t last_wanted = page_idx;
+      for (size_t i = page_idx + 1; i < pages_.size() && pages_[i].empty() &&
+                                    i - last_wanted <= kMaxGapPages; ++i) {
+        if (wanted[i]) {
+          last_wanted = i;
+        }
+      }
+      LoadPages(page_idx, last_wanted + 1);
+      page_idx = last_wanted + 1;
+    }
+  }
+
+  /// \brief Loads every page which is not loaded yet.
+  void PrefetchAll() const {
+    size_t page_idx = 0;
+    while (page_idx < pages_.size()) {
+      size_t end = page_idx;
+      while (end < pages_.size() && pages_[end].empty()) {
+        end++;
+      }
+      if (end > page_idx) {
+        LoadPages(page_idx, end);
+      }
+      page_idx = end + 1;
+    }
+  }
+
+  /// \brief Writes the modified pages back to the map's memory.
+  void Commit() {
+    for (size_t page_idx = 0; page_idx < pages_.size(); ++page_idx) {
+      if (dirty_pages_[page_idx]) {
+        const std::vector<T> &page = pages_[page_idx];
+        CopyToMap(data_ + page_idx * kPageSize, page.data(), page.size() * sizeof(T), on_gpu_);
+        dirty_pages_[page_idx] = false;
+      }
+    }
+  }
+
+ private:
+  /// \brief Small enough for sparse accesses, e.g., hash table lookups, to stay cheap.
+  static const size_t kPageSize = 256;
+  static const size_t kMaxGapPages = 4;
+
+  T *data_;
+  size_t size_;
+  bool on_gpu_;
+  /// \brief Empty until loaded.
+  mutable std::vector<std::vector<T>> pages_;
+  std::vector<bool> dirty_pages_;
+
+  size_t GetPageLength(size_t page_idx) const {
+    size_t begin = page_idx * kPageSize;
+    return (size_ - begin < kPageSize) ? size_ - begin : kPageSize;
+  }
+
+  std::vector<T>& LoadPage(size_t page_idx) const {
+    if (pages_[page_idx].empty()) {
+      LoadPages(page_idx, page_idx + 1);
+    }
+    return pages_[page_idx];
+  }
+
+  /// \brief Loads the pages in [begin, end) with a single transfer, overwriting loaded ones.
+  void LoadPages(size_t begin, size_t end) const {
+    size_t first = begin * kPageSize;
+    size_t count = (end - 1) * kPageSize + GetPageLength(end - 1) - first;
+    std::vector<T> staging(count);
+    CopyFromMap(staging.data(), data_ + first, count * sizeof(T), on_gpu_);
+    for (size_t page_idx = begin; page_idx < end; ++page_idx) {
+      if (pages_[page_idx].empty()) {
+        auto page_begin = staging.begin() + (page_idx * kPageSize - first);
+        pages_[page_idx].assign(page_begin, page_begin + GetPageLength(page_idx));
+      }
+    }
+  }
+};
+
+/// \brief Host-side view of an InfiniTAM voxel block hash, supporting reading, adding, and
+///        removing voxel blocks outside of InfiniTAM's own allocation kernels.
+///
+/// Nothing is transferred when the object is created. The hash table and the allocation
+/// bookkeeping are transferred to the host page by page, as they get accessed, and voxel data one
+/// block at a time, so the cost of using the map scales with the number of blocks actually touched,
+/// and not with the size of the map. Only the modified pages and blocks are written back. No
+/// changes are visible to InfiniTAM until 'Commit' is called, and the scene must not be touched by
+/// anything else while this object is alive.
+///
+/// \note Mirrors the hashing scheme used by InfiniTAM: a block lives either in its bucket, or in
+/// the excess list, chained to its bucket via the entries' 'offset' fields.
+class HostVoxelBlockMap {
+ public:
+  HostVoxelBlockMap(ItmScene *scene, bool on_gpu);
+
+  HostVoxelBlockMap(const HostVoxelBlockMap&) = delete;
+  HostVoxelBlockMap& operator=(const HostVoxelBlockMap&) = delete;
+
+  /// \brief Returns the IDs of all hash entries with voxel data in the block array.
+  /// \note Transfers the whole hash table, so this should not be used every frame.
+  std::vector<int> GetAllocatedEntries() const;
+
+  const ITMHashEntry& GetEntry(int entry_id) const {
+    return hash_entries_[entry_id];
+  }
+
+  /// \brief Transfers the given hash entries in bulk, ahead of accessing them.
+  void PrefetchEntries(const std::vector<int> &entry_ids) const {
+    hash_entries_.Prefetch(entry_ids);
+  }
+
+  /// \brief Returns the ID of the hash entry corresponding to the given block, or -1 if the block
+  ///        is not in the map.
+  int FindEntry(const Vector3s &pos) const;
+
+  /// \brief Copies the contents of the given (allocated) block into 'out'.
+  void ReadBlock(int entry_id, VoxelBlock &out) const;
+
+  /// \brief Adds the given block to the map, overwriting it if it already exists.
+  /// \returns Whether the block could be added. This can fail if the voxel block array or the
+  ///          hash table's excess list are full.
+  bool InsertBlock(const VoxelBlock &block);
+
+  /// \brief Removes the block from the map, returning its memory to the voxel block array.
+  void RemoveBlock(int entry_id);
+
+  /// \brief The number of blocks which can still be allocated.
+  int GetFreeBlockCount() const { return last_free_block_id_ + 1; }
+
+  /// \brief The total number of blocks in the voxel block array.
+  int GetBlockCapacity() const { return static_cast<int>(allocation_list_.size()); }
+
+  /// \brief Whether any blocks were added or removed since the map was opened or committed.
+  bool HasChanges() const { return ! pending_writes_.empty(); }
+
+  /// \brief Lists the changes made since the map was opened or committed, e.g., for keeping a
+  ///        copy of the map up to date without going through all of it.
+  /// \param removed Receives the positions of the removed blocks.
+  /// \param written Receives the blocks which were added or overwritten, and are still in the map.
+  ///                Blocks which were removed and added back show up in both lists.
+  void GetChanges(std::vector<Vector3s> &removed, std::vector<VoxelBlock> &written) const;
+
+  /// \brief Writes all the changes back to the InfiniTAM scene.
+  void Commit();
+
+ private:
+  ItmScene *scene_;
+  bool on_gpu_;
+
+  PagedMapArray<ITMHashEntry> hash_entries_;
+  PagedMapArray<int> allocation_list_;
+  PagedMapArray<int> excess_allocation_list_;
+  int last_free_block_id_;
+  int last_free_excess_id_;
+
+  /// \brief Voxel data to be written to the block array on commit, keyed by block array index.
+  /// Removed blocks are scheduled to be cleared, since InfiniTAM expects free blocks to be clean.
+  std::map<int, std::vector<ITMVoxel>> pending_writes_;
+  std::vector<Vector3s> removed_blocks_;
+  std::vector<Vector3s> written_blocks_;
+};
+
+}  // namespace drivers
+}  // namespace dynslam
+
+#endif  // DYNSLAM_VOXELBLOCKS_H